@@ -500,6 +500,42 @@ mkRules variant sourceDir buildDir options pkgConfigOptions = do
         command_ [] result []
     phony "clean-test" $ removeFilesAfter "tests/output" ["*.osc", "*.wav"]
 
+  -- benchmark
+  do
+    let (target, toolChain) = second ((=<<) applyEnv) Host.defaultToolChain
+        getConfig = getConfigFromWithEnv [
+            ("Target.os", map toLower . show . targetOS $ target)
+          ] "config/benchmark.cfg"
+    result <- executable toolChain
+                (targetBuildPrefix' target </> "methcla-benchmark" <.> Host.executableExtension)
+                (getBuildFlags getConfig)
+                (getSources getConfig)
+    phony "benchmark" $ need [result]
+
+  -- oscillator benchmark
+  do
+    let (target, toolChain) = second ((=<<) applyEnv) Host.defaultToolChain
+        getConfig = getConfigFromWithEnv [
+            ("Target.os", map toLower . show . targetOS $ target)
+          ] "config/oscillator_benchmark.cfg"
+    result <- executable toolChain
+                (targetBuildPrefix' target </> "methcla-oscillator-benchmark" <.> Host.executableExtension)
+                (getBuildFlags getConfig)
+                (getSources getConfig)
+    phony "oscillator-benchmark" $ need [result]
+
+  -- shared memory audio driver client
+  do
+    let (target, toolChain) = second ((=<<) applyEnv) Host.defaultToolChain
+        getConfig = getConfigFromWithEnv [
+            ("Target.os", map toLower . show . targetOS $ target)
+          ] "config/shm_client.cfg"
+    result <- staticLibrary toolChain
+                (targetBuildPrefix' target </> "libmethcla-shm-client" <.> "a")
+                (getBuildFlags getConfig)
+                (getSources getConfig)
+    phony "shm-client" $ need [result]
+
   --tags
   -- do
   --   let and_ a b = do { as <- a; bs <- b; return $! as ++ bs }
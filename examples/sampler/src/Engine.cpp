@@ -22,16 +22,17 @@
 
 #include <sstream>
 #include <stdexcept>
-#include <tinydir.h>
 
 using namespace Methcla::Examples::Sampler;
 
 Sound::Sound(const Methcla::Engine& engine, const std::string& path)
+    : Sound(path, Methcla::soundFileInfo(engine, path))
+{ }
+
+Sound::Sound(const std::string& path, const Methcla::SoundFileInfo& info)
     : m_path(path)
-{
-    Methcla::SoundFile file(engine, path);
-    m_duration = (double)file.info().frames / (double)file.info().samplerate;
-}
+    , m_duration((double)info.frames / (double)info.samplerate)
+{ }
 
 // Return a list of sounds in directory path.
 static std::vector<Sound> loadSounds(Methcla::Engine& engine, const std::string& path)
@@ -40,39 +41,13 @@ static std::vector<Sound> loadSounds(Methcla::Engine& engine, const std::string&
 
     std::vector<Sound> result;
 
-    tinydir_dir dir;
-    int err = tinydir_open(&dir, path.c_str());
-    if (err != 0)
+    // Files that are already in the engine's sound file index aren't opened again.
+    for (const auto& file : Methcla::scanSoundFiles(engine, path))
     {
-        std::stringstream s;
-        s << "Couldn't open directory " << path
-          << ": " << strerror(errno);
-        throw std::runtime_error(s.str());
+        engine.logLine(kMethcla_LogDebug, std::string("Loading sound ") + file.first);
+        result.push_back(Sound(file.first, file.second));
     }
 
-    while (dir.has_next)
-    {
-        tinydir_file file;
-        tinydir_readfile(&dir, &file);
-        std::stringstream s;
-        s << "readfile: " << file.path << " " << file.name << " " << file.is_dir << " " << file.is_reg;
-        engine.logLine(kMethcla_LogDebug, s.str());
-        if (!file.is_dir) {
-            try {
-                engine.logLine(kMethcla_LogDebug, std::string("Loading sound ") + path + "/" + std::string(file.name));
-                result.push_back(Sound(engine, path + "/" + std::string(file.name)));
-            } catch (std::exception& e) {
-                std::stringstream s;
-                s << "Exception while registering sound "
-                  << file.name << ": " << e.what();
-                engine.logLine(kMethcla_LogError, s.str());
-            }
-        }
-        tinydir_next(&dir);
-    }
-
-    tinydir_close(&dir);
-
     return result;
 }
 
@@ -16,6 +16,7 @@
 #define ENGINE_HPP_INCLUDED
 
 #include <methcla/engine.hpp>
+#include <methcla/file.hpp>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -26,6 +27,7 @@ class Sound
 {
 public:
     Sound(const Methcla::Engine& engine, const std::string& path);
+    Sound(const std::string& path, const Methcla::SoundFileInfo& info);
 
     const std::string& path() const
     {
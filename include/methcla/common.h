@@ -75,6 +75,7 @@ typedef enum
     kMethcla_SynthDefNotFoundError = 1000,
     kMethcla_NodeIdError,
     kMethcla_NodeTypeError,
+    kMethcla_BufferIdError,
 
     /* File errors */
     kMethcla_FileNotFoundError = 2000,
@@ -47,7 +47,8 @@ namespace Methcla
             ResultBase(const ResultBase&) = delete;
             ResultBase& operator=(const ResultBase&) = delete;
 
-            void checkResponse(const char* requestAddress, const OSCPP::Server::Message& msg)
+            //* Set the error from an error response; return true if msg is the expected response.
+            bool checkResponse(const char* requestAddress, const OSCPP::Server::Message& msg)
             {
                 if (msg == "/error")
                 {
@@ -55,13 +56,16 @@ namespace Methcla
                     Methcla_ErrorCode errorCode = static_cast<Methcla_ErrorCode>(args.int32());
                     const char* errorMessage = args.string();
                     setError(errorCode, errorMessage);
+                    return false;
                 }
                 else if (msg != requestAddress)
                 {
                     std::stringstream s;
                     s << "Unexpected response message address " << msg.address() << " (expected " << requestAddress << ")";
                     setError(kMethcla_LogicError, s.str().c_str());
+                    return false;
                 }
+                return true;
             }
 
         protected:
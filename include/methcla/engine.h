@@ -89,6 +89,16 @@ struct Methcla_EngineOptions
     size_t                      realtime_memory_size;
     size_t                      max_num_nodes;
     size_t                      max_num_audio_buses;
+    size_t                      max_num_buffers;
+
+    //* Memory budget in bytes for unreferenced sample buffers in the buffer cache.
+    size_t                      buffer_cache_size;
+
+    //* Keep 16 and 24 bit PCM sample data in its native format in the buffer cache instead of converting it to float.
+    bool                        compact_sample_buffers;
+
+    //* Path of the file storing the sound file index (see `methcla_engine_soundfile_info`) or NULL for an index kept in memory only.
+    const char*                 soundfile_index_path;
 
     //* NULL terminated array of plugin library functions.
     Methcla_LibraryFunction*    plugin_libraries;
@@ -148,6 +158,19 @@ METHCLA_EXPORT Methcla_Error methcla_engine_send(Methcla_Engine* engine, const v
 //* Open a sound file.
 METHCLA_EXPORT Methcla_Error methcla_engine_soundfile_open(const Methcla_Engine* engine, const char* path, Methcla_FileMode mode, Methcla_SoundFile** file, Methcla_SoundFileInfo* info);
 
+//* Get the info of a sound file from the engine's sound file index.
+//
+// The file is only opened if it isn't in the index yet or its size or modification time have changed since it was indexed.
+METHCLA_EXPORT Methcla_Error methcla_engine_soundfile_info(const Methcla_Engine* engine, const char* path, Methcla_SoundFileInfo* info);
+
+//* Callback receiving the sound files found by `methcla_engine_soundfile_scan`.
+typedef void (*Methcla_SoundFileScanFunction)(void* data, const char* path, const Methcla_SoundFileInfo* info);
+
+//* Add the sound files in a directory to the engine's sound file index.
+//
+// Files are indexed in parallel by a pool of threads. When the scan has finished, callback is called from the calling thread for each sound file in directory in order of their paths; files that can't be opened are skipped and subdirectories are not scanned. Files that have been removed from directory since the last scan are removed from the index. The index is written to `Methcla_EngineOptions::soundfile_index_path` if it has changed.
+METHCLA_EXPORT Methcla_Error methcla_engine_soundfile_scan(Methcla_Engine* engine, const char* directory, Methcla_SoundFileScanFunction callback, void* data);
+
 #if defined(__cplusplus)
 }
 #endif
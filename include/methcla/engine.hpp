@@ -115,6 +115,17 @@ namespace Methcla
         { }
     };
 
+    class BufferId : public detail::Id<BufferId,int32_t>
+    {
+    public:
+        BufferId(int32_t id)
+            : Id<BufferId,int32_t>(id)
+        { }
+        BufferId()
+            : BufferId(-1)
+        { }
+    };
+
     // Node placement specification given a target.
     class NodePlacement
     {
@@ -482,6 +493,10 @@ namespace Methcla
         size_t maxNumNodes = 1024;
         size_t maxNumAudioBuses = 128;
         size_t maxNumControlBuses = 4096;
+        size_t maxNumBuffers = 1024;
+        size_t bufferCacheSize = 64*1024*1024;
+        bool compactSampleBuffers = false;
+        std::string soundFileIndexPath;
         size_t sampleRate = 44100;
         size_t blockSize = 64;
         std::list<LibraryFunction> pluginLibraries;
@@ -503,6 +518,10 @@ namespace Methcla
             m_options.realtime_memory_size = realtimeMemorySize;
             m_options.max_num_nodes = maxNumNodes;
             m_options.max_num_audio_buses = maxNumAudioBuses;
+            m_options.max_num_buffers = maxNumBuffers;
+            m_options.buffer_cache_size = bufferCacheSize;
+            m_options.compact_sample_buffers = compactSampleBuffers;
+            m_options.soundfile_index_path = soundFileIndexPath.empty() ? nullptr : soundFileIndexPath.c_str();
 
             m_pluginLibraries.assign(pluginLibraries.begin(), pluginLibraries.end());
             m_pluginLibraries.push_back(nullptr);
@@ -517,6 +536,7 @@ namespace Methcla
 
     typedef ResourceIdAllocator<NodeId,int32_t> NodeIdAllocator;
     typedef ResourceIdAllocator<AudioBusId,int32_t> AudioBusIdAllocator;
+    typedef ResourceIdAllocator<BufferId,int32_t> BufferIdAllocator;
 
     class Request;
 
@@ -531,6 +551,7 @@ namespace Methcla
         }
 
         virtual NodeIdAllocator& nodeIdAllocator() = 0;
+        virtual BufferIdAllocator& bufferIdAllocator() = 0;
 
         virtual std::unique_ptr<Packet> allocPacket() = 0;
         virtual void sendPacket(const std::unique_ptr<Packet>& packet) = 0;
@@ -544,7 +565,12 @@ namespace Methcla
         inline void mapInput(SynthId synth, size_t index, AudioBusId bus, BusMappingFlags flags=kBusMappingInternal);
         inline void mapOutput(SynthId synth, size_t index, AudioBusId bus, BusMappingFlags flags=kBusMappingInternal);
         inline void set(NodeId node, size_t index, double value);
+        inline void setRange(NodeId node, size_t index, const std::vector<float>& values);
         inline void free(NodeId node);
+        inline BufferId allocBuffer(size_t numChannels, size_t numFrames);
+        inline BufferId readBuffer(const char* path, size_t startFrame=0, int32_t numFrames=-1);
+        inline void setBuffer(BufferId buffer, size_t startFrame, const std::vector<float>& samples);
+        inline void freeBuffer(BufferId buffer);
     };
 
     class Request
@@ -749,6 +775,19 @@ namespace Methcla
                 .closeMessage();
         }
 
+        //* Set consecutive control inputs starting at index.
+        void setRange(NodeId node, size_t index, const std::vector<float>& values)
+        {
+            beginMessage();
+
+            oscPacket()
+                .openMessage("/node/set-range", 2 + OSCPP::Tags::array(values.size()))
+                    .int32(node.id())
+                    .int32(index)
+                    .putArray(values.begin(), values.end())
+                .closeMessage();
+        }
+
         void free(NodeId node)
         {
             beginMessage();
@@ -770,6 +809,70 @@ namespace Methcla
                     .int32(flags)
                 .closeMessage();
         }
+
+        //* Allocate a zero-initialized buffer.
+        //
+        // The sample data can be written with setBuffer, e.g. for wavetables
+        // or envelopes computed by the client.
+        BufferId allocBuffer(size_t numChannels, size_t numFrames)
+        {
+            beginMessage();
+
+            const BufferId bufferId(m_engine->bufferIdAllocator().alloc());
+
+            oscPacket()
+                .openMessage("/buffer/alloc", 3)
+                    .int32(bufferId.id())
+                    .int32(numChannels)
+                    .int32(numFrames)
+                .closeMessage();
+
+            return bufferId;
+        }
+
+        //* Read a buffer from a sound file.
+        //
+        // If numFrames is negative, read until the end of the file.
+        BufferId readBuffer(const char* path, size_t startFrame=0, int32_t numFrames=-1)
+        {
+            beginMessage();
+
+            const BufferId bufferId(m_engine->bufferIdAllocator().alloc());
+
+            oscPacket()
+                .openMessage("/buffer/read", 4)
+                    .int32(bufferId.id())
+                    .string(path)
+                    .int32(startFrame)
+                    .int32(numFrames)
+                .closeMessage();
+
+            return bufferId;
+        }
+
+        //* Write interleaved samples to an allocated buffer starting at startFrame.
+        void setBuffer(BufferId buffer, size_t startFrame, const std::vector<float>& samples)
+        {
+            beginMessage();
+
+            oscPacket()
+                .openMessage("/buffer/set", 2 + OSCPP::Tags::array(samples.size()))
+                    .int32(buffer.id())
+                    .int32(startFrame)
+                    .putArray(samples.begin(), samples.end())
+                .closeMessage();
+        }
+
+        void freeBuffer(BufferId buffer)
+        {
+            beginMessage();
+
+            oscPacket()
+                .openMessage("/buffer/free", 1)
+                .int32(buffer.id())
+                .closeMessage();
+            m_engine->bufferIdAllocator().free(buffer.id());
+        }
     };
 
     void EngineInterface::bundle(Methcla_Time time, std::function<void(Request&)> func)
@@ -830,6 +933,13 @@ namespace Methcla
         request.send();
     }
 
+    void EngineInterface::setRange(NodeId node, size_t index, const std::vector<float>& values)
+    {
+        Request request(this);
+        request.setRange(node, index, values);
+        request.send();
+    }
+
     void EngineInterface::free(NodeId node)
     {
         Request request(this);
@@ -837,6 +947,36 @@ namespace Methcla
         request.send();
     }
 
+    BufferId EngineInterface::allocBuffer(size_t numChannels, size_t numFrames)
+    {
+        Request request(this);
+        BufferId result = request.allocBuffer(numChannels, numFrames);
+        request.send();
+        return result;
+    }
+
+    BufferId EngineInterface::readBuffer(const char* path, size_t startFrame, int32_t numFrames)
+    {
+        Request request(this);
+        BufferId result = request.readBuffer(path, startFrame, numFrames);
+        request.send();
+        return result;
+    }
+
+    void EngineInterface::setBuffer(BufferId buffer, size_t startFrame, const std::vector<float>& samples)
+    {
+        Request request(this);
+        request.setBuffer(buffer, startFrame, samples);
+        request.send();
+    }
+
+    void EngineInterface::freeBuffer(BufferId buffer)
+    {
+        Request request(this);
+        request.freeBuffer(buffer);
+        request.send();
+    }
+
     class Engine : public EngineInterface
     {
     public:
@@ -844,6 +984,7 @@ namespace Methcla
             : m_logHandler(inOptions.logHandler)
             , m_nodeIds(1, inOptions.maxNumNodes - 1)
             , m_audioBusIds(0, inOptions.maxNumAudioBuses)
+            , m_bufferIds(0, inOptions.maxNumBuffers)
             , m_requestId(kMethcla_Notification+1)
             , m_notificationHandlerId(0)
             , m_packets(8192)
@@ -926,6 +1067,11 @@ namespace Methcla
             return m_audioBusIds;
         }
 
+        BufferIdAllocator& bufferIdAllocator() override
+        {
+            return m_bufferIds;
+        }
+
         std::unique_ptr<Packet> allocPacket() override
         {
             return std::unique_ptr<Packet>(new Packet(m_packets));
@@ -982,6 +1128,33 @@ namespace Methcla
             };
         }
 
+        //* Return a handler that calls whenLoaded when the buffer has been
+        // installed, or whenFailed with the error message if loading it failed.
+        static NotificationHandler bufferLoadedHandler(BufferId bufferId,
+                                                       std::function<void(BufferId)> whenLoaded,
+                                                       std::function<void(BufferId,const std::string&)> whenFailed=nullptr)
+        {
+            return [bufferId,whenLoaded,whenFailed](const OSCPP::Server::Message& msg) {
+                if (msg == "/buffer/loaded") {
+                    BufferId otherBufferId = BufferId(msg.args().int32());
+                    if (bufferId == otherBufferId) {
+                        whenLoaded(bufferId);
+                        return true;
+                    }
+                } else if (msg == "/buffer/error") {
+                    OSCPP::Server::ArgStream args(msg.args());
+                    BufferId otherBufferId = BufferId(args.int32());
+                    if (bufferId == otherBufferId) {
+                        args.int32();
+                        if (whenFailed)
+                            whenFailed(bufferId, args.string());
+                        return true;
+                    }
+                }
+                return false;
+            };
+        }
+
         NotificationHandler freeNodeIdHandler(NodeId nodeId)
         {
             return [this,nodeId](const OSCPP::Server::Message& msg) {
@@ -1053,6 +1226,50 @@ namespace Methcla
             return result.get();
         }
 
+        //* Return synth specific statistics.
+        //
+        // The interpretation of the values depends on the synth definition; an empty list is returned for synths that don't provide statistics. Throws if synth doesn't refer to an existing synth.
+        std::vector<int32_t> getSynthStatistics(SynthId synth)
+        {
+            const char* request = "/synth/statistics";
+            const Methcla_RequestId requestId = getRequestId();
+            auto packet = allocPacket();
+            packet->packet()
+                .openMessage(request, 2)
+                .int32(requestId)
+                .int32(synth.id())
+                .closeMessage();
+            detail::Result<std::vector<int32_t>> result;
+            withRequest(requestId, packet->packet(), [&request,&result](Methcla_RequestId, const OSCPP::Server::Message& response){
+                if (!result.checkResponse(request, response))
+                    return;
+                OSCPP::Server::ArgStream args(response.args());
+                std::vector<int32_t> value;
+                while (!args.atEnd())
+                    value.push_back(args.int32());
+                result.set(value);
+            });
+            return result.get();
+        }
+
+        //* Change the maximum number of frames the engine processes in one block.
+        //
+        // Processing is paused while bus and synth buffers are reallocated;
+        // the node tree and synth state are preserved. Audio driver periods
+        // longer than the block size are processed in several blocks.
+        void setBlockSize(size_t blockSize)
+        {
+            const char* request = "/engine/block-size/set";
+            const Methcla_RequestId requestId = getRequestId();
+            auto packet = allocPacket();
+            packet->packet()
+                .openMessage(request, 2)
+                .int32(requestId)
+                .int32(blockSize)
+                .closeMessage();
+            execRequest(request, requestId, packet->packet());
+        }
+
     private:
         static void logLineCallback(void* data, Methcla_LogLevel level, const char* message)
         {
@@ -1168,6 +1385,7 @@ namespace Methcla
         LogHandler              m_logHandler;
         NodeIdAllocator         m_nodeIds;
         AudioBusIdAllocator     m_audioBusIds;
+        BufferIdAllocator       m_bufferIds;
         Methcla_RequestId       m_requestId;
         std::mutex              m_requestIdMutex;
         ResponseHandlers        m_responseHandlers;
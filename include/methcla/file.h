@@ -57,6 +57,18 @@ typedef struct
     Methcla_SoundFileFormat file_format;
 } Methcla_SoundFileInfo;
 
+//* Read-only view of the sample data of a sound file.
+//
+// Samples are interleaved and in native byte order. The data is valid
+// until the sound file is closed.
+typedef struct
+{
+    const void*             data;
+    int64_t                 frames;
+    unsigned int            channels;
+    Methcla_SoundFileFormat format;
+} Methcla_SoundFileView;
+
 typedef struct Methcla_SoundFile Methcla_SoundFile;
 
 struct Methcla_SoundFile
@@ -67,6 +79,8 @@ struct Methcla_SoundFile
     Methcla_Error (*tell)(const Methcla_SoundFile* file, int64_t* numFrames);
     Methcla_Error (*read_float)(const Methcla_SoundFile* file, float* buffer, size_t numFrames, size_t* outNumFrames);
     Methcla_Error (*write_float)(const Methcla_SoundFile* file, const float* buffer, size_t numFrames, size_t* outNumFrames);
+    //* Return a view of the sample data without copying (optional).
+    Methcla_Error (*view)(const Methcla_SoundFile* file, Methcla_SoundFileView* view);
 };
 
 typedef struct Methcla_SoundFileAPI Methcla_SoundFileAPI;
@@ -115,6 +129,19 @@ static inline Methcla_Error methcla_soundfile_write_float(Methcla_SoundFile* fil
     return file->write_float(file, buffer, numFrames, outNumFrames);
 }
 
+//* Get a view of a sound file's sample data.
+//
+// Returns kMethcla_UnsupportedDataFormatError if the sound file API
+// doesn't support views or the data isn't available in native byte order.
+static inline Methcla_Error methcla_soundfile_view(Methcla_SoundFile* file, Methcla_SoundFileView* view)
+{
+    if ((file == NULL) || (view == NULL))
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (file->view == NULL)
+        return methcla_error_new(kMethcla_UnsupportedDataFormatError);
+    return file->view(file, view);
+}
+
 #if defined(__cplusplus)
 }
 #endif
@@ -22,6 +22,9 @@
 #include <methcla/plugin.h>
 
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace Methcla
 {
@@ -180,7 +183,47 @@ namespace Methcla
             detail::checkReturnCode(methcla_soundfile_write_float(m_file, buffer, numFrames, &outNumFrames));
             return outNumFrames;
         }
+
+        //* Get a view of the sample data.
+        //
+        // Return false if the sound file doesn't provide views.
+        bool view(Methcla_SoundFileView& view)
+        {
+            ensureInitialized();
+            Methcla_Error err = methcla_soundfile_view(m_file, &view);
+            if (methcla_error_has_code(err, kMethcla_UnsupportedDataFormatError))
+            {
+                methcla_error_free(err);
+                return false;
+            }
+            detail::checkReturnCode(err);
+            return true;
+        }
     };
+
+    //* Return the info of the sound file at path from the engine's sound file index.
+    inline SoundFileInfo soundFileInfo(const Engine& engine, const std::string& path)
+    {
+        Methcla_SoundFileInfo info;
+        detail::checkReturnCode(methcla_engine_soundfile_info(engine, path.c_str(), &info));
+        return SoundFileInfo(info);
+    }
+
+    //* Add the sound files in directory to the engine's sound file index.
+    //
+    // Returns the paths and info of the sound files in directory sorted by
+    // path; subdirectories are not scanned.
+    inline std::vector<std::pair<std::string,SoundFileInfo>> scanSoundFiles(Engine& engine, const std::string& directory)
+    {
+        std::vector<std::pair<std::string,SoundFileInfo>> result;
+        detail::checkReturnCode(
+            methcla_engine_soundfile_scan(engine, directory.c_str(), [](void* data, const char* path, const Methcla_SoundFileInfo* info) {
+                static_cast<std::vector<std::pair<std::string,SoundFileInfo>>*>(data)->push_back(
+                    std::make_pair(std::string(path), SoundFileInfo(*info)));
+            }, &result)
+        );
+        return result;
+    }
 }
 
 #endif // METHCLA_FILE_HPP_INCLUDED
\ No newline at end of file
@@ -0,0 +1,78 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_PLATFORM_BENCHMARK_H_INCLUDED
+#define METHCLA_PLATFORM_BENCHMARK_H_INCLUDED
+
+#include <methcla/engine.h>
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+//* Callback invoked on the driver thread before each block, starting with the warm-up blocks.
+//
+//  Requests sent to the engine from the callback are processed in the
+//  following block; the time spent in the callback is not measured.
+typedef void (*Methcla_BenchmarkBlockCallback)(void* data, uint64_t block);
+
+typedef struct Methcla_BenchmarkStatistics
+{
+    //* Number of measured blocks.
+    uint64_t num_blocks;
+    //* Time spent processing blocks in seconds.
+    double process_time;
+    //* Wall clock time from the first measured block to the last block in seconds.
+    double elapsed_time;
+    //* Processed blocks per second of processing time.
+    double blocks_per_second;
+    //* Ratio of processed audio time to processing time.
+    double realtime_factor;
+    //* Block processing latency percentiles and maximum in seconds.
+    double latency_p50;
+    double latency_p90;
+    double latency_p99;
+    double latency_p999;
+    double latency_max;
+} Methcla_BenchmarkStatistics;
+
+//* Create an audio driver that processes blocks as fast as possible after the engine has been started.
+//
+//  The driver processes num_warmup_blocks blocks that are not measured,
+//  followed by num_blocks measured blocks. block_callback may be NULL.
+METHCLA_EXPORT Methcla_AudioDriver* methcla_benchmark_driver_new(
+    const Methcla_AudioDriverOptions* options,
+    uint64_t num_warmup_blocks,
+    uint64_t num_blocks,
+    Methcla_BenchmarkBlockCallback block_callback,
+    void* block_callback_data
+    );
+
+//* Wait for a benchmark driver to finish and return its statistics.
+//
+//  driver must have been created with methcla_benchmark_driver_new and the
+//  engine it was passed to must have been started; other drivers are
+//  rejected with kMethcla_ArgumentError.
+METHCLA_EXPORT Methcla_Error methcla_benchmark_driver_wait(
+    Methcla_AudioDriver* driver,
+    Methcla_BenchmarkStatistics* statistics
+    );
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // METHCLA_PLATFORM_BENCHMARK_H_INCLUDED
@@ -0,0 +1,55 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_PLATFORM_JACK_H_INCLUDED
+#define METHCLA_PLATFORM_JACK_H_INCLUDED
+
+#include <methcla/engine.h>
+
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+//* Create a JACK client audio driver.
+//
+//  The client registers options->num_inputs input and options->num_outputs
+//  output ports (two each by default). The engine's initial block size is
+//  the larger of options->buffer_size and the JACK server's buffer size.
+//
+//  The engine's block size doesn't follow later changes of the JACK buffer
+//  size: larger periods are processed as several blocks and smaller ones as
+//  partial blocks. Clients that want the block size to match the new buffer
+//  size have to set it with Methcla::Engine::setBlockSize.
+METHCLA_EXPORT Methcla_AudioDriver* methcla_jack_driver_new(
+    const Methcla_AudioDriverOptions* options
+    );
+
+//* Ask the JACK server to enter or leave freewheel mode.
+//
+//  While freewheeling the JACK graph is processed as fast as possible and the
+//  engine's time advances by the duration of the processed frames instead of
+//  following the system clock. driver must have been created with
+//  methcla_jack_driver_new.
+METHCLA_EXPORT Methcla_Error methcla_jack_driver_set_freewheel(
+    Methcla_AudioDriver* driver,
+    bool freewheel
+    );
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // METHCLA_PLATFORM_JACK_H_INCLUDED
@@ -0,0 +1,50 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_PLATFORM_SHM_H_INCLUDED
+#define METHCLA_PLATFORM_SHM_H_INCLUDED
+
+#include <methcla/engine.h>
+
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+//* Create an audio driver exchanging audio with another process through shared memory.
+//
+//  The driver creates the POSIX shared memory segment name, which must start
+//  with a slash, holding num_slots blocks of options->buffer_size frames
+//  (num_slots is rounded up to a power of two, 2 by default when 0). A
+//  process attaches to the segment with the client library declared in
+//  <methcla/shm_client.h>, submits input blocks and receives the rendered
+//  output blocks. The engine processes blocks as they are submitted and its
+//  time advances by the duration of the processed frames.
+//
+//  Returns kMethcla_DeviceUnavailableError if the segment already exists,
+//  e.g. because it is used by another engine; segments left behind by a
+//  process that didn't shut down have to be removed with shm_unlink.
+METHCLA_EXPORT Methcla_Error methcla_shm_driver_new(
+    const Methcla_AudioDriverOptions* options,
+    const char* name,
+    size_t num_slots,
+    Methcla_AudioDriver** driver
+    );
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // METHCLA_PLATFORM_SHM_H_INCLUDED
@@ -40,6 +40,47 @@ typedef struct Methcla_Host Methcla_Host;
 //* Synth handle managed by a plugin.
 typedef void Methcla_Synth;
 
+//* Engine buffer identifier.
+typedef int32_t Methcla_BufferId;
+
+//* Sample buffer shared between plugins and the engine.
+typedef struct Methcla_SampleBuffer
+{
+    //* Interleaved sample data in native byte order.
+    const void* data;
+    //* Sample format of data; kMethcla_SoundFileFormatFloat, kMethcla_SoundFileFormatPCM16 or kMethcla_SoundFileFormatPCM24 (packed).
+    Methcla_SoundFileFormat format;
+    //* Number of channels.
+    size_t channels;
+    //* Number of frames.
+    int64_t frames;
+    //* Sample rate of the data.
+    double samplerate;
+    //* Return the number of frames that have been loaded so far.
+    // May be NULL, in which case all frames are available.
+    int64_t (*frames_available)(const struct Methcla_SampleBuffer* buffer);
+} Methcla_SampleBuffer;
+
+//* Return the number of frames of a sample buffer that can be accessed.
+//
+// Buffers may be loaded progressively; frames below the returned index are
+// valid and the number increases until it reaches `buffer->frames`.
+static inline int64_t methcla_sample_buffer_frames_available(const Methcla_SampleBuffer* buffer)
+{
+    assert(buffer);
+    return buffer->frames_available ? buffer->frames_available(buffer) : buffer->frames;
+}
+
+//* Return a pointer to the sample data of a frame of a sample buffer.
+static inline const void* methcla_sample_buffer_frame(const Methcla_SampleBuffer* buffer, int64_t frame)
+{
+    assert(buffer);
+    const size_t sampleSize = buffer->format == kMethcla_SoundFileFormatPCM16 ? 2
+                            : buffer->format == kMethcla_SoundFileFormatPCM24 ? 3
+                            : sizeof(float);
+    return (const char*)buffer->data + frame * buffer->channels * sampleSize;
+}
+
 //* Callback function type for performing commands in the non-realtime context.
 typedef void (*Methcla_HostPerformFunction)(const Methcla_Host* host, void* data);
 
@@ -56,6 +97,10 @@ struct Methcla_World
     double (*samplerate)(const Methcla_World*);
 
     //* Return maximum audio block size.
+    //
+    // The block size can change between calls to `process` when the engine
+    // is reconfigured; audio port buffers are reconnected before the first
+    // larger block.
     size_t (*block_size)(const Methcla_World* world);
 
     //* Return the time at the start of the current audio block in seconds.
@@ -75,6 +120,19 @@ struct Methcla_World
 
     //* Free synth.
     void (*synth_done)(const struct Methcla_World* world, Methcla_Synth* synth);
+
+    //* Look up the engine buffer with the given id.
+    //
+    // Return NULL if there is no buffer with that id. The buffer is only
+    // guaranteed to exist during the current process cycle unless it is
+    // retained.
+    const Methcla_SampleBuffer* (*buffer)(const Methcla_World* world, Methcla_BufferId id);
+
+    //* Retain a reference to an engine buffer.
+    void (*buffer_retain)(const Methcla_World* world, const Methcla_SampleBuffer* buffer);
+
+    //* Release a reference to an engine buffer.
+    void (*buffer_release)(const Methcla_World* world, const Methcla_SampleBuffer* buffer);
 };
 
 static inline double methcla_world_samplerate(const Methcla_World* world)
@@ -143,6 +201,26 @@ static inline void methcla_world_synth_done(const Methcla_World* world, Methcla_
     world->synth_done(world, synth);
 }
 
+static inline const Methcla_SampleBuffer* methcla_world_buffer(const Methcla_World* world, Methcla_BufferId id)
+{
+    assert(world && world->buffer);
+    return world->buffer(world, id);
+}
+
+static inline void methcla_world_buffer_retain(const Methcla_World* world, const Methcla_SampleBuffer* buffer)
+{
+    assert(world && world->buffer_retain);
+    assert(buffer);
+    world->buffer_retain(world, buffer);
+}
+
+static inline void methcla_world_buffer_release(const Methcla_World* world, const Methcla_SampleBuffer* buffer)
+{
+    assert(world && world->buffer_release);
+    assert(buffer);
+    world->buffer_release(world, buffer);
+}
+
 typedef enum
 {
     kMethcla_Input,
@@ -207,6 +285,11 @@ struct Methcla_SynthDef
 
     //* Destroy a synth instance.
     void (*destroy)(const Methcla_World* world, Methcla_Synth* synth);
+
+    //* Retrieve synth specific statistics (optional).
+    //
+    // Write at most `size` values to `values` and return the number of values written.
+    size_t (*statistics)(const Methcla_World* world, Methcla_Synth* synth, int32_t* values, size_t size);
 };
 
 struct Methcla_Host
@@ -243,6 +326,18 @@ struct Methcla_Host
 
     //* Log a message and a newline character.
     void (*log_line)(const Methcla_Host* host, Methcla_LogLevel level, const char* message);
+
+    //* Acquire a reference to a cached sample buffer.
+    //
+    // Load `num_frames` frames (-1 for the rest of the file) starting at
+    // `start_frame` from the sound file at `path`. Pass 0 as `samplerate` to
+    // keep the sound file's sample rate, otherwise the sample data is
+    // converted to `samplerate` while loading. Buffers with the same
+    // parameters are shared and concurrent requests wait for a single load.
+    Methcla_Error (*buffer_acquire)(const Methcla_Host* host, const char* path, int64_t start_frame, int64_t num_frames, double samplerate, const Methcla_SampleBuffer** buffer);
+
+    //* Release a sample buffer acquired with `buffer_acquire`.
+    void (*buffer_release)(const Methcla_Host* host, const Methcla_SampleBuffer* buffer);
 };
 
 static inline void methcla_host_register_synthdef(const Methcla_Host* host, const Methcla_SynthDef* synthDef)
@@ -279,6 +374,13 @@ static inline void methcla_host_free(const Methcla_Host* context, void* ptr)
     context->free(context, ptr);
 }
 
+static inline void methcla_host_free_aligned(const Methcla_Host* context, void* ptr)
+{
+    assert(context);
+    assert(context->free_aligned);
+    context->free_aligned(context, ptr);
+}
+
 static inline Methcla_Error methcla_host_soundfile_open(const Methcla_Host* host, const char* path, Methcla_FileMode mode, Methcla_SoundFile** file, Methcla_SoundFileInfo* info)
 {
     assert(host && host->soundfile_open);
@@ -302,6 +404,21 @@ static inline void methcla_host_log_line(const Methcla_Host* host, Methcla_LogLe
     host->log_line(host, level, message);
 }
 
+static inline Methcla_Error methcla_host_buffer_acquire(const Methcla_Host* host, const char* path, int64_t start_frame, int64_t num_frames, double samplerate, const Methcla_SampleBuffer** buffer)
+{
+    assert(host && host->buffer_acquire);
+    assert(path);
+    assert(buffer);
+    return host->buffer_acquire(host, path, start_frame, num_frames, samplerate, buffer);
+}
+
+static inline void methcla_host_buffer_release(const Methcla_Host* host, const Methcla_SampleBuffer* buffer)
+{
+    assert(host && host->buffer_release);
+    assert(buffer);
+    host->buffer_release(host, buffer);
+}
+
 typedef struct Methcla_Library Methcla_Library;
 
 struct Methcla_Library
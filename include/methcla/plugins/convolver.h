@@ -0,0 +1,54 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_PLUGINS_CONVOLVER_H_INCLUDED
+#define METHCLA_PLUGINS_CONVOLVER_H_INCLUDED
+
+#include <methcla/plugin.h>
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_convolver(const Methcla_Host*, const char*);
+
+//* Convolution of an audio input with an impulse response read from a sound file.
+//
+// Synth options: `s:path [i:channel] [i:num-frames] [i:partition-size]`,
+// where `channel` selects the sound file channel used as impulse response
+// (default 0), `num-frames` limits its length (default -1 for the whole
+// file) and `partition-size` is the size of the first partition (a power
+// of two from 16 to 4096, default 64).
+//
+// Control input 0 is the output amplitude, followed by the audio input and
+// the audio output. The output is delayed by `partition-size` frames.
+//
+// The first part of the impulse response is convolved in the realtime
+// context, the rest with partitions 16 times as large on a background
+// thread. Impulse response spectra are shared between all convolvers using
+// the same sound file with the same options. The impulse response is used
+// at the engine's sample rate without conversion.
+#define METHCLA_PLUGINS_CONVOLVER_URI METHCLA_PLUGINS_URI "/convolver"
+
+//* Indices of the values returned by `/synth/statistics` for a convolver synth.
+typedef enum
+{
+    //* Number of background partitions that weren't computed in time.
+    kMethcla_ConvolverUnderruns,
+    //* Length of the impulse response in frames.
+    kMethcla_ConvolverImpulseResponseFrames,
+    //* Output latency in frames.
+    kMethcla_ConvolverLatency,
+    kMethcla_ConvolverNumStatistics
+} Methcla_ConvolverStatistics;
+
+#endif /* METHCLA_PLUGINS_CONVOLVER_H_INCLUDED */
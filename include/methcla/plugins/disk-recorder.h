@@ -0,0 +1,37 @@
+/*
+    Copyright 2012-2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_PLUGINS_DISK_RECORDER_H_INCLUDED
+#define METHCLA_PLUGINS_DISK_RECORDER_H_INCLUDED
+
+#include <methcla/file.h>
+#include <methcla/plugin.h>
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_disk_recorder(const Methcla_Host*, const char*);
+//* Synth options: `s:path i:num-inputs [i:file-type] [i:file-format]`, where `file-type` is a `Methcla_SoundFileType` (default WAV) and `file-format` a `Methcla_SoundFileFormat` (default float, written without conversion). Synths with an unknown file type or format log an error and don't record.
+#define METHCLA_PLUGINS_DISK_RECORDER_URI METHCLA_PLUGINS_URI "/disk-recorder"
+
+//* Indices of the values returned by `/synth/statistics` for a disk-recorder synth.
+typedef enum
+{
+    //* Number of audio blocks dropped because the stream buffer was full.
+    kMethcla_DiskRecorderOverruns,
+    //* Number of kilobytes written to disk.
+    kMethcla_DiskRecorderKilobytesWritten,
+    kMethcla_DiskRecorderNumStatistics
+} Methcla_DiskRecorderStatistics;
+
+#endif // METHCLA_PLUGINS_DISK_RECORDER_H_INCLUDED
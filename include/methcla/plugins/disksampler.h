@@ -16,9 +16,31 @@
 #define METHCLA_PLUGINS_DISKSAMPLER_H_INCLUDED
 
 #include <methcla/plugin.h>
+#include <methcla/plugins/resample.h>
 
 #define METHCLA_PLUGINS_DISKSAMPLER "methcla_plugins_disksampler"
 METHCLA_EXPORT const Methcla_Library* methcla_plugins_disksampler(const Methcla_Host*, const char*);
+//* Synth options: `s:path [i:loop] [i:start-frame] [i:num-frames] [i:quality] [i:num-outputs]`, where `quality` is a `Methcla_ResampleQuality` and `num-outputs` the number of audio outputs (1 to 32, default 2).
 #define METHCLA_PLUGINS_DISKSAMPLER_URI METHCLA_PLUGINS_URI "/disksampler"
 
+//* Indices of the values returned by `/synth/statistics` for a disksampler synth.
+typedef enum
+{
+    //* Number of audio blocks that couldn't be filled completely.
+    kMethcla_DiskSamplerUnderruns,
+    //* Number of refills that didn't find enough free buffer space.
+    kMethcla_DiskSamplerOverflows,
+    //* Number of kilobytes read from disk.
+    kMethcla_DiskSamplerKilobytesRead,
+    //* Refill latency estimate in microseconds.
+    kMethcla_DiskSamplerRefillLatency,
+    //* Maximum refill latency in microseconds.
+    kMethcla_DiskSamplerMaxRefillLatency,
+    //* Current stream buffer size in frames.
+    kMethcla_DiskSamplerBufferFrames,
+    //* Number of frames buffered ahead of the playback position.
+    kMethcla_DiskSamplerBufferedFrames,
+    kMethcla_DiskSamplerNumStatistics
+} Methcla_DiskSamplerStatistics;
+
 #endif // METHCLA_PLUGINS_DISKSAMPLER_H_INCLUDED
@@ -0,0 +1,247 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_PLUGINS_FFT_HPP_INCLUDED
+#define METHCLA_PLUGINS_FFT_HPP_INCLUDED
+
+#include <methcla/plugins/simd.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// NOTE: This API is unstable and subject to change!
+
+namespace Methcla { namespace Plugin { namespace FFT {
+
+    //* Real FFT of a fixed power of two size.
+    //
+    // Spectra are stored in split format, i.e. the real and the imaginary
+    // parts of the numBins() bins are stored in separate arrays. The
+    // transform is computed by a complex radix 2 FFT of half the size on
+    // the even and odd samples, the butterflies of the larger stages are
+    // computed four at a time.
+    //
+    // The tables are computed by the constructor, which allocates memory;
+    // forward() and inverse() don't allocate and can be called from the
+    // realtime context and from several threads at the same time.
+    class RealFFT
+    {
+        static constexpr double kPi = 3.14159265358979323846264338327950288;
+
+    public:
+        RealFFT(size_t size)
+            : m_size(size)
+            , m_half(size / 2)
+            , m_bitrev(m_half)
+            , m_twiddleRe(m_half)
+            , m_twiddleIm(m_half)
+            , m_realTwiddleRe(m_half + 1)
+            , m_realTwiddleIm(m_half + 1)
+        {
+            assert( size >= 2 && (size & (size - 1)) == 0 );
+
+            size_t bits = 0;
+            while (((size_t)1 << bits) < m_half)
+                bits++;
+            for (size_t i=0; i < m_half; i++)
+            {
+                size_t r = 0;
+                for (size_t b=0; b < bits; b++)
+                    r |= ((i >> b) & 1) << (bits - 1 - b);
+                m_bitrev[i] = (uint32_t)r;
+            }
+
+            // Twiddles of the stage with butterfly span h start at index h.
+            for (size_t h=1; h < m_half; h *= 2)
+            {
+                for (size_t j=0; j < h; j++)
+                {
+                    const double w = -kPi * (double)j / (double)h;
+                    m_twiddleRe[h+j] = (float)std::cos(w);
+                    m_twiddleIm[h+j] = (float)std::sin(w);
+                }
+            }
+
+            for (size_t k=0; k <= m_half; k++)
+            {
+                const double w = -2. * kPi * (double)k / (double)m_size;
+                m_realTwiddleRe[k] = (float)std::cos(w);
+                m_realTwiddleIm[k] = (float)std::sin(w);
+            }
+        }
+
+        //* Number of real samples transformed.
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        //* Number of complex bins of a spectrum, size() / 2 + 1.
+        size_t numBins() const
+        {
+            return m_half + 1;
+        }
+
+        //* Compute the spectrum of size() samples of input.
+        void forward(const float* input, float* re, float* im) const
+        {
+            // Pack even and odd samples into a complex signal in bit reversed order.
+            for (size_t k=0; k < m_half; k++)
+            {
+                re[m_bitrev[k]] = input[2*k];
+                im[m_bitrev[k]] = input[2*k+1];
+            }
+
+            transform(re, im);
+
+            // Separate the spectra of the even and odd samples and combine them.
+            const float z0r = re[0], z0i = im[0];
+            re[0] = z0r + z0i;
+            im[0] = 0.f;
+            re[m_half] = z0r - z0i;
+            im[m_half] = 0.f;
+
+            for (size_t k=1; k <= m_half / 2; k++)
+            {
+                const size_t l = m_half - k;
+                const float ar = re[k], ai = im[k];
+                const float br = re[l], bi = im[l];
+                // Even and odd sample spectra times two.
+                const float er = ar + br, ei = ai - bi;
+                const float or_ = ai + bi, oi = br - ar;
+                const float wr = m_realTwiddleRe[k], wi = m_realTwiddleIm[k];
+                const float tr = wr * or_ - wi * oi;
+                const float ti = wr * oi + wi * or_;
+                re[k] = 0.5f * (er + tr);
+                im[k] = 0.5f * (ei + ti);
+                // Bin l from the conjugate symmetric spectra.
+                re[l] = 0.5f * (er - tr);
+                im[l] = 0.5f * (ti - ei);
+            }
+        }
+
+        //* Compute size() samples of output from a spectrum.
+        //
+        // The result is scaled by size(), i.e. inverse(forward(x)) is size() * x.
+        // The spectrum is overwritten.
+        void inverse(float* re, float* im, float* output) const
+        {
+            // Recombine into the spectrum of the complex signal of even and odd samples.
+            const float x0 = re[0], xn = re[m_half];
+            re[0] = x0 + xn;
+            im[0] = x0 - xn;
+
+            for (size_t k=1; k <= m_half / 2; k++)
+            {
+                const size_t l = m_half - k;
+                const float ar = re[k], ai = im[k];
+                const float br = re[l], bi = im[l];
+                const float er = ar + br, ei = ai - bi;
+                const float dr = ar - br, di = ai + bi;
+                // Odd sample spectrum times two: (X[k] - conj(X[l])) conj(W^k).
+                const float wr = m_realTwiddleRe[k], wi = m_realTwiddleIm[k];
+                const float or_ = dr * wr + di * wi;
+                const float oi = di * wr - dr * wi;
+                re[k] = er - oi;
+                im[k] = ei + or_;
+                re[l] = er + oi;
+                im[l] = or_ - ei;
+            }
+
+            // The inverse transform is the forward transform with real and
+            // imaginary parts swapped.
+            for (size_t k=0; k < m_half; k++)
+            {
+                const size_t r = m_bitrev[k];
+                if (k < r)
+                {
+                    std::swap(re[k], re[r]);
+                    std::swap(im[k], im[r]);
+                }
+            }
+
+            transform(im, re);
+
+            for (size_t k=0; k < m_half; k++)
+            {
+                output[2*k] = re[k];
+                output[2*k+1] = im[k];
+            }
+        }
+
+    private:
+        // In-place complex FFT of m_half points in bit reversed order.
+        void transform(float* re, float* im) const
+        {
+            for (size_t h=1; h < m_half; h *= 2)
+            {
+                const float* wr = m_twiddleRe.data() + h;
+                const float* wi = m_twiddleIm.data() + h;
+                for (size_t s=0; s < m_half; s += 2*h)
+                {
+                    float* ar = re + s;
+                    float* ai = im + s;
+                    float* br = ar + h;
+                    float* bi = ai + h;
+                    if (h >= 4)
+                    {
+                        for (size_t j=0; j < h; j += 4)
+                        {
+                            const Methcla_Float4 xr = methcla_float4_load(br + j);
+                            const Methcla_Float4 xi = methcla_float4_load(bi + j);
+                            const Methcla_Float4 cr = methcla_float4_load(wr + j);
+                            const Methcla_Float4 ci = methcla_float4_load(wi + j);
+                            const Methcla_Float4 tr = xr * cr - xi * ci;
+                            const Methcla_Float4 ti = xr * ci + xi * cr;
+                            const Methcla_Float4 yr = methcla_float4_load(ar + j);
+                            const Methcla_Float4 yi = methcla_float4_load(ai + j);
+                            methcla_float4_store(br + j, yr - tr);
+                            methcla_float4_store(bi + j, yi - ti);
+                            methcla_float4_store(ar + j, yr + tr);
+                            methcla_float4_store(ai + j, yi + ti);
+                        }
+                    }
+                    else
+                    {
+                        for (size_t j=0; j < h; j++)
+                        {
+                            const float tr = br[j] * wr[j] - bi[j] * wi[j];
+                            const float ti = br[j] * wi[j] + bi[j] * wr[j];
+                            br[j] = ar[j] - tr;
+                            bi[j] = ai[j] - ti;
+                            ar[j] += tr;
+                            ai[j] += ti;
+                        }
+                    }
+                }
+            }
+        }
+
+    private:
+        size_t                  m_size;
+        size_t                  m_half;
+        std::vector<uint32_t>   m_bitrev;
+        std::vector<float>      m_twiddleRe;
+        std::vector<float>      m_twiddleIm;
+        std::vector<float>      m_realTwiddleRe;
+        std::vector<float>      m_realTwiddleIm;
+    };
+
+} } }
+
+#endif // METHCLA_PLUGINS_FFT_HPP_INCLUDED
@@ -0,0 +1,58 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_PLUGINS_FILTERBANK_H_INCLUDED
+#define METHCLA_PLUGINS_FILTERBANK_H_INCLUDED
+
+#include <methcla/plugin.h>
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_filterbank(const Methcla_Host*, const char*);
+
+//* Bank of biquad filters, each a cascade of identical second order sections.
+//
+// Synth options: `[i:num-filters] [i:num-stages] [i:bands]`, where
+// `num-filters` is 1 to 256 (default 1), `num-stages` the number of
+// cascaded sections per filter (1 to 4, default 1) and `bands` selects
+// whether all filters process the first audio input (non-zero) or filter i
+// processes audio input i (0, the default).
+//
+// Control inputs are grouped by parameter: num-filters filter types
+// (`Methcla_FilterbankType`), followed by num-filters frequencies in Hz,
+// num-filters Q values and num-filters gains in dB (only used by the peak
+// and shelving filters). They are followed by the audio inputs (one in
+// band mode, num-filters otherwise) and num-filters audio outputs.
+//
+// Coefficients are computed by the engine's worker thread when control
+// inputs change and are interpolated over 5 ms; the outputs are silent
+// until the first coefficients have been computed.
+#define METHCLA_PLUGINS_FILTERBANK_URI METHCLA_PLUGINS_URI "/filterbank"
+
+//* Filter response types; see the Audio EQ Cookbook by Robert Bristow-Johnson.
+typedef enum
+{
+    kMethcla_FilterbankLowpass,
+    kMethcla_FilterbankHighpass,
+    //* Band pass with 0 dB gain at the center frequency.
+    kMethcla_FilterbankBandpass,
+    kMethcla_FilterbankNotch,
+    kMethcla_FilterbankAllpass,
+    kMethcla_FilterbankPeak,
+    kMethcla_FilterbankLowShelf,
+    kMethcla_FilterbankHighShelf,
+    kMethcla_FilterbankNumTypes
+} Methcla_FilterbankType;
+
+#endif /* METHCLA_PLUGINS_FILTERBANK_H_INCLUDED */
@@ -0,0 +1,38 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_PLUGINS_MATRIX_MIXER_H_INCLUDED
+#define METHCLA_PLUGINS_MATRIX_MIXER_H_INCLUDED
+
+#include <methcla/plugin.h>
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_matrix_mixer(const Methcla_Host*, const char*);
+
+//* Mixer of M audio inputs to N audio outputs with an M x N gain matrix.
+//
+// Synth options: `[i:num-inputs] [i:num-outputs]` (1 to 32, default 2).
+//
+// Control inputs 0 to M*N-1 are the gains in row major order with one row
+// per output, i.e. control input j*M+i is the gain of input i in output j.
+// They are followed by the M audio inputs and the N audio outputs.
+//
+// Gains are interpolated linearly over the block following a change and
+// entries that are zero at both ends of a block are skipped. All control
+// changes in one request are applied at the same block boundary; use
+// `/node/set-range` for setting a row or the whole matrix with one message.
+#define METHCLA_PLUGINS_MATRIX_MIXER_URI METHCLA_PLUGINS_URI "/matrix-mixer"
+
+#endif /* METHCLA_PLUGINS_MATRIX_MIXER_H_INCLUDED */
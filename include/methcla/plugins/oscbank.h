@@ -0,0 +1,37 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_PLUGINS_OSCBANK_H_INCLUDED
+#define METHCLA_PLUGINS_OSCBANK_H_INCLUDED
+
+#include <methcla/plugin.h>
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_oscbank(const Methcla_Host*, const char*);
+
+//* Bank of sine oscillators summed to one audio output.
+//
+// Synth options: `[i:num-partials]` (1 to 4096, default 1).
+//
+// Control inputs 0 to num-partials-1 are the partial frequencies in Hz,
+// control inputs num-partials to 2*num-partials-1 the partial amplitudes.
+// The audio output follows the control inputs. Frequencies and amplitudes
+// are interpolated linearly over each block; use `/node/set-range` for
+// setting many of them with one message. Control inputs without initial
+// value in `/synth/new` are zero, so large banks can be created without
+// initial values and set with several `/node/set-range` messages.
+#define METHCLA_PLUGINS_OSCBANK_URI METHCLA_PLUGINS_URI "/oscbank"
+
+#endif /* METHCLA_PLUGINS_OSCBANK_H_INCLUDED */
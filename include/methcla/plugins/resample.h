@@ -0,0 +1,35 @@
+/*
+    Copyright 2012-2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_PLUGINS_RESAMPLE_H_INCLUDED
+#define METHCLA_PLUGINS_RESAMPLE_H_INCLUDED
+
+//* Interpolation used by sample playback synths when the playback rate is not 1.
+//
+// Passed as a synth option to the sampler and the disksampler.
+typedef enum
+{
+    //* No interpolation (drop or repeat samples).
+    kMethcla_ResampleNone,
+    //* Linear interpolation.
+    kMethcla_ResampleLinear,
+    //* 4-point cubic Hermite interpolation (default).
+    kMethcla_ResampleHermite,
+    //* 16-point windowed sinc interpolation.
+    kMethcla_ResampleSinc
+} Methcla_ResampleQuality;
+
+#endif /* METHCLA_PLUGINS_RESAMPLE_H_INCLUDED */
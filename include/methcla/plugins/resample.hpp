@@ -0,0 +1,601 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_PLUGINS_RESAMPLE_HPP_INCLUDED
+#define METHCLA_PLUGINS_RESAMPLE_HPP_INCLUDED
+
+#include <methcla/file.h>
+#include <methcla/plugins/resample.h>
+#include <methcla/plugins/simd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// NOTE: This API is unstable and subject to change!
+
+namespace Methcla { namespace Plugin { namespace Resample {
+
+    //* Maximum number of output frames processed by a kernel at once.
+    static const size_t kBlockSize = 32;
+    static_assert(kBlockSize % 4 == 0, "kBlockSize must be a multiple of four");
+
+    //* Maximum number of input frames accessed per output frame.
+    static const size_t kMaxTaps = 16;
+
+    //* Interleaved sample data to resample from.
+    struct Source
+    {
+        const void* data;
+        //* kMethcla_SoundFileFormatFloat, kMethcla_SoundFileFormatPCM16 or kMethcla_SoundFileFormatPCM24 (packed).
+        Methcla_SoundFileFormat format;
+        size_t channels;
+        size_t frames;
+        //* Whether to wrap around at the ends of the data (loops and ring buffers) instead of clamping.
+        bool wrap;
+    };
+
+    // Sample formats convert the sample at an index to float. load4()
+    // converts the samples at index[l] + offset for the four lanes l.
+
+    struct Float
+    {
+        static inline float load(const void* data, size_t index)
+        {
+            return static_cast<const float*>(data)[index];
+        }
+
+        static inline Methcla_Float4 load4(const void* data, const size_t* index, size_t offset)
+        {
+            const float* x = static_cast<const float*>(data) + offset;
+            const Methcla_Float4 v = { x[index[0]], x[index[1]], x[index[2]], x[index[3]] };
+            return v;
+        }
+    };
+
+    struct PCM16
+    {
+        static inline float load(const void* data, size_t index)
+        {
+            return static_cast<const int16_t*>(data)[index] * (1.f / 32768.f);
+        }
+
+        static inline Methcla_Float4 load4(const void* data, const size_t* index, size_t offset)
+        {
+            const int16_t* x = static_cast<const int16_t*>(data) + offset;
+            const Methcla_Int4 v = { x[index[0]], x[index[1]], x[index[2]], x[index[3]] };
+            return methcla_int4_to_float4(v) * methcla_float4_splat(1.f / 32768.f);
+        }
+    };
+
+    //* Packed 24 bit samples in native byte order.
+    struct PCM24
+    {
+        static inline int32_t value(const void* data, size_t index)
+        {
+            const uint8_t* x = static_cast<const uint8_t*>(data) + 3 * index;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+            return (int32_t)((uint32_t)x[0] << 24 | (uint32_t)x[1] << 16 | (uint32_t)x[2] << 8) >> 8;
+#else
+            return (int32_t)((uint32_t)x[2] << 24 | (uint32_t)x[1] << 16 | (uint32_t)x[0] << 8) >> 8;
+#endif
+        }
+
+        static inline float load(const void* data, size_t index)
+        {
+            return value(data, index) * (1.f / 8388608.f);
+        }
+
+        static inline Methcla_Float4 load4(const void* data, const size_t* index, size_t offset)
+        {
+            const Methcla_Int4 v = {
+                value(data, index[0] + offset), value(data, index[1] + offset),
+                value(data, index[2] + offset), value(data, index[3] + offset)
+            };
+            // 24 bit values exceed the range of methcla_int4_to_float4; the
+            // upper 16 and the lower 8 bits are converted separately and
+            // added exactly.
+            const Methcla_Float4 hi = methcla_int4_to_float4(v >> methcla_int4_splat(8));
+            const Methcla_Float4 lo = methcla_int4_to_float4(v & methcla_int4_splat(0xFF));
+            return (hi * methcla_float4_splat(256.f) + lo) * methcla_float4_splat(1.f / 8388608.f);
+        }
+    };
+
+    // Kernels interpolate between the input frames at the integer part of
+    // the phase and the frame following it. kLeft and kRight are the
+    // number of frames accessed before and after the integer part.
+    //
+    // interpolate() computes n output frames from taps stored in
+    // structure of arrays layout, taps[i][j] being tap i of output frame j.
+    // Output frames are computed four at a time with Methcla_Float4; taps
+    // and frac are padded to a multiple of four frames.
+
+    struct Nearest
+    {
+        enum { kLeft = 0, kRight = 0, kTaps = 1 };
+
+        static inline void interpolate(float* out, const float (*taps)[kBlockSize], const float*, size_t n, float amp)
+        {
+            const Methcla_Float4 a = methcla_float4_splat(amp);
+            for (size_t j=0; j < n; j += 4)
+                methcla_float4_store_n(out + j, a * methcla_float4_load(taps[0] + j), n - j);
+        }
+    };
+
+    struct Linear
+    {
+        enum { kLeft = 0, kRight = 1, kTaps = 2 };
+
+        static inline void interpolate(float* out, const float (*taps)[kBlockSize], const float* frac, size_t n, float amp)
+        {
+            const Methcla_Float4 a = methcla_float4_splat(amp);
+            for (size_t j=0; j < n; j += 4)
+            {
+                const Methcla_Float4 x = methcla_float4_load(frac + j);
+                const Methcla_Float4 y0 = methcla_float4_load(taps[0] + j);
+                const Methcla_Float4 y1 = methcla_float4_load(taps[1] + j);
+                methcla_float4_store_n(out + j, a * (y0 + x * (y1 - y0)), n - j);
+            }
+        }
+    };
+
+    struct Hermite
+    {
+        enum { kLeft = 1, kRight = 2, kTaps = 4 };
+
+        static inline void interpolate(float* out, const float (*taps)[kBlockSize], const float* frac, size_t n, float amp)
+        {
+            const Methcla_Float4 a = methcla_float4_splat(amp);
+            const Methcla_Float4 half = methcla_float4_splat(0.5f);
+            const Methcla_Float4 oneAndHalf = methcla_float4_splat(1.5f);
+            const Methcla_Float4 two = methcla_float4_splat(2.f);
+            const Methcla_Float4 twoAndHalf = methcla_float4_splat(2.5f);
+
+            for (size_t j=0; j < n; j += 4)
+            {
+                // 4-point, 3rd-order Hermite (x-form)
+                const Methcla_Float4 x = methcla_float4_load(frac + j);
+                const Methcla_Float4 y0 = methcla_float4_load(taps[0] + j);
+                const Methcla_Float4 y1 = methcla_float4_load(taps[1] + j);
+                const Methcla_Float4 y2 = methcla_float4_load(taps[2] + j);
+                const Methcla_Float4 y3 = methcla_float4_load(taps[3] + j);
+                const Methcla_Float4 c0 = y1;
+                const Methcla_Float4 c1 = half * (y2 - y0);
+                const Methcla_Float4 c2 = y0 - twoAndHalf * y1 + two * y2 - half * y3;
+                const Methcla_Float4 c3 = oneAndHalf * (y1 - y2) + half * (y3 - y0);
+                methcla_float4_store_n(out + j, a * (((c3 * x + c2) * x + c1) * x + c0), n - j);
+            }
+        }
+    };
+
+    //* Polyphase table of Blackman windowed sinc coefficients.
+    class SincTable
+    {
+    public:
+        enum { kTaps = 16, kPhases = 256 };
+
+        SincTable()
+        {
+            const double pi = 3.14159265358979323846;
+            const double halfWidth = kTaps / 2;
+
+            for (size_t p=0; p <= kPhases; p++)
+            {
+                const double x = (double)p / kPhases;
+                double sum = 0.;
+
+                for (size_t i=0; i < kTaps; i++)
+                {
+                    const double t = (double)i - (kTaps / 2 - 1) - x;
+                    const double s = t == 0. ? 1. : std::sin(pi * t) / (pi * t);
+                    const double w = 0.42 + 0.5 * std::cos(pi * t / halfWidth)
+                                          + 0.08 * std::cos(2. * pi * t / halfWidth);
+                    m_coeffs[i][p] = s * w;
+                    sum += s * w;
+                }
+
+                // Normalize to unity gain at DC.
+                for (size_t i=0; i < kTaps; i++)
+                    m_coeffs[i][p] /= sum;
+            }
+        }
+
+        //* Return coefficients of tap i for all phases.
+        const float* coeffs(size_t i) const
+        {
+            return m_coeffs[i];
+        }
+
+    private:
+        float m_coeffs[kTaps][kPhases+1];
+    };
+
+    //* Return the sinc coefficient table.
+    //
+    // The table is computed on first use; call this function once in the
+    // non-realtime context before using the sinc kernel.
+    inline const SincTable& sincTable()
+    {
+        static const SincTable table;
+        return table;
+    }
+
+    //* Windowed sinc interpolation.
+    //
+    // Coefficients are interpolated linearly between adjacent phases. The
+    // kernel's cutoff is fixed at the input's Nyquist frequency, i.e. there
+    // is no additional band limiting when playing back faster than 1.
+    struct Sinc
+    {
+        enum { kLeft = SincTable::kTaps / 2 - 1, kRight = SincTable::kTaps / 2, kTaps = SincTable::kTaps };
+
+        static inline void interpolate(float* out, const float (*taps)[kBlockSize], const float* frac, size_t n, float amp)
+        {
+            const SincTable& table = sincTable();
+            const Methcla_Float4 a = methcla_float4_splat(amp);
+
+            for (size_t j=0; j < n; j += 4)
+            {
+                // The coefficients of each lane are gathered from its phase.
+                size_t index[4];
+                Methcla_Float4 weight;
+                for (size_t l=0; l < 4; l++)
+                {
+                    const float p = frac[j+l] * SincTable::kPhases;
+                    index[l] = std::min((size_t)p, (size_t)SincTable::kPhases - 1);
+                    weight[l] = p - index[l];
+                }
+
+                Methcla_Float4 acc = methcla_float4_splat(0.f);
+                for (size_t i=0; i < kTaps; i++)
+                {
+                    const float* c = table.coeffs(i);
+                    const Methcla_Float4 c0 = { c[index[0]], c[index[1]], c[index[2]], c[index[3]] };
+                    const Methcla_Float4 c1 = { c[index[0]+1], c[index[1]+1], c[index[2]+1], c[index[3]+1] };
+                    acc += (c0 + weight * (c1 - c0)) * methcla_float4_load(taps[i] + j);
+                }
+
+                methcla_float4_store_n(out + j, a * acc, n - j);
+            }
+        }
+    };
+
+    //* Pad the n frames of a kernel argument to a multiple of four by repeating the last frame.
+    template <typename T> inline void pad(T* x, size_t n)
+    {
+        assert(n > 0 && n <= kBlockSize);
+        for (size_t j=n; j % 4 != 0; j++)
+            x[j] = x[n-1];
+    }
+
+    //* Set frames [begin, end) of numOutputs output buffers to zero.
+    inline void clear(float* const* outputs, size_t numOutputs, size_t begin, size_t end)
+    {
+        for (size_t c=0; c < numOutputs; c++)
+            std::fill(outputs[c] + begin, outputs[c] + end, 0.f);
+    }
+
+    //* Copy channel of n consecutive interleaved frames starting at sample index first to out.
+    //
+    // Frames are converted four at a time with Format::load4. kStride is
+    // the number of channels if known at compile time and zero otherwise;
+    // a constant stride turns the gather into loads at constant offsets.
+    template <class Format, size_t kStride> inline void deinterleave(
+        const void* data,
+        size_t stride,
+        size_t first,
+        size_t channel,
+        float amp,
+        float* out,
+        size_t n )
+    {
+        if (kStride != 0)
+            stride = kStride;
+
+        const size_t numVectorFrames = n & ~(size_t)3;
+        const size_t index[4] = { 0, stride, 2 * stride, 3 * stride };
+        const Methcla_Float4 a = methcla_float4_splat(amp);
+
+        for (size_t j=0; j < numVectorFrames; j += 4)
+            methcla_float4_store(out + j, a * Format::load4(data, index, first + j * stride + channel));
+
+        for (size_t j=numVectorFrames; j < n; j++)
+            out[j] = amp * Format::load(data, first + j * stride + channel);
+    }
+
+    // Output c is taken from source channel c; mono sources are copied to
+    // all outputs and outputs without a source channel are set to zero.
+    template <class Format> inline void deinterleave(
+        const Source& source,
+        size_t frame,
+        float amp,
+        float* const* outputs,
+        size_t numOutputs,
+        size_t offset,
+        size_t n )
+    {
+        const size_t channels = source.channels;
+        const size_t first = frame * channels;
+        for (size_t c=0; c < numOutputs; c++)
+        {
+            float* out = outputs[c] + offset;
+            if (c > 0 && channels == 1)
+            {
+                std::copy(outputs[0] + offset, outputs[0] + offset + n, out);
+            }
+            else if (c >= channels)
+            {
+                std::fill(out, out + n, 0.f);
+            }
+            else
+            {
+                switch (channels)
+                {
+                    case 1: deinterleave<Format,1>(source.data, channels, first, c, amp, out, n); break;
+                    case 2: deinterleave<Format,2>(source.data, channels, first, c, amp, out, n); break;
+                    case 4: deinterleave<Format,4>(source.data, channels, first, c, amp, out, n); break;
+                    case 8: deinterleave<Format,8>(source.data, channels, first, c, amp, out, n); break;
+                    default: deinterleave<Format,0>(source.data, channels, first, c, amp, out, n); break;
+                }
+            }
+        }
+    }
+
+    //* Copy frames of source to the outputs without interpolation.
+    //
+    // Equivalent to resampling with rate 1 from an integer phase; the
+    // frames are deinterleaved in contiguous runs up to end or the end of
+    // the source. See resample() for the meaning of the arguments.
+    template <class Format> inline size_t copy(
+        const Source& source,
+        int64_t end,
+        double& phase,
+        float amp,
+        float* const* outputs,
+        size_t numOutputs,
+        size_t numFrames )
+    {
+        assert(source.frames > 0);
+        assert(phase >= 0. && phase == std::floor(phase));
+
+        const int64_t frames = source.frames;
+        int64_t index = (int64_t)phase;
+
+        if (!source.wrap)
+            end = std::min(end, frames);
+
+        size_t k = 0;
+
+        while (k < numFrames)
+        {
+            if (source.wrap && index >= frames)
+            {
+                const int64_t offset = (index / frames) * frames;
+                index -= offset;
+                end -= offset;
+            }
+
+            if (index >= end)
+                break;
+
+            const size_t n = (size_t)std::min<int64_t>(numFrames - k, std::min(end, frames) - index);
+            deinterleave<Format>(source, index, amp, outputs, numOutputs, k, n);
+            index += n;
+            k += n;
+        }
+
+        if (source.wrap && index >= frames)
+            index %= frames;
+
+        phase = (double)index;
+
+        return k;
+    }
+
+    //* Resample source into numOutputs output buffers.
+    //
+    // Produces at most numFrames output frames, starting at phase and
+    // advancing it by rate for each frame. Stops before the integer part of
+    // the phase reaches end; input frames at or beyond end are treated as
+    // not available and replaced by the last frame before end. If the
+    // source wraps around, end may exceed the number of source frames and
+    // the returned phase is in the range [0, source.frames).
+    //
+    // Returns the number of frames produced. Output c is taken from source
+    // channel c; mono sources are copied to all outputs and outputs without
+    // a source channel are set to zero. Samples are converted to float
+    // according to Format while gathering the kernel's taps.
+    template <class Kernel, class Format=Float> inline size_t resample(
+        const Source& source,
+        int64_t end,
+        double& phase,
+        float rate,
+        float amp,
+        float* const* outputs,
+        size_t numOutputs,
+        size_t numFrames )
+    {
+        assert(source.frames > 0);
+        assert(phase >= 0.);
+
+        const size_t numTaps = Kernel::kTaps;
+        const int64_t frames = source.frames;
+        const size_t channels = source.channels;
+        const size_t numChannels = std::min(channels, numOutputs);
+        const double step = std::max(rate, 0.f);
+
+        if (!source.wrap)
+            end = std::min(end, frames);
+
+        float frac[kBlockSize];
+        size_t first[kBlockSize];
+        float taps[Kernel::kTaps][kBlockSize];
+
+        size_t k = 0;
+
+        while (k < numFrames)
+        {
+            if (source.wrap && phase >= frames)
+            {
+                const double offset = std::floor(phase / frames) * frames;
+                phase -= offset;
+                end -= (int64_t)offset;
+            }
+
+            const int64_t index = (int64_t)phase;
+            if (index >= end)
+                break;
+
+            // Frames in this range can be computed without wrapping or
+            // clamping any of the kernel's taps.
+            const double limit = (double)(std::min(end, frames) - Kernel::kRight);
+
+            size_t n = std::min(kBlockSize, numFrames - k);
+
+            if (index >= Kernel::kLeft && phase < limit)
+            {
+                if (step > 0.)
+                {
+                    n = std::min(n, (size_t)std::ceil((limit - phase) / step));
+                    while (n > 1 && phase + (n-1) * step >= limit)
+                        n--;
+                }
+
+                for (size_t j=0; j < n; j++)
+                {
+                    const double pos = phase + j * step;
+                    const int64_t i = (int64_t)pos;
+                    first[j] = (i - Kernel::kLeft) * channels;
+                    frac[j] = (float)(pos - i);
+                }
+                pad(first, n);
+                pad(frac, n);
+
+                for (size_t c=0; c < numChannels; c++)
+                {
+                    for (size_t t=0; t < numTaps; t++)
+                    {
+                        for (size_t j=0; j < n; j += 4)
+                            methcla_float4_store(taps[t] + j, Format::load4(source.data, first + j, t * channels + c));
+                    }
+                    Kernel::interpolate(outputs[c] + k, taps, frac, n, amp);
+                }
+            }
+            else
+            {
+                n = 1;
+                frac[0] = (float)(phase - index);
+                pad(frac, n);
+                for (size_t c=0; c < numChannels; c++)
+                {
+                    for (size_t t=0; t < numTaps; t++)
+                    {
+                        int64_t i = index - Kernel::kLeft + (int64_t)t;
+                        if (i >= end)
+                            i = end - 1;
+                        if (source.wrap)
+                        {
+                            i %= frames;
+                            if (i < 0) i += frames;
+                        }
+                        else if (i < 0)
+                        {
+                            i = 0;
+                        }
+                        taps[t][0] = Format::load(source.data, i * channels + c);
+                        pad(taps[t], n);
+                    }
+                    Kernel::interpolate(outputs[c] + k, taps, frac, n, amp);
+                }
+            }
+
+            for (size_t c=numChannels; c < numOutputs; c++)
+            {
+                if (channels == 1)
+                    std::copy(outputs[0] + k, outputs[0] + k + n, outputs[c] + k);
+                else
+                    std::fill(outputs[c] + k, outputs[c] + k + n, 0.f);
+            }
+
+            phase += n * step;
+            k += n;
+        }
+
+        if (source.wrap && phase >= frames)
+            phase -= std::floor(phase / frames) * frames;
+
+        return k;
+    }
+
+    //* Resample with the kernel selected by quality.
+    //
+    // Playback at rate 1 from an integer phase doesn't need interpolation
+    // and copies the source frames instead.
+    template <class Format> inline size_t resample(
+        Methcla_ResampleQuality quality,
+        const Source& source,
+        int64_t end,
+        double& phase,
+        float rate,
+        float amp,
+        float* const* outputs,
+        size_t numOutputs,
+        size_t numFrames )
+    {
+        if (rate == 1.f && phase == std::floor(phase))
+            return copy<Format>(source, end, phase, amp, outputs, numOutputs, numFrames);
+
+        switch (quality)
+        {
+            case kMethcla_ResampleNone:
+                return resample<Nearest,Format>(source, end, phase, rate, amp, outputs, numOutputs, numFrames);
+            case kMethcla_ResampleLinear:
+                return resample<Linear,Format>(source, end, phase, rate, amp, outputs, numOutputs, numFrames);
+            case kMethcla_ResampleSinc:
+                return resample<Sinc,Format>(source, end, phase, rate, amp, outputs, numOutputs, numFrames);
+            case kMethcla_ResampleHermite:
+            default:
+                return resample<Hermite,Format>(source, end, phase, rate, amp, outputs, numOutputs, numFrames);
+        }
+    }
+
+    //* Resample with the kernel selected by quality and the source's sample format.
+    inline size_t resample(
+        Methcla_ResampleQuality quality,
+        const Source& source,
+        int64_t end,
+        double& phase,
+        float rate,
+        float amp,
+        float* const* outputs,
+        size_t numOutputs,
+        size_t numFrames )
+    {
+        switch (source.format)
+        {
+            case kMethcla_SoundFileFormatPCM16:
+                return resample<PCM16>(quality, source, end, phase, rate, amp, outputs, numOutputs, numFrames);
+            case kMethcla_SoundFileFormatPCM24:
+                return resample<PCM24>(quality, source, end, phase, rate, amp, outputs, numOutputs, numFrames);
+            default:
+                assert(source.format == kMethcla_SoundFileFormatFloat);
+                return resample<Float>(quality, source, end, phase, rate, amp, outputs, numOutputs, numFrames);
+        }
+    }
+
+} } }
+
+#endif // METHCLA_PLUGINS_RESAMPLE_HPP_INCLUDED
@@ -18,8 +18,10 @@
 #define METHCLA_PLUGINS_SAMPLER_H_INCLUDED
 
 #include <methcla/plugin.h>
+#include <methcla/plugins/resample.h>
 
 METHCLA_EXPORT const Methcla_Library* methcla_plugins_sampler(const Methcla_Host*, const char*);
+//* Synth options: `s:path|i:buffer-id [i:loop] [i:start-frame] [i:num-frames] [i:quality] [i:num-outputs]`, where `quality` is a `Methcla_ResampleQuality` and `num-outputs` the number of audio outputs (1 to 32, default 2).
 #define METHCLA_PLUGINS_SAMPLER_URI METHCLA_PLUGINS_URI "/sampler"
 
 #endif /* METHCLA_PLUGINS_SAMPLER_H_INCLUDED */
@@ -0,0 +1,78 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_PLUGINS_SIMD_H_INCLUDED
+#define METHCLA_PLUGINS_SIMD_H_INCLUDED
+
+// Four lane vector types for plugin kernels.
+//
+// The types use the GCC/Clang vector extensions, which map to SSE or NEON
+// registers without depending on a particular instruction set. Plugins are
+// built with -Os in release builds, which doesn't vectorise loops, so
+// kernels that should be vectorised have to use these types explicitly.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef float   Methcla_Float4 __attribute__((vector_size(16)));
+typedef int32_t Methcla_Int4   __attribute__((vector_size(16)));
+
+static inline Methcla_Float4 methcla_float4_splat(float x)
+{
+    const Methcla_Float4 v = { x, x, x, x };
+    return v;
+}
+
+static inline Methcla_Int4 methcla_int4_splat(int32_t x)
+{
+    const Methcla_Int4 v = { x, x, x, x };
+    return v;
+}
+
+//* Convert four integers in the range [-2^22, 2^22) to float.
+//
+// The integers are added to the mantissa of 1.5 * 2^23, which is exact in
+// this range; the vector extensions don't provide a portable conversion.
+static inline Methcla_Float4 methcla_int4_to_float4(Methcla_Int4 x)
+{
+    return (Methcla_Float4)(x + methcla_int4_splat(0x4B400000)) - methcla_float4_splat(12582912.f);
+}
+
+//* Load four floats from x, which doesn't need to be aligned.
+static inline Methcla_Float4 methcla_float4_load(const float* x)
+{
+    Methcla_Float4 v;
+    memcpy(&v, x, sizeof(v));
+    return v;
+}
+
+//* Store four floats to x, which doesn't need to be aligned.
+static inline void methcla_float4_store(float* x, Methcla_Float4 v)
+{
+    memcpy(x, &v, sizeof(v));
+}
+
+//* Store the first min(n, 4) lanes of v to x, which doesn't need to be aligned.
+static inline void methcla_float4_store_n(float* x, Methcla_Float4 v, size_t n)
+{
+    if (n >= 4)
+        memcpy(x, &v, sizeof(v));
+    else
+        memcpy(x, &v, n * sizeof(float));
+}
+
+#endif /* METHCLA_PLUGINS_SIMD_H_INCLUDED */
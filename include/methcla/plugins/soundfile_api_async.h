@@ -0,0 +1,35 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_SOUNDFILEAPI_ASYNC_H_INCLUDED
+#define METHCLA_SOUNDFILEAPI_ASYNC_H_INCLUDED
+
+#include <methcla/file.h>
+#include <methcla/plugin.h>
+
+//* Sound file API for uncompressed WAV and AIFF files with asynchronous read-ahead (read only).
+//
+// Each open file keeps a window of segments ahead of its read position
+// filled by a single I/O thread. On Linux the refills of all open files
+// are submitted in batches through io_uring; where io_uring isn't
+// available a small pool of threads reads the segments with pread.
+METHCLA_EXPORT const Methcla_Library* methcla_soundfile_api_async(const Methcla_Host*, const char*);
+
+//* Bypass the operating system's page cache when reading sound files.
+//
+// Files are opened with O_DIRECT (F_NOCACHE on OS X) if the file system
+// supports it. Call before opening files; the default is false.
+METHCLA_EXPORT void methcla_soundfile_api_async_set_direct_io(bool flag);
+
+#endif /* METHCLA_SOUNDFILEAPI_ASYNC_H_INCLUDED */
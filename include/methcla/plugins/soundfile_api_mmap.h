@@ -0,0 +1,26 @@
+// Copyright 2013 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_SOUNDFILEAPI_MMAP_H_INCLUDED
+#define METHCLA_SOUNDFILEAPI_MMAP_H_INCLUDED
+
+#include <methcla/file.h>
+#include <methcla/plugin.h>
+
+//* Memory mapped sound file API for uncompressed WAV and AIFF files (read only).
+//
+// Sound files opened with this API support zero-copy views of their sample data (see `methcla_soundfile_view`).
+METHCLA_EXPORT const Methcla_Library* methcla_soundfile_api_mmap(const Methcla_Host*, const char*);
+
+#endif /* METHCLA_SOUNDFILEAPI_MMAP_H_INCLUDED */
@@ -20,4 +20,12 @@
 
 METHCLA_EXPORT const Methcla_Library* methcla_soundfile_api_mpg123(const Methcla_Host*, const char*);
 
+//* Cache the seek indices of MP3 files in directory.
+//
+// Seek indices are built when opening a file by scanning all frames, which
+// can take a while for long files. If directory is non-NULL, indices are
+// stored in directory and reused as long as the file doesn't change. Call
+// before loading the library; directory must exist.
+METHCLA_EXPORT void methcla_soundfile_api_mpg123_set_index_cache(const char* directory);
+
 #endif /* METHCLA_SOUNDFILEAPI_MPG123_H_INCLUDED */
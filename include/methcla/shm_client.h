@@ -0,0 +1,89 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_SHM_CLIENT_H_INCLUDED
+#define METHCLA_SHM_CLIENT_H_INCLUDED
+
+// Client library for exchanging audio with an engine running the shared
+// memory audio driver (see <methcla/platform/shm.h>) in another process.
+//
+// The library is self-contained and doesn't depend on the engine. Blocks
+// are exchanged in place: the client writes the input channels of a block
+// directly to shared memory with methcla_shm_client_begin_write and
+// methcla_shm_client_end_write, and reads the rendered output channels
+// with methcla_shm_client_begin_read and methcla_shm_client_end_read. Up to
+// methcla_shm_client_num_slots blocks can be in flight; blocks are read
+// back in the order they were written.
+//
+// A client must only be used by one thread at a time. Functions returning
+// int return 0 on success and a negative errno value on failure.
+
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct Methcla_ShmClient Methcla_ShmClient;
+
+//* Attach to the shared memory segment name created by the engine's audio driver.
+//
+//  Returns -ENOENT when the segment doesn't exist and -EPROTO when it
+//  wasn't created by a compatible engine.
+int methcla_shm_client_open(const char* name, Methcla_ShmClient** client);
+
+//* Detach from the shared memory segment and free the client.
+void methcla_shm_client_close(Methcla_ShmClient* client);
+
+size_t methcla_shm_client_num_inputs(const Methcla_ShmClient* client);
+size_t methcla_shm_client_num_outputs(const Methcla_ShmClient* client);
+size_t methcla_shm_client_block_size(const Methcla_ShmClient* client);
+size_t methcla_shm_client_num_slots(const Methcla_ShmClient* client);
+double methcla_shm_client_sample_rate(const Methcla_ShmClient* client);
+
+//* Return the input channels of the next block in *inputs.
+//
+//  Each channel holds methcla_shm_client_block_size samples. Returns
+//  -EAGAIN when all slots are in flight; read a block first.
+int methcla_shm_client_begin_write(Methcla_ShmClient* client, float* const** inputs);
+
+//* Submit the block returned by the preceding call to methcla_shm_client_begin_write to the engine.
+int methcla_shm_client_end_write(Methcla_ShmClient* client);
+
+//* Wait for the oldest block in flight to be processed and return its output channels in *outputs.
+//
+//  Returns -EAGAIN when no block is in flight, -ETIMEDOUT when the block
+//  hasn't been processed within timeout_ms milliseconds and -EPIPE when
+//  the engine's driver has been stopped.
+int methcla_shm_client_begin_read(Methcla_ShmClient* client, int timeout_ms, const float* const** outputs);
+
+//* Release the block returned by the preceding call to methcla_shm_client_begin_read.
+int methcla_shm_client_end_read(Methcla_ShmClient* client);
+
+//* Process one block synchronously.
+//
+//  Copies the input channels to the next slot, waits for the block to be
+//  processed and copies the output channels. Returns -EBUSY when blocks
+//  written with methcla_shm_client_begin_write are in flight. When waiting
+//  times out the block stays in flight and can be read with
+//  methcla_shm_client_begin_read.
+int methcla_shm_client_process(Methcla_ShmClient* client, const float* const* inputs, float* const* outputs, int timeout_ms);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // METHCLA_SHM_CLIENT_H_INCLUDED
@@ -18,13 +18,18 @@
 #include "Methcla/Utility/Semaphore.hpp"
 
 #include <boost/assert.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <lame/lame.h>
 #include <memory>
 #include <shout/shout.h>
 #include <stdexcept>
 #include <thread>
+#include <vector>
 
 using namespace Methcla;
 using namespace Methcla::Audio::IO;
@@ -33,29 +38,279 @@ using Methcla::Audio::sample_t;
 static const size_t kNumOutputs = 2;
 static const size_t kMinLameBufferSize = 7200;
 
-class detail::IcecastDriverImpl
+constexpr double IcecastDriver::kDefaultSampleRate;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double> Seconds;
+
+typedef std::unique_ptr<lame_global_flags,std::function<int(lame_global_flags*)>> LamePtr;
+typedef std::unique_ptr<shout_t,std::function<void(shout_t*)>> ShoutPtr;
+
+void check(lame_global_flags*, int code)
+{
+    if (code < 0) {
+        switch (code) {
+            case LAME_NOMEM:
+                throw Error(kMethcla_MemoryError);
+            case LAME_GENERICERROR:
+            case LAME_BADBITRATE:
+            case LAME_BADSAMPFREQ:
+            case LAME_INTERNALERROR:
+            default:
+                throw Error(kMethcla_UnspecifiedError, "LAME error");
+        }
+    }
+}
+
+void check(shout_t* self, int code)
+{
+    if (code != SHOUTERR_SUCCESS) {
+        std::cerr << "libshout: " << shout_get_error(self) << "\n";
+        if (code == SHOUTERR_INSANE)
+            throw std::logic_error(shout_get_error(self));
+        else if (code == SHOUTERR_MALLOC)
+            throw std::bad_alloc();
+        else
+            throw std::runtime_error(shout_get_error(self));
+    }
+}
+
+//* Encoder and server connection of a single mount point.
+//
+// The render thread writes interleaved blocks to the stream's ring buffer;
+// the stream's thread encodes whatever is available and sends it to the
+// server.
+class Stream
 {
 public:
-    typedef std::unique_ptr<lame_global_flags,std::function<int(lame_global_flags*)>> LamePtr;
-    typedef std::unique_ptr<shout_t,std::function<void(shout_t*)>> ShoutPtr;
+    //* Minimum time between attempts to reconnect to the server.
+    static constexpr double kReconnectInterval = 1.;
+
+    Stream(const IcecastDriver::IcecastOptions& icecastOptions,
+           const IcecastDriver::StreamOptions& options,
+           double sampleRate,
+           size_t bufferSize,
+           size_t ringBufferFrames)
+        : m_lame(LamePtr(lame_init(), lame_close))
+        , m_shout(ShoutPtr(shout_new(), shout_free))
+        , m_connected(false)
+        , m_lastConnect(Clock::now())
+        , m_ring(ringBufferFrames * kNumOutputs)
+        , m_pcm(bufferSize * kNumOutputs)
+        , m_mp3(1.25 * bufferSize + kMinLameBufferSize + 0.5)
+        , m_continue(false)
+        , m_framesEncoded(0)
+        , m_framesDropped(0)
+        , m_bytesSent(0)
+    {
+        if (!m_lame || !m_shout)
+            throw std::bad_alloc();
+        initEncoder(m_lame.get(), sampleRate, options.bitrate);
+        initConnection(m_shout.get(), icecastOptions, options);
+        check(m_shout.get(), shout_open(m_shout.get()));
+        m_connected = true;
+    }
+
+    ~Stream()
+    {
+        stop();
+        if (m_connected)
+            shout_close(m_shout.get());
+    }
+
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    void start()
+    {
+        if (!m_thread.joinable()) {
+            m_continue = true;
+            m_thread = std::thread(&Stream::run, this);
+        }
+    }
+
+    void stop()
+    {
+        if (m_thread.joinable()) {
+            m_continue = false;
+            m_wakeup.post();
+            m_thread.join();
+        }
+    }
+
+    //* Write a block of interleaved frames; drops the block if the ring buffer is full.
+    //
+    // Context: render thread
+    void write(const sample_t* frames, size_t numFrames)
+    {
+        const size_t numSamples = numFrames * kNumOutputs;
+        if (m_ring.write_available() >= numSamples) {
+            m_ring.push(frames, numSamples);
+            m_wakeup.post();
+        } else {
+            m_framesDropped.fetch_add(numFrames, std::memory_order_relaxed);
+        }
+    }
+
+    IcecastDriver::StreamStatistics statistics() const
+    {
+        IcecastDriver::StreamStatistics stats;
+        stats.framesEncoded = m_framesEncoded.load(std::memory_order_relaxed);
+        stats.framesDropped = m_framesDropped.load(std::memory_order_relaxed);
+        stats.bytesSent = m_bytesSent.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    void run()
+    {
+        BOOST_ASSERT( sizeof(sample_t) == sizeof(float) );
+
+        for (;;) {
+            m_wakeup.wait();
+            if (!m_continue)
+                break;
+
+            // Blocks are pushed as a whole, so pops are frame aligned.
+            size_t numSamples;
+            while ((numSamples = m_ring.pop(m_pcm.data(), m_pcm.size())) > 0) {
+                const size_t numFrames = numSamples / kNumOutputs;
+                const int n = lame_encode_buffer_interleaved_ieee_float(
+                        m_lame.get(),
+                        m_pcm.data(),
+                        static_cast<int>(numFrames),
+                        m_mp3.data(),
+                        static_cast<int>(m_mp3.size())
+                    );
+                if (n < 0) {
+                    std::cerr << "lame_encode_buffer_interleaved_ieee_float failed: " << n << "\n";
+                    continue;
+                }
+                m_framesEncoded.fetch_add(numFrames, std::memory_order_relaxed);
+                if (n > 0)
+                    send(static_cast<size_t>(n));
+            }
+        }
+    }
+
+    void send(size_t size)
+    {
+        if (!m_connected && !reconnect())
+            return;
+        const int code = shout_send(m_shout.get(), m_mp3.data(), size);
+        if (code == SHOUTERR_SUCCESS) {
+            m_bytesSent.fetch_add(size, std::memory_order_relaxed);
+        } else {
+            // Drop encoded data until the connection has been reestablished.
+            std::cerr << "libshout: " << shout_get_error(m_shout.get()) << "\n";
+            shout_close(m_shout.get());
+            m_connected = false;
+        }
+    }
+
+    bool reconnect()
+    {
+        const auto now = Clock::now();
+        if (std::chrono::duration_cast<Seconds>(now - m_lastConnect).count() < kReconnectInterval)
+            return false;
+        m_lastConnect = now;
+        m_connected = shout_open(m_shout.get()) == SHOUTERR_SUCCESS;
+        if (!m_connected)
+            std::cerr << "libshout: " << shout_get_error(m_shout.get()) << "\n";
+        return m_connected;
+    }
+
+    static void initEncoder(lame_global_flags* self, double sampleRate, int bitrate)
+    {
+        // TODO: Verify sample rate validity
+        check(self, lame_set_in_samplerate(self, (int)sampleRate));
+        check(self, lame_set_out_samplerate(self, (int)sampleRate));
+        check(self, lame_set_num_channels(self, kNumOutputs));
+        // check(self, lame_set_VBR(self, vbr_default));
+        check(self, lame_set_brate(self, bitrate));
+        check(self, lame_set_mode(self, JOINT_STEREO));
+        check(self, lame_set_force_short_blocks(self, 1));
+        check(self, lame_set_asm_optimizations(self, SSE, 1));
+        check(self, lame_init_params(self));
+    }
 
+    static void initConnection(shout_t* self, const IcecastDriver::IcecastOptions& icecastOptions, const IcecastDriver::StreamOptions& options)
+    {
+        check(self, shout_set_host(self, icecastOptions.host.c_str()));
+        check(self, shout_set_port(self, icecastOptions.port));
+        check(self, shout_set_user(self, icecastOptions.user.c_str()));
+        check(self, shout_set_password(self, icecastOptions.password.c_str()));
+        check(self, shout_set_protocol(self, SHOUT_PROTOCOL_HTTP));
+        check(self, shout_set_format(self, SHOUT_FORMAT_MP3));
+        if (!options.mount.empty())
+            check(self, shout_set_mount(self, options.mount.c_str()));
+        const std::string& name = options.name.empty() ? options.mount : options.name;
+        if (!name.empty())
+            check(self, shout_set_name(self, name.c_str()));
+    }
+
+    LamePtr                             m_lame;
+    ShoutPtr                            m_shout;
+    bool                                m_connected;
+    Clock::time_point                   m_lastConnect;
+    boost::lockfree::spsc_queue<sample_t> m_ring;
+    std::vector<sample_t>               m_pcm;
+    std::vector<unsigned char>          m_mp3;
+    Utility::Semaphore                  m_wakeup;
+    std::thread                         m_thread;
+    std::atomic<bool>                   m_continue;
+    std::atomic<uint64_t>               m_framesEncoded;
+    std::atomic<uint64_t>               m_framesDropped;
+    std::atomic<uint64_t>               m_bytesSent;
+};
+
+constexpr double Stream::kReconnectInterval;
+
+}
+
+class detail::IcecastDriverImpl
+{
+public:
     IcecastDriverImpl(Driver::Options driverOptions, IcecastDriver::IcecastOptions icecastOptions, IcecastDriver* driver)
         : m_driver(driver)
-        , m_sampleRate(driverOptions.sampleRate)
-        , m_bufferSize(driverOptions.bufferSize)
+        , m_sampleRate(driverOptions.sampleRate > 0 ? driverOptions.sampleRate : IcecastDriver::kDefaultSampleRate)
+        , m_bufferSize(driverOptions.bufferSize > 0 ? driverOptions.bufferSize : Driver::kDefaultBufferSize)
         , m_outputBuffers(Driver::makeBuffers(kNumOutputs, m_bufferSize))
-        , m_lame(LamePtr(lame_init(), lame_close))
-        , m_shout(ShoutPtr(shout_new(), shout_free))
+        , m_interleaved(m_bufferSize * kNumOutputs)
+        , m_time(0)
+        , m_continue(false)
     {
-        initEncoder(m_lame.get(), driverOptions);
-        initConnection(m_shout.get(), icecastOptions);
-        connect();
+        if (icecastOptions.streams.empty()) {
+            IcecastDriver::StreamOptions stream;
+            stream.mount = icecastOptions.mount;
+            stream.name = icecastOptions.name;
+            icecastOptions.streams.push_back(stream);
+        }
+
+        const size_t ringBufferFrames =
+            std::max(m_bufferSize, (size_t)(icecastOptions.bufferDuration * m_sampleRate));
+
+        try {
+            for (const auto& stream : icecastOptions.streams) {
+                m_streams.push_back(
+                    std::unique_ptr<Stream>(
+                        new Stream(icecastOptions, stream, m_sampleRate, m_bufferSize, ringBufferFrames)
+                    )
+                );
+            }
+        } catch (...) {
+            m_streams.clear();
+            Driver::freeBuffers(kNumOutputs, m_outputBuffers);
+            throw;
+        }
     }
 
     ~IcecastDriverImpl()
     {
         stop();
-        disconnect();
+        m_streams.clear();
         Driver::freeBuffers(kNumOutputs, m_outputBuffers);
     }
 
@@ -69,19 +324,27 @@ public:
         return m_bufferSize;
     }
 
-    void connect()
+    Methcla_Time currentTime() const
     {
-        check(m_shout.get(), shout_open(m_shout.get()));
+        return m_time.load(std::memory_order_relaxed);
     }
 
-    void disconnect()
+    size_t numStreams() const
     {
-        check(m_shout.get(), shout_close(m_shout.get()));
+        return m_streams.size();
+    }
+
+    IcecastDriver::StreamStatistics streamStatistics(size_t index) const
+    {
+        return m_streams.at(index)->statistics();
     }
 
     void start()
     {
         if (!m_thread.joinable()) {
+            for (auto& stream : m_streams)
+                stream->start();
+            m_driver->resetTimeFilter();
             m_continue = true;
             m_thread = std::thread(&IcecastDriverImpl::run, this);
         }
@@ -92,112 +355,50 @@ public:
         if (m_thread.joinable()) {
             m_continue = false;
             m_thread.join();
+            for (auto& stream : m_streams)
+                stream->stop();
         }
     }
 
 private:
     void run()
     {
-        const size_t lameBufferSize = 1.25 * bufferSize() + kMinLameBufferSize + 0.5;
-        std::unique_ptr<unsigned char[]> lameBuffer(new unsigned char[lameBufferSize]);
+        // Render at absolute deadlines; encoding and sending happens on the
+        // streams' threads.
+        const Seconds dt(bufferSize()/sampleRate());
+        const auto t0 = Clock::now();
+        auto t = t0 + Seconds(0);
 
-        BOOST_ASSERT( sizeof(sample_t) == sizeof(float) );
-        BOOST_ASSERT( lameBufferSize >= kMinLameBufferSize );
-  
         while (m_continue) {
-            std::chrono::milliseconds delay(shout_delay(m_shout.get()));
-            auto start = std::chrono::steady_clock::now();
-
-            m_driver->process(bufferSize(), nullptr, m_outputBuffers);
-
-            int n = lame_encode_buffer_ieee_float(
-                    m_lame.get(),
-                    m_outputBuffers[0],
-                    m_outputBuffers[1],
-                    bufferSize(),
-                    lameBuffer.get(),
-                    static_cast<int>(lameBufferSize)
-                );
-            // std::cout << n << '\n';
-            if (n < 0) check(m_lame.get(), n);
-            BOOST_ASSERT_MSG( n > 0, "lame_encode_buffer_ieee_float returned 0" );            
-
-            auto end = std::chrono::steady_clock::now();
-            auto elapsed = end - start;
+            const double now = std::chrono::duration_cast<Seconds>(Clock::now()-t0).count();
+            m_time.store(now, std::memory_order_relaxed);
 
-            std::this_thread::sleep_for(delay - elapsed);
-            // shout_sync(m_shout.get());
-            shout_send(m_shout.get(), lameBuffer.get(), n);
-        }
-    }
+            m_driver->process(now, bufferSize(), nullptr, m_outputBuffers);
 
-private:
-    void check(lame_global_flags*, int code)
-    {
-        if (code < 0) {
-            switch (code) {
-                case LAME_NOMEM:
-                    throw Error::memory();
-                case LAME_GENERICERROR:
-                case LAME_BADBITRATE:
-                case LAME_BADSAMPFREQ:
-                case LAME_INTERNALERROR:
-                default:
-                    throw Error::unspecified();
+            for (size_t i=0; i < bufferSize(); i++) {
+                for (size_t c=0; c < kNumOutputs; c++) {
+                    m_interleaved[i * kNumOutputs + c] = m_outputBuffers[c][i];
+                }
             }
-        }
-    }
 
-    void initEncoder(lame_global_flags* self, Driver::Options options)
-    {
-        // TODO: Verify sample rate validity
-        check(self, lame_set_in_samplerate(self, (int)options.sampleRate));
-        check(self, lame_set_out_samplerate(self, (int)options.sampleRate));
-        check(self, lame_set_num_channels(self, kNumOutputs));
-        // check(self, lame_set_VBR(self, vbr_default));
-        check(self, lame_set_brate(self, 128));
-        check(self, lame_set_mode(self, JOINT_STEREO));
-        check(self, lame_set_force_short_blocks(self, 1));
-        check(self, lame_set_asm_optimizations(self, SSE, 1));
-        check(self, lame_init_params(self));
-    }
-
-    void check(shout_t* self, int code)
-    {
-        if (code != SHOUTERR_SUCCESS) {
-            std::cerr << "libshout: " << shout_get_error(self) << "\n";
-            if (code == SHOUTERR_INSANE)
-                throw std::logic_error(shout_get_error(self));
-            else if (code == SHOUTERR_MALLOC)
-                throw std::bad_alloc();
-            else
-                throw std::runtime_error(shout_get_error(self));
-        }
-    }
+            for (auto& stream : m_streams)
+                stream->write(m_interleaved.data(), bufferSize());
 
-    void initConnection(shout_t* self, IcecastDriver::IcecastOptions options)
-    {
-        check(self, shout_set_host(self, options.host.c_str()));
-        check(self, shout_set_port(self, options.port));
-        check(self, shout_set_user(self, options.user.c_str()));
-        check(self, shout_set_password(self, options.password.c_str()));
-        check(self, shout_set_protocol(self, SHOUT_PROTOCOL_HTTP));
-        check(self, shout_set_format(self, SHOUT_FORMAT_MP3));
-        if (!options.mount.empty())
-            check(self, shout_set_mount(self, options.mount.c_str()));
-        if (!options.name.empty()) {
-            check(self, shout_set_name(self, options.name.c_str()));
+            t += dt;
+            std::this_thread::sleep_until(t);
         }
     }
 
-    IcecastDriver*      m_driver;
-    double              m_sampleRate;
-    size_t              m_bufferSize;
-    sample_t**          m_outputBuffers;
-    LamePtr             m_lame;
-    ShoutPtr            m_shout;
-    std::thread         m_thread;
-    std::atomic<bool>   m_continue;
+private:
+    IcecastDriver*                          m_driver;
+    double                                  m_sampleRate;
+    size_t                                  m_bufferSize;
+    sample_t**                              m_outputBuffers;
+    std::vector<sample_t>                   m_interleaved;
+    std::vector<std::unique_ptr<Stream>>    m_streams;
+    std::atomic<double>                     m_time;
+    std::thread                             m_thread;
+    std::atomic<bool>                       m_continue;
 };
 
 class ShoutLibrary
@@ -213,6 +414,11 @@ public:
     }
 };
 
+IcecastDriver::IcecastDriver(Driver::Options driverOptions)
+    : IcecastDriver(driverOptions, IcecastOptions())
+{
+}
+
 IcecastDriver::IcecastDriver(Driver::Options driverOptions, IcecastOptions icecastOptions)
     : Driver(driverOptions)
 {
@@ -245,6 +451,20 @@ size_t IcecastDriver::bufferSize() const
     return m_impl->bufferSize();
 }
 
+Methcla_Time IcecastDriver::currentTime()
+{
+    return m_impl->currentTime();
+}
+
+size_t IcecastDriver::numStreams() const
+{
+    return m_impl->numStreams();
+}
+
+IcecastDriver::StreamStatistics IcecastDriver::streamStatistics(size_t index) const
+{
+    return m_impl->streamStatistics(index);
+}
 
 void IcecastDriver::start()
 {
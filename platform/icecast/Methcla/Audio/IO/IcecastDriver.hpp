@@ -18,7 +18,9 @@
 #include "Methcla/Audio/IO/Driver.hpp"
 #include "Methcla/Audio.hpp"
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace Methcla { namespace Audio { namespace IO {
 
@@ -27,20 +29,51 @@ namespace Methcla { namespace Audio { namespace IO {
         class IcecastDriverImpl;
     }
 
+    //* Driver rendering audio at realtime speed and streaming it to an Icecast server.
+    //
+    // The rendered signal is handed to one or more streams through lock-free
+    // ring buffers; each stream encodes and sends it on its own thread, so
+    // that slow encoders or network hiccups don't delay rendering. A stream
+    // that can't keep up drops frames instead of blocking the render thread.
     class IcecastDriver : public Driver
     {
     public:
+        static constexpr double kDefaultSampleRate = 44100;
+
+        struct StreamOptions
+        {
+            //* Mount point, e.g. "live-128".
+            std::string mount;
+            //* Stream name shown to listeners; defaults to the mount point.
+            std::string name;
+            //* MP3 bitrate in kbit/s.
+            int bitrate = 128;
+        };
+
         struct IcecastOptions
         {
             std::string host = "localhost";
             int port = 8000;
             std::string user = "source";
             std::string password;
+            //* Mount point and name of the single stream used when streams is empty.
             std::string mount;
             std::string name;
+            //* Streams fed from the rendered signal.
+            std::vector<StreamOptions> streams;
+            //* Capacity of each stream's ring buffer in seconds.
+            double bufferDuration = 2.;
         };
 
-        IcecastDriver(Driver::Options driverOptions, IcecastOptions icecastOptions=IcecastOptions());
+        struct StreamStatistics
+        {
+            uint64_t framesEncoded = 0;
+            uint64_t framesDropped = 0;
+            uint64_t bytesSent = 0;
+        };
+
+        IcecastDriver(Driver::Options driverOptions);
+        IcecastDriver(Driver::Options driverOptions, IcecastOptions icecastOptions);
         ~IcecastDriver();
 
         virtual double sampleRate() const override;
@@ -51,6 +84,14 @@ namespace Methcla { namespace Audio { namespace IO {
         virtual void start() override;
         virtual void stop() override;
 
+        virtual Methcla_Time currentTime() override;
+
+        //* Return the number of streams.
+        size_t numStreams() const;
+
+        //* Return statistics of the stream at index.
+        StreamStatistics streamStatistics(size_t index) const;
+
     private:
         friend class detail::IcecastDriverImpl;
         detail::IcecastDriverImpl* m_impl;
@@ -13,12 +13,15 @@
 // limitations under the License.
 
 #include "Methcla/Audio/IO/JackDriver.hpp"
+#include "Methcla/API.hpp"
 #include "Methcla/Exception.hpp"
 #include "Methcla/Memory.hpp"
 #include "Methcla/Platform.hpp"
 
 #include <methcla/common.h>
+#include <methcla/platform/jack.h>
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <sstream>
@@ -28,10 +31,37 @@ using namespace Methcla::Audio::IO;
 using Methcla::Audio::sample_t;
 using namespace std;
 
+constexpr size_t JackDriver::kDefaultNumInputs;
+constexpr size_t JackDriver::kDefaultNumOutputs;
+
+static jack_port_t* registerPort(jack_client_t* client, const char* prefix, size_t index, unsigned long flags)
+{
+    ostringstream name;
+    name << prefix << index;
+    jack_port_t* port =
+        jack_port_register( client
+                          , name.str().c_str()
+                          , JACK_DEFAULT_AUDIO_TYPE
+                          , flags
+                          , 0
+                          );
+    if (port == nullptr)
+        throw Error(kMethcla_DeviceUnavailableError, "Couldn't register JACK port");
+    return port;
+}
+
 JackDriver::JackDriver(Options options)
     : Driver(options)
     , m_sampleRate(0)
+    , m_numInputs(options.numInputs >= 0 ? options.numInputs : kDefaultNumInputs)
+    , m_numOutputs(options.numOutputs >= 0 ? options.numOutputs : kDefaultNumOutputs)
     , m_bufferSize(0)
+    , m_freewheel(false)
+    , m_resetTimeFilter(false)
+    , m_freewheeling(false)
+    , m_freewheelStartTime(0)
+    , m_freewheelFrames(0)
+    , m_freewheelTime(0)
 {
     jack_status_t status;
 
@@ -41,11 +71,10 @@ JackDriver::JackDriver(Options options)
     }
 
     m_sampleRate = jack_get_sample_rate(m_jackClient);
-    m_bufferSize = jack_get_buffer_size(m_jackClient);
-
-    static const size_t kNumPorts = 2;
-    m_numInputs = kNumPorts;
-    m_numOutputs = kNumPorts;
+    // The engine's initial block size; leave room for the requested buffer
+    // size so that the JACK buffer size can be raised without splitting
+    // periods into several blocks.
+    m_bufferSize = std::max((size_t)jack_get_buffer_size(m_jackClient), options.bufferSize > 0 ? (size_t)options.bufferSize : 0);
 
     m_inputBuffers = new sample_t*[m_numInputs];
     m_outputBuffers = new sample_t*[m_numOutputs];
@@ -53,30 +82,17 @@ JackDriver::JackDriver(Options options)
     m_jackInputPorts = new jack_port_t*[m_numInputs];
     m_jackOutputPorts = new jack_port_t*[m_numOutputs];
 
-    for (size_t i=0; i < kNumPorts; i++) {
-        ostringstream inputName;
-        inputName << "input_" << i;
-        m_jackInputPorts[i] =
-            jack_port_register( m_jackClient
-                              , inputName.str().c_str()
-                              , JACK_DEFAULT_AUDIO_TYPE
-                              , JackPortIsInput
-                              , 0
-                              );
-        ostringstream outputName;
-        outputName << "output_" << i;
-        m_jackOutputPorts[i] =
-            jack_port_register( m_jackClient
-                              , outputName.str().c_str()
-                              , JACK_DEFAULT_AUDIO_TYPE
-                              , JackPortIsOutput
-                              , 0
-                              );
+    for (size_t i=0; i < m_numInputs; i++) {
+        m_jackInputPorts[i] = registerPort(m_jackClient, "input_", i, JackPortIsInput);
+    }
+    for (size_t i=0; i < m_numOutputs; i++) {
+        m_jackOutputPorts[i] = registerPort(m_jackClient, "output_", i, JackPortIsOutput);
     }
 
     jack_set_process_callback(m_jackClient, processCallback, this);
     jack_set_sample_rate_callback(m_jackClient, sampleRateCallback, this);
     jack_set_buffer_size_callback(m_jackClient, bufferSizeCallback, this);
+    jack_set_freewheel_callback(m_jackClient, freewheelCallback, this);
 }
 
 static void check(const char* function, int code)
@@ -122,13 +138,24 @@ int JackDriver::sampleRateCallback(jack_nframes_t nframes, void* arg)
 int JackDriver::bufferSizeCallback(jack_nframes_t nframes, void* arg)
 {
     JackDriver* self = static_cast<JackDriver*>(arg);
-    self->m_bufferSize = nframes;
+    // The engine keeps its block size and splits larger periods; only the
+    // time filter has to be restarted for the new period length.
+    self->m_resetTimeFilter = true;
 #ifndef NDEBUG
     std::cout << "Methcla::Audio::IO::JackDriver: the buffer size is now " << nframes << std::endl;
 #endif
     return 0;
 }
 
+void JackDriver::freewheelCallback(int starting, void* arg)
+{
+    JackDriver* self = static_cast<JackDriver*>(arg);
+    self->m_freewheel = starting != 0;
+#ifndef NDEBUG
+    std::cout << "Methcla::Audio::IO::JackDriver: " << (starting ? "entering" : "leaving") << " freewheel mode" << std::endl;
+#endif
+}
+
 int JackDriver::processCallback(jack_nframes_t nframes, void* arg)
 {
     JackDriver* self = static_cast<JackDriver*>(arg);
@@ -144,17 +171,53 @@ int JackDriver::processCallback(jack_nframes_t nframes, void* arg)
             jack_port_get_buffer(self->m_jackOutputPorts[i], nframes) );
     }
 
-    // for (size_t i=0; i < min(numInputs,numOutputs); i++) {
-    //     memcpy(self->m_outputBuffers[i], self->m_inputBuffers[i], sizeof(sample_t) * nframes);
-    // }
+    // Timestamps jump when entering or leaving freewheel mode and after the
+    // graph has been restarted with a new buffer size.
+    const bool freewheel = self->m_freewheel.load(std::memory_order_relaxed);
+    if (self->m_resetTimeFilter.exchange(false) || freewheel != self->m_freewheeling)
+    {
+        self->resetTimeFilter();
+    }
+
+    Methcla_Time currentTime;
+    if (freewheel)
+    {
+        // JACK time follows the system clock while the graph is processed
+        // as fast as possible; count processed frames instead.
+        if (!self->m_freewheeling)
+        {
+            self->m_freewheelStartTime = (double)jack_get_time() * 1e-6;
+            self->m_freewheelFrames = 0;
+        }
+        currentTime = self->m_freewheelStartTime + (double)self->m_freewheelFrames / self->m_sampleRate;
+        self->m_freewheelFrames += nframes;
+        self->m_freewheelTime.store(currentTime, std::memory_order_relaxed);
+    }
+    else
+    {
+        currentTime =
+            (double)jack_frames_to_time(self->m_jackClient, jack_last_frame_time(self->m_jackClient)) * 1e-6;
+    }
+    self->m_freewheeling = freewheel;
 
     // Run DSP graph
-    const Methcla_Time currentTime = 0.;
     self->process(currentTime, nframes, self->m_inputBuffers, self->m_outputBuffers);
 
     return 0;
 }
 
+Methcla_Time JackDriver::currentTime()
+{
+    return m_freewheel.load(std::memory_order_relaxed)
+        ? m_freewheelTime.load(std::memory_order_relaxed)
+        : (double)jack_get_time() * 1e-6;
+}
+
+void JackDriver::setFreewheel(bool freewheel)
+{
+    check("jack_set_freewheel", jack_set_freewheel(m_jackClient, freewheel ? 1 : 0));
+}
+
 void JackDriver::start()
 {
     jack_activate(m_jackClient);
@@ -169,3 +232,27 @@ Driver* Methcla::Platform::defaultAudioDriver(Driver::Options options)
 {
     return new JackDriver(options);
 }
+
+METHCLA_EXPORT Methcla_AudioDriver* methcla_jack_driver_new(
+    const Methcla_AudioDriverOptions* options
+    )
+{
+    return Methcla::API::wrapAudioDriver(
+        new JackDriver(Methcla::API::convertOptions(options))
+        );
+}
+
+METHCLA_EXPORT Methcla_Error methcla_jack_driver_set_freewheel(
+    Methcla_AudioDriver* driver,
+    bool freewheel
+    )
+{
+    if (driver == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    try {
+        static_cast<JackDriver*>(Methcla::API::unwrapAudioDriver(driver))->setFreewheel(freewheel);
+    } catch (std::exception& e) {
+        return methcla_error_new_with_message(kMethcla_UnspecifiedError, e.what());
+    }
+    return methcla_no_error();
+}
@@ -17,14 +17,24 @@
 
 #include "Methcla/Audio/IO/Driver.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <jack/jack.h>
 
 namespace Methcla { namespace Audio { namespace IO
 {
+    //* Driver running the engine as a JACK client.
+    //
+    // The buffer size reported to the engine is the larger of the requested
+    // buffer size and the JACK buffer size at construction time. While the
+    // server is freewheeling the time passed to the engine advances by the
+    // duration of the processed frames.
     class JackDriver : public Driver
     {
     public:
+        static constexpr size_t kDefaultNumInputs = 2;
+        static constexpr size_t kDefaultNumOutputs = 2;
+
         JackDriver(Options options);
         virtual ~JackDriver();
 
@@ -36,9 +46,17 @@ namespace Methcla { namespace Audio { namespace IO
         virtual void start() override;
         virtual void stop() override;
 
+        virtual Methcla_Time currentTime() override;
+
+        //* Ask the server to enter or leave freewheel mode.
+        //
+        // Context: NRT, must not be called from the process callback.
+        void setFreewheel(bool freewheel);
+
     private:
         static int sampleRateCallback(jack_nframes_t nframes, void* arg);
         static int bufferSizeCallback(jack_nframes_t nframes, void* arg);
+        static void freewheelCallback(int starting, void* arg);
         static int processCallback(jack_nframes_t nframes, void* arg);
 
     private:
@@ -46,6 +64,12 @@ namespace Methcla { namespace Audio { namespace IO
         size_t              m_numInputs;
         size_t              m_numOutputs;
         size_t              m_bufferSize;
+        std::atomic<bool>   m_freewheel;
+        std::atomic<bool>   m_resetTimeFilter;
+        bool                m_freewheeling;
+        Methcla_Time        m_freewheelStartTime;
+        uint64_t            m_freewheelFrames;
+        std::atomic<double> m_freewheelTime;
         jack_client_t*      m_jackClient;
         jack_port_t**       m_jackInputPorts;
         jack_port_t**       m_jackOutputPorts;
@@ -0,0 +1,212 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Methcla/Audio/IO/ShmDriver.hpp"
+#include "Methcla/API.hpp"
+#include "Methcla/Exception.hpp"
+
+#include <methcla/platform/shm.h>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Methcla::Audio::IO;
+
+constexpr double ShmDriver::kDefaultSampleRate;
+constexpr size_t ShmDriver::kDefaultNumInputs;
+constexpr size_t ShmDriver::kDefaultNumOutputs;
+constexpr size_t ShmDriver::kDefaultBufferSize;
+constexpr size_t ShmDriver::kDefaultNumSlots;
+
+// Maximum time the driver thread sleeps before checking whether it should stop.
+static const int kWaitTimeoutMs = 100;
+
+// Slot indices are computed from wrapping 32 bit counters, so the number of
+// slots must divide 2^32.
+static size_t slotCount(size_t numSlots)
+{
+    size_t n = 1;
+    while (n < numSlots)
+        n *= 2;
+    return n;
+}
+
+static Methcla::Error shmError(const std::string& what, int err)
+{
+    return Methcla::Error(kMethcla_DeviceUnavailableError, what + ": " + std::strerror(err));
+}
+
+ShmDriver::ShmDriver(Options options, const std::string& name, size_t numSlots)
+    : Driver(options)
+    , m_name(name)
+    , m_sampleRate(options.sampleRate > 0 ? options.sampleRate : kDefaultSampleRate)
+    , m_numInputs(options.numInputs >= 0 ? options.numInputs : kDefaultNumInputs)
+    , m_numOutputs(options.numOutputs >= 0 ? options.numOutputs : kDefaultNumOutputs)
+    , m_bufferSize(options.bufferSize > 0 ? options.bufferSize : kDefaultBufferSize)
+    , m_numSlots(slotCount(numSlots > 0 ? numSlots : kDefaultNumSlots))
+    , m_segmentSize(methcla_shm_segment_size(m_numInputs, m_numOutputs, m_bufferSize, m_numSlots))
+    , m_header(nullptr)
+    , m_continue(false)
+    , m_numFrames(0)
+{
+    if (m_name.empty() || m_name[0] != '/')
+        throw Error(kMethcla_ArgumentError, "Shared memory segment name must start with a slash");
+    if (m_numOutputs == 0)
+        throw Error(kMethcla_ArgumentError, "Shared memory driver needs at least one output");
+
+    // Fails with EEXIST if the segment is in use by another engine; stale
+    // segments have to be removed explicitly.
+    const int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+        throw shmError("Couldn't create shared memory segment " + m_name, errno);
+
+    if (ftruncate(fd, (off_t)m_segmentSize) == -1)
+    {
+        const int err = errno;
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw shmError("Couldn't resize shared memory segment " + m_name, err);
+    }
+
+    void* addr = mmap(nullptr, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int err = errno;
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        shm_unlink(m_name.c_str());
+        throw shmError("Couldn't map shared memory segment " + m_name, err);
+    }
+
+    // Avoid page faults in the audio thread; fails without sufficient privileges.
+    mlock(addr, m_segmentSize);
+
+    m_header = static_cast<Methcla_ShmHeader*>(addr);
+    m_header->version = METHCLA_SHM_VERSION;
+    m_header->num_inputs = m_numInputs;
+    m_header->num_outputs = m_numOutputs;
+    m_header->block_size = m_bufferSize;
+    m_header->num_slots = m_numSlots;
+    m_header->sample_rate = m_sampleRate;
+    m_header->state = kMethcla_ShmStateStarting;
+    m_header->write_count = 0;
+    m_header->read_count = 0;
+    // Clients check the magic number before reading the rest of the header.
+    methcla_shm_store(&m_header->magic, METHCLA_SHM_MAGIC);
+
+    for (size_t slot=0; slot < m_numSlots; slot++)
+    {
+        sample_t* buffer = methcla_shm_slot(m_header, slot);
+        for (size_t i=0; i < m_numInputs; i++, buffer += m_bufferSize)
+            m_inputBuffers.push_back(buffer);
+        for (size_t i=0; i < m_numOutputs; i++, buffer += m_bufferSize)
+            m_outputBuffers.push_back(buffer);
+    }
+}
+
+ShmDriver::~ShmDriver()
+{
+    stop();
+    methcla_shm_store(&m_header->state, kMethcla_ShmStateStopped);
+    methcla_shm_wake(&m_header->read_count);
+    munmap(m_header, m_segmentSize);
+    shm_unlink(m_name.c_str());
+}
+
+void ShmDriver::start()
+{
+    if (!m_thread.joinable())
+    {
+        resetTimeFilter();
+        m_continue = true;
+        methcla_shm_store(&m_header->state, kMethcla_ShmStateRunning);
+        m_thread = std::thread(&ShmDriver::run, this);
+    }
+}
+
+void ShmDriver::stop()
+{
+    if (m_thread.joinable())
+    {
+        m_continue = false;
+        methcla_shm_wake(&m_header->write_count);
+        m_thread.join();
+        methcla_shm_store(&m_header->state, kMethcla_ShmStateStopped);
+        // Release clients waiting for a block.
+        methcla_shm_wake(&m_header->read_count);
+    }
+}
+
+Methcla_Time ShmDriver::currentTime()
+{
+    return (double)m_numFrames.load() / m_sampleRate;
+}
+
+void ShmDriver::run()
+{
+    uint32_t readCount = methcla_shm_load(&m_header->read_count);
+
+    while (m_continue)
+    {
+        if (methcla_shm_load(&m_header->write_count) == readCount)
+        {
+            methcla_shm_wait(&m_header->write_count, readCount, kWaitTimeoutMs);
+            continue;
+        }
+
+        const size_t slot = readCount % m_numSlots;
+        const uint64_t numFrames = m_numFrames.load(std::memory_order_relaxed);
+
+        process(
+            (double)numFrames / m_sampleRate,
+            m_bufferSize,
+            m_inputBuffers.data() + slot * m_numInputs,
+            m_outputBuffers.data() + slot * m_numOutputs
+            );
+
+        m_numFrames = numFrames + m_bufferSize;
+        methcla_shm_store(&m_header->read_count, ++readCount);
+        methcla_shm_wake(&m_header->read_count);
+    }
+}
+
+METHCLA_EXPORT Methcla_Error methcla_shm_driver_new(
+    const Methcla_AudioDriverOptions* options,
+    const char* name,
+    size_t num_slots,
+    Methcla_AudioDriver** driver
+    )
+{
+    if (options == nullptr || driver == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (name == nullptr)
+        return methcla_error_new_with_message(kMethcla_ArgumentError, "Shared memory segment name must not be NULL");
+    try {
+        *driver = Methcla::API::wrapAudioDriver(
+            new ShmDriver(Methcla::API::convertOptions(options), name, num_slots)
+            );
+    } catch (Methcla::Error& e) {
+        return methcla_error_new_with_message(e.errorCode(), e.what());
+    } catch (std::bad_alloc&) {
+        return methcla_error_new(kMethcla_MemoryError);
+    } catch (std::exception& e) {
+        return methcla_error_new_with_message(kMethcla_UnspecifiedError, e.what());
+    }
+    return methcla_no_error();
+}
@@ -0,0 +1,86 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_AUDIO_IO_SHMDRIVER_HPP_INCLUDED
+#define METHCLA_AUDIO_IO_SHMDRIVER_HPP_INCLUDED
+
+#include "Methcla/Audio/IO/Driver.hpp"
+#include "Methcla/Audio/IO/ShmProtocol.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Methcla { namespace Audio { namespace IO
+{
+    //* Driver exchanging audio with another process through shared memory.
+    //
+    // The driver creates a POSIX shared memory segment holding a ring of
+    // numSlots blocks (see ShmProtocol.h), which a client process attaches to
+    // with the shm client library. The engine processes each block submitted
+    // by the client in place, reading its inputs from and writing its outputs
+    // to the shared segment, and signals the client through a futex.
+    //
+    // Processing is paced by the client. The time passed to the engine
+    // advances by the duration of the processed frames, so that the engine
+    // can render faster or slower than realtime.
+    class ShmDriver : public Driver
+    {
+    public:
+        static constexpr double kDefaultSampleRate = 44100;
+        static constexpr size_t kDefaultNumInputs = 2;
+        static constexpr size_t kDefaultNumOutputs = 2;
+        static constexpr size_t kDefaultBufferSize = 256;
+        static constexpr size_t kDefaultNumSlots = 2;
+
+        //* Create the shared memory segment name.
+        //
+        // name must start with a slash. An existing segment with the same
+        // name is replaced. numSlots is rounded up to a power of two.
+        ShmDriver(Options options, const std::string& name, size_t numSlots=kDefaultNumSlots);
+        virtual ~ShmDriver();
+
+        virtual double sampleRate() const override { return m_sampleRate; }
+        virtual size_t numInputs() const override { return m_numInputs; }
+        virtual size_t numOutputs() const override { return m_numOutputs; }
+        virtual size_t bufferSize() const override { return m_bufferSize; }
+
+        virtual void start() override;
+        virtual void stop() override;
+
+        virtual Methcla_Time currentTime() override;
+
+    private:
+        void run();
+
+    private:
+        std::string             m_name;
+        double                  m_sampleRate;
+        size_t                  m_numInputs;
+        size_t                  m_numOutputs;
+        size_t                  m_bufferSize;
+        size_t                  m_numSlots;
+        size_t                  m_segmentSize;
+        Methcla_ShmHeader*      m_header;
+        std::vector<sample_t*>  m_inputBuffers;
+        std::vector<sample_t*>  m_outputBuffers;
+        std::atomic<bool>       m_continue;
+        std::atomic<uint64_t>   m_numFrames;
+        std::thread             m_thread;
+    };
+} } }
+
+#endif // METHCLA_AUDIO_IO_SHMDRIVER_HPP_INCLUDED
@@ -0,0 +1,138 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef METHCLA_AUDIO_IO_SHMPROTOCOL_H_INCLUDED
+#define METHCLA_AUDIO_IO_SHMPROTOCOL_H_INCLUDED
+
+// Layout of the shared memory segment exchanged between ShmDriver and the
+// client library, included by both.
+//
+// The segment starts with a header of METHCLA_SHM_HEADER_SIZE bytes,
+// followed by num_slots slots. Each slot holds one block of planar input
+// channels followed by one block of planar output channels, each channel
+// consisting of block_size floats.
+//
+// The client writes the inputs of slot write_count % num_slots and
+// increments write_count. The engine processes slots in order, writing the
+// outputs in place, and increments read_count after each block. Both
+// counters wrap around and are used as futex words, so that a waiting side
+// can sleep on the counter the other side advances.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+#include <errno.h>
+#include <time.h>
+
+#define METHCLA_SHM_MAGIC       0x4d43534dU // "MCSM"
+#define METHCLA_SHM_VERSION     1
+#define METHCLA_SHM_HEADER_SIZE 4096
+
+enum
+{
+    kMethcla_ShmStateStarting,
+    kMethcla_ShmStateRunning,
+    kMethcla_ShmStateStopped
+};
+
+typedef struct Methcla_ShmHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_inputs;
+    uint32_t num_outputs;
+    uint32_t block_size;
+    uint32_t num_slots;
+    double   sample_rate;
+    //* One of kMethcla_ShmState*; written by the engine.
+    uint32_t state;
+    // Keep the counters on separate cache lines.
+    uint32_t write_count __attribute__((aligned(64)));
+    uint32_t read_count  __attribute__((aligned(64)));
+} Methcla_ShmHeader;
+
+static inline size_t methcla_shm_slot_size(uint32_t num_inputs, uint32_t num_outputs, uint32_t block_size)
+{
+    return (size_t)(num_inputs + num_outputs) * block_size * sizeof(float);
+}
+
+static inline size_t methcla_shm_segment_size(uint32_t num_inputs, uint32_t num_outputs, uint32_t block_size, uint32_t num_slots)
+{
+    return METHCLA_SHM_HEADER_SIZE + num_slots * methcla_shm_slot_size(num_inputs, num_outputs, block_size);
+}
+
+//* Return the first input channel of slot; output channels follow the input channels.
+static inline float* methcla_shm_slot(Methcla_ShmHeader* header, uint32_t slot)
+{
+    return (float*)((char*)header + METHCLA_SHM_HEADER_SIZE
+                    + slot * methcla_shm_slot_size(header->num_inputs, header->num_outputs, header->block_size));
+}
+
+static inline uint32_t methcla_shm_load(const uint32_t* word)
+{
+    return __atomic_load_n(word, __ATOMIC_ACQUIRE);
+}
+
+static inline void methcla_shm_store(uint32_t* word, uint32_t value)
+{
+    __atomic_store_n(word, value, __ATOMIC_RELEASE);
+}
+
+//* Wait until *word differs from value or timeout_ms milliseconds have passed.
+//
+//  May return early; callers re-check the word. Returns -ETIMEDOUT on
+//  timeout, 0 otherwise.
+static inline int methcla_shm_wait(uint32_t* word, uint32_t value, int timeout_ms)
+{
+#if defined(__linux__)
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    // The segment is mapped by several processes, so the futex can't be private.
+    if (syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0) == -1 && errno == ETIMEDOUT)
+        return -ETIMEDOUT;
+    return 0;
+#else
+    // Without futexes poll the word with short sleeps.
+    const struct timespec interval = { 0, 50000 };
+    int waited_us = 0;
+    while (methcla_shm_load(word) == value)
+    {
+        if (waited_us >= timeout_ms * 1000)
+            return -ETIMEDOUT;
+        nanosleep(&interval, NULL);
+        waited_us += 50;
+    }
+    return 0;
+#endif
+}
+
+//* Wake all waiters on word.
+static inline void methcla_shm_wake(uint32_t* word)
+{
+#if defined(__linux__)
+    syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+#endif // METHCLA_AUDIO_IO_SHMPROTOCOL_H_INCLUDED
@@ -0,0 +1,242 @@
+/*
+    Copyright 2014 Samplecount S.L.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <methcla/shm_client.h>
+#include "Methcla/Audio/IO/ShmProtocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct Methcla_ShmClient
+{
+    Methcla_ShmHeader* header;
+    size_t size;
+    uint32_t num_slots;
+    // Number of blocks written.
+    uint32_t write_count;
+    // Number of blocks read and released.
+    uint32_t release_count;
+    // Channel pointers of all slots.
+    float** inputs;
+    float** outputs;
+};
+
+int methcla_shm_client_open(const char* name, Methcla_ShmClient** result)
+{
+    if (name == NULL || result == NULL)
+        return -EINVAL;
+
+    const int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1)
+        return -errno;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        const int err = errno;
+        close(fd);
+        return -err;
+    }
+
+    if ((size_t)st.st_size < METHCLA_SHM_HEADER_SIZE)
+    {
+        close(fd);
+        return -EPROTO;
+    }
+
+    void* addr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int err = errno;
+    close(fd);
+    if (addr == MAP_FAILED)
+        return -err;
+
+    Methcla_ShmHeader* header = (Methcla_ShmHeader*)addr;
+    if (methcla_shm_load(&header->magic) != METHCLA_SHM_MAGIC
+        || header->version != METHCLA_SHM_VERSION
+        || header->num_slots == 0
+        || methcla_shm_segment_size(header->num_inputs, header->num_outputs, header->block_size, header->num_slots) > (size_t)st.st_size)
+    {
+        munmap(addr, (size_t)st.st_size);
+        return -EPROTO;
+    }
+
+    Methcla_ShmClient* client = calloc(1, sizeof(Methcla_ShmClient));
+    if (client == NULL)
+    {
+        munmap(addr, (size_t)st.st_size);
+        return -ENOMEM;
+    }
+
+    client->header = header;
+    client->size = (size_t)st.st_size;
+    client->num_slots = header->num_slots;
+    client->write_count = methcla_shm_load(&header->write_count);
+    client->release_count = client->write_count;
+    client->inputs = calloc((size_t)client->num_slots * header->num_inputs + 1, sizeof(float*));
+    client->outputs = calloc((size_t)client->num_slots * header->num_outputs + 1, sizeof(float*));
+
+    if (client->inputs == NULL || client->outputs == NULL)
+    {
+        methcla_shm_client_close(client);
+        return -ENOMEM;
+    }
+
+    for (uint32_t slot=0; slot < client->num_slots; slot++)
+    {
+        float* buffer = methcla_shm_slot(header, slot);
+        for (uint32_t i=0; i < header->num_inputs; i++, buffer += header->block_size)
+            client->inputs[slot * header->num_inputs + i] = buffer;
+        for (uint32_t i=0; i < header->num_outputs; i++, buffer += header->block_size)
+            client->outputs[slot * header->num_outputs + i] = buffer;
+    }
+
+    *result = client;
+
+    return 0;
+}
+
+void methcla_shm_client_close(Methcla_ShmClient* client)
+{
+    if (client != NULL)
+    {
+        free(client->inputs);
+        free(client->outputs);
+        munmap(client->header, client->size);
+        free(client);
+    }
+}
+
+size_t methcla_shm_client_num_inputs(const Methcla_ShmClient* client)
+{
+    return client->header->num_inputs;
+}
+
+size_t methcla_shm_client_num_outputs(const Methcla_ShmClient* client)
+{
+    return client->header->num_outputs;
+}
+
+size_t methcla_shm_client_block_size(const Methcla_ShmClient* client)
+{
+    return client->header->block_size;
+}
+
+size_t methcla_shm_client_num_slots(const Methcla_ShmClient* client)
+{
+    return client->num_slots;
+}
+
+double methcla_shm_client_sample_rate(const Methcla_ShmClient* client)
+{
+    return client->header->sample_rate;
+}
+
+int methcla_shm_client_begin_write(Methcla_ShmClient* client, float* const** inputs)
+{
+    if (client->write_count - client->release_count >= client->num_slots)
+        return -EAGAIN;
+    const uint32_t slot = client->write_count % client->num_slots;
+    *inputs = client->inputs + slot * client->header->num_inputs;
+    return 0;
+}
+
+int methcla_shm_client_end_write(Methcla_ShmClient* client)
+{
+    if (client->write_count - client->release_count >= client->num_slots)
+        return -EAGAIN;
+    client->write_count++;
+    methcla_shm_store(&client->header->write_count, client->write_count);
+    methcla_shm_wake(&client->header->write_count);
+    return 0;
+}
+
+static double monotonic_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int methcla_shm_client_begin_read(Methcla_ShmClient* client, int timeout_ms, const float* const** outputs)
+{
+    const uint32_t num_in_flight = client->write_count - client->release_count;
+    if (num_in_flight == 0)
+        return -EAGAIN;
+
+    const double deadline = monotonic_time() + (double)timeout_ms * 1e-3;
+
+    for (;;)
+    {
+        const uint32_t read_count = methcla_shm_load(&client->header->read_count);
+        const uint32_t num_processed = read_count - client->release_count;
+        // Blocks left in flight by a previous client may still be pending.
+        if (num_processed > 0 && num_processed <= num_in_flight)
+            break;
+        if (methcla_shm_load(&client->header->state) == kMethcla_ShmStateStopped)
+            return -EPIPE;
+        const int remaining_ms = (int)((deadline - monotonic_time()) * 1e3 + 0.5);
+        if (remaining_ms <= 0)
+            return -ETIMEDOUT;
+        methcla_shm_wait(&client->header->read_count, read_count, remaining_ms);
+    }
+
+    const uint32_t slot = client->release_count % client->num_slots;
+    *outputs = (const float* const*)(client->outputs + slot * client->header->num_outputs);
+
+    return 0;
+}
+
+int methcla_shm_client_end_read(Methcla_ShmClient* client)
+{
+    if (client->write_count == client->release_count)
+        return -EAGAIN;
+    client->release_count++;
+    return 0;
+}
+
+int methcla_shm_client_process(Methcla_ShmClient* client, const float* const* inputs, float* const* outputs, int timeout_ms)
+{
+    if (client->write_count != client->release_count)
+        return -EBUSY;
+
+    const size_t block_size = client->header->block_size;
+
+    float* const* slot_inputs;
+    int err = methcla_shm_client_begin_write(client, &slot_inputs);
+    if (err != 0)
+        return err;
+    for (uint32_t i=0; i < client->header->num_inputs; i++)
+        memcpy(slot_inputs[i], inputs[i], block_size * sizeof(float));
+    methcla_shm_client_end_write(client);
+
+    const float* const* slot_outputs;
+    err = methcla_shm_client_begin_read(client, timeout_ms, &slot_outputs);
+    if (err != 0)
+        return err;
+    for (uint32_t i=0; i < client->header->num_outputs; i++)
+        memcpy(outputs[i], slot_outputs[i], block_size * sizeof(float));
+    methcla_shm_client_end_read(client);
+
+    return 0;
+}
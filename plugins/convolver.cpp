@@ -0,0 +1,1015 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <methcla/plugins/convolver.h>
+#include <methcla/plugins/fft.hpp>
+#include <methcla/plugins/simd.h>
+#include <methcla/file.hpp>
+#include <oscpp/server.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+using Methcla::Plugin::FFT::RealFFT;
+
+static const size_t kCacheLineSize = 64;
+static const size_t kDefaultPartitionSize = 64;
+static const size_t kMinPartitionSize = 16;
+static const size_t kMaxPartitionSize = 4096;
+// Ratio of the background partition size to the first partition size.
+static const size_t kTailPartitionRatio = 16;
+// Number of frames read from the impulse response file at once.
+static const size_t kReadFrames = 8192;
+
+static inline size_t roundUpToPowerOfTwo(size_t n)
+{
+    size_t result = 1;
+    while (result < n)
+        result *= 2;
+    return result;
+}
+
+//* Add the products of the spectra x and h to acc.
+//
+// Spectra are stored as stride real parts followed by stride imaginary
+// parts; stride is a multiple of four.
+static inline void multiplyAccumulate(float* acc, const float* x, const float* h, size_t stride)
+{
+    float* accRe = acc;
+    float* accIm = acc + stride;
+    const float* xRe = x;
+    const float* xIm = x + stride;
+    const float* hRe = h;
+    const float* hIm = h + stride;
+    for (size_t k=0; k < stride; k += 4)
+    {
+        const Methcla_Float4 xr = methcla_float4_load(xRe + k);
+        const Methcla_Float4 xi = methcla_float4_load(xIm + k);
+        const Methcla_Float4 hr = methcla_float4_load(hRe + k);
+        const Methcla_Float4 hi = methcla_float4_load(hIm + k);
+        methcla_float4_store(accRe + k, methcla_float4_load(accRe + k) + xr * hr - xi * hi);
+        methcla_float4_store(accIm + k, methcla_float4_load(accIm + k) + xr * hi + xi * hr);
+    }
+}
+
+//* Uniformly partitioned convolution state.
+//
+// Computes the convolution of an input signal with a partitioned impulse
+// response block by block with overlap-save. The spectra of the last
+// numPartitions input blocks are kept in a frequency domain delay line.
+//
+// Buffers are allocated by the owner; see bufferSize().
+class Partitioned
+{
+public:
+    Partitioned()
+        : m_fft(nullptr)
+        , m_blockSize(0)
+        , m_stride(0)
+        , m_numPartitions(0)
+        , m_partitions(nullptr)
+        , m_input(nullptr)
+        , m_delayLine(nullptr)
+        , m_delayPos(0)
+        , m_acc(nullptr)
+        , m_output(nullptr)
+    { }
+
+    static size_t stride(const RealFFT& fft)
+    {
+        return (fft.numBins() + 3) & ~(size_t)3;
+    }
+
+    //* Return the number of floats needed for the buffers of a convolution with numPartitions partitions.
+    static size_t bufferSize(const RealFFT& fft, size_t numPartitions)
+    {
+        return 2 * fft.size() + 2 * stride(fft) * (numPartitions + 1);
+    }
+
+    void init(const RealFFT* fft, size_t numPartitions, const float* partitions, float* buffer)
+    {
+        m_fft = fft;
+        m_blockSize = fft->size() / 2;
+        m_stride = stride(*fft);
+        m_numPartitions = numPartitions;
+        m_partitions = partitions;
+        m_input = buffer;
+        m_output = m_input + fft->size();
+        m_acc = m_output + fft->size();
+        m_delayLine = m_acc + 2 * m_stride;
+        m_delayPos = 0;
+        std::fill(buffer, buffer + bufferSize(*fft, numPartitions), 0.f);
+    }
+
+    size_t numPartitions() const
+    {
+        return m_numPartitions;
+    }
+
+    //* Skip numBlocks input blocks of silence.
+    void skip(size_t numBlocks)
+    {
+        std::fill(m_input, m_input + 2 * m_blockSize, 0.f);
+        for (size_t i=0; i < std::min(numBlocks, m_numPartitions); i++)
+        {
+            m_delayPos = (m_delayPos + m_numPartitions - 1) % m_numPartitions;
+            float* x = m_delayLine + 2 * m_stride * m_delayPos;
+            std::fill(x, x + 2 * m_stride, 0.f);
+        }
+    }
+
+    //* Convolve the next block of input and return the output block.
+    const float* process(const float* input)
+    {
+        std::copy(m_input + m_blockSize, m_input + 2 * m_blockSize, m_input);
+        std::copy(input, input + m_blockSize, m_input + m_blockSize);
+
+        m_delayPos = (m_delayPos + m_numPartitions - 1) % m_numPartitions;
+        float* x = m_delayLine + 2 * m_stride * m_delayPos;
+        m_fft->forward(m_input, x, x + m_stride);
+
+        std::fill(m_acc, m_acc + 2 * m_stride, 0.f);
+        for (size_t k=0; k < m_numPartitions; k++)
+        {
+            const size_t i = (m_delayPos + k) % m_numPartitions;
+            multiplyAccumulate(m_acc, m_delayLine + 2 * m_stride * i, m_partitions + 2 * m_stride * k, m_stride);
+        }
+
+        m_fft->inverse(m_acc, m_acc + m_stride, m_output);
+
+        // The first half is aliased by the circular convolution.
+        return m_output + m_blockSize;
+    }
+
+private:
+    const RealFFT*  m_fft;
+    size_t          m_blockSize;
+    size_t          m_stride;
+    size_t          m_numPartitions;
+    const float*    m_partitions;
+    float*          m_input;
+    float*          m_delayLine;
+    size_t          m_delayPos;
+    float*          m_acc;
+    float*          m_output;
+};
+
+//* Partitioned impulse response spectra shared between convolvers.
+//
+// The first 2 * tailPartitionSize() frames are split into partitions of
+// headPartitionSize() frames, the rest into partitions of
+// tailPartitionSize() frames. Spectra are scaled by the inverse FFT size.
+class ImpulseResponse
+{
+public:
+    struct Key
+    {
+        std::string path;
+        size_t      channel;
+        int64_t     numFrames;
+        size_t      partitionSize;
+
+        bool operator<(const Key& other) const
+        {
+            return std::tie(path, channel, numFrames, partitionSize)
+                 < std::tie(other.path, other.channel, other.numFrames, other.partitionSize);
+        }
+    };
+
+    ImpulseResponse(const Methcla_Host* host, const Key& key)
+        : m_key(key)
+        , m_refCount(0)
+        , m_headFFT(2 * key.partitionSize)
+        , m_tailFFT(2 * key.partitionSize * kTailPartitionRatio)
+    {
+        const std::vector<float> ir = read(host, key);
+        m_numFrames = ir.size();
+
+        const size_t headSize = headPartitionSize();
+        const size_t tailSize = tailPartitionSize();
+        const size_t headFrames = std::min(m_numFrames, 2 * tailSize);
+        const size_t tailFrames = m_numFrames - headFrames;
+
+        m_numHeadPartitions = std::max((size_t)1, (headFrames + headSize - 1) / headSize);
+        m_numTailPartitions = (tailFrames + tailSize - 1) / tailSize;
+
+        computeSpectra(m_headFFT, ir.data(), headFrames, m_numHeadPartitions, m_headSpectra);
+        computeSpectra(m_tailFFT, ir.data() + headFrames, tailFrames, m_numTailPartitions, m_tailSpectra);
+    }
+
+    ImpulseResponse(const ImpulseResponse&) = delete;
+    ImpulseResponse& operator=(const ImpulseResponse&) = delete;
+
+    const Key& key() const { return m_key; }
+    size_t& refCount() { return m_refCount; }
+
+    size_t numFrames() const { return m_numFrames; }
+    size_t headPartitionSize() const { return m_key.partitionSize; }
+    size_t tailPartitionSize() const { return m_key.partitionSize * kTailPartitionRatio; }
+
+    const RealFFT& headFFT() const { return m_headFFT; }
+    const RealFFT& tailFFT() const { return m_tailFFT; }
+    size_t numHeadPartitions() const { return m_numHeadPartitions; }
+    size_t numTailPartitions() const { return m_numTailPartitions; }
+    const float* headSpectra() const { return m_headSpectra.data(); }
+    const float* tailSpectra() const { return m_tailSpectra.data(); }
+
+private:
+    static std::vector<float> read(const Methcla_Host* host, const Key& key)
+    {
+        Methcla::SoundFile file(host, key.path);
+        const size_t channels = file.info().channels;
+        if (channels == 0)
+            throw std::runtime_error("Sound file has no channels");
+        const size_t channel = std::min(key.channel, channels - 1);
+        const int64_t numFrames =
+            key.numFrames < 0 ? file.info().frames : std::min(key.numFrames, file.info().frames);
+
+        std::vector<float> result;
+        result.reserve((size_t)std::max<int64_t>(0, numFrames));
+        std::vector<float> buffer(kReadFrames * channels);
+
+        while ((int64_t)result.size() < numFrames)
+        {
+            const size_t n = file.read(buffer.data(), std::min<size_t>(kReadFrames, numFrames - result.size()));
+            if (n == 0)
+                break;
+            for (size_t i=0; i < n; i++)
+                result.push_back(buffer[i * channels + channel]);
+        }
+
+        return result;
+    }
+
+    static void computeSpectra(const RealFFT& fft, const float* ir, size_t numFrames, size_t numPartitions, std::vector<float>& spectra)
+    {
+        const size_t partitionSize = fft.size() / 2;
+        const size_t stride = Partitioned::stride(fft);
+        const float scale = 1.f / (float)fft.size();
+
+        spectra.assign(2 * stride * numPartitions, 0.f);
+        std::vector<float> input(fft.size());
+
+        for (size_t k=0; k < numPartitions; k++)
+        {
+            const size_t offset = k * partitionSize;
+            const size_t n = std::min(partitionSize, numFrames - std::min(numFrames, offset));
+            std::fill(input.begin(), input.end(), 0.f);
+            for (size_t i=0; i < n; i++)
+                input[i] = ir[offset + i] * scale;
+            float* x = spectra.data() + 2 * stride * k;
+            fft.forward(input.data(), x, x + stride);
+        }
+    }
+
+private:
+    Key                 m_key;
+    size_t              m_refCount;
+    size_t              m_numFrames;
+    RealFFT             m_headFFT;
+    RealFFT             m_tailFFT;
+    size_t              m_numHeadPartitions;
+    size_t              m_numTailPartitions;
+    std::vector<float>  m_headSpectra;
+    std::vector<float>  m_tailSpectra;
+};
+
+class Convolver;
+
+//* Impulse response cache and background thread shared by all convolvers of an engine.
+//
+// Background partitions of all convolvers are computed on one thread in
+// the order of their deadlines.
+class ConvolverService
+{
+public:
+    ConvolverService(const Methcla_Host* host);
+    ~ConvolverService();
+
+    ConvolverService(const ConvolverService&) = delete;
+    ConvolverService& operator=(const ConvolverService&) = delete;
+
+    //* Return a reference to the impulse response for key, reading it if necessary.
+    const ImpulseResponse* acquire(const Methcla_Host* host, const ImpulseResponse::Key& key);
+    //* Release an impulse response returned by acquire.
+    void release(const ImpulseResponse* ir);
+
+    //* Schedule the background partitions of convolver that need to be computed before deadline.
+    void schedule(Convolver* convolver, Methcla_Time deadline);
+
+    //* Perform a command in the realtime context unless the service is shutting down.
+    void perform(Methcla_WorldPerformFunction perform, void* data);
+
+    //* Track a convolver that is being loaded.
+    void insert(Convolver* convolver);
+    //* Forget a convolver that is being destroyed.
+    void remove(Convolver* convolver);
+
+private:
+    struct Job
+    {
+        Methcla_Time    deadline;
+        Convolver*      convolver;
+
+        // Reversed for std::priority_queue: earliest deadline on top.
+        bool operator<(const Job& other) const
+        {
+            return deadline > other.deadline;
+        }
+    };
+
+    void process();
+
+private:
+    const Methcla_Host*                                 m_host;
+    std::mutex                                          m_cacheMutex;
+    std::map<ImpulseResponse::Key,ImpulseResponse*>     m_cache;
+    std::mutex                                          m_mutex;
+    std::condition_variable                             m_cond;
+    bool                                                m_continue;
+    std::priority_queue<Job>                            m_queue;
+    // Convolvers that have been loaded and not destroyed yet.
+    std::unordered_set<Convolver*>                      m_convolvers;
+    std::thread                                         m_thread;
+};
+
+//* Convolution of one input with an impulse response.
+//
+// The input is collected in blocks of the first partition size. Each block
+// is convolved with the head of the impulse response, covering the first
+// two background partitions, in the realtime context. The input blocks
+// are also collected into blocks of the background partition size, which
+// are passed to the service thread through two slots. The result for input
+// block m is added to the output during block m+2, which leaves the service
+// thread the duration of one block for computing it.
+//
+// Slots are tagged with the index of the block they contain. If the service
+// thread hasn't taken a block from its slot when it is due to be reused,
+// the new input block is dropped; if a result isn't available in time,
+// the output of the block is dropped. Both are counted as underruns.
+class Convolver
+{
+    friend class ConvolverService;
+
+    // Reference count manipulated in the realtime context only.
+    int m_refCount;
+
+    ConvolverService* m_service;
+    ImpulseResponse::Key m_key;
+    double m_sampleRate;
+
+    const ImpulseResponse* m_ir;
+    bool m_ready;
+    float* m_buffer;
+
+    // Context: RT
+    size_t m_partitionSize;
+    size_t m_tailPartitionSize;
+    float* m_inputBlock;
+    float* m_outputBlock;
+    size_t m_blockPos;
+    int64_t m_numBlocks;
+    Partitioned m_head;
+    float* m_tailInput;
+    bool m_tailWriting;
+    bool m_tailReadable;
+    std::atomic<Methcla_Time> m_deadline;
+
+    // Context: service thread
+    Partitioned m_tail;
+    int64_t m_tailLastBlock;
+
+    // Tags of the blocks in the tail input and output slots.
+    std::atomic<int64_t> m_tailInputTag[2];
+    std::atomic<int64_t> m_tailOutputTag[2];
+    // Index of the last input block taken by the service thread.
+    std::atomic<int64_t> m_tailConsumed;
+    float* m_tailOutput;
+
+    std::atomic<uint32_t> m_underruns;
+
+public:
+    Convolver(ConvolverService* service, const char* path, size_t channel, int64_t numFrames, size_t partitionSize, double sampleRate)
+        : m_refCount(1)
+        , m_service(service)
+        , m_sampleRate(sampleRate)
+        , m_ir(nullptr)
+        , m_ready(false)
+        , m_buffer(nullptr)
+        , m_partitionSize(partitionSize)
+        , m_tailPartitionSize(partitionSize * kTailPartitionRatio)
+        , m_inputBlock(nullptr)
+        , m_outputBlock(nullptr)
+        , m_blockPos(0)
+        , m_numBlocks(0)
+        , m_tailInput(nullptr)
+        , m_tailWriting(false)
+        , m_tailReadable(false)
+        , m_deadline(0.)
+        , m_tailLastBlock(-1)
+        , m_tailConsumed(-1)
+        , m_tailOutput(nullptr)
+        , m_underruns(0)
+    {
+        m_key.path = path;
+        m_key.channel = channel;
+        m_key.numFrames = numFrames;
+        m_key.partitionSize = partitionSize;
+
+        for (size_t i=0; i < 2; i++)
+        {
+            m_tailInputTag[i] = -1;
+            m_tailOutputTag[i] = -1;
+        }
+    }
+
+    size_t statistics(int32_t* values, size_t size) const
+    {
+        const int32_t stats[kMethcla_ConvolverNumStatistics] = {
+            (int32_t)m_underruns.load(std::memory_order_relaxed),
+            m_ready ? (int32_t)m_ir->numFrames() : 0,
+            (int32_t)m_partitionSize
+        };
+        const size_t n = std::min<size_t>(size, kMethcla_ConvolverNumStatistics);
+        std::copy(stats, stats + n, values);
+        return n;
+    }
+
+    // Context: RT
+
+    //* Read the impulse response in the context of the engine's worker.
+    void load(const Methcla_World* world)
+    {
+        m_refCount++;
+        methcla_world_perform_command(world, loadCallback, this);
+    }
+
+    void release(const Methcla_World* world)
+    {
+        assert(m_refCount > 0);
+        m_refCount--;
+        if (m_refCount == 0)
+        {
+            methcla_world_perform_command(world, destroyCallback, this);
+        }
+    }
+
+    void process(const Methcla_World* world, float amp, const float* input, float* output, size_t numFrames)
+    {
+        if (!m_ready)
+        {
+            std::fill(output, output + numFrames, 0.f);
+            return;
+        }
+
+        for (size_t i=0; i < numFrames; )
+        {
+            const size_t n = std::min(numFrames - i, m_partitionSize - m_blockPos);
+            // Copy the input first, it may share memory with the output.
+            std::copy(input + i, input + i + n, m_inputBlock + m_blockPos);
+            for (size_t k=0; k < n; k++)
+                output[i+k] = amp * m_outputBlock[m_blockPos+k];
+            m_blockPos += n;
+            i += n;
+            if (m_blockPos == m_partitionSize)
+            {
+                processBlock(world);
+                m_blockPos = 0;
+            }
+        }
+    }
+
+    // Context: service thread
+
+    //* Compute the background partitions of all pending input blocks.
+    void processTail()
+    {
+        const size_t tailSize = m_tailPartitionSize;
+        for (;;)
+        {
+            // Take the oldest block not processed yet.
+            int64_t block = -1;
+            for (size_t i=0; i < 2; i++)
+            {
+                const int64_t tag = m_tailInputTag[i].load(std::memory_order_acquire);
+                if (tag > m_tailLastBlock && (block < 0 || tag < block))
+                    block = tag;
+            }
+            if (block < 0)
+                break;
+
+            if (block > m_tailLastBlock + 1)
+                m_tail.skip(block - m_tailLastBlock - 1);
+            m_tailLastBlock = block;
+
+            const float* output = m_tail.process(m_tailInput + (block % 2) * tailSize);
+            m_tailConsumed.store(block, std::memory_order_release);
+
+            std::copy(output, output + tailSize, m_tailOutput + (block % 2) * tailSize);
+            m_tailOutputTag[block % 2].store(block, std::memory_order_release);
+        }
+
+        // Drop the reference held for the job.
+        m_service->perform(releaseCallback, this);
+    }
+
+private:
+    ~Convolver()
+    {
+        if (m_ir != nullptr)
+            m_service->release(m_ir);
+    }
+
+    void processBlock(const Methcla_World* world)
+    {
+        const float* head = m_head.process(m_inputBlock);
+        std::copy(head, head + m_partitionSize, m_outputBlock);
+
+        if (m_tail.numPartitions() > 0)
+        {
+            const size_t tailSize = m_tailPartitionSize;
+            const size_t offset = (size_t)(m_numBlocks % (int64_t)kTailPartitionRatio) * m_partitionSize;
+            const int64_t block = m_numBlocks / (int64_t)kTailPartitionRatio;
+
+            if (offset == 0)
+            {
+                // The result for block-2 is added during this block.
+                const int64_t resultBlock = block - 2;
+                m_tailReadable = resultBlock >= 0
+                              && m_tailOutputTag[resultBlock % 2].load(std::memory_order_acquire) == resultBlock;
+                if (resultBlock >= 0 && !m_tailReadable
+                    && m_tailInputTag[resultBlock % 2].load(std::memory_order_relaxed) == resultBlock)
+                    m_underruns.fetch_add(1, std::memory_order_relaxed);
+
+                // Reuse the input slot only after the service thread has taken block-2.
+                m_tailWriting = m_tailInputTag[block % 2].load(std::memory_order_relaxed)
+                             <= m_tailConsumed.load(std::memory_order_acquire);
+                if (!m_tailWriting)
+                    m_underruns.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (m_tailWriting)
+                std::copy(m_inputBlock, m_inputBlock + m_partitionSize, m_tailInput + (block % 2) * tailSize + offset);
+
+            if (m_tailReadable)
+            {
+                const float* tail = m_tailOutput + ((block - 2) % 2) * tailSize + offset;
+                for (size_t k=0; k < m_partitionSize; k++)
+                    m_outputBlock[k] += tail[k];
+            }
+
+            if (m_tailWriting && offset + m_partitionSize == tailSize)
+            {
+                m_tailInputTag[block % 2].store(block, std::memory_order_release);
+                scheduleTail(world, methcla_world_current_time(world) + (double)tailSize / m_sampleRate);
+            }
+        }
+
+        m_numBlocks++;
+    }
+
+    void scheduleTail(const Methcla_World* world, Methcla_Time deadline)
+    {
+        m_refCount++;
+        m_deadline.store(deadline, std::memory_order_relaxed);
+        methcla_world_perform_command(world, scheduleCallback, this);
+    }
+
+    // Context: engine worker
+
+    void load(const Methcla_Host* host)
+    {
+        m_service->insert(this);
+
+        try
+        {
+            m_ir = m_service->acquire(host, m_key);
+
+            const RealFFT& headFFT = m_ir->headFFT();
+            const RealFFT& tailFFT = m_ir->tailFFT();
+            // Input and output blocks, head convolution and tail slots and convolution.
+            const size_t headBufferSize = Partitioned::bufferSize(headFFT, m_ir->numHeadPartitions());
+            const size_t tailBufferSize = m_ir->numTailPartitions() > 0
+                ? 4 * m_tailPartitionSize + Partitioned::bufferSize(tailFFT, m_ir->numTailPartitions())
+                : 0;
+            const size_t size = 2 * m_partitionSize + headBufferSize + tailBufferSize;
+
+            m_buffer = static_cast<float*>(methcla_host_alloc_aligned(host, kCacheLineSize, size * sizeof(float)));
+            if (m_buffer == nullptr)
+                throw std::bad_alloc();
+
+            m_inputBlock = m_buffer;
+            m_outputBlock = m_inputBlock + m_partitionSize;
+            std::fill(m_inputBlock, m_inputBlock + 2 * m_partitionSize, 0.f);
+            m_head.init(&headFFT, m_ir->numHeadPartitions(), m_ir->headSpectra(), m_outputBlock + m_partitionSize);
+
+            if (m_ir->numTailPartitions() > 0)
+            {
+                m_tailInput = m_outputBlock + m_partitionSize + headBufferSize;
+                m_tailOutput = m_tailInput + 2 * m_tailPartitionSize;
+                std::fill(m_tailInput, m_tailInput + 4 * m_tailPartitionSize, 0.f);
+                m_tail.init(&tailFFT, m_ir->numTailPartitions(), m_ir->tailSpectra(), m_tailOutput + 2 * m_tailPartitionSize);
+            }
+        }
+        catch (std::exception& e)
+        {
+            std::stringstream s;
+            s << METHCLA_PLUGINS_CONVOLVER_URI << ": " << m_key.path << ": " << e.what();
+            methcla_host_log_line(host, kMethcla_LogError, s.str().c_str());
+        }
+
+        m_service->perform(loadedCallback, this);
+    }
+
+    static void loadCallback(const Methcla_Host* host, void* data)
+    {
+        static_cast<Convolver*>(data)->load(host);
+    }
+
+    static void loadedCallback(const Methcla_World* world, void* data)
+    {
+        Convolver* self = static_cast<Convolver*>(data);
+        self->m_ready = self->m_buffer != nullptr;
+        self->release(world);
+    }
+
+    static void scheduleCallback(const Methcla_Host*, void* data)
+    {
+        Convolver* self = static_cast<Convolver*>(data);
+        self->m_service->schedule(self, self->m_deadline.load(std::memory_order_relaxed));
+    }
+
+    static void releaseCallback(const Methcla_World* world, void* data)
+    {
+        static_cast<Convolver*>(data)->release(world);
+    }
+
+    static void freeCallback(const Methcla_World* world, void* data)
+    {
+        methcla_world_free(world, data);
+    }
+
+    //* Free the convolver's buffers and call its destructor.
+    void destroy(const Methcla_Host* host)
+    {
+        if (m_buffer != nullptr)
+            methcla_host_free_aligned(host, m_buffer);
+        this->~Convolver();
+    }
+
+    static void destroyCallback(const Methcla_Host* host, void* data)
+    {
+        Convolver* self = static_cast<Convolver*>(data);
+        ConvolverService* service = self->m_service;
+        service->remove(self);
+        self->destroy(host);
+        // Free memory allocated from RT heap
+        service->perform(freeCallback, data);
+    }
+};
+
+ConvolverService::ConvolverService(const Methcla_Host* host)
+    : m_host(host)
+    , m_continue(true)
+{
+    m_thread = std::thread([this](){ this->process(); });
+}
+
+ConvolverService::~ConvolverService()
+{
+    // The engine's worker has been stopped at this point, so commands posted
+    // to the realtime context would never be performed. Cancel pending jobs,
+    // stop posting and destroy the remaining convolvers directly; their
+    // realtime memory is reclaimed with the realtime memory pool.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_continue = false;
+        m_queue = std::priority_queue<Job>();
+    }
+    m_cond.notify_all();
+    m_thread.join();
+    for (Convolver* convolver : m_convolvers)
+        convolver->destroy(m_host);
+    for (auto& entry : m_cache)
+        delete entry.second;
+}
+
+const ImpulseResponse* ConvolverService::acquire(const Methcla_Host* host, const ImpulseResponse::Key& key)
+{
+    // Concurrent requests for the same impulse response wait for a single read.
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    auto it = m_cache.find(key);
+    ImpulseResponse* ir;
+    if (it == m_cache.end())
+    {
+        ir = new ImpulseResponse(host, key);
+        m_cache[key] = ir;
+    }
+    else
+    {
+        ir = it->second;
+    }
+    ir->refCount()++;
+    return ir;
+}
+
+void ConvolverService::release(const ImpulseResponse* ir)
+{
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    auto it = m_cache.find(ir->key());
+    assert( it != m_cache.end() && it->second == ir );
+    if (--it->second->refCount() == 0)
+    {
+        delete it->second;
+        m_cache.erase(it);
+    }
+}
+
+void ConvolverService::schedule(Convolver* convolver, Methcla_Time deadline)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_continue)
+            return;
+        m_queue.push({ deadline, convolver });
+    }
+    m_cond.notify_one();
+}
+
+void ConvolverService::perform(Methcla_WorldPerformFunction perform, void* data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_continue)
+        methcla_host_perform_command(m_host, perform, data);
+}
+
+void ConvolverService::insert(Convolver* convolver)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_convolvers.insert(convolver);
+}
+
+void ConvolverService::remove(Convolver* convolver)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_convolvers.erase(convolver);
+}
+
+void ConvolverService::process()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this](){ return !m_continue || !m_queue.empty(); });
+            if (!m_continue)
+                break;
+            job = m_queue.top();
+            m_queue.pop();
+        }
+        job.convolver->processTail();
+    }
+}
+
+typedef enum {
+    kPort_amp,
+    kPort_input,
+    kPort_output
+} PortIndex;
+
+struct ConvolverSynth
+{
+    float* ports[kPort_output + 1];
+    Convolver* convolver;
+};
+
+struct ConvolverOptions
+{
+    const char* path;
+    size_t channel;
+    int64_t numFrames;
+    size_t partitionSize;
+};
+
+//* Synth definition with a reference to the library's convolver service.
+struct ConvolverDef
+{
+    Methcla_SynthDef    def;
+    ConvolverService*   service;
+};
+
+extern "C"
+{
+    static bool convolver_port_descriptor(const Methcla_SynthOptions*, Methcla_PortCount, Methcla_PortDescriptor*);
+    static void convolver_configure(const void*, size_t, const void*, size_t, Methcla_SynthOptions*);
+    static void convolver_construct(const Methcla_World*, const Methcla_SynthDef*, const Methcla_SynthOptions*, Methcla_Synth*);
+    static void convolver_destroy(const Methcla_World*, Methcla_Synth*);
+    static void convolver_connect(Methcla_Synth*, Methcla_PortCount, void* data);
+    static void convolver_process(const Methcla_World*, Methcla_Synth*, size_t);
+    static size_t convolver_statistics(const Methcla_World*, Methcla_Synth*, int32_t*, size_t);
+}
+
+bool
+convolver_port_descriptor(
+    const Methcla_SynthOptions*,
+    Methcla_PortCount index,
+    Methcla_PortDescriptor* port )
+{
+    switch ((PortIndex)index) {
+        case kPort_amp:
+            port->type = kMethcla_ControlPort;
+            port->direction = kMethcla_Input;
+            port->flags = kMethcla_PortFlags;
+            return true;
+        case kPort_input:
+            port->type = kMethcla_AudioPort;
+            port->direction = kMethcla_Input;
+            port->flags = kMethcla_PortFlags;
+            return true;
+        case kPort_output:
+            port->type = kMethcla_AudioPort;
+            port->direction = kMethcla_Output;
+            port->flags = kMethcla_PortFlags;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void
+convolver_configure(
+    const void* tags,
+    size_t tags_size,
+    const void* args,
+    size_t args_size,
+    Methcla_SynthOptions* outOptions )
+{
+    OSCPP::Server::ArgStream argStream(OSCPP::ReadStream(tags, tags_size), OSCPP::ReadStream(args, args_size));
+    ConvolverOptions* options =
+        static_cast<ConvolverOptions*>(outOptions);
+    options->path = argStream.string();
+    options->channel = argStream.atEnd() ? 0 : std::max(0, argStream.int32());
+    options->numFrames = argStream.atEnd() ? -1 : argStream.int32();
+    const size_t partitionSize = argStream.atEnd() ? kDefaultPartitionSize : std::max(1, argStream.int32());
+    options->partitionSize = roundUpToPowerOfTwo(std::min(std::max(partitionSize, kMinPartitionSize), kMaxPartitionSize));
+}
+
+void
+convolver_construct(
+    const Methcla_World* world,
+    const Methcla_SynthDef* synthDef,
+    const Methcla_SynthOptions* inOptions,
+    Methcla_Synth* synth )
+{
+    const ConvolverOptions* options =
+        static_cast<const ConvolverOptions*>(inOptions);
+    ConvolverService* service =
+        reinterpret_cast<const ConvolverDef*>(synthDef)->service;
+
+    ConvolverSynth* self = (ConvolverSynth*)synth;
+
+    self->convolver = static_cast<Convolver*>(methcla_world_alloc(world, sizeof(Convolver)));
+
+    if (self->convolver != nullptr)
+    {
+        new (self->convolver) Convolver(
+            service,
+            options->path,
+            options->channel,
+            options->numFrames,
+            options->partitionSize,
+            methcla_world_samplerate(world)
+        );
+
+        // Output silence until the impulse response has been read.
+        self->convolver->load(world);
+    }
+}
+
+void
+convolver_destroy(const Methcla_World* world, Methcla_Synth* synth)
+{
+    Convolver* convolver = static_cast<ConvolverSynth*>(synth)->convolver;
+    if (convolver) convolver->release(world);
+}
+
+void
+convolver_connect(
+    Methcla_Synth* synth,
+    Methcla_PortCount index,
+    void* data )
+{
+    ((ConvolverSynth*)synth)->ports[index] = (float*)data;
+}
+
+void
+convolver_process(
+    const Methcla_World* world,
+    Methcla_Synth* synth,
+    size_t numFrames )
+{
+    ConvolverSynth* self = static_cast<ConvolverSynth*>(synth);
+    float* output = self->ports[kPort_output];
+
+    if (self->convolver)
+        self->convolver->process(world, *self->ports[kPort_amp], self->ports[kPort_input], output, numFrames);
+    else
+        std::fill(output, output + numFrames, 0.f);
+}
+
+size_t
+convolver_statistics(
+    const Methcla_World* /* world */,
+    Methcla_Synth* synth,
+    int32_t* values,
+    size_t size )
+{
+    const Convolver* convolver = static_cast<ConvolverSynth*>(synth)->convolver;
+    return convolver ? convolver->statistics(values, size) : 0;
+}
+
+static const Methcla_SynthDef kConvolverDef =
+{
+    METHCLA_PLUGINS_CONVOLVER_URI,
+    sizeof(ConvolverSynth),
+    sizeof(ConvolverOptions),
+    convolver_configure,
+    convolver_port_descriptor,
+    convolver_construct,
+    convolver_connect,
+    nullptr,
+    convolver_process,
+    convolver_destroy,
+    convolver_statistics
+};
+
+class ConvolverLibrary
+{
+public:
+    ConvolverLibrary(const Methcla_Host* host)
+        : m_service(host)
+    {
+        m_library.handle = this;
+        m_library.destroy = destroy;
+        m_synthDef.def = kConvolverDef;
+        m_synthDef.service = &m_service;
+    }
+
+    const Methcla_Library* library() const
+    {
+        return &m_library;
+    }
+
+    const Methcla_SynthDef* synthDef() const
+    {
+        return &m_synthDef.def;
+    }
+
+private:
+    static void destroy(const Methcla_Library* library)
+    {
+        // Stops the service thread.
+        delete static_cast<ConvolverLibrary*>(library->handle);
+    }
+
+private:
+    Methcla_Library     m_library;
+    ConvolverDef        m_synthDef;
+    ConvolverService    m_service;
+};
+
+METHCLA_EXPORT const Methcla_Library*
+methcla_plugins_convolver(
+    const Methcla_Host* host,
+    const char* /* bundlePath */)
+{
+    ConvolverLibrary* library = new ConvolverLibrary(host);
+    methcla_host_register_synthdef(host, library->synthDef());
+    return library->library();
+}
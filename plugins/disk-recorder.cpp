@@ -0,0 +1,671 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <methcla/plugins/disk-recorder.h>
+#include <methcla/file.hpp>
+#include <methcla/plugin.hpp>
+#include <oscpp/server.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+static const size_t kCacheLineSize = 64;
+// Number of frames written to disk at once. Float files are written in
+// multiples of the disk block size.
+static const size_t kWriteFrames = 8192;
+// Minimum number of seconds of audio the stream buffer can hold.
+static const double kBufferDuration = 2.;
+// Maximum number of inputs selectable by synth options.
+static const size_t kMaxInputs = 32;
+
+enum StateVar
+{
+    kOpening,
+    kRecording,
+    kFailed
+};
+
+static inline size_t bytesPerSample(Methcla_SoundFileFormat format)
+{
+    switch (format)
+    {
+        case kMethcla_SoundFileFormatPCM16: return 2;
+        case kMethcla_SoundFileFormatPCM24: return 3;
+        default: return 4;
+    }
+}
+
+class Recorder;
+
+//* Performs file operations for recorders on a background thread.
+class RecorderService
+{
+public:
+    enum Command
+    {
+        kOpen,
+        kFlush,
+        kClose
+    };
+
+    RecorderService(const Methcla_Host* host);
+    ~RecorderService();
+
+    RecorderService(const RecorderService&) = delete;
+    RecorderService& operator=(const RecorderService&) = delete;
+
+    //* Schedule a command; commands are performed in the order they were scheduled.
+    void schedule(Recorder* recorder, Command command);
+
+    //* Perform a command in the realtime context unless the service is shutting down.
+    void perform(Methcla_WorldPerformFunction perform, void* data);
+
+private:
+    struct Request
+    {
+        Recorder*   recorder;
+        Command     command;
+    };
+
+    void process();
+
+private:
+    const Methcla_Host*     m_host;
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    bool                    m_continue;
+    std::deque<Request>     m_queue;
+    // Recorders that have been opened but not yet closed.
+    std::unordered_set<Recorder*> m_recorders;
+    std::thread             m_thread;
+};
+
+//* Stream of audio blocks from the realtime context to a sound file.
+//
+// The realtime context interleaves the inputs into a lock-free single
+// producer/single consumer ring buffer and the service thread writes
+// complete chunks of kWriteFrames to disk.
+class Recorder
+{
+    std::atomic<int> m_state;
+
+    RecorderService* m_service;
+
+    char m_path[FILENAME_MAX];
+    Methcla::SoundFileInfo m_info;
+    Methcla::SoundFile m_file;
+
+    size_t m_bufferFrames;
+    float* m_buffer;
+
+    // Set while a flush has been requested but not yet performed.
+    std::atomic<bool> m_flushRequested;
+
+    // Statistics
+    std::atomic<uint32_t> m_overruns;
+    std::atomic<uint64_t> m_bytesWritten;
+    // Overruns already logged by the service thread.
+    uint32_t m_loggedOverruns;
+
+    // Total number of frames read and written; positions in the buffer are
+    // taken modulo m_bufferFrames.
+    std::atomic<size_t> m_readPos;
+    // Force read and write positions to different cache lines.
+    char m_padding[kCacheLineSize-sizeof(m_readPos)];
+    std::atomic<size_t> m_writePos;
+
+public:
+    Recorder(RecorderService* service, const char* path, size_t channels, double sampleRate, Methcla_SoundFileType fileType, Methcla_SoundFileFormat fileFormat)
+        : m_state(kOpening)
+        , m_service(service)
+        , m_bufferFrames(0)
+        , m_buffer(nullptr)
+        , m_flushRequested(false)
+        , m_overruns(0)
+        , m_bytesWritten(0)
+        , m_loggedOverruns(0)
+        , m_readPos(0)
+        , m_writePos(0)
+    {
+        assert( m_state.is_lock_free() );
+        assert( m_writePos.is_lock_free() );
+        assert( m_readPos.is_lock_free() );
+
+        strncpy(m_path, path, FILENAME_MAX-1);
+        m_path[FILENAME_MAX-1] = '\0';
+
+        m_info.channels = channels;
+        m_info.samplerate = (unsigned int)sampleRate;
+        m_info.file_type = fileType;
+        m_info.file_format = fileFormat;
+    }
+
+    StateVar state() const
+    {
+        return static_cast<StateVar>(m_state.load(std::memory_order_acquire));
+    }
+
+    size_t statistics(int32_t* values, size_t size) const
+    {
+        const int32_t stats[kMethcla_DiskRecorderNumStatistics] = {
+            (int32_t)m_overruns.load(std::memory_order_relaxed),
+            (int32_t)(m_bytesWritten.load(std::memory_order_relaxed) / 1024)
+        };
+        const size_t n = std::min<size_t>(size, kMethcla_DiskRecorderNumStatistics);
+        std::copy(stats, stats + n, values);
+        return n;
+    }
+
+    // Context: RT
+
+    //* Open the sound file on the service thread.
+    void open(const Methcla_World* world)
+    {
+        methcla_world_perform_command(world, scheduleCallback<RecorderService::kOpen>, this);
+    }
+
+    //* Append a block of audio to the stream buffer.
+    //
+    // Blocks are dropped while the buffer is full; overruns are counted
+    // here and logged by the service thread.
+    void write(const Methcla_World* world, float* const* inputs, size_t numFrames)
+    {
+        if (state() != kRecording)
+            return;
+
+        const size_t writePos = m_writePos.load(std::memory_order_relaxed);
+        const size_t readPos = m_readPos.load(std::memory_order_acquire);
+
+        if (m_bufferFrames - (writePos - readPos) < numFrames)
+        {
+            m_overruns.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const size_t pos = writePos % m_bufferFrames;
+        const size_t numFrames1 = std::min(numFrames, m_bufferFrames - pos);
+        interleave(inputs, 0, numFrames1, m_buffer + pos * m_info.channels);
+        interleave(inputs, numFrames1, numFrames - numFrames1, m_buffer);
+
+        m_writePos.store(writePos + numFrames, std::memory_order_release);
+
+        if (writePos + numFrames - readPos >= kWriteFrames
+            && !m_flushRequested.exchange(true, std::memory_order_acq_rel))
+        {
+            methcla_world_perform_command(world, scheduleCallback<RecorderService::kFlush>, this);
+        }
+    }
+
+    //* Write the remaining frames, close the file and destroy the recorder.
+    void close(const Methcla_World* world)
+    {
+        methcla_world_perform_command(world, scheduleCallback<RecorderService::kClose>, this);
+    }
+
+    // Context: service thread
+
+    void open(const Methcla_Host* host)
+    {
+        try
+        {
+            m_file = Methcla::SoundFile(host, m_path, m_info);
+
+            // Round up to whole chunks so that chunks are never split at the end of the buffer.
+            const size_t minFrames = (size_t)std::ceil(kBufferDuration * m_info.samplerate);
+            m_bufferFrames = std::max((size_t)4, (minFrames + kWriteFrames - 1) / kWriteFrames) * kWriteFrames;
+            m_buffer = static_cast<float*>(
+                methcla_host_alloc_aligned(host, kCacheLineSize, m_bufferFrames * m_info.channels * sizeof(float)));
+            if (m_buffer == nullptr)
+                throw std::bad_alloc();
+
+            m_state.store(kRecording, std::memory_order_release);
+        }
+        catch (std::exception& e)
+        {
+            logError(host, e);
+            fail(host);
+        }
+    }
+
+    void flush(const Methcla_Host* host, bool all)
+    {
+        if (state() != kRecording)
+            return;
+
+        // Clear the request first; blocks written from now on request the next flush.
+        m_flushRequested.store(false, std::memory_order_release);
+
+        logOverruns(host);
+
+        try
+        {
+            const size_t writePos = m_writePos.load(std::memory_order_acquire);
+            size_t readPos = m_readPos.load(std::memory_order_relaxed);
+
+            while (writePos - readPos >= (all ? 1 : kWriteFrames))
+            {
+                const size_t pos = readPos % m_bufferFrames;
+                const size_t numFrames = std::min(std::min(writePos - readPos, kWriteFrames), m_bufferFrames - pos);
+                const size_t numFramesWritten = m_file.write(m_buffer + pos * m_info.channels, numFrames);
+                if (numFramesWritten != numFrames)
+                    throw std::runtime_error("Short write");
+                m_bytesWritten.fetch_add(numFrames * m_info.channels * bytesPerSample(m_info.file_format), std::memory_order_relaxed);
+                readPos += numFrames;
+                m_readPos.store(readPos, std::memory_order_release);
+            }
+        }
+        catch (std::exception& e)
+        {
+            logError(host, e);
+            fail(host);
+        }
+    }
+
+    // The recorder's memory is returned to the realtime context unless the
+    // service is shutting down.
+    void close(const Methcla_Host* host)
+    {
+        flush(host, true);
+        logOverruns(host);
+        if (m_file)
+        {
+            try
+            {
+                m_file.close();
+            }
+            catch (std::exception& e)
+            {
+                logError(host, e);
+            }
+        }
+        if (m_buffer != nullptr)
+        {
+            methcla_host_free_aligned(host, m_buffer);
+            m_buffer = nullptr;
+        }
+        RecorderService* service = m_service;
+        // Call destructor
+        this->~Recorder();
+        // Free memory allocated from RT heap
+        service->perform(freeCallback, this);
+    }
+
+private:
+    void interleave(float* const* inputs, size_t offset, size_t numFrames, float* dst)
+    {
+        const size_t channels = m_info.channels;
+        for (size_t c=0; c < channels; c++)
+        {
+            const float* src = inputs[c] + offset;
+            for (size_t k=0; k < numFrames; k++)
+                dst[k * channels + c] = src[k];
+        }
+    }
+
+    void logOverruns(const Methcla_Host* host)
+    {
+        const uint32_t overruns = m_overruns.load(std::memory_order_relaxed);
+        if (overruns != m_loggedOverruns)
+        {
+            Methcla::Plugin::HostContext(host).log(kMethcla_LogWarn)
+                << METHCLA_PLUGINS_DISK_RECORDER_URI
+                << ": " << m_path
+                << ": buffer overrun"
+                << ", dropped " << overruns - m_loggedOverruns << " blocks";
+            m_loggedOverruns = overruns;
+        }
+    }
+
+    void logError(const Methcla_Host* host, const std::exception& e)
+    {
+        std::stringstream s;
+        s << METHCLA_PLUGINS_DISK_RECORDER_URI << ": " << m_path << ": " << e.what();
+        methcla_host_log_line(host, kMethcla_LogError, s.str().c_str());
+    }
+
+    // Stop recording; the realtime context drops all subsequent blocks.
+    void fail(const Methcla_Host*)
+    {
+        m_state.store(kFailed, std::memory_order_release);
+        if (m_file)
+        {
+            try { m_file.close(); } catch (std::exception&) { }
+        }
+    }
+
+    template <RecorderService::Command command> static void scheduleCallback(const Methcla_Host*, void* data)
+    {
+        Recorder* self = static_cast<Recorder*>(data);
+        self->m_service->schedule(self, command);
+    }
+
+    static void freeCallback(const Methcla_World* world, void* data)
+    {
+        methcla_world_free(world, data);
+    }
+};
+
+RecorderService::RecorderService(const Methcla_Host* host)
+    : m_host(host)
+    , m_continue(true)
+{
+    m_thread = std::thread([this](){ this->process(); });
+}
+
+RecorderService::~RecorderService()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_continue = false;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+
+    // Close commands sent after the engine's worker has been stopped are
+    // dropped; close the remaining files synchronously.
+    std::unordered_set<Recorder*> recorders;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        recorders.swap(m_recorders);
+    }
+    for (Recorder* recorder : recorders)
+        recorder->close(m_host);
+}
+
+void RecorderService::schedule(Recorder* recorder, Command command)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (command == kOpen)
+            m_recorders.insert(recorder);
+        m_queue.push_back({ recorder, command });
+    }
+    m_cond.notify_one();
+}
+
+void RecorderService::perform(Methcla_WorldPerformFunction perform, void* data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_continue)
+        methcla_host_perform_command(m_host, perform, data);
+}
+
+void RecorderService::process()
+{
+    for (;;)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this](){ return !m_continue || !m_queue.empty(); });
+            // Close pending recorders before exiting so that no recording is lost.
+            if (!m_continue && m_queue.empty())
+                break;
+            request = m_queue.front();
+            m_queue.pop_front();
+        }
+        switch (request.command)
+        {
+            case kOpen:
+                request.recorder->open(m_host);
+                break;
+            case kFlush:
+                request.recorder->flush(m_host, false);
+                break;
+            case kClose:
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_recorders.erase(request.recorder);
+                }
+                request.recorder->close(m_host);
+                break;
+        }
+    }
+}
+
+typedef enum {
+    kPort_input_0
+} PortIndex;
+
+struct DiskRecorder
+{
+    float* ports[kMaxInputs];
+    size_t numInputs;
+    Recorder* recorder;
+};
+
+struct DiskRecorderOptions
+{
+    const char* path;
+    size_t numInputs;
+    Methcla_SoundFileType fileType;
+    Methcla_SoundFileFormat fileFormat;
+};
+
+//* Synth definition with a reference to the library's recorder service.
+struct DiskRecorderDef
+{
+    Methcla_SynthDef    def;
+    RecorderService*    service;
+};
+
+extern "C"
+{
+    static bool diskrecorder_port_descriptor(const Methcla_SynthOptions*, Methcla_PortCount, Methcla_PortDescriptor*);
+    static void diskrecorder_configure(const void*, size_t, const void*, size_t, Methcla_SynthOptions*);
+    static void diskrecorder_construct(const Methcla_World*, const Methcla_SynthDef*, const Methcla_SynthOptions*, Methcla_Synth*);
+    static void diskrecorder_destroy(const Methcla_World*, Methcla_Synth*);
+    static void diskrecorder_connect(Methcla_Synth*, Methcla_PortCount, void* data);
+    static void diskrecorder_process(const Methcla_World*, Methcla_Synth*, size_t);
+    static size_t diskrecorder_statistics(const Methcla_World*, Methcla_Synth*, int32_t*, size_t);
+}
+
+bool
+diskrecorder_port_descriptor(
+    const Methcla_SynthOptions* inOptions,
+    Methcla_PortCount index,
+    Methcla_PortDescriptor* port )
+{
+    const DiskRecorderOptions* options =
+        static_cast<const DiskRecorderOptions*>(inOptions);
+    if (index < kPort_input_0 + options->numInputs) {
+        port->type = kMethcla_AudioPort;
+        port->direction = kMethcla_Input;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    }
+    return false;
+}
+
+void
+diskrecorder_configure(
+    const void* tags,
+    size_t tags_size,
+    const void* args,
+    size_t args_size,
+    Methcla_SynthOptions* outOptions )
+{
+    OSCPP::Server::ArgStream argStream(OSCPP::ReadStream(tags, tags_size), OSCPP::ReadStream(args, args_size));
+    DiskRecorderOptions* options =
+        static_cast<DiskRecorderOptions*>(outOptions);
+    options->path = argStream.string();
+    options->numInputs = std::min<size_t>(std::max(1, argStream.int32()), kMaxInputs);
+    options->fileType = kMethcla_SoundFileTypeWAV;
+    options->fileFormat = kMethcla_SoundFileFormatFloat;
+    if (!argStream.atEnd())
+    {
+        const int32_t fileType = argStream.int32();
+        // Unknown values are rejected when constructing the synth.
+        options->fileType = fileType == kMethcla_SoundFileTypeAIFF || fileType == kMethcla_SoundFileTypeWAV
+                                ? (Methcla_SoundFileType)fileType
+                                : kMethcla_SoundFileTypeUnknown;
+    }
+    if (!argStream.atEnd())
+    {
+        const int32_t fileFormat = argStream.int32();
+        options->fileFormat = fileFormat > kMethcla_SoundFileFormatUnknown && fileFormat <= kMethcla_SoundFileFormatFloat
+                                ? (Methcla_SoundFileFormat)fileFormat
+                                : kMethcla_SoundFileFormatUnknown;
+    }
+}
+
+void
+diskrecorder_construct(
+    const Methcla_World* world,
+    const Methcla_SynthDef* synthDef,
+    const Methcla_SynthOptions* inOptions,
+    Methcla_Synth* synth )
+{
+    const DiskRecorderOptions* options =
+        static_cast<const DiskRecorderOptions*>(inOptions);
+    RecorderService* service =
+        reinterpret_cast<const DiskRecorderDef*>(synthDef)->service;
+
+    DiskRecorder* self = (DiskRecorder*)synth;
+
+    self->numInputs = options->numInputs;
+    self->recorder = nullptr;
+
+    if (options->fileType == kMethcla_SoundFileTypeUnknown || options->fileFormat == kMethcla_SoundFileFormatUnknown)
+    {
+        methcla_world_log_line(world, kMethcla_LogError, METHCLA_PLUGINS_DISK_RECORDER_URI ": Invalid file type or format");
+        return;
+    }
+
+    self->recorder = static_cast<Recorder*>(methcla_world_alloc(world, sizeof(Recorder)));
+
+    if (self->recorder != nullptr)
+    {
+        new (self->recorder) Recorder(
+            service,
+            options->path,
+            options->numInputs,
+            methcla_world_samplerate(world),
+            options->fileType,
+            options->fileFormat
+        );
+
+        // Recording starts when the file has been opened.
+        self->recorder->open(world);
+    }
+}
+
+void
+diskrecorder_destroy(const Methcla_World* world, Methcla_Synth* synth)
+{
+    Recorder* recorder = static_cast<DiskRecorder*>(synth)->recorder;
+    if (recorder) recorder->close(world);
+}
+
+void
+diskrecorder_connect(
+    Methcla_Synth* synth,
+    Methcla_PortCount index,
+    void* data )
+{
+    ((DiskRecorder*)synth)->ports[index] = (float*)data;
+}
+
+void
+diskrecorder_process(
+    const Methcla_World* world,
+    Methcla_Synth* synth,
+    size_t numFrames )
+{
+    DiskRecorder* self = static_cast<DiskRecorder*>(synth);
+
+    if (self->recorder)
+        self->recorder->write(world, self->ports + kPort_input_0, numFrames);
+}
+
+size_t
+diskrecorder_statistics(
+    const Methcla_World* /* world */,
+    Methcla_Synth* synth,
+    int32_t* values,
+    size_t size )
+{
+    const Recorder* recorder = static_cast<DiskRecorder*>(synth)->recorder;
+    return recorder ? recorder->statistics(values, size) : 0;
+}
+
+static const Methcla_SynthDef kDiskRecorderDef =
+{
+    METHCLA_PLUGINS_DISK_RECORDER_URI,
+    sizeof(DiskRecorder),
+    sizeof(DiskRecorderOptions),
+    diskrecorder_configure,
+    diskrecorder_port_descriptor,
+    diskrecorder_construct,
+    diskrecorder_connect,
+    nullptr,
+    diskrecorder_process,
+    diskrecorder_destroy,
+    diskrecorder_statistics
+};
+
+class DiskRecorderLibrary
+{
+public:
+    DiskRecorderLibrary(const Methcla_Host* host)
+        : m_service(host)
+    {
+        m_library.handle = this;
+        m_library.destroy = destroy;
+        m_synthDef.def = kDiskRecorderDef;
+        m_synthDef.service = &m_service;
+    }
+
+    const Methcla_Library* library() const
+    {
+        return &m_library;
+    }
+
+    const Methcla_SynthDef* synthDef() const
+    {
+        return &m_synthDef.def;
+    }
+
+private:
+    static void destroy(const Methcla_Library* library)
+    {
+        // Closes pending recorders and stops the service thread.
+        delete static_cast<DiskRecorderLibrary*>(library->handle);
+    }
+
+private:
+    Methcla_Library     m_library;
+    DiskRecorderDef     m_synthDef;
+    RecorderService     m_service;
+};
+
+METHCLA_EXPORT const Methcla_Library*
+methcla_plugins_disk_recorder(
+    const Methcla_Host* host,
+    const char* /* bundlePath */)
+{
+    DiskRecorderLibrary* library = new DiskRecorderLibrary(host);
+    methcla_host_register_synthdef(host, library->synthDef());
+    return library->library();
+}
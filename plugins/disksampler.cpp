@@ -13,14 +13,24 @@
 // limitations under the License.
 
 #include <methcla/plugins/disksampler.h>
+#include <methcla/plugins/resample.hpp>
 #include <methcla/file.hpp>
 #include <methcla/plugin.hpp>
 #include <oscpp/server.hpp>
 
-#include <cassert>
+#include <algorithm>
 #include <atomic>
-
-#define METHCLA_PLUGINS_DISKSAMPLER_USE_RESAMPLING 1
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 static const size_t kCacheLineSize = 64;
 // Multiple of disk block size, more or less.
@@ -29,10 +39,22 @@ static const size_t kDiskBlockSize = 8192;
 // NOTE: Previously kDiskBlockSize * 4, now kDiskBlockSize * 8 in order to avoid buffer underruns while app is in background on iOS.
 // TODO: Make disk buffer size configurable at runtime.
 static const size_t kDiskTransferSize = kDiskBlockSize * 8;
-// How many transfer blocks are in a buffer?
+// How many transfer blocks are in a buffer initially?
 static const size_t kNumTransfersPerBuffer = 4;
-
-static const size_t kMinInterpFrames = 4;
+// Bounds for the number of transfer blocks in a buffer when adapting the
+// read-ahead to playback rate and refill latency.
+static const size_t kMinTransfersPerBuffer = 2;
+static const size_t kMaxTransfersPerBuffer = 32;
+// Factor applied to the refill latency estimate in order to absorb jitter.
+static const double kRefillLatencyHeadroom = 2.;
+// Decay of the refill latency estimate per refill.
+static const double kRefillLatencyDecay = 0.9;
+// Number of threads performing disk I/O for all streams.
+static const size_t kNumStreamingThreads = 2;
+
+// Frames behind the read position that are read by the interpolation
+// kernel and must not be overwritten by refills.
+static const size_t kMinInterpFrames = Methcla::Plugin::Resample::kMaxTaps;
 
 static inline size_t bytesToFrames(size_t channels, size_t bytes)
 {
@@ -47,12 +69,12 @@ static inline size_t framesToBytes(size_t channels, size_t frames)
 typedef enum {
     kPort_amp,
     kPort_rate,
-    kPort_output_0,
-    kPort_output_1,
-    kNumPorts
+    kPort_output_0
 } PortIndex;
 
-static const size_t kNumOutputChannels = 2;
+// Maximum number of outputs selectable by synth options.
+static const size_t kMaxOutputs = 32;
+static const size_t kDefaultOutputs = 2;
 
 enum StateVar
 {
@@ -89,12 +111,82 @@ size_t readAll(
     return numFramesRead;
 }
 
+class State;
+
+//* Disk streaming service shared by all disksampler instances of an engine.
+//
+// The service owns the stream buffers and performs all disk transfers on a
+// pool of dedicated I/O threads. Pending transfers are ordered by deadline,
+// i.e. the time at which a stream would run out of buffered frames, so that
+// nearly empty buffers are refilled before nearly full ones.
+class StreamingService
+{
+public:
+    StreamingService(const Methcla_Host* host, size_t numThreads);
+    ~StreamingService();
+
+    StreamingService(const StreamingService&) = delete;
+    StreamingService& operator=(const StreamingService&) = delete;
+
+    const Methcla_Host* host() const
+    {
+        return m_host;
+    }
+
+    //* Allocate a stream buffer.
+    float* allocBuffer(size_t channels, size_t frames);
+    //* Free a stream buffer allocated by allocBuffer.
+    void freeBuffer(float* buffer);
+
+    //* Schedule a transfer for stream that needs to complete before deadline.
+    void schedule(State* stream, Methcla_Time deadline);
+
+    //* Perform a command in the realtime context unless the service is shutting down.
+    void perform(Methcla_WorldPerformFunction perform, void* data);
+
+    //* Forget a stream that is being destroyed.
+    void remove(State* stream);
+
+private:
+    struct Transfer
+    {
+        Methcla_Time    deadline;
+        State*          stream;
+
+        // Reversed for std::priority_queue: earliest deadline on top.
+        bool operator<(const Transfer& other) const
+        {
+            return deadline > other.deadline;
+        }
+    };
+
+    void process();
+
+private:
+    const Methcla_Host*             m_host;
+    std::mutex                      m_mutex;
+    std::condition_variable         m_cond;
+    bool                            m_continue;
+    std::priority_queue<Transfer>   m_queue;
+    std::vector<std::thread>        m_threads;
+    // Streams that have been scheduled at least once and not destroyed yet.
+    std::unordered_set<State*>      m_streams;
+};
+
 class State
 {
+    friend class StreamingService;
+
+    typedef std::chrono::steady_clock Clock;
+
     std::atomic<int> m_state;
 
     int m_refCount;
 
+    StreamingService* m_service;
+    Methcla_Time m_deadline;
+    Clock::time_point m_requestTime;
+
     char m_path[FILENAME_MAX];
     bool m_loop;
 
@@ -104,29 +196,68 @@ class State
     int64_t m_startFrame;
     int64_t m_fileFrames;
 
+    double m_sampleRate;
+    // Buffer frames consumed per engine frame during the last refill.
+    float m_rate;
+    // Ratio of the sound file's sample rate to the engine's sample rate.
+    float m_rateScale;
+
     size_t m_transferFrames;
     size_t m_bufferFrames;
     float* m_buffer;
 
+    // Buffer handed over from a streaming thread when resizing.
+    float* m_nextBuffer;
+    size_t m_nextBufferFrames;
+    size_t m_nextWritePos;
+    size_t m_nextReadPos;
+    StateVar m_nextState;
+
     double m_phase;
 
+    // Statistics
+    std::atomic<uint32_t> m_underruns;
+    std::atomic<uint32_t> m_overflows;
+    std::atomic<uint64_t> m_bytesRead;
+    std::atomic<float> m_refillLatency;
+    std::atomic<float> m_maxRefillLatency;
+    uint32_t m_lastUnderruns;
+    size_t m_underrunTransfers;
+
     std::atomic<size_t> m_readPos;
     // Force read and write pointers to different cache lines.
     char m_padding[kCacheLineSize-sizeof(m_readPos)];
     std::atomic<size_t> m_writePos;
 
 public:
-    State(const char* path, bool loop, int64_t startFrame, int64_t fileFrames, size_t bufferFrames)
+    State(StreamingService* service, const char* path, bool loop, int64_t startFrame, int64_t fileFrames, double sampleRate, size_t bufferFrames)
        : m_state(kInitializing)
        , m_refCount(1)
+       , m_service(service)
+       , m_deadline(0.)
        , m_loop(loop)
        , m_channels(0)
        , m_startFrame(startFrame)
        , m_fileFrames(fileFrames)
+       , m_sampleRate(sampleRate)
+       , m_rate(1.f)
+       , m_rateScale(1.f)
        , m_transferFrames(0)
        , m_bufferFrames(bufferFrames)
        , m_buffer(nullptr)
+       , m_nextBuffer(nullptr)
+       , m_nextBufferFrames(0)
+       , m_nextWritePos(0)
+       , m_nextReadPos(0)
+       , m_nextState(kIdle)
        , m_phase(0.)
+       , m_underruns(0)
+       , m_overflows(0)
+       , m_bytesRead(0)
+       , m_refillLatency(0.f)
+       , m_maxRefillLatency(0.f)
+       , m_lastUnderruns(0)
+       , m_underrunTransfers(0)
        , m_readPos(0)
        , m_writePos(0)
     {
@@ -162,6 +293,11 @@ public:
         return m_bufferFrames;
     }
 
+    float rateScale() const
+    {
+        return m_rateScale;
+    }
+
     size_t transferFrames() const
     {
         return m_transferFrames;
@@ -174,7 +310,8 @@ public:
 
     void initBuffer(const Methcla_World* world)
     {
-        performCommand(world, initBufferCallback);
+        // Nothing to play until the first transfer has completed.
+        scheduleTransfer(world, methcla_world_current_time(world));
     }
 
     inline void release(const Methcla_World* world)
@@ -192,10 +329,55 @@ public:
         m_state.store(kFinished, std::memory_order_relaxed);
     }
 
-    void fillBuffer(const Methcla_World* world)
+    //* Request a buffer refill.
+    //
+    // numFramesReadable frames are left in the buffer and consumed at the
+    // given playback rate, scaled to the sound file's sample rate, until the
+    // stream runs dry.
+    void fillBuffer(const Methcla_World* world, size_t numFramesReadable, float rate)
     {
         m_state.store(kFilling, std::memory_order_relaxed);
-        performCommand(world, fillBufferCallback);
+        m_rate = rate * m_rateScale;
+
+        const double framesPerSecond = std::abs(m_rate) * m_sampleRate;
+        const Methcla_Time deadline =
+            framesPerSecond > 0.
+                ? methcla_world_current_time(world) + numFramesReadable / framesPerSecond
+                : std::numeric_limits<Methcla_Time>::max();
+
+        scheduleTransfer(world, deadline);
+    }
+
+    //* Perform a pending transfer in the context of a streaming thread.
+    void transfer(const Methcla_Host* host)
+    {
+        if (state() == kInitializing)
+            initBuffer(host);
+        else
+            fillBuffer(host);
+    }
+
+    void underrun()
+    {
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t statistics(int32_t* values, size_t size) const
+    {
+        const int32_t stats[kMethcla_DiskSamplerNumStatistics] = {
+            (int32_t)m_underruns.load(std::memory_order_relaxed),
+            (int32_t)m_overflows.load(std::memory_order_relaxed),
+            (int32_t)(m_bytesRead.load(std::memory_order_relaxed) / 1024),
+            (int32_t)(m_refillLatency.load(std::memory_order_relaxed) * 1e6f),
+            (int32_t)(m_maxRefillLatency.load(std::memory_order_relaxed) * 1e6f),
+            (int32_t)m_bufferFrames,
+            (int32_t)(state() == kMemoryPlayback
+                        ? m_bufferFrames
+                        : readable(writePos(), readPos(), m_bufferFrames))
+        };
+        const size_t n = std::min<size_t>(size, kMethcla_DiskSamplerNumStatistics);
+        std::copy(stats, stats + n, values);
+        return n;
     }
 
     size_t readPos() const
@@ -228,15 +410,32 @@ public:
         return w >= r ? w - r : w + n - r;
     }
 
+    //* Return the number of frames that can be written without overwriting readable frames or the kMinInterpFrames frames preceding the read position.
     inline static size_t writable(size_t w, size_t r, size_t n)
     {
-        return w >= r ? r - w + n - 1 : r - w - 1;
+        const size_t numFramesFree = w >= r ? r - w + n - 1 : r - w - 1;
+        return numFramesFree > kMinInterpFrames ? numFramesFree - kMinInterpFrames : 0;
+    }
+
+    //* Copy the kMinInterpFrames frames preceding readPos in the current buffer to the end of buffer.
+    void copyInterpFrames(float* buffer, size_t bufferFrames, size_t readPos) const
+    {
+        for (size_t i=0; i < kMinInterpFrames; i++)
+        {
+            const size_t src = (readPos + m_bufferFrames - kMinInterpFrames + i) % m_bufferFrames;
+            const size_t dst = bufferFrames - kMinInterpFrames + i;
+            std::copy(
+                m_buffer + m_channels * src,
+                m_buffer + m_channels * (src + 1),
+                buffer + m_channels * dst);
+        }
     }
 
 private:
     ~State()
     {
-        delete [] m_buffer;
+        if (m_buffer != nullptr)
+            m_service->freeBuffer(m_buffer);
     }
 
     static void freeCallback(const Methcla_World* world, void* data)
@@ -244,12 +443,15 @@ private:
         methcla_world_free(world, data);
     }
 
-    static void destroyCallback(const Methcla_Host* host, void* data)
+    static void destroyCallback(const Methcla_Host*, void* data)
     {
+        State* self = static_cast<State*>(data);
+        StreamingService* service = self->m_service;
+        service->remove(self);
         // Call destructor
-        static_cast<State*>(data)->~State();
+        self->~State();
         // Free memory allocated from RT heap
-        methcla_host_perform_command(host, freeCallback, data);
+        service->perform(freeCallback, data);
     }
 
     static void releaseCallback(const Methcla_World* world, void* data)
@@ -258,15 +460,105 @@ private:
     }
 
     // Release from host context
-    void release(const Methcla_Host* host)
+    void release(const Methcla_Host*)
     {
-        methcla_host_perform_command(host, releaseCallback, this);
+        m_service->perform(releaseCallback, this);
     }
 
-    void performCommand(const Methcla_World* world, Methcla_HostPerformFunction func)
+    void scheduleTransfer(const Methcla_World* world, Methcla_Time deadline)
     {
         m_refCount++;
-        methcla_world_perform_command(world, func, this);
+        m_deadline = deadline;
+        m_requestTime = Clock::now();
+        methcla_world_perform_command(world, scheduleTransferCallback, this);
+    }
+
+    static void scheduleTransferCallback(const Methcla_Host*, void* data)
+    {
+        State* self = static_cast<State*>(data);
+        self->m_service->schedule(self, self->m_deadline);
+    }
+
+    void freeBuffer()
+    {
+        if (m_buffer != nullptr)
+        {
+            m_service->freeBuffer(m_buffer);
+            m_buffer = nullptr;
+        }
+    }
+
+    void updateRefillLatency()
+    {
+        const float latency = std::chrono::duration<float>(Clock::now() - m_requestTime).count();
+        // Track peaks immediately and let the estimate decay slowly afterwards.
+        m_refillLatency.store(
+            std::max(latency, (float)kRefillLatencyDecay * m_refillLatency.load(std::memory_order_relaxed)),
+            std::memory_order_relaxed);
+        if (latency > m_maxRefillLatency.load(std::memory_order_relaxed))
+            m_maxRefillLatency.store(latency, std::memory_order_relaxed);
+    }
+
+    //* Return the number of transfers per buffer needed to bridge the refill latency at the current playback rate.
+    size_t numTransfersPerBuffer()
+    {
+        // Grow the buffer by one transfer for every refill cycle with underruns.
+        const uint32_t underruns = m_underruns.load(std::memory_order_relaxed);
+        if (underruns != m_lastUnderruns)
+        {
+            m_lastUnderruns = underruns;
+            m_underrunTransfers = std::min(m_underrunTransfers + 1, kMaxTransfersPerBuffer);
+        }
+
+        // Frames consumed while a refill is in flight.
+        const double latencyFrames =
+            std::abs(m_rate) * m_sampleRate
+          * kRefillLatencyHeadroom * m_refillLatency.load(std::memory_order_relaxed);
+
+        // A refill is requested as soon as one transfer fits into the buffer;
+        // the remaining transfers need to cover the latency.
+        const size_t numTransfers =
+            1 + (size_t)std::ceil(latencyFrames / m_transferFrames) + m_underrunTransfers;
+
+        return std::max(kMinTransfersPerBuffer, std::min(numTransfers, kMaxTransfersPerBuffer));
+    }
+
+    //* Read from the sound file into buffer starting at writePos, filling at most numFramesFree frames in multiples of the transfer size.
+    //
+    // Return the new write position and set endOfFile if the end of a non-looping file was reached.
+    size_t readTransfers(float* buffer, size_t bufferFrames, size_t writePos, size_t numFramesFree, bool& endOfFile)
+    {
+        // Coalesce all transfers that fit into the free space of the buffer,
+        // splitting the read only at the end of the buffer.
+        size_t numFramesToRead = (numFramesFree / m_transferFrames) * m_transferFrames;
+        endOfFile = false;
+
+        while (numFramesToRead > 0 && !endOfFile)
+        {
+            const size_t numFramesRequested =
+                std::min(numFramesToRead, bufferFrames - writePos);
+
+            const size_t numFrames = readAll(
+                m_file,
+                buffer + m_channels * writePos,
+                m_channels,
+                numFramesRequested,
+                m_loop,
+                m_startFrame);
+
+            assert( !m_loop || (numFrames == numFramesRequested) );
+
+            m_bytesRead.fetch_add(framesToBytes(m_channels, numFrames), std::memory_order_relaxed);
+
+            writePos += numFrames;
+            if (writePos == bufferFrames)
+                writePos = 0;
+
+            numFramesToRead -= numFrames;
+            endOfFile = numFrames < numFramesRequested;
+        }
+
+        return writePos;
     }
 
     void initBuffer(const Methcla_Host* host)
@@ -276,6 +568,9 @@ private:
             m_file = std::move(Methcla::SoundFile(host, m_path));
 
             m_channels = m_file.info().channels;
+            // Streams are not converted; play back at the file's sample rate instead.
+            if (m_file.info().samplerate > 0)
+                m_rateScale = m_file.info().samplerate / m_sampleRate;
             m_startFrame = std::min(std::max<int64_t>(0, m_startFrame), m_file.info().frames);
             m_fileFrames = m_fileFrames < 0
                             ? m_file.info().frames - m_startFrame
@@ -300,11 +595,12 @@ private:
                 // read the entire contents and play back directly from memory.
                 m_transferFrames = 0;
                 m_bufferFrames = m_fileFrames;
-                m_buffer = new float[framesToBytes(m_channels, m_bufferFrames)];
+                m_buffer = m_service->allocBuffer(m_channels, m_bufferFrames);
 
                 const size_t numFrames = m_file.read(m_buffer, m_bufferFrames);
                 if (numFrames != m_bufferFrames)
                     throw std::exception();
+                m_bytesRead.fetch_add(framesToBytes(m_channels, numFrames), std::memory_order_relaxed);
 
                 // After having read the whole file close it right away.
                 // FIXME: In order to keep latency low, maybe better do it later.
@@ -315,11 +611,18 @@ private:
             {
                 // Load the first transferFrames into memory for streaming.
                 m_bufferFrames = m_transferFrames * kNumTransfersPerBuffer;
-                m_buffer = new float[framesToBytes(m_channels, m_bufferFrames)];
+                m_buffer = m_service->allocBuffer(m_channels, m_bufferFrames);
+
+                // The interpolation kernel reads the end of the buffer before the start of the file.
+                std::fill(
+                    m_buffer + m_channels * (m_bufferFrames - kMinInterpFrames),
+                    m_buffer + m_channels * m_bufferFrames,
+                    0.f);
 
                 const size_t numFrames = m_file.read(m_buffer, m_transferFrames);
                 if (numFrames != m_transferFrames)
                     throw std::exception();
+                m_bytesRead.fetch_add(framesToBytes(m_channels, numFrames), std::memory_order_relaxed);
 
                 m_writePos.store(numFrames == m_bufferFrames ? 0 : numFrames, std::memory_order_release);
                 m_state.store(kIdle, std::memory_order_release);
@@ -330,27 +633,30 @@ private:
             finish();
             if (m_file)
                 m_file.close();
-            if (m_buffer != nullptr)
-            {
-                delete [] m_buffer;
-                m_buffer = nullptr;
-            }
+            freeBuffer();
         }
 
         release(host);
     }
 
-    static void initBufferCallback(const Methcla_Host* host, void* data)
-    {
-        static_cast<State*>(data)->initBuffer(host);
-    }
-
     inline void fillBuffer(const Methcla_Host* host)
     {
-        const size_t writePos = m_writePos.load(std::memory_order_relaxed);
-
         assert( (m_bufferFrames % m_transferFrames) == 0 );
 
+        updateRefillLatency();
+
+        const size_t numTransfers = numTransfersPerBuffer();
+        const size_t currentNumTransfers = m_bufferFrames / m_transferFrames;
+
+        // Grow right away, shrink only if the buffer is considerably too large.
+        if (numTransfers > currentNumTransfers || 2 * numTransfers <= currentNumTransfers)
+        {
+            if (resizeBuffer(host, numTransfers * m_transferFrames))
+                return;
+        }
+
+        const size_t writePos = m_writePos.load(std::memory_order_relaxed);
+
         try
         {
             const size_t writeSpace =
@@ -362,6 +668,7 @@ private:
 
             if (writeSpace < m_transferFrames)
             {
+                m_overflows.fetch_add(1, std::memory_order_relaxed);
                 Methcla::Plugin::HostContext(host).log(kMethcla_LogError)
                     << METHCLA_PLUGINS_DISKSAMPLER_URI
                     << ": buffer overflow"
@@ -372,23 +679,13 @@ private:
             }
             else
             {
-                const size_t numFrames = readAll(
-                    m_file,
-                    m_buffer + m_channels * writePos,
-                    m_channels,
-                    m_transferFrames,
-                    m_loop,
-                    m_startFrame);
-
-                assert( !m_loop || (numFrames == m_transferFrames) );
-
-                const size_t nextWritePos = writePos + numFrames;
-                m_writePos.store(
-                    nextWritePos == m_bufferFrames ? 0 : nextWritePos,
-                    std::memory_order_release
-                );
+                bool endOfFile;
+                const size_t nextWritePos =
+                    readTransfers(m_buffer, m_bufferFrames, writePos, writeSpace, endOfFile);
 
-                if (!m_loop && (numFrames < m_transferFrames)) {
+                m_writePos.store(nextWritePos, std::memory_order_release);
+
+                if (!m_loop && endOfFile) {
                     m_state.store(kFinishing, std::memory_order_release);
                 } else {
                     m_state.store(kIdle, std::memory_order_release);
@@ -403,16 +700,202 @@ private:
         release(host);
     }
 
-    static void fillBufferCallback(const Methcla_Host* host, void* data)
+    //* Replace the stream buffer by a buffer of bufferFrames frames.
+    //
+    // The frames not yet consumed are copied to the new buffer, the rest
+    // is filled from disk and the buffer is swapped in the realtime context.
+    // Return false if the buffer couldn't be resized.
+    bool resizeBuffer(const Methcla_Host* host, size_t bufferFrames)
     {
-        static_cast<State*>(data)->fillBuffer(host);
+        const size_t readPos = m_readPos.load(std::memory_order_acquire);
+        const size_t writePos = m_writePos.load(std::memory_order_relaxed);
+        const size_t numFramesReadable = readable(writePos, readPos, m_bufferFrames);
+
+        // Can't shrink below the number of frames not yet consumed.
+        if (numFramesReadable + m_transferFrames + kMinInterpFrames >= bufferFrames)
+            return false;
+
+        float* buffer;
+
+        try
+        {
+            buffer = m_service->allocBuffer(m_channels, bufferFrames);
+        }
+        catch (std::bad_alloc)
+        {
+            // Keep streaming with the current buffer.
+            return false;
+        }
+
+        try
+        {
+            const size_t numFrames1 = std::min(numFramesReadable, m_bufferFrames - readPos);
+            const size_t numFrames2 = numFramesReadable - numFrames1;
+            std::copy(
+                m_buffer + m_channels * readPos,
+                m_buffer + m_channels * (readPos + numFrames1),
+                buffer);
+            std::copy(
+                m_buffer,
+                m_buffer + m_channels * numFrames2,
+                buffer + m_channels * numFrames1);
+            // The new buffer starts at readPos; the frames preceding it wrap around.
+            copyInterpFrames(buffer, bufferFrames, readPos);
+
+            bool endOfFile;
+            m_nextWritePos = readTransfers(
+                buffer,
+                bufferFrames,
+                numFramesReadable,
+                writable(numFramesReadable, 0, bufferFrames),
+                endOfFile);
+            m_nextBuffer = buffer;
+            m_nextBufferFrames = bufferFrames;
+            m_nextReadPos = readPos;
+            m_nextState = !m_loop && endOfFile ? kFinishing : kIdle;
+        }
+        catch (std::exception)
+        {
+            m_service->freeBuffer(buffer);
+            finish();
+            release(host);
+            return true;
+        }
+
+        // Swapping the buffer releases the stream.
+        m_service->perform(swapBufferCallback, this);
+
+        return true;
+    }
+
+    static void freeBufferCallback(const Methcla_Host* host, void* data)
+    {
+        methcla_host_free_aligned(host, data);
+    }
+
+    void swapBuffer(const Methcla_World* world)
+    {
+        // Frames consumed since the contents were copied to the new buffer.
+        const size_t numFramesConsumed = readable(readPos(), m_nextReadPos, m_bufferFrames);
+
+        double phase = m_phase - m_nextReadPos;
+        if (phase < 0.)
+            phase += m_bufferFrames;
+
+        methcla_world_perform_command(world, freeBufferCallback, m_buffer);
+
+        m_buffer = m_nextBuffer;
+        m_bufferFrames = m_nextBufferFrames;
+        m_nextBuffer = nullptr;
+        m_phase = phase;
+        m_readPos.store(numFramesConsumed, std::memory_order_relaxed);
+        m_writePos.store(m_nextWritePos, std::memory_order_relaxed);
+        if (state() == kFilling)
+            m_state.store(m_nextState, std::memory_order_relaxed);
+
+        release(world);
+    }
+
+    static void swapBufferCallback(const Methcla_World* world, void* data)
+    {
+        static_cast<State*>(data)->swapBuffer(world);
     }
 };
 
+StreamingService::StreamingService(const Methcla_Host* host, size_t numThreads)
+    : m_host(host)
+    , m_continue(true)
+{
+    for (size_t i=0; i < std::max((size_t)1, numThreads); i++) {
+        m_threads.emplace_back([this](){ this->process(); });
+    }
+}
+
+StreamingService::~StreamingService()
+{
+    // The engine's worker has been stopped at this point, so commands posted
+    // to the realtime context would never be performed. Cancel pending
+    // transfers, stop posting and destroy the remaining streams directly;
+    // their realtime memory is reclaimed with the realtime memory pool.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_continue = false;
+        m_queue = std::priority_queue<Transfer>();
+    }
+    m_cond.notify_all();
+    for (auto& t : m_threads) { t.join(); }
+    for (State* stream : m_streams) { stream->~State(); }
+}
+
+float* StreamingService::allocBuffer(size_t channels, size_t frames)
+{
+    float* buffer = static_cast<float*>(
+        methcla_host_alloc_aligned(m_host, kCacheLineSize, framesToBytes(channels, frames)));
+    if (buffer == nullptr)
+        throw std::bad_alloc();
+    return buffer;
+}
+
+void StreamingService::freeBuffer(float* buffer)
+{
+    methcla_host_free_aligned(m_host, buffer);
+}
+
+void StreamingService::schedule(State* stream, Methcla_Time deadline)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_continue)
+            return;
+        m_streams.insert(stream);
+        m_queue.push({ deadline, stream });
+    }
+    m_cond.notify_one();
+}
+
+void StreamingService::perform(Methcla_WorldPerformFunction perform, void* data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_continue)
+        methcla_host_perform_command(m_host, perform, data);
+}
+
+void StreamingService::remove(State* stream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streams.erase(stream);
+}
+
+void StreamingService::process()
+{
+    for (;;)
+    {
+        Transfer transfer;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this](){ return !m_continue || !m_queue.empty(); });
+            if (!m_continue)
+                break;
+            transfer = m_queue.top();
+            m_queue.pop();
+        }
+        transfer.stream->transfer(m_host);
+    }
+}
+
 struct DiskSampler
 {
-    float* ports[kNumPorts];
+    float* ports[kPort_output_0 + kMaxOutputs];
+    size_t numOutputs;
     State* state;
+    Methcla_ResampleQuality quality;
+};
+
+//* Synth definition with a reference to the library's streaming service.
+struct DiskSamplerDef
+{
+    Methcla_SynthDef    def;
+    StreamingService*   service;
 };
 
 extern "C"
@@ -423,14 +906,27 @@ extern "C"
     static void disksampler_destroy(const Methcla_World*, Methcla_Synth*);
     static void disksampler_connect(Methcla_Synth*, Methcla_PortCount, void* data);
     static void disksampler_process(const Methcla_World*, Methcla_Synth*, size_t);
+    static size_t disksampler_statistics(const Methcla_World*, Methcla_Synth*, int32_t*, size_t);
 }
 
+struct DiskSamplerOptions
+{
+    const char* path;
+    bool loop;
+    size_t startFrame;
+    int32_t frames;
+    Methcla_ResampleQuality quality;
+    size_t numOutputs;
+};
+
 bool
 disksampler_port_descriptor(
-    const Methcla_SynthOptions* /* options */,
+    const Methcla_SynthOptions* inOptions,
     Methcla_PortCount index,
     Methcla_PortDescriptor* port )
 {
+    const DiskSamplerOptions* options =
+        static_cast<const DiskSamplerOptions*>(inOptions);
     switch ((PortIndex)index) {
         case kPort_amp:
         case kPort_rate:
@@ -438,25 +934,17 @@ disksampler_port_descriptor(
             port->direction = kMethcla_Input;
             port->flags = kMethcla_PortFlags;
             return true;
-        case kPort_output_0:
-        case kPort_output_1:
-            port->type = kMethcla_AudioPort;
-            port->direction = kMethcla_Output;
-            port->flags = kMethcla_PortFlags;
-            return true;
         default:
+            if (index < kPort_output_0 + options->numOutputs) {
+                port->type = kMethcla_AudioPort;
+                port->direction = kMethcla_Output;
+                port->flags = kMethcla_PortFlags;
+                return true;
+            }
             return false;
     }
 }
 
-struct DiskSamplerOptions
-{
-    const char* path;
-    bool loop;
-    size_t startFrame;
-    int32_t frames;
-};
-
 void
 disksampler_configure(
     const void* tags,
@@ -472,6 +960,8 @@ disksampler_configure(
     options->loop = argStream.atEnd() ? false : argStream.int32();
     options->startFrame = argStream.atEnd() ? 0 : std::max(0, argStream.int32());
     options->frames = argStream.atEnd() ? -1 : argStream.int32();
+    options->quality = argStream.atEnd() ? kMethcla_ResampleHermite : (Methcla_ResampleQuality)argStream.int32();
+    options->numOutputs = argStream.atEnd() ? kDefaultOutputs : std::min<size_t>(std::max(1, argStream.int32()), kMaxOutputs);
     // std::cout << "DiskSampler: "
     //           << options->path << " "
     //           << options->loop << " "
@@ -481,24 +971,30 @@ disksampler_configure(
 void
 disksampler_construct(
     const Methcla_World* world,
-    const Methcla_SynthDef* /* synthDef */,
+    const Methcla_SynthDef* synthDef,
     const Methcla_SynthOptions* inOptions,
     Methcla_Synth* synth )
 {
     const DiskSamplerOptions* options =
         static_cast<const DiskSamplerOptions*>(inOptions);
+    StreamingService* service =
+        reinterpret_cast<const DiskSamplerDef*>(synthDef)->service;
 
     DiskSampler* self = (DiskSampler*)synth;
 
+    self->numOutputs = options->numOutputs;
+    self->quality = options->quality;
     self->state = static_cast<State*>(methcla_world_alloc(world, sizeof(State)));
 
     if (self->state != nullptr)
     {
         new (self->state) State(
+            service,
             options->path,
             options->loop,
             options->startFrame,
             options->frames,
+            methcla_world_samplerate(world),
             methcla_world_block_size(world)
         );
 
@@ -535,262 +1031,6 @@ static void reportUnderrun(
         << ", missing " << numFramesNeeded - numFramesProvided;
 }
 
-static inline void
-process_disk(
-    const Methcla_World* world,
-    DiskSampler* self,
-    size_t numFrames,
-    float amp,
-    const float* buffer,
-    float* out0,
-    float* out1,
-    StateVar state )
-{
-    assert( self->state->isValid() );
-
-    const size_t bufferFrames = self->state->bufferFrames();
-    const size_t writePos = self->state->writePos();
-    const size_t readPos = self->state->readPos();
-
-    if (   state == kIdle
-        && State::writable(writePos, readPos, bufferFrames) >= self->state->transferFrames())
-    {
-        // Trigger refill
-        self->state->fillBuffer(world);
-    }
-
-    const size_t readable = std::min(numFrames, State::readable(writePos, readPos, bufferFrames));
-    const size_t readable1 = std::min(readable, bufferFrames - readPos);
-    const size_t readable2 = readable - readable1;
-    const size_t bufferChannels = self->state->bufferChannels();
-
-    if (bufferChannels == 1)
-    {
-        for (size_t k = 0; k < readable1; k++)
-        {
-            out0[k] = out1[k] = amp * buffer[(readPos+k)*bufferChannels];
-        }
-        for (size_t k = 0; k < readable2; k++)
-        {
-            out0[readable1+k] = out1[readable1+k] = amp * buffer[k*bufferChannels];
-        }
-        for (size_t k = readable; k < numFrames; k++)
-        {
-            out0[k] = out1[k] = 0.f;
-        }
-    }
-    else
-    {
-        for (size_t k = 0; k < readable1; k++)
-        {
-            const size_t j = (readPos+k)*bufferChannels;
-            out0[k] = amp * buffer[j];
-            out1[k] = amp * buffer[j+1];
-        }
-        for (size_t k = 0; k < readable2; k++)
-        {
-            const size_t m = readable1+k;
-            const size_t j = k*bufferChannels;
-            out0[m] = amp * buffer[j];
-            out1[m] = amp * buffer[j+1];
-        }
-        for (size_t k = readable; k < numFrames; k++)
-        {
-            out0[k] = out1[k] = 0.f;
-        }
-    }
-
-    if (readable < numFrames)
-    {
-        if (state == kFinishing)
-        {
-            self->state->finish();
-        }
-        else
-        {
-            reportUnderrun(world, numFrames, readable);
-        }
-    }
-
-    const size_t nextReadPos = readable2 > 0 ? readable2 : readPos + readable1;
-    self->state->setReadPos(nextReadPos == bufferFrames ? 0 : nextReadPos);
-}
-
-static inline void
-process_memory(
-    DiskSampler* self,
-    size_t numFrames,
-    float amp,
-    const float* buffer,
-    float* out0,
-    float* out1 )
-{
-    size_t pos = self->state->readPos();
-    const size_t left = self->state->bufferFrames() - pos;
-    const size_t channels = self->state->bufferChannels();
-
-    if (left >= numFrames) {
-        if (channels == 1) {
-            for (size_t k = 0; k < numFrames; k++) {
-                out0[k] = out1[k] = amp * buffer[(pos+k)*channels];
-            }
-        } else {
-            for (size_t k = 0; k < numFrames; k++) {
-                const size_t j = (pos+k)*channels;
-                out0[k] = amp * buffer[j];
-                out1[k] = amp * buffer[j+1];
-            }
-        }
-        if (left == numFrames) {
-            if (self->state->loop()) self->state->setReadPos(0);
-            else self->state->finish();
-        } else {
-            self->state->setReadPos(pos + numFrames);
-        }
-    } else if (self->state->loop()) {
-        size_t played = 0;
-        size_t toPlay = left;
-        while (played < numFrames) {
-            if (channels == 1) {
-                for (size_t k = 0; k < toPlay; k++) {
-                    const size_t m = played+k;
-                    out0[m] = out1[m] = amp * buffer[(pos+k)*channels];
-                }
-            } else {
-                for (size_t k = 0; k < toPlay; k++) {
-                    const size_t m = played+k;
-                    const size_t j = (pos+k)*channels;
-                    out0[m] = amp * buffer[j];
-                    out1[m] = amp * buffer[j+1];
-                }
-            }
-            played += toPlay;
-            pos += toPlay;
-            if (pos >= self->state->bufferFrames())
-                pos = 0;
-            toPlay = std::min<size_t>(numFrames - played, self->state->bufferFrames());
-        }
-        self->state->setReadPos(pos);
-    } else {
-        if (channels == 1) {
-            for (size_t k = 0; k < left; k++) {
-                out0[k] = out1[k] = amp * buffer[(pos+k)*channels];
-            }
-        } else {
-            for (size_t k = 0; k < left; k++) {
-                const size_t j = (pos+k)*channels;
-                out0[k] = amp * buffer[j];
-                out1[k] = amp * buffer[j+1];
-            }
-        }
-        for (size_t k = left; k < numFrames; k++) {
-            out0[k] = out1[k] = 0.f;
-        }
-        self->state->finish();
-    }
-}
-
-static inline float hermite1(float x, float y0, float y1, float y2, float y3)
-{
-    // 4-point, 3rd-order Hermite (x-form)
-    const float c0 = y1;
-    const float c1 = 0.5f * (y2 - y0);
-    const float c2 = y0 - 2.5f * y1 + 2.f * y2 - 0.5f * y3;
-    const float c3 = 1.5f * (y1 - y2) + 0.5f * (y3 - y0);
-
-    return ((c3 * x + c2) * x + c1) * x + c0;
-}
-
-template <bool wrapInterp, bool wrapPhase>
-inline size_t
-resample(
-    float* out0,
-    float* out1,
-    size_t numFrames,
-    const float* buffer,
-    size_t bufferChannels,
-    size_t bufferFrames,
-    size_t bufferEnd,
-    float amp,
-    float rate,
-    double& phase )
-{
-    const size_t bufferChannel1 = 0;
-    const size_t bufferChannel2 = bufferChannels > 1 ? 1 : 0;
-    const double maxPhase = (double)bufferFrames;
-
-    size_t k;
-
-    for (k=0; k < numFrames; k++)
-    {
-        const double findex = std::floor(phase);
-        const size_t index = (size_t)findex;
-
-        const float* xm;
-        const float* x0;
-        const float* x1;
-        const float* x2;
-
-        if (index == 0)
-        {
-            if (wrapInterp)
-                xm = buffer + (bufferFrames - 1) * bufferChannels;
-            else
-                xm = buffer;
-        }
-        else
-        {
-            xm = buffer + (index - 1) * bufferChannels;
-        }
-
-        if (index < bufferEnd - 2)
-        {
-            x0 = buffer + index * bufferChannels;
-            x1 = x0 + bufferChannels;
-            x2 = x1 + bufferChannels;
-        }
-        else if (index < bufferEnd - 1)
-        {
-            x0 = buffer + index * bufferChannels;
-            x1 = x0 + bufferChannels;
-            if (wrapInterp)
-                x2 = buffer;
-            else
-                x2 = x1;
-        }
-        else if (index < bufferEnd)
-        {
-            x0 = buffer + index * bufferChannels;
-            if (wrapInterp)
-            {
-                x1 = buffer;
-                x2 = buffer + bufferChannels;
-            }
-            else
-            {
-                x1 = x0;
-                x2 = x0;
-            }
-        }
-        else
-        {
-            break;
-        }
-
-        const double x = phase - findex;
-
-        out0[k] = amp * hermite1(x, xm[bufferChannel1], x0[bufferChannel1], x1[bufferChannel1], x2[bufferChannel1]);
-        out1[k] = amp * hermite1(x, xm[bufferChannel2], x0[bufferChannel2], x1[bufferChannel2], x2[bufferChannel2]);
-
-        phase += rate;
-
-        if (wrapPhase && phase >= maxPhase)
-            phase -= maxPhase;
-    }
-
-    return k;
-}
-
 static inline void
 process_disk_interp(
     const Methcla_World* world,
@@ -799,8 +1039,7 @@ process_disk_interp(
     float amp,
     float rate,
     const float* buffer,
-    float* out0,
-    float* out1,
+    float* const* outputs,
     StateVar state )
 {
     assert( self->state->isValid() );
@@ -814,78 +1053,38 @@ process_disk_interp(
     if (state == kIdle)
     {
         if (State::writable(writePos, readPos, bufferFrames)
-            >= (self->state->transferFrames() + kMinInterpFrames))
+            >= self->state->transferFrames())
         {
             // Trigger refill
-            self->state->fillBuffer(world);
+            self->state->fillBuffer(world, State::readable(writePos, readPos, bufferFrames), rate);
         }
     }
 
-    const size_t readable  = State::readable(writePos, readPos, bufferFrames);
-    const size_t readable1 = std::min(readable, bufferFrames - readPos);
-    const size_t readable2 = readable - readable1;
+    const size_t readable = State::readable(writePos, readPos, bufferFrames);
 
     double phase = self->state->phase();
+    rate *= self->state->rateScale();
     using namespace std;
     assert((size_t)trunc(phase) == readPos);
 
-    size_t numFramesProduced = 0;
-
-    if (readable > 0)
-    {
-        if (readable2 > 0)
-        {
-            numFramesProduced = resample<true,true>(
-                out0,
-                out1,
-                numFrames,
-                buffer,
-                bufferChannels,
-                bufferFrames,
-                bufferFrames,
-                amp,
-                rate,
-                phase
-            );
-            if (numFramesProduced < numFrames)
-            {
-                numFramesProduced += resample<true,true>(
-                    out0 + numFramesProduced,
-                    out1 + numFramesProduced,
-                    numFrames - numFramesProduced,
-                    buffer,
-                    bufferChannels,
-                    bufferFrames,
-                    readable2,
-                    amp,
-                    rate,
-                    phase
-                );
-            }
-        }
-        else
-        {
-            numFramesProduced = resample<false,true>(
-                out0,
-                out1,
-                numFrames,
-                buffer,
-                bufferChannels,
-                bufferFrames,
-                readPos + readable1,
-                amp,
-                rate,
-                phase
-            );
-        }
-    }
+    // The stream buffer is a ring buffer; only the readable frames are valid.
+    const Methcla::Plugin::Resample::Source source = { buffer, kMethcla_SoundFileFormatFloat, bufferChannels, bufferFrames, true };
+    const size_t numFramesProduced =
+        Methcla::Plugin::Resample::resample(
+            self->quality,
+            source,
+            readPos + readable,
+            phase,
+            rate,
+            amp,
+            outputs,
+            self->numOutputs,
+            numFrames
+        );
 
     if (numFramesProduced < numFrames)
     {
-        for (size_t k=numFramesProduced; k < numFrames; k++)
-        {
-            out0[k] = out1[k] = 0.f;
-        }
+        Methcla::Plugin::Resample::clear(outputs, self->numOutputs, numFramesProduced, numFrames);
 
         if (state == kFinishing)
         {
@@ -893,6 +1092,7 @@ process_disk_interp(
         }
         else
         {
+            self->state->underrun();
             reportUnderrun(world, numFrames, numFramesProduced);
         }
     }
@@ -912,57 +1112,31 @@ process_memory_interp(
     float amp,
     float rate,
     const float* buffer,
-    float* out0,
-    float* out1 )
+    float* const* outputs )
 {
     const size_t bufferFrames = self->state->bufferFrames();
-    const size_t bufferChannels = self->state->bufferChannels();
+    const bool loop = self->state->loop();
     double phase = self->state->phase();
-
-    if (self->state->loop())
-    {
-        size_t numFramesProduced = 0;
-
-        while (numFramesProduced < numFrames)
-        {
-            numFramesProduced += resample<true,true>(
-                out0 + numFramesProduced,
-                out1 + numFramesProduced,
-                numFrames - numFramesProduced,
-                buffer,
-                bufferChannels,
-                bufferFrames,
-                bufferFrames,
-                amp,
-                rate,
-                phase
-            );
-        }
-
-        assert(numFramesProduced == numFrames);
-    }
-    else
-    {
-        const size_t numFramesProduced = resample<false,false>(
-            out0,
-            out1,
-            numFrames,
-            buffer,
-            bufferChannels,
-            bufferFrames,
-            bufferFrames,
-            amp,
+    rate *= self->state->rateScale();
+
+    const Methcla::Plugin::Resample::Source source = { buffer, kMethcla_SoundFileFormatFloat, self->state->bufferChannels(), bufferFrames, loop };
+    const size_t numFramesProduced =
+        Methcla::Plugin::Resample::resample(
+            self->quality,
+            source,
+            loop ? std::numeric_limits<int64_t>::max() : (int64_t)bufferFrames,
+            phase,
             rate,
-            phase
+            amp,
+            outputs,
+            self->numOutputs,
+            numFrames
         );
 
-        if (numFramesProduced < numFrames)
-        {
-            for (size_t k = numFramesProduced; k < numFrames; k++) {
-                out0[k] = out1[k] = 0.f;
-            }
-            self->state->finish();
-        }
+    if (numFramesProduced < numFrames)
+    {
+        Methcla::Plugin::Resample::clear(outputs, self->numOutputs, numFramesProduced, numFrames);
+        self->state->finish();
     }
 
     self->state->setPhase(phase);
@@ -978,8 +1152,7 @@ disksampler_process(
 
     const float amp = *self->ports[kPort_amp];
     const float rate = *self->ports[kPort_rate];
-    float* out0 = self->ports[kPort_output_0];
-    float* out1 = self->ports[kPort_output_1];
+    float* const* outputs = self->ports + kPort_output_0;
     const float* buffer = self->state->buffer();
 
     const StateVar state = self->state->state();
@@ -989,28 +1162,29 @@ disksampler_process(
         case kIdle:
         case kFilling:
         case kFinishing:
-#if METHCLA_PLUGINS_DISKSAMPLER_USE_RESAMPLING
-        process_disk_interp(world, self, numFrames, amp, rate, buffer, out0, out1, state);
-#else
-        process_disk(world, self, numFrames, amp, buffer, out0, out1, state);
-#endif
+        process_disk_interp(world, self, numFrames, amp, rate, buffer, outputs, state);
         break;
         case kMemoryPlayback:
-#if METHCLA_PLUGINS_DISKSAMPLER_USE_RESAMPLING
-        process_memory_interp(self, numFrames, amp, rate, buffer, out0, out1);
-#else
-        process_memory(self, numFrames, amp, buffer, out0, out1);
-#endif
+        process_memory_interp(self, numFrames, amp, rate, buffer, outputs);
         break;
         case kInitializing:
         case kFinished:
-        for (size_t k = 0; k < numFrames; k++) {
-            out0[k] = out1[k] = 0.f;
-        }
+        Methcla::Plugin::Resample::clear(outputs, self->numOutputs, 0, numFrames);
         break;
     }
 }
 
+static size_t
+disksampler_statistics(
+    const Methcla_World* /* world */,
+    Methcla_Synth* synth,
+    int32_t* values,
+    size_t size )
+{
+    const State* state = static_cast<DiskSampler*>(synth)->state;
+    return state ? state->statistics(values, size) : 0;
+}
+
 static const Methcla_SynthDef kDiskSamplerDef =
 {
     METHCLA_PLUGINS_DISKSAMPLER_URI,
@@ -1022,16 +1196,53 @@ static const Methcla_SynthDef kDiskSamplerDef =
     disksampler_connect,
     nullptr,
     disksampler_process,
-    disksampler_destroy
+    disksampler_destroy,
+    disksampler_statistics
 };
 
-static const Methcla_Library kDiskSamplerLibrary = { nullptr, nullptr };
+class DiskSamplerLibrary
+{
+public:
+    DiskSamplerLibrary(const Methcla_Host* host)
+        : m_service(host, kNumStreamingThreads)
+    {
+        m_library.handle = this;
+        m_library.destroy = destroy;
+        m_synthDef.def = kDiskSamplerDef;
+        m_synthDef.service = &m_service;
+    }
+
+    const Methcla_Library* library() const
+    {
+        return &m_library;
+    }
+
+    const Methcla_SynthDef* synthDef() const
+    {
+        return &m_synthDef.def;
+    }
+
+private:
+    static void destroy(const Methcla_Library* library)
+    {
+        // Stops the streaming threads.
+        delete static_cast<DiskSamplerLibrary*>(library->handle);
+    }
+
+private:
+    Methcla_Library     m_library;
+    DiskSamplerDef      m_synthDef;
+    StreamingService    m_service;
+};
 
 METHCLA_EXPORT const Methcla_Library*
 methcla_plugins_disksampler(
     const Methcla_Host* host,
     const char* /* bundlePath */)
 {
-    methcla_host_register_synthdef(host, &kDiskSamplerDef);
-    return &kDiskSamplerLibrary;
+    // Compute the interpolation tables outside the realtime context.
+    Methcla::Plugin::Resample::sincTable();
+    DiskSamplerLibrary* library = new DiskSamplerLibrary(host);
+    methcla_host_register_synthdef(host, library->synthDef());
+    return library->library();
 }
@@ -0,0 +1,533 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <methcla/plugins/filterbank.h>
+#include <methcla/plugins/simd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <oscpp/server.hpp>
+
+namespace
+{
+
+static const double kPi = 3.14159265358979323846264338327950288;
+
+static const size_t kMaxFilters = 256;
+static const size_t kMaxStages = 4;
+
+// Filters are processed in groups of four, one filter per vector lane.
+static const size_t kLanes = 4;
+
+// Control inputs per filter: type, frequency, Q and gain.
+static const size_t kNumParams = 4;
+// Coefficients per filter: b0, b1, b2, a1, a2 (normalized by a0).
+static const size_t kNumCoeffs = 5;
+
+// Duration of the coefficient interpolation after a change in seconds.
+static const double kSmoothingTime = 0.005;
+
+// State magnitude below which filter states are flushed to zero at the end
+// of each block, so that decaying filters never reach denormal numbers.
+static const float kFlushThreshold = 1e-15f;
+
+struct Options
+{
+    size_t numFilters;
+    size_t numStages;
+    bool bands;
+};
+
+struct Design;
+
+// Filter state and coefficients are kept in structure of arrays layout,
+// padded to a multiple of kLanes filters. Padding filters have zero
+// coefficients.
+typedef struct {
+    size_t numFilters;
+    size_t numGroups;
+    size_t numStages;
+    size_t numInputs;
+    // Control inputs (kNumParams groups of numFilters) and audio inputs.
+    float** ports;
+    // Current coefficients, kNumCoeffs groups of numGroups * kLanes.
+    float* coeffs;
+    // Coefficients being interpolated to and their increments per frame.
+    float* target;
+    float* coeffsInc;
+    size_t rampLength;
+    size_t rampFrames;
+    // Transposed direct form II state, z1 and z2 of each stage.
+    float* state;
+    Design* design;
+    // Audio outputs; kept in the synth so that they can be cleared if the
+    // filters couldn't be allocated.
+    float* outputs[kMaxFilters];
+} Synth;
+
+// Coefficient computation request, shared between the synth and the
+// worker thread. The reference count is only accessed in the realtime
+// context; the parameters and coefficients are only written by the realtime
+// context while no request is pending.
+struct Design
+{
+    size_t refCount;
+    bool pending;
+    // Synth to pass the coefficients to, nullptr after the synth has been destroyed.
+    Synth* synth;
+    size_t numFilters;
+    size_t numLanes;
+    double sampleRate;
+    // Control values the coefficients are computed from.
+    float* params;
+    float* coeffs;
+};
+
+// Declare callback with C linkage
+extern "C"
+{
+    static bool
+    port_descriptor( const Methcla_SynthOptions*,
+                     Methcla_PortCount,
+                     Methcla_PortDescriptor* );
+    static void
+    configure( const void*, size_t,
+               const void*, size_t,
+               Methcla_SynthOptions* );
+
+    static void
+    construct( const Methcla_World*,
+               const Methcla_SynthDef*,
+               const Methcla_SynthOptions*,
+               Methcla_Synth* );
+
+    static void
+    destroy( const Methcla_World*,
+             Methcla_Synth* );
+
+    static void
+    connect( Methcla_Synth*,
+             Methcla_PortCount,
+             void* );
+
+    static void
+    process( const Methcla_World*,
+             Methcla_Synth*,
+             size_t );
+}
+
+bool
+port_descriptor( const Methcla_SynthOptions* inOptions
+               , Methcla_PortCount index
+               , Methcla_PortDescriptor* port )
+{
+    const Options* options = (const Options*)inOptions;
+    const size_t numControls = kNumParams * options->numFilters;
+    const size_t numInputs = options->bands ? 1 : options->numFilters;
+    if (index < numControls) {
+        port->type = kMethcla_ControlPort;
+        port->direction = kMethcla_Input;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    } else if (index < numControls + numInputs) {
+        port->type = kMethcla_AudioPort;
+        port->direction = kMethcla_Input;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    } else if (index < numControls + numInputs + options->numFilters) {
+        port->type = kMethcla_AudioPort;
+        port->direction = kMethcla_Output;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    }
+    return false;
+}
+
+void
+configure(const void* tags, size_t tags_size, const void* args, size_t args_size, Methcla_SynthOptions* outOptions)
+{
+    OSCPP::Server::ArgStream argStream(OSCPP::ReadStream(tags, tags_size), OSCPP::ReadStream(args, args_size));
+    Options* options = (Options*)outOptions;
+    options->numFilters = argStream.atEnd() ? 1 : std::min<size_t>(std::max(1, argStream.int32()), kMaxFilters);
+    options->numStages = argStream.atEnd() ? 1 : std::min<size_t>(std::max(1, argStream.int32()), kMaxStages);
+    options->bands = argStream.atEnd() ? false : argStream.int32() != 0;
+}
+
+// Compute the coefficients of one second order section, normalized by a0.
+static void
+design_biquad(int type, double freq, double q, double gain, double sampleRate, double* coeffs)
+{
+    const double w0 = 2. * kPi * std::min(std::max(freq, 1.), 0.49 * sampleRate) / sampleRate;
+    const double cosw0 = std::cos(w0);
+    const double alpha = std::sin(w0) / (2. * std::max(q, 0.01));
+    const double A = std::pow(10., gain / 40.);
+
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (type)
+    {
+        default:
+        case kMethcla_FilterbankLowpass:
+            b0 = b2 = (1. - cosw0) / 2.;
+            b1 = 1. - cosw0;
+            a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+            break;
+        case kMethcla_FilterbankHighpass:
+            b0 = b2 = (1. + cosw0) / 2.;
+            b1 = -(1. + cosw0);
+            a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+            break;
+        case kMethcla_FilterbankBandpass:
+            b0 = alpha; b1 = 0.; b2 = -alpha;
+            a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+            break;
+        case kMethcla_FilterbankNotch:
+            b0 = 1.; b1 = -2. * cosw0; b2 = 1.;
+            a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+            break;
+        case kMethcla_FilterbankAllpass:
+            b0 = 1. - alpha; b1 = -2. * cosw0; b2 = 1. + alpha;
+            a0 = 1. + alpha; a1 = -2. * cosw0; a2 = 1. - alpha;
+            break;
+        case kMethcla_FilterbankPeak:
+            b0 = 1. + alpha * A; b1 = -2. * cosw0; b2 = 1. - alpha * A;
+            a0 = 1. + alpha / A; a1 = -2. * cosw0; a2 = 1. - alpha / A;
+            break;
+        case kMethcla_FilterbankLowShelf: {
+            const double s = 2. * std::sqrt(A) * alpha;
+            b0 = A * ((A + 1.) - (A - 1.) * cosw0 + s);
+            b1 = 2. * A * ((A - 1.) - (A + 1.) * cosw0);
+            b2 = A * ((A + 1.) - (A - 1.) * cosw0 - s);
+            a0 = (A + 1.) + (A - 1.) * cosw0 + s;
+            a1 = -2. * ((A - 1.) + (A + 1.) * cosw0);
+            a2 = (A + 1.) + (A - 1.) * cosw0 - s;
+            break;
+        }
+        case kMethcla_FilterbankHighShelf: {
+            const double s = 2. * std::sqrt(A) * alpha;
+            b0 = A * ((A + 1.) + (A - 1.) * cosw0 + s);
+            b1 = -2. * A * ((A - 1.) + (A + 1.) * cosw0);
+            b2 = A * ((A + 1.) + (A - 1.) * cosw0 - s);
+            a0 = (A + 1.) - (A - 1.) * cosw0 + s;
+            a1 = 2. * ((A - 1.) - (A + 1.) * cosw0);
+            a2 = (A + 1.) - (A - 1.) * cosw0 - s;
+            break;
+        }
+    }
+
+    coeffs[0] = b0 / a0;
+    coeffs[1] = b1 / a0;
+    coeffs[2] = b2 / a0;
+    coeffs[3] = a1 / a0;
+    coeffs[4] = a2 / a0;
+}
+
+static void
+release_design(const Methcla_World* world, Design* design)
+{
+    if (--design->refCount == 0)
+        methcla_world_free(world, design);
+}
+
+// Start interpolating the current coefficients to the computed ones.
+static void
+start_ramp(Synth* self, const float* coeffs)
+{
+    const size_t n = kNumCoeffs * self->numGroups * kLanes;
+    std::copy(coeffs, coeffs + n, self->target);
+    for (size_t i=0; i < n; i++)
+        self->coeffsInc[i] = (self->target[i] - self->coeffs[i]) / (float)self->rampLength;
+    self->rampFrames = self->rampLength;
+}
+
+static void
+designed(const Methcla_World* world, void* data)
+{
+    Design* design = (Design*)data;
+    design->pending = false;
+    if (design->synth != nullptr)
+        start_ramp(design->synth, design->coeffs);
+    release_design(world, design);
+}
+
+static void
+compute_design(const Methcla_Host* host, void* data)
+{
+    Design* design = (Design*)data;
+    const size_t n = design->numFilters;
+    for (size_t i=0; i < n; i++)
+    {
+        const float* params = design->params;
+        const int type = std::min(std::max((int)params[i], 0), (int)kMethcla_FilterbankNumTypes - 1);
+        double coeffs[kNumCoeffs];
+        design_biquad(type, params[n + i], params[2 * n + i], params[3 * n + i], design->sampleRate, coeffs);
+        for (size_t c=0; c < kNumCoeffs; c++)
+            design->coeffs[c * design->numLanes + i] = (float)coeffs[c];
+    }
+    methcla_host_perform_command(host, designed, design);
+}
+
+// Request new coefficients from the worker thread when the control inputs
+// have changed since the last request. Requests don't overlap; changes made
+// while one is pending are picked up after it has completed.
+static void
+request_design(const Methcla_World* world, Synth* self)
+{
+    Design* design = self->design;
+    if (design->pending)
+        return;
+
+    const size_t numParams = kNumParams * self->numFilters;
+    bool changed = false;
+    for (size_t i=0; i < numParams; i++) {
+        const float value = *self->ports[i];
+        if (value != design->params[i]) {
+            design->params[i] = value;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        design->pending = true;
+        design->refCount++;
+        methcla_world_perform_command(world, compute_design, design);
+    }
+}
+
+static void
+construct( const Methcla_World* world
+         , const Methcla_SynthDef* /* synthDef */
+         , const Methcla_SynthOptions* inOptions
+         , Methcla_Synth* synth )
+{
+    const Options* options = (const Options*)inOptions;
+
+    Synth* self = (Synth*)synth;
+    self->numFilters = options->numFilters;
+    self->numGroups = (options->numFilters + kLanes - 1) / kLanes;
+    self->numStages = options->numStages;
+    self->numInputs = options->bands ? 1 : options->numFilters;
+    self->rampLength = std::max<size_t>(1, (size_t)(kSmoothingTime * methcla_world_samplerate(world)));
+    self->rampFrames = 0;
+    std::fill(self->outputs, self->outputs + kMaxFilters, nullptr);
+
+    // Allocate all arrays in one block.
+    const size_t numLanes = self->numGroups * kLanes;
+    const size_t coeffsSize = kNumCoeffs * numLanes * sizeof(float);
+    const size_t stateSize = 2 * self->numStages * numLanes * sizeof(float);
+    const size_t numPorts = kNumParams * self->numFilters + self->numInputs;
+    const size_t portsSize = numPorts * sizeof(float*);
+    char* mem = (char*)methcla_world_alloc_aligned(world, sizeof(Methcla_Float4), 3 * coeffsSize + stateSize + portsSize);
+
+    const size_t paramsSize = kNumParams * self->numFilters * sizeof(float);
+    Design* design = mem == nullptr ? nullptr : (Design*)methcla_world_alloc(world, sizeof(Design) + paramsSize + coeffsSize);
+
+    if (design == nullptr) {
+        // The outputs are cleared in every block.
+        methcla_world_log_line(world, kMethcla_LogError, METHCLA_PLUGINS_FILTERBANK_URI ": Couldn't allocate filters");
+        if (mem != nullptr)
+            methcla_world_free_aligned(world, mem);
+        self->numGroups = 0;
+        self->coeffs = self->target = self->coeffsInc = self->state = nullptr;
+        self->ports = nullptr;
+        self->design = nullptr;
+        return;
+    }
+
+    self->coeffs = (float*)mem;
+    self->target = (float*)(mem + coeffsSize);
+    self->coeffsInc = (float*)(mem + 2 * coeffsSize);
+    self->state = (float*)(mem + 3 * coeffsSize);
+    self->ports = (float**)(mem + 3 * coeffsSize + stateSize);
+
+    // Zero coefficients silence the outputs until the first design arrives,
+    // which is then faded in.
+    std::fill(self->coeffs, self->coeffs + 3 * kNumCoeffs * numLanes, 0.f);
+    std::fill(self->state, self->state + 2 * self->numStages * numLanes, 0.f);
+    std::fill(self->ports, self->ports + numPorts, nullptr);
+
+    design->refCount = 1;
+    design->pending = false;
+    design->synth = self;
+    design->numFilters = self->numFilters;
+    design->numLanes = numLanes;
+    design->sampleRate = methcla_world_samplerate(world);
+    design->params = (float*)((char*)design + sizeof(Design));
+    design->coeffs = (float*)((char*)design + sizeof(Design) + paramsSize);
+    // NaN compares unequal to any control value, which triggers the first request.
+    std::fill(design->params, design->params + kNumParams * self->numFilters, std::numeric_limits<float>::quiet_NaN());
+    std::fill(design->coeffs, design->coeffs + kNumCoeffs * numLanes, 0.f);
+    self->design = design;
+}
+
+static void
+destroy(const Methcla_World* world, Methcla_Synth* synth)
+{
+    Synth* self = (Synth*)synth;
+    if (self->design != nullptr) {
+        // A pending request outlives the synth.
+        self->design->synth = nullptr;
+        release_design(world, self->design);
+        methcla_world_free_aligned(world, self->coeffs);
+    }
+}
+
+static void
+connect( Methcla_Synth* synth
+       , Methcla_PortCount index
+       , void* data )
+{
+    Synth* self = (Synth*)synth;
+    const size_t numInputPorts = kNumParams * self->numFilters + self->numInputs;
+    if (index >= numInputPorts)
+        self->outputs[index - numInputPorts] = (float*)data;
+    else if (self->ports != nullptr)
+        self->ports[index] = (float*)data;
+}
+
+// Run frames [begin, end) of a group of four filters through the cascade,
+// adding the coefficient increments after every frame if Ramp is true.
+//
+// Linear interpolation between two stable sets of coefficients is stable,
+// because the region of stable (a1, a2) is convex.
+template <bool Ramp> static inline void
+process_group(Synth* self, size_t group, size_t begin, size_t end)
+{
+    const size_t numLanes = self->numGroups * kLanes;
+    const size_t first = group * kLanes;
+    const size_t count = std::min(kLanes, self->numFilters - first);
+    float* const* inputs = self->ports + kNumParams * self->numFilters;
+
+    // Padding lanes read the first filter's input; their outputs are dropped.
+    const float* in[kLanes];
+    for (size_t i=0; i < kLanes; i++)
+        in[i] = inputs[self->numInputs == 1 ? 0 : first + (i < count ? i : 0)];
+    float* const* out = self->outputs + first;
+
+    float* const coeffs = self->coeffs + first;
+    Methcla_Float4 b0 = methcla_float4_load(coeffs);
+    Methcla_Float4 b1 = methcla_float4_load(coeffs + numLanes);
+    Methcla_Float4 b2 = methcla_float4_load(coeffs + 2 * numLanes);
+    Methcla_Float4 a1 = methcla_float4_load(coeffs + 3 * numLanes);
+    Methcla_Float4 a2 = methcla_float4_load(coeffs + 4 * numLanes);
+
+    const float* const inc = self->coeffsInc + first;
+    const Methcla_Float4 db0 = Ramp ? methcla_float4_load(inc) : methcla_float4_splat(0.f);
+    const Methcla_Float4 db1 = Ramp ? methcla_float4_load(inc + numLanes) : methcla_float4_splat(0.f);
+    const Methcla_Float4 db2 = Ramp ? methcla_float4_load(inc + 2 * numLanes) : methcla_float4_splat(0.f);
+    const Methcla_Float4 da1 = Ramp ? methcla_float4_load(inc + 3 * numLanes) : methcla_float4_splat(0.f);
+    const Methcla_Float4 da2 = Ramp ? methcla_float4_load(inc + 4 * numLanes) : methcla_float4_splat(0.f);
+
+    const size_t numStages = self->numStages;
+    float* const state = self->state + first;
+    Methcla_Float4 z1[kMaxStages], z2[kMaxStages];
+    for (size_t s=0; s < numStages; s++) {
+        z1[s] = methcla_float4_load(state + 2 * s * numLanes);
+        z2[s] = methcla_float4_load(state + (2 * s + 1) * numLanes);
+    }
+
+    for (size_t k=begin; k < end; k++)
+    {
+        Methcla_Float4 x = { in[0][k], in[1][k], in[2][k], in[3][k] };
+        for (size_t s=0; s < numStages; s++)
+        {
+            const Methcla_Float4 y = b0 * x + z1[s];
+            z1[s] = b1 * x - a1 * y + z2[s];
+            z2[s] = b2 * x - a2 * y;
+            x = y;
+        }
+        for (size_t i=0; i < count; i++)
+            out[i][k] = x[i];
+        if (Ramp) {
+            b0 += db0; b1 += db1; b2 += db2;
+            a1 += da1; a2 += da2;
+        }
+    }
+
+    if (Ramp) {
+        methcla_float4_store(coeffs, b0);
+        methcla_float4_store(coeffs + numLanes, b1);
+        methcla_float4_store(coeffs + 2 * numLanes, b2);
+        methcla_float4_store(coeffs + 3 * numLanes, a1);
+        methcla_float4_store(coeffs + 4 * numLanes, a2);
+    }
+
+    const Methcla_Float4 threshold = methcla_float4_splat(kFlushThreshold);
+    for (size_t s=0; s < numStages; s++) {
+        const Methcla_Int4 small1 = (z1[s] < threshold) & (z1[s] > -threshold);
+        const Methcla_Int4 small2 = (z2[s] < threshold) & (z2[s] > -threshold);
+        methcla_float4_store(state + 2 * s * numLanes, (Methcla_Float4)((Methcla_Int4)z1[s] & ~small1));
+        methcla_float4_store(state + (2 * s + 1) * numLanes, (Methcla_Float4)((Methcla_Int4)z2[s] & ~small2));
+    }
+}
+
+static void
+process(const Methcla_World* world, Methcla_Synth* synth, size_t numFrames)
+{
+    Synth* self = (Synth*)synth;
+
+    if (self->design == nullptr) {
+        for (size_t i=0; i < self->numFilters; i++)
+            std::fill(self->outputs[i], self->outputs[i] + numFrames, 0.f);
+        return;
+    }
+
+    request_design(world, self);
+
+    size_t rampEnd = 0;
+    if (self->rampFrames > 0)
+    {
+        rampEnd = std::min(self->rampFrames, numFrames);
+        for (size_t g=0; g < self->numGroups; g++)
+            process_group<true>(self, g, 0, rampEnd);
+        self->rampFrames -= rampEnd;
+        if (self->rampFrames == 0) {
+            // Snap to the target to avoid accumulated rounding errors.
+            const size_t n = kNumCoeffs * self->numGroups * kLanes;
+            std::copy(self->target, self->target + n, self->coeffs);
+        }
+    }
+
+    if (rampEnd < numFrames)
+    {
+        for (size_t g=0; g < self->numGroups; g++)
+            process_group<false>(self, g, rampEnd, numFrames);
+    }
+}
+
+} // namespace
+
+static const Methcla_SynthDef descriptor =
+{
+    METHCLA_PLUGINS_FILTERBANK_URI,
+    sizeof(Synth),
+    sizeof(Options),
+    configure,
+    port_descriptor,
+    construct,
+    connect,
+    nullptr,
+    process,
+    destroy,
+    nullptr
+};
+
+static const Methcla_Library library = { NULL, NULL };
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_filterbank(const Methcla_Host* host, const char* /* bundlePath */)
+{
+    methcla_host_register_synthdef(host, &descriptor);
+    return &library;
+}
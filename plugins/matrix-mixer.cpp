@@ -0,0 +1,278 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <methcla/plugins/matrix-mixer.h>
+#include <methcla/plugins/simd.h>
+
+#include <algorithm>
+#include <oscpp/server.hpp>
+
+namespace
+{
+
+static const size_t kMaxChannels = 32;
+static const size_t kDefaultChannels = 2;
+
+struct Options
+{
+    size_t numInputs;
+    size_t numOutputs;
+};
+
+typedef struct {
+    size_t numInputs;
+    size_t numOutputs;
+    // Gain control inputs and audio inputs.
+    float** ports;
+    // Gains at the end of the previous block, in the layout of the controls.
+    float* gains;
+    // Audio outputs; kept in the synth so that they can be cleared if the
+    // gain matrix couldn't be allocated.
+    float* outputs[kMaxChannels];
+} Synth;
+
+// Declare callback with C linkage
+extern "C"
+{
+    static bool
+    port_descriptor( const Methcla_SynthOptions*,
+                     Methcla_PortCount,
+                     Methcla_PortDescriptor* );
+    static void
+    configure( const void*, size_t,
+               const void*, size_t,
+               Methcla_SynthOptions* );
+
+    static void
+    construct( const Methcla_World*,
+               const Methcla_SynthDef*,
+               const Methcla_SynthOptions*,
+               Methcla_Synth* );
+
+    static void
+    activate( const Methcla_World*,
+              Methcla_Synth* );
+
+    static void
+    destroy( const Methcla_World*,
+             Methcla_Synth* );
+
+    static void
+    connect( Methcla_Synth*,
+             Methcla_PortCount,
+             void* );
+
+    static void
+    process( const Methcla_World*,
+             Methcla_Synth*,
+             size_t );
+}
+
+bool
+port_descriptor( const Methcla_SynthOptions* inOptions
+               , Methcla_PortCount index
+               , Methcla_PortDescriptor* port )
+{
+    const Options* options = (const Options*)inOptions;
+    const size_t numGains = options->numInputs * options->numOutputs;
+    if (index < numGains) {
+        port->type = kMethcla_ControlPort;
+        port->direction = kMethcla_Input;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    } else if (index < numGains + options->numInputs) {
+        port->type = kMethcla_AudioPort;
+        port->direction = kMethcla_Input;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    } else if (index < numGains + options->numInputs + options->numOutputs) {
+        port->type = kMethcla_AudioPort;
+        port->direction = kMethcla_Output;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    }
+    return false;
+}
+
+void
+configure(const void* tags, size_t tags_size, const void* args, size_t args_size, Methcla_SynthOptions* outOptions)
+{
+    OSCPP::Server::ArgStream argStream(OSCPP::ReadStream(tags, tags_size), OSCPP::ReadStream(args, args_size));
+    Options* options = (Options*)outOptions;
+    options->numInputs = argStream.atEnd() ? kDefaultChannels : std::min<size_t>(std::max(1, argStream.int32()), kMaxChannels);
+    options->numOutputs = argStream.atEnd() ? kDefaultChannels : std::min<size_t>(std::max(1, argStream.int32()), kMaxChannels);
+}
+
+static void
+construct( const Methcla_World* world
+         , const Methcla_SynthDef* /* synthDef */
+         , const Methcla_SynthOptions* inOptions
+         , Methcla_Synth* synth )
+{
+    const Options* options = (const Options*)inOptions;
+
+    Synth* self = (Synth*)synth;
+    self->numInputs = options->numInputs;
+    self->numOutputs = options->numOutputs;
+
+    std::fill(self->outputs, self->outputs + kMaxChannels, nullptr);
+
+    // Allocate all arrays in one block.
+    const size_t numGains = self->numInputs * self->numOutputs;
+    const size_t numPorts = numGains + self->numInputs;
+    char* mem = (char*)methcla_world_alloc(world, numGains * sizeof(float) + numPorts * sizeof(float*));
+
+    if (mem == nullptr) {
+        // The outputs are cleared in every block.
+        methcla_world_log_line(world, kMethcla_LogError, METHCLA_PLUGINS_MATRIX_MIXER_URI ": Couldn't allocate gain matrix");
+        self->ports = nullptr;
+        self->gains = nullptr;
+        return;
+    }
+
+    self->ports = (float**)mem;
+    self->gains = (float*)(mem + numPorts * sizeof(float*));
+
+    std::fill(self->ports, self->ports + numPorts, nullptr);
+    std::fill(self->gains, self->gains + numGains, 0.f);
+}
+
+static void
+destroy(const Methcla_World* world, Methcla_Synth* synth)
+{
+    Synth* self = (Synth*)synth;
+    if (self->ports != nullptr)
+        methcla_world_free(world, self->ports);
+}
+
+static void
+connect( Methcla_Synth* synth
+       , Methcla_PortCount index
+       , void* data )
+{
+    Synth* self = (Synth*)synth;
+    const size_t numInputPorts = self->numInputs * self->numOutputs + self->numInputs;
+    if (index >= numInputPorts)
+        self->outputs[index - numInputPorts] = (float*)data;
+    else if (self->ports != nullptr)
+        self->ports[index] = (float*)data;
+}
+
+static void
+activate(const Methcla_World*, Methcla_Synth* synth)
+{
+    Synth* self = (Synth*)synth;
+    if (self->gains == nullptr)
+        return;
+    // Start at the initial gains instead of ramping from zero.
+    for (size_t i=0; i < self->numInputs * self->numOutputs; i++)
+        self->gains[i] = *self->ports[i];
+}
+
+// Write (Add false) or add (Add true) input times a gain ramping linearly
+// from gain0 by dGain per frame to output.
+template <bool Add> static inline void
+multiply(float* output, const float* input, size_t numFrames, float gain0, float dGain)
+{
+    const size_t numVectorFrames = numFrames & ~(size_t)3;
+
+    Methcla_Float4 gain = { gain0, gain0 + dGain, gain0 + 2.f * dGain, gain0 + 3.f * dGain };
+    const Methcla_Float4 step = methcla_float4_splat(4.f * dGain);
+
+    for (size_t k=0; k < numVectorFrames; k += 4)
+    {
+        Methcla_Float4 y = gain * methcla_float4_load(input + k);
+        if (Add)
+            y += methcla_float4_load(output + k);
+        methcla_float4_store(output + k, y);
+        gain += step;
+    }
+
+    for (size_t k=numVectorFrames; k < numFrames; k++)
+    {
+        const float y = (gain0 + (float)k * dGain) * input[k];
+        output[k] = Add ? output[k] + y : y;
+    }
+}
+
+static void
+process(const Methcla_World*, Methcla_Synth* synth, size_t numFrames)
+{
+    Synth* self = (Synth*)synth;
+    float* const* outputs = self->outputs;
+
+    if (self->gains == nullptr)
+    {
+        for (size_t j=0; j < self->numOutputs; j++)
+            std::fill(outputs[j], outputs[j] + numFrames, 0.f);
+        return;
+    }
+
+    const size_t numInputs = self->numInputs;
+    float* const* inputs = self->ports + numInputs * self->numOutputs;
+
+    for (size_t j=0; j < self->numOutputs; j++)
+    {
+        float* const output = outputs[j];
+        float* const gains = self->gains + j * numInputs;
+        bool silent = true;
+
+        for (size_t i=0; i < numInputs; i++)
+        {
+            const float gain0 = gains[i];
+            const float gain1 = *self->ports[j * numInputs + i];
+
+            if (gain0 == 0.f && gain1 == 0.f)
+                continue;
+
+            const float dGain = (gain1 - gain0) / (float)numFrames;
+            // The first contributing input overwrites the output.
+            if (silent)
+                multiply<false>(output, inputs[i], numFrames, gain0, dGain);
+            else
+                multiply<true>(output, inputs[i], numFrames, gain0, dGain);
+            silent = false;
+
+            gains[i] = gain1;
+        }
+
+        if (silent)
+            std::fill(output, output + numFrames, 0.f);
+    }
+}
+
+} // namespace
+
+static const Methcla_SynthDef descriptor =
+{
+    METHCLA_PLUGINS_MATRIX_MIXER_URI,
+    sizeof(Synth),
+    sizeof(Options),
+    configure,
+    port_descriptor,
+    construct,
+    connect,
+    activate,
+    process,
+    destroy,
+    nullptr
+};
+
+static const Methcla_Library library = { NULL, NULL };
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_matrix_mixer(const Methcla_Host* host, const char* /* bundlePath */)
+{
+    methcla_host_register_synthdef(host, &descriptor);
+    return &library;
+}
@@ -0,0 +1,337 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <methcla/plugins/oscbank.h>
+#include <methcla/plugins/oscillator.h>
+
+#include <algorithm>
+#include <oscpp/server.hpp>
+
+namespace
+{
+
+static const size_t kMaxPartials = 4096;
+
+// Partials are processed in groups of four, one partial per vector lane.
+static const size_t kLanes = 4;
+
+struct Options
+{
+    size_t numPartials;
+};
+
+// Partial state is kept in structure of arrays layout, padded to a multiple
+// of kLanes partials. Padding partials have zero amplitude.
+typedef struct {
+    size_t numPartials;
+    size_t numGroups;
+    double freqToPhaseInc;
+    // Control input ports, frequencies followed by amplitudes.
+    float** ports;
+    // Audio output; kept in the synth so that it can be cleared if the
+    // partials couldn't be allocated.
+    float* output;
+    // Phase in cycles at the start of the next block.
+    double* phase;
+    // Phase increment and amplitude at the end of the previous block.
+    float* phaseInc;
+    float* amp;
+    // Phase increment and amplitude at the end of the current block.
+    float* phaseInc1;
+    float* amp1;
+} Synth;
+
+// Declare callback with C linkage
+extern "C"
+{
+    static bool
+    port_descriptor( const Methcla_SynthOptions*,
+                     Methcla_PortCount,
+                     Methcla_PortDescriptor* );
+    static void
+    configure( const void*, size_t,
+               const void*, size_t,
+               Methcla_SynthOptions* );
+
+    static void
+    construct( const Methcla_World*,
+               const Methcla_SynthDef*,
+               const Methcla_SynthOptions*,
+               Methcla_Synth* );
+
+    static void
+    activate( const Methcla_World*,
+              Methcla_Synth* );
+
+    static void
+    destroy( const Methcla_World*,
+             Methcla_Synth* );
+
+    static void
+    connect( Methcla_Synth*,
+             Methcla_PortCount,
+             void* );
+
+    static void
+    process( const Methcla_World*,
+             Methcla_Synth*,
+             size_t );
+}
+
+bool
+port_descriptor( const Methcla_SynthOptions* inOptions
+               , Methcla_PortCount index
+               , Methcla_PortDescriptor* port )
+{
+    const Options* options = (const Options*)inOptions;
+    if (index < 2 * options->numPartials) {
+        port->type = kMethcla_ControlPort;
+        port->direction = kMethcla_Input;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    } else if (index == 2 * options->numPartials) {
+        port->type = kMethcla_AudioPort;
+        port->direction = kMethcla_Output;
+        port->flags = kMethcla_PortFlags;
+        return true;
+    }
+    return false;
+}
+
+void
+configure(const void* tags, size_t tags_size, const void* args, size_t args_size, Methcla_SynthOptions* outOptions)
+{
+    OSCPP::Server::ArgStream argStream(OSCPP::ReadStream(tags, tags_size), OSCPP::ReadStream(args, args_size));
+    Options* options = (Options*)outOptions;
+    options->numPartials = argStream.atEnd() ? 1 : std::min<size_t>(std::max(1, argStream.int32()), kMaxPartials);
+}
+
+static void
+construct( const Methcla_World* world
+         , const Methcla_SynthDef* /* synthDef */
+         , const Methcla_SynthOptions* inOptions
+         , Methcla_Synth* synth )
+{
+    const Options* options = (const Options*)inOptions;
+
+    Synth* self = (Synth*)synth;
+    self->numPartials = options->numPartials;
+    self->numGroups = (options->numPartials + kLanes - 1) / kLanes;
+    self->freqToPhaseInc = 1. / methcla_world_samplerate(world);
+
+    self->output = nullptr;
+
+    // Allocate all arrays in one block.
+    const size_t numLanes = self->numGroups * kLanes;
+    const size_t portsSize = 2 * self->numPartials * sizeof(float*);
+    const size_t phaseSize = numLanes * sizeof(double);
+    const size_t floatSize = numLanes * sizeof(float);
+    char* mem = (char*)methcla_world_alloc_aligned(world, sizeof(Methcla_Float4), phaseSize + 4 * floatSize + portsSize);
+
+    if (mem == nullptr) {
+        // The output is cleared in every block.
+        methcla_world_log_line(world, kMethcla_LogError, METHCLA_PLUGINS_OSCBANK_URI ": Couldn't allocate partials");
+        self->numGroups = 0;
+        self->phase = nullptr;
+        self->phaseInc = self->amp = nullptr;
+        self->phaseInc1 = self->amp1 = nullptr;
+        self->ports = nullptr;
+        return;
+    }
+
+    self->phase = (double*)mem;
+    self->phaseInc = (float*)(mem + phaseSize);
+    self->amp = (float*)(mem + phaseSize + floatSize);
+    self->phaseInc1 = (float*)(mem + phaseSize + 2 * floatSize);
+    self->amp1 = (float*)(mem + phaseSize + 3 * floatSize);
+    self->ports = (float**)(mem + phaseSize + 4 * floatSize);
+
+    std::fill(self->phase, self->phase + numLanes, 0.);
+    std::fill(self->phaseInc, self->phaseInc + numLanes, 0.f);
+    std::fill(self->amp, self->amp + numLanes, 0.f);
+    std::fill(self->phaseInc1, self->phaseInc1 + numLanes, 0.f);
+    std::fill(self->amp1, self->amp1 + numLanes, 0.f);
+    std::fill(self->ports, self->ports + 2 * self->numPartials, nullptr);
+}
+
+static void
+destroy(const Methcla_World* world, Methcla_Synth* synth)
+{
+    Synth* self = (Synth*)synth;
+    if (self->phase != nullptr)
+        methcla_world_free_aligned(world, self->phase);
+}
+
+static void
+connect( Methcla_Synth* synth
+       , Methcla_PortCount index
+       , void* data )
+{
+    Synth* self = (Synth*)synth;
+    if (index == 2 * self->numPartials)
+        self->output = (float*)data;
+    else if (self->ports != nullptr)
+        self->ports[index] = (float*)data;
+}
+
+static void
+activate(const Methcla_World*, Methcla_Synth* synth)
+{
+    Synth* self = (Synth*)synth;
+    if (self->ports == nullptr)
+        return;
+    // Start at the initial control values instead of ramping from zero.
+    for (size_t p=0; p < self->numPartials; p++) {
+        self->phaseInc[p] = (float)methcla_oscillator_wrap(*self->ports[p] * self->freqToPhaseInc);
+        self->amp[p] = *self->ports[self->numPartials + p];
+    }
+}
+
+static inline Methcla_Float4 make_float4(const double* x)
+{
+    const Methcla_Float4 v = { (float)x[0], (float)x[1], (float)x[2], (float)x[3] };
+    return v;
+}
+
+// Return the phase after numFrames frames with the phase increment ramping
+// linearly from inc0 to inc1; the phase of frame k is
+// phase + k inc0 + dInc k (k-1) / 2 with dInc = (inc1 - inc0) / numFrames.
+static inline double advance_phase(double phase, double k, double inc0, double dInc)
+{
+    return methcla_oscillator_wrap(phase + k * inc0 + dInc * k * (k - 1.) * 0.5);
+}
+
+// Add frames begin to end of a group of four partials to the lanes of acc,
+// interpolating phase increment and amplitude linearly from inc0, amp0 to
+// inc1, amp1 over the block of numFrames frames. phase is the phase at the
+// start of the block and end - begin at most kMethcla_OscillatorChunkSize.
+static inline void
+process_group( Methcla_Float4* acc
+             , size_t begin
+             , size_t end
+             , size_t numFrames
+             , const double* phase
+             , const float* inc0
+             , const float* inc1
+             , const float* amp0
+             , const float* amp1 )
+{
+    // Recompute the lane phases in double precision for each chunk.
+    const double k = (double)begin;
+    double dInc[kLanes], x0[kLanes], incK[kLanes];
+    for (size_t i=0; i < kLanes; i++) {
+        dInc[i] = ((double)inc1[i] - (double)inc0[i]) / (double)numFrames;
+        x0[i] = advance_phase(phase[i], k, inc0[i], dInc[i]);
+        incK[i] = inc0[i] + dInc[i] * k;
+    }
+
+    const Methcla_Float4 dInc4 = make_float4(dInc);
+    const Methcla_Float4 dAmp4 = (methcla_float4_load(amp1) - methcla_float4_load(amp0)) / methcla_float4_splat((float)numFrames);
+
+    Methcla_Float4 x = make_float4(x0);
+    Methcla_Float4 inc = make_float4(incK);
+    Methcla_Float4 amp = methcla_float4_load(amp0) + dAmp4 * methcla_float4_splat((float)begin);
+
+    for (size_t j = begin; j < end; j++)
+    {
+        *acc++ += amp * methcla_float4_sin2pi(x);
+        x = methcla_float4_wrap(x + inc);
+        inc += dInc4;
+        amp += dAmp4;
+    }
+}
+
+static inline bool is_silent(const float* amp)
+{
+    return std::all_of(amp, amp + kLanes, [](float a) { return a == 0.f; });
+}
+
+static void
+process(const Methcla_World*, Methcla_Synth* synth, size_t numFrames)
+{
+    Synth* self = (Synth*)synth;
+
+    float* const output = self->output;
+
+    if (self->ports == nullptr) {
+        std::fill(output, output + numFrames, 0.f);
+        return;
+    }
+
+    // Targets at the end of the block; padding lanes stay silent.
+    for (size_t p=0; p < self->numPartials; p++) {
+        self->phaseInc1[p] = (float)methcla_oscillator_wrap(*self->ports[p] * self->freqToPhaseInc);
+        self->amp1[p] = *self->ports[self->numPartials + p];
+    }
+
+    // Partials are summed per frame in the lanes of a vector across all
+    // groups; the lanes are added once per frame.
+    Methcla_Float4 acc[kMethcla_OscillatorChunkSize];
+
+    for (size_t chunk = 0; chunk < numFrames; chunk += kMethcla_OscillatorChunkSize)
+    {
+        const size_t end = std::min(numFrames, chunk + kMethcla_OscillatorChunkSize);
+        std::fill(acc, acc + (end - chunk), methcla_float4_splat(0.f));
+
+        for (size_t first = 0; first < self->numGroups * kLanes; first += kLanes)
+        {
+            const float* const amp0 = self->amp + first;
+            const float* const amp1 = self->amp1 + first;
+            if (!is_silent(amp0) || !is_silent(amp1))
+                process_group(acc, chunk, end, numFrames, self->phase + first,
+                              self->phaseInc + first, self->phaseInc1 + first, amp0, amp1);
+        }
+
+        for (size_t j = chunk; j < end; j++)
+        {
+            const Methcla_Float4 y = acc[j - chunk];
+            output[j] = (y[0] + y[1]) + (y[2] + y[3]);
+        }
+    }
+
+    // Advance the phases of all partials, including silent ones.
+    const size_t numLanes = self->numGroups * kLanes;
+    for (size_t i=0; i < numLanes; i++) {
+        const double dInc = ((double)self->phaseInc1[i] - (double)self->phaseInc[i]) / (double)numFrames;
+        self->phase[i] = advance_phase(self->phase[i], (double)numFrames, self->phaseInc[i], dInc);
+    }
+
+    std::copy(self->phaseInc1, self->phaseInc1 + numLanes, self->phaseInc);
+    std::copy(self->amp1, self->amp1 + numLanes, self->amp);
+}
+
+} // namespace
+
+static const Methcla_SynthDef descriptor =
+{
+    METHCLA_PLUGINS_OSCBANK_URI,
+    sizeof(Synth),
+    sizeof(Options),
+    configure,
+    port_descriptor,
+    construct,
+    connect,
+    activate,
+    process,
+    destroy,
+    nullptr
+};
+
+static const Methcla_Library library = { NULL, NULL };
+
+METHCLA_EXPORT const Methcla_Library* methcla_plugins_oscbank(const Methcla_Host* host, const char* /* bundlePath */)
+{
+    methcla_host_register_synthdef(host, &descriptor);
+    return &library;
+}
@@ -95,6 +95,7 @@ static const Methcla_SynthDef descriptor =
     connect,
     NULL,
     process,
+    NULL,
     NULL
 };
 
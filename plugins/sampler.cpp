@@ -13,8 +13,10 @@
 // limitations under the License.
 
 #include <methcla/plugins/sampler.h>
+#include <methcla/plugins/resample.hpp>
 
 #include <cmath>
+#include <limits>
 #include <oscpp/server.hpp>
 
 namespace
@@ -23,35 +25,50 @@ namespace
 typedef enum {
     kSampler_amp,
     kSampler_rate,
-    kSampler_output_0,
-    kSampler_output_1,
-    kSamplerPorts
+    kSampler_output_0
 } PortIndex;
 
+// Maximum number of outputs selectable by synth options.
+static const size_t kMaxOutputs = 32;
+static const size_t kDefaultOutputs = 2;
+
 typedef struct {
-    float* ports[kSamplerPorts];
-    float* buffer;
+    float* ports[kSampler_output_0 + kMaxOutputs];
+    size_t numOutputs;
+    const Methcla_SampleBuffer* sampleBuffer;
+    const Methcla_SampleBuffer* engineBuffer;
+    const void* buffer;
+    Methcla_SoundFileFormat format;
     size_t channels;
     size_t frames;
+    // Offset of the first frame relative to the start of the sample buffer.
+    size_t offset;
+    // True when all frames of the sample buffer have been loaded.
+    bool complete;
     bool loop;
+    Methcla_ResampleQuality quality;
     double phase;
 } Synth;
 
 struct Options
 {
+    // Either a sound file path or an engine buffer id.
     const char* path;
+    Methcla_BufferId bufferId;
     bool loop;
     size_t startFrame;
     size_t numFrames;
+    Methcla_ResampleQuality quality;
+    size_t numOutputs;
 };
 
 struct LoadMessage
 {
     Synth* synth;
-    size_t numChannels;
     int64_t startFrame;
     int64_t numFrames;
-    float* buffer;
+    double sampleRate;
+    const Methcla_SampleBuffer* sampleBuffer;
     char* path;
 };
 
@@ -89,10 +106,11 @@ extern "C"
 }
 
 bool
-port_descriptor( const Methcla_SynthOptions* /* options */
+port_descriptor( const Methcla_SynthOptions* inOptions
                , Methcla_PortCount index
                , Methcla_PortDescriptor* port )
 {
+    const Options* options = (const Options*)inOptions;
     switch ((PortIndex)index) {
         case kSampler_amp:
         case kSampler_rate:
@@ -100,13 +118,13 @@ port_descriptor( const Methcla_SynthOptions* /* options */
             port->direction = kMethcla_Input;
             port->flags = kMethcla_PortFlags;
             return true;
-        case kSampler_output_0:
-        case kSampler_output_1:
-            port->type = kMethcla_AudioPort;
-            port->direction = kMethcla_Output;
-            port->flags = kMethcla_PortFlags;
-            return true;
         default:
+            if (index < kSampler_output_0 + options->numOutputs) {
+                port->type = kMethcla_AudioPort;
+                port->direction = kMethcla_Output;
+                port->flags = kMethcla_PortFlags;
+                return true;
+            }
             return false;
     }
 }
@@ -116,18 +134,32 @@ configure(const void* tags, size_t tags_size, const void* args, size_t args_size
 {
     OSCPP::Server::ArgStream argStream(OSCPP::ReadStream(tags, tags_size), OSCPP::ReadStream(args, args_size));
     Options* options = (Options*)outOptions;
-    options->path = argStream.string();
+    if (argStream.tag() == 'i') {
+        options->path = nullptr;
+        options->bufferId = argStream.int32();
+    } else {
+        options->path = argStream.string();
+        options->bufferId = -1;
+    }
     options->loop = argStream.atEnd() ? false : argStream.int32();
     options->startFrame = argStream.atEnd() ? 0 : std::max(0, argStream.int32());
     options->numFrames = argStream.atEnd() ? -1 : std::max(0, argStream.int32());
+    options->quality = argStream.atEnd() ? kMethcla_ResampleHermite : (Methcla_ResampleQuality)argStream.int32();
+    options->numOutputs = argStream.atEnd() ? kDefaultOutputs : std::min<size_t>(std::max(1, argStream.int32()), kMaxOutputs);
 }
 
 static void set_buffer(const Methcla_World* world, void* data)
 {
     LoadMessage* msg = (LoadMessage*)data;
-    msg->synth->buffer = msg->buffer;
-    msg->synth->channels = msg->numChannels;
-    msg->synth->frames = msg->numFrames;
+    if (msg->sampleBuffer) {
+        msg->synth->sampleBuffer = msg->sampleBuffer;
+        msg->synth->buffer = msg->sampleBuffer->data;
+        msg->synth->format = msg->sampleBuffer->format;
+        msg->synth->channels = msg->sampleBuffer->channels;
+        msg->synth->frames = msg->sampleBuffer->frames;
+        msg->synth->offset = 0;
+        msg->synth->complete = false;
+    }
     methcla_world_free(world, msg);
 }
 
@@ -136,56 +168,45 @@ static void load_sound_file(const Methcla_Host* context, void* data)
     LoadMessage* msg = (LoadMessage*)data;
     assert( msg != nullptr );
 
-    Methcla_SoundFile* file = nullptr;
-    Methcla_SoundFileInfo info;
-    memset(&info, 0, sizeof(info));
-
-    Methcla_Error err = methcla_host_soundfile_open(context, msg->path, kMethcla_FileModeRead, &file, &info);
-
-    if (methcla_is_ok(err))
+    // Buffers are shared between all synths playing the same file region
+    // and converted to the engine's sample rate while loading.
+    Methcla_Error err = methcla_host_buffer_acquire(
+        context,
+        msg->path,
+        msg->startFrame,
+        msg->numFrames,
+        msg->sampleRate,
+        &msg->sampleBuffer
+    );
+
+    if (methcla_is_error(err))
     {
-        msg->startFrame = std::min(std::max(int64_t(0), msg->startFrame), info.frames);
-        msg->numFrames = msg->numFrames < 0
-                            ? info.frames - msg->startFrame
-                            : std::min(msg->numFrames, info.frames - msg->startFrame);
-        msg->numChannels = info.channels;
-
-        if (msg->numFrames > 0)
-        {
-            msg->buffer = (float*)methcla_host_alloc(context, msg->numChannels * msg->numFrames * sizeof(float));
-
-            // TODO: error handling
-            if (msg->buffer != nullptr)
-            {
-                methcla_soundfile_seek(file, msg->startFrame);
-                size_t numFrames;
-                err = methcla_soundfile_read_float(file, msg->buffer, msg->numFrames, &numFrames);
-            }
-        }
-        else
-        {
-            msg->buffer = nullptr;
-        }
-
-        methcla_soundfile_close(file);
+        msg->sampleBuffer = nullptr;
+        methcla_error_free(err);
     }
-    else
+    else if (msg->sampleBuffer->frames == 0)
     {
-        methcla_error_free(err);
+        methcla_host_buffer_release(context, msg->sampleBuffer);
+        msg->sampleBuffer = nullptr;
     }
 
     methcla_host_perform_command(context, set_buffer, msg);
 }
 
-static void free_buffer_cb(const Methcla_Host* context, void* data)
+static void release_buffer_cb(const Methcla_Host* context, void* data)
 {
-    methcla_host_free(context, data);
+    methcla_host_buffer_release(context, (const Methcla_SampleBuffer*)data);
 }
 
 static void freeBuffer(const Methcla_World* world, Synth* self)
 {
-    if (self->buffer) {
-        methcla_world_perform_command(world, free_buffer_cb, self->buffer);
+    if (self->engineBuffer) {
+        methcla_world_buffer_release(world, self->engineBuffer);
+        self->engineBuffer = nullptr;
+        self->buffer = nullptr;
+    } else if (self->sampleBuffer) {
+        methcla_world_perform_command(world, release_buffer_cb, (void*)self->sampleBuffer);
+        self->sampleBuffer = nullptr;
         self->buffer = nullptr;
     }
 }
@@ -199,17 +220,40 @@ construct( const Methcla_World* world
     const Options* options = (const Options*)inOptions;
 
     Synth* self = (Synth*)synth;
+    self->numOutputs = options->numOutputs;
+    self->sampleBuffer = nullptr;
+    self->engineBuffer = nullptr;
     self->buffer = nullptr;
+    self->format = kMethcla_SoundFileFormatFloat;
     self->channels = 0;
     self->frames = 0;
+    self->offset = 0;
+    self->complete = false;
     self->loop = options->loop;
+    self->quality = options->quality;
     self->phase = 0.;
 
+    if (options->path == nullptr) {
+        // Play from an engine buffer that has been loaded ahead of time.
+        const Methcla_SampleBuffer* buffer = methcla_world_buffer(world, options->bufferId);
+        if (buffer && options->startFrame < (size_t)buffer->frames) {
+            methcla_world_buffer_retain(world, buffer);
+            self->engineBuffer = buffer;
+            self->buffer = methcla_sample_buffer_frame(buffer, options->startFrame);
+            self->format = buffer->format;
+            self->channels = buffer->channels;
+            self->frames = std::min<size_t>(buffer->frames - options->startFrame, options->numFrames);
+            self->offset = options->startFrame;
+        }
+        return;
+    }
+
     LoadMessage* msg = (LoadMessage*)methcla_world_alloc(world, sizeof(LoadMessage) + strlen(options->path)+1);
     msg->synth = self;
-    msg->numChannels = 0;
     msg->startFrame = options->startFrame;
     msg->numFrames = options->numFrames;
+    msg->sampleRate = methcla_world_samplerate(world);
+    msg->sampleBuffer = nullptr;
     msg->path = (char*)msg + sizeof(LoadMessage);
     strcpy(msg->path, options->path);
 
@@ -231,173 +275,6 @@ connect( Methcla_Synth* synth
     ((Synth*)synth)->ports[index] = (float*)data;
 }
 
-static inline void
-process_no_interp(
-    const Methcla_World* world,
-    Synth* self,
-    size_t numFrames,
-    float amp,
-    float /* rate */,
-    const float* buffer,
-    float* out0,
-    float* out1 )
-{
-    size_t pos = (size_t)self->phase;
-    const size_t left = self->frames - pos;
-    const size_t channels = self->channels;
-
-    if (left >= numFrames) {
-        if (channels == 1) {
-            for (size_t k = 0; k < numFrames; k++) {
-                out0[k] = out1[k] = amp * buffer[(pos+k)*channels];
-            }
-        } else {
-            for (size_t k = 0; k < numFrames; k++) {
-                const size_t j = (pos+k)*channels;
-                out0[k] = amp * buffer[j];
-                out1[k] = amp * buffer[j+1];
-            }
-        }
-        if (left == numFrames) {
-            if (self->loop) self->phase = 0;
-            else freeBuffer(world, self);
-        } else {
-            self->phase = pos + numFrames;
-        };
-    } else if (self->loop) {
-        size_t played = 0;
-        size_t toPlay = left;
-        while (played < numFrames) {
-            if (channels == 1) {
-                for (size_t k = 0; k < toPlay; k++) {
-                    const size_t m = played+k;
-                    const size_t j = (pos+k)*channels;
-                    out0[m] = out1[m] = amp * buffer[j];
-                }
-            } else {
-                for (size_t k = 0; k < toPlay; k++) {
-                    const size_t m = played+k;
-                    const size_t j = (pos+k)*channels;
-                    out0[m] = amp * buffer[j];
-                    out1[m] = amp * buffer[j+1];
-                }
-            }
-            played += toPlay;
-            pos += toPlay;
-            if (pos >= self->frames)
-                pos = 0;
-            toPlay = std::min(numFrames - played, self->frames);
-        }
-        self->phase = pos;
-    } else {
-        if (channels == 1) {
-            for (size_t k = 0; k < left; k++) {
-                const size_t j = (pos+k)*channels;
-                out0[k] = out1[k] = amp * buffer[j];
-            }
-        } else {
-            for (size_t k = 0; k < left; k++) {
-                const size_t j = (pos+k)*channels;
-                out0[k] = amp * buffer[j];
-                out1[k] = amp * buffer[j+1];
-            }
-        }
-        for (size_t k = left; k < numFrames; k++) {
-            out0[k] = out1[k] = 0.f;
-        }
-        freeBuffer(world, self);
-    }
-}
-
-static inline float hermite1(float x, float y0, float y1, float y2, float y3)
-{
-    // 4-point, 3rd-order Hermite (x-form)
-    const float c0 = y1;
-    const float c1 = 0.5f * (y2 - y0);
-    const float c2 = y0 - 2.5f * y1 + 2.f * y2 - 0.5f * y3;
-    const float c3 = 1.5f * (y1 - y2) + 0.5f * (y3 - y0);
-
-    return ((c3 * x + c2) * x + c1) * x + c0;
-}
-
-template <bool wrapInterp, bool wrapPhase> inline size_t resample(float* out0, float* out1, size_t numFrames, const float* buffer, size_t bufferChannels, size_t bufferFrames, size_t bufferEnd, float amp, float rate, double& phase)
-{
-    const size_t bufferChannel1 = 0;
-    const size_t bufferChannel2 = bufferChannels > 1 ? 1 : 0;
-    const double maxPhase = (double)bufferFrames;
-
-    size_t k;
-
-    for (k=0; k < numFrames; k++)
-    {
-        const double findex = std::floor(phase);
-        const size_t index = (size_t)findex;
-
-        const float* xm;
-        const float* x0;
-        const float* x1;
-        const float* x2;
-
-        if (index == 0)
-        {
-            if (wrapInterp)
-                xm = buffer + (bufferFrames - 1) * bufferChannels;
-            else
-                xm = buffer;
-        }
-        else
-        {
-            xm = buffer + (index - 1) * bufferChannels;
-        }
-
-        if (index < bufferEnd - 2)
-        {
-            x0 = buffer + index * bufferChannels;
-            x1 = x0 + bufferChannels;
-            x2 = x1 + bufferChannels;
-        }
-        else if (index < bufferEnd - 1)
-        {
-            x0 = buffer + index * bufferChannels;
-            x1 = x0 + bufferChannels;
-            if (wrapInterp)
-                x2 = buffer;
-            else
-                x2 = x1;
-        }
-        else if (index < bufferEnd)
-        {
-            x0 = buffer + index * bufferChannels;
-            if (wrapInterp)
-            {
-                x1 = buffer;
-                x2 = buffer + bufferChannels;
-            }
-            else
-            {
-                x1 = x0;
-                x2 = x0;
-            }
-        }
-        else
-        {
-            break;
-        }
-
-        const double x = phase - findex;
-
-        out0[k] = amp * hermite1(x, xm[bufferChannel1], x0[bufferChannel1], x1[bufferChannel1], x2[bufferChannel1]);
-        out1[k] = amp * hermite1(x, xm[bufferChannel2], x0[bufferChannel2], x1[bufferChannel2], x2[bufferChannel2]);
-
-        phase += rate;
-
-        if (wrapPhase && phase >= maxPhase)
-            phase -= maxPhase;
-    }
-
-    return k;
-}
-
 static inline void
 process_interp(
     const Methcla_World* world,
@@ -405,59 +282,42 @@ process_interp(
     size_t numFrames,
     float amp,
     float rate,
-    const float* buffer,
-    float* out0,
-    float* out1 )
+    const void* buffer,
+    float* const* outputs )
 {
+    using namespace Methcla::Plugin::Resample;
+
     const size_t bufferFrames = self->frames;
-    const size_t bufferChannels = self->channels;
     double phase = self->phase;
+    size_t numFramesProduced;
 
-    if (self->loop)
+    if (!self->complete)
     {
-        size_t numFramesProduced = 0;
+        const Methcla_SampleBuffer* source = self->engineBuffer ? self->engineBuffer : self->sampleBuffer;
+        const int64_t available = methcla_sample_buffer_frames_available(source) - (int64_t)self->offset;
+        self->complete = available >= (int64_t)bufferFrames;
 
-        while (numFramesProduced < numFrames)
+        if (!self->complete)
         {
-            numFramesProduced += resample<true,true>(
-                out0 + numFramesProduced,
-                out1 + numFramesProduced,
-                numFrames - numFramesProduced,
-                buffer,
-                bufferChannels,
-                bufferFrames,
-                bufferFrames,
-                amp,
-                rate,
-                phase
-            );
+            // Play up to the frames loaded so far and output silence when
+            // catching up with the loader; neither loop nor free the buffer
+            // until it is complete.
+            const Source src = { buffer, self->format, self->channels, bufferFrames, false };
+            numFramesProduced = available <= 0 ? 0 : resample(self->quality, src, available, phase, rate, amp, outputs, self->numOutputs, numFrames);
+            clear(outputs, self->numOutputs, numFramesProduced, numFrames);
+
+            self->phase = phase;
+            return;
         }
-
-        assert(numFramesProduced == numFrames);
     }
-    else
+
+    const Source src = { buffer, self->format, self->channels, bufferFrames, self->loop };
+    numFramesProduced = resample(self->quality, src, self->loop ? std::numeric_limits<int64_t>::max() : (int64_t)bufferFrames, phase, rate, amp, outputs, self->numOutputs, numFrames);
+
+    if (numFramesProduced < numFrames)
     {
-        const size_t numFramesProduced = resample<false,false>(
-            out0,
-            out1,
-            numFrames,
-            buffer,
-            bufferChannels,
-            bufferFrames,
-            bufferFrames,
-            amp,
-            rate,
-            phase
-        );
-
-        if (numFramesProduced < numFrames)
-        {
-            for (size_t k = numFramesProduced; k < numFrames; k++)
-            {
-                out0[k] = out1[k] = 0.f;
-            }
-            freeBuffer(world, self);
-        }
+        clear(outputs, self->numOutputs, numFramesProduced, numFrames);
+        freeBuffer(world, self);
     }
 
     self->phase = phase;
@@ -467,21 +327,18 @@ static void
 process(const Methcla_World* world, Methcla_Synth* synth, size_t numFrames)
 {
     Synth* self = (Synth*)synth;
-    float* out0 = self->ports[kSampler_output_0];
-    float* out1 = self->ports[kSampler_output_1];
-    const float* buffer = self->buffer;
+    float* const* outputs = self->ports + kSampler_output_0;
+    const void* buffer = self->buffer;
 
     if (buffer)
     {
         const float amp = *self->ports[kSampler_amp];
         const float rate = *self->ports[kSampler_rate];
-        process_interp(world, self, numFrames, amp, rate, buffer, out0, out1);
+        process_interp(world, self, numFrames, amp, rate, buffer, outputs);
     }
     else
     {
-        for (size_t k = 0; k < numFrames; k++) {
-            out0[k] = out1[k] = 0.f;
-        }
+        Methcla::Plugin::Resample::clear(outputs, self->numOutputs, 0, numFrames);
     }
 }
 
@@ -496,7 +353,8 @@ static const Methcla_SynthDef descriptor =
     connect,
     nullptr,
     process,
-    destroy
+    destroy,
+    nullptr
 };
 
 static const Methcla_Library library = { NULL, NULL };
@@ -505,6 +363,8 @@ static const Methcla_Library library = { NULL, NULL };
 
 METHCLA_EXPORT const Methcla_Library* methcla_plugins_sampler(const Methcla_Host* host, const char* /* bundlePath */)
 {
+    // Compute the interpolation tables outside the realtime context.
+    Methcla::Plugin::Resample::sincTable();
     methcla_host_register_synthdef(host, &descriptor);
     return &library;
 }
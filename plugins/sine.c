@@ -15,15 +15,13 @@
 */
 
 #include <methcla/plugins/sine.h>
+#include <methcla/plugins/oscillator.h>
 
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-/* M_PI is not in C11 */
-static const double kPi = 3.14159265358979323846264338327950288;
-
 typedef enum {
     kSine_freq,
     kSine_amp,
@@ -33,6 +31,7 @@ typedef enum {
 
 typedef struct {
     float* ports[kSinePorts];
+    // Phase in cycles, wrapped to [-0.5, 0.5].
     double phase;
     double freqToPhaseInc;
 } Sine;
@@ -69,7 +68,7 @@ construct( const Methcla_World* world
 {
     Sine* sine = (Sine*)synth;
     sine->phase = 0.;
-    sine->freqToPhaseInc = 2.*kPi/methcla_world_samplerate(world);
+    sine->freqToPhaseInc = 1./methcla_world_samplerate(world);
     // methcla_world_perform_command(world, print_freq, sine);
 }
 
@@ -88,16 +87,10 @@ process(const Methcla_World* world, Methcla_Synth* synth, size_t numFrames)
 
     const float freq      = *sine->ports[kSine_freq];
     const float amp       = *sine->ports[kSine_amp];
-    double phase          = sine->phase;
     const double phaseInc = freq * sine->freqToPhaseInc;
     float* const output   = sine->ports[kSine_out];
 
-    for (size_t k = 0; k < numFrames; k++) {
-        output[k] = amp * sin(phase);
-        phase += phaseInc;
-    }
-
-    sine->phase = phase;
+    sine->phase = methcla_oscillator_sine(output, numFrames, sine->phase, phaseInc, amp);
 }
 
 static const Methcla_SynthDef descriptor =
@@ -110,6 +103,7 @@ static const Methcla_SynthDef descriptor =
     connect,
     NULL,
     process,
+    NULL,
     NULL
 };
 
@@ -0,0 +1,892 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <methcla/plugins/soundfile_api_async.h>
+#include "soundfile_pcm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  define METHCLA_SOUNDFILE_API_ASYNC_IO_URING 1
+# endif
+#endif
+
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+# include <linux/io_uring.h>
+# include <poll.h>
+# include <sys/eventfd.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+#endif
+
+namespace
+{
+using namespace Methcla::Plugin::PCMFile;
+
+// Size of a read-ahead segment in bytes; a multiple of the logical block
+// size of any device, as required for direct I/O.
+const size_t kSegmentSize = 256 * 1024;
+// Number of segments read ahead per file.
+const size_t kNumSegments = 4;
+// Alignment of segment buffers.
+const size_t kAlignment = 4096;
+// Number of bytes read for parsing the file header.
+const size_t kHeaderSize = 64 * 1024;
+// Number of reader threads when io_uring is not available.
+const size_t kNumReaderThreads = 4;
+// Maximum number of reads in flight in the io_uring submission queue.
+const unsigned kQueueDepth = 256;
+
+std::atomic<bool> gDirectIO(false);
+
+enum SegmentState
+{
+    kSegmentEmpty,
+    kSegmentPending,
+    kSegmentReady,
+    kSegmentFailed
+};
+
+struct SoundFileHandle;
+
+//* Aligned region of a sound file read ahead of the read position.
+struct Segment
+{
+    SoundFileHandle* file;
+    uint8_t*         data;
+    // Offset in the file, a multiple of kSegmentSize.
+    uint64_t         offset;
+    // Number of bytes expected and number of bytes read so far.
+    size_t           expected;
+    size_t           size;
+    SegmentState     state;
+    int              error;
+    struct iovec     iov;
+};
+
+class IOService;
+
+struct SoundFileHandle
+{
+    Methcla_SoundFile       soundFile;
+    IOService*              service;
+    int                     fd;
+    SampleLayout            layout;
+    uint64_t                dataEnd;
+    int64_t                 position;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    size_t                  numPending;
+    bool                    closing;
+    uint8_t*                buffer;
+    Segment                 segments[kNumSegments];
+    // Frame straddling two segments.
+    std::vector<uint8_t>    frameBuffer;
+
+    SoundFileHandle(IOService* service_)
+        : service(service_)
+        , fd(-1)
+        , dataEnd(0)
+        , position(0)
+        , numPending(0)
+        , closing(false)
+        , buffer(nullptr)
+    {
+        std::memset(&soundFile, 0, sizeof(soundFile));
+        std::memset(&layout, 0, sizeof(layout));
+        std::memset(segments, 0, sizeof(segments));
+    }
+
+    ~SoundFileHandle()
+    {
+        if (fd != -1)
+            ::close(fd);
+        free(buffer);
+    }
+
+    SoundFileHandle(const SoundFileHandle&) = delete;
+    SoundFileHandle& operator=(const SoundFileHandle&) = delete;
+
+    uint64_t byteOffset(int64_t frame) const
+    {
+        return layout.dataOffset + (uint64_t)frame * layout.frameSize();
+    }
+
+    Segment* find(uint64_t offset)
+    {
+        for (size_t i=0; i < kNumSegments; i++)
+        {
+            if (segments[i].state != kSegmentEmpty && segments[i].offset == offset)
+                return &segments[i];
+        }
+        return nullptr;
+    }
+};
+
+inline uint64_t segmentOffset(uint64_t byteOffset)
+{
+    return byteOffset - byteOffset % kSegmentSize;
+}
+
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+//* Minimal io_uring interface on top of the system calls.
+class IoUring
+{
+public:
+    IoUring()
+        : m_fd(-1)
+        , m_sqRing(MAP_FAILED)
+        , m_cqRing(MAP_FAILED)
+        , m_sqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+    { }
+
+    ~IoUring()
+    {
+        if (m_sqes != MAP_FAILED)
+            munmap(m_sqes, m_sqesSize);
+        if (m_cqRing != MAP_FAILED)
+            munmap(m_cqRing, m_cqRingSize);
+        if (m_sqRing != MAP_FAILED)
+            munmap(m_sqRing, m_sqRingSize);
+        if (m_fd != -1)
+            ::close(m_fd);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    //* Set up the rings; returns false if io_uring is not supported.
+    bool init(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (m_fd == -1)
+            return false;
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED)
+            return false;
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED)
+            return false;
+        m_sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, m_sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        if (m_sqes == MAP_FAILED)
+            return false;
+
+        uint8_t* sq = static_cast<uint8_t*>(m_sqRing);
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_sqEntries = params.sq_entries;
+
+        uint8_t* cq = static_cast<uint8_t*>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        m_sqLocalTail = *m_sqTail;
+        m_numQueued = 0;
+
+        return true;
+    }
+
+    //* Return the next free submission queue entry or nullptr if the queue is full.
+    io_uring_sqe* next()
+    {
+        const unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqLocalTail - head >= m_sqEntries)
+            return nullptr;
+        const unsigned index = m_sqLocalTail & m_sqMask;
+        io_uring_sqe* sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        m_sqLocalTail++;
+        m_numQueued++;
+        return sqe;
+    }
+
+    //* Submit all queued entries and wait for at least one completion.
+    //
+    // Returns 0 or a negative error code.
+    int submitAndWait()
+    {
+        __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+        for (;;)
+        {
+            const int result = (int)syscall(__NR_io_uring_enter, m_fd, m_numQueued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (result >= 0)
+            {
+                m_numQueued -= std::min<unsigned>(m_numQueued, result);
+                return 0;
+            }
+            if (errno != EINTR)
+                return -errno;
+        }
+    }
+
+    //* Call func(user_data, result) for each completed entry.
+    template <class F> void complete(F func)
+    {
+        unsigned head = *m_cqHead;
+        const unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            func(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int             m_fd;
+    void*           m_sqRing;
+    size_t          m_sqRingSize;
+    void*           m_cqRing;
+    size_t          m_cqRingSize;
+    io_uring_sqe*   m_sqes;
+    size_t          m_sqesSize;
+    unsigned*       m_sqHead;
+    unsigned*       m_sqTail;
+    unsigned        m_sqMask;
+    unsigned*       m_sqArray;
+    unsigned        m_sqEntries;
+    unsigned        m_sqLocalTail;
+    unsigned        m_numQueued;
+    unsigned*       m_cqHead;
+    unsigned*       m_cqTail;
+    unsigned        m_cqMask;
+    io_uring_cqe*   m_cqes;
+};
+#endif // METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+
+void prefetch(SoundFileHandle* file);
+
+//* Read segments of all open files.
+//
+// With io_uring a single thread submits all segments queued since its last
+// wakeup with one system call; otherwise a pool of threads reads them one
+// at a time.
+class IOService
+{
+public:
+    IOService()
+        : m_continue(true)
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+        , m_eventFd(-1)
+        , m_ringFailed(false)
+#endif
+    {
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+        if (m_ring.init(kQueueDepth))
+        {
+            m_eventFd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+            if (m_eventFd != -1)
+            {
+                m_threads.emplace_back([this](){ this->processRing(); });
+                return;
+            }
+        }
+#endif
+        for (size_t i=0; i < kNumReaderThreads; i++)
+            m_threads.emplace_back([this](){ this->processBlocking(); });
+    }
+
+    ~IOService()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_continue = false;
+        }
+        wakeup();
+        for (auto& thread : m_threads)
+            thread.join();
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+        if (m_eventFd != -1)
+            ::close(m_eventFd);
+#endif
+    }
+
+    IOService(const IOService&) = delete;
+    IOService& operator=(const IOService&) = delete;
+
+    //* Queue segment for reading the remaining bytes.
+    void submit(Segment* segment)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(segment);
+        }
+        wakeup();
+    }
+
+private:
+    void wakeup()
+    {
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+        if (m_eventFd != -1 && !m_ringFailed.load(std::memory_order_acquire))
+        {
+            const uint64_t value = 1;
+            ssize_t result = write(m_eventFd, &value, sizeof(value));
+            (void)result;
+            return;
+        }
+#endif
+        m_cond.notify_all();
+    }
+
+    // Segment reads are completed outside of the service lock because
+    // completion may queue more segments.
+    static void complete(Segment* segment, ssize_t result)
+    {
+        SoundFileHandle* file = segment->file;
+        std::lock_guard<std::mutex> lock(file->mutex);
+        if (result < 0)
+        {
+            segment->state = kSegmentFailed;
+            segment->error = (int)-result;
+        }
+        else
+        {
+            segment->size += result;
+            if (result > 0 && segment->size < segment->expected && !file->closing)
+            {
+                // Short read; continue after the bytes read so far.
+                file->service->submit(segment);
+                return;
+            }
+            segment->state = kSegmentReady;
+        }
+        file->numPending--;
+        prefetch(file);
+        file->cond.notify_all();
+    }
+
+    void processBlocking()
+    {
+        for (;;)
+        {
+            Segment* segment;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this](){ return !m_continue || !m_queue.empty(); });
+                if (m_queue.empty())
+                    break;
+                segment = m_queue.front();
+                m_queue.pop_front();
+            }
+            const ssize_t result = pread(
+                segment->file->fd,
+                segment->data + segment->size,
+                kSegmentSize - segment->size,
+                segment->offset + segment->size);
+            complete(segment, result < 0 ? -errno : result);
+        }
+    }
+
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+    void pollEvent()
+    {
+        io_uring_sqe* sqe = m_ring.next();
+        assert(sqe != nullptr);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = m_eventFd;
+        sqe->poll_events = POLLIN;
+        sqe->user_data = 0;
+    }
+
+    void processRing()
+    {
+        // The event file descriptor wakes up the thread when segments are queued.
+        pollEvent();
+
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_continue && m_queue.empty() && m_inflight.empty())
+                    break;
+                // One entry is reserved for polling the event file descriptor.
+                while (!m_queue.empty() && m_inflight.size() < kQueueDepth - 1)
+                {
+                    io_uring_sqe* sqe = m_ring.next();
+                    if (sqe == nullptr)
+                        break;
+                    Segment* segment = m_queue.front();
+                    m_queue.pop_front();
+                    segment->iov.iov_base = segment->data + segment->size;
+                    segment->iov.iov_len = kSegmentSize - segment->size;
+                    sqe->opcode = IORING_OP_READV;
+                    sqe->fd = segment->file->fd;
+                    sqe->off = segment->offset + segment->size;
+                    sqe->addr = (uint64_t)(uintptr_t)&segment->iov;
+                    sqe->len = 1;
+                    sqe->user_data = (uint64_t)(uintptr_t)segment;
+                    m_inflight.insert(segment);
+                }
+            }
+
+            const int result = m_ring.submitAndWait();
+            if (result < 0 && result != -EAGAIN && result != -EBUSY)
+            {
+                failRing(result);
+                // Read the remaining segments with blocking I/O on this thread.
+                processBlocking();
+                break;
+            }
+
+            m_ring.complete([this](uint64_t userData, int32_t res) { this->completeRing(userData, res); });
+        }
+    }
+
+    void completeRing(uint64_t userData, int32_t res)
+    {
+        if (userData == 0)
+        {
+            uint64_t value;
+            ssize_t n = read(m_eventFd, &value, sizeof(value));
+            (void)n;
+            if (!m_ringFailed.load(std::memory_order_relaxed))
+                pollEvent();
+        }
+        else
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_inflight.erase(reinterpret_cast<Segment*>(userData));
+            }
+            complete(reinterpret_cast<Segment*>(userData), res);
+        }
+    }
+
+    //* Fail the segments submitted to the ring after an unrecoverable error.
+    //
+    // Their completions would never be reaped, so files waiting for them
+    // couldn't be closed.
+    void failRing(int error)
+    {
+        std::vector<Segment*> segments;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // Segments queued from now on are read by processBlocking.
+            m_ringFailed.store(true, std::memory_order_release);
+        }
+
+        // Completions that arrived before the error are still valid.
+        m_ring.complete([this](uint64_t userData, int32_t res) { this->completeRing(userData, res); });
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            segments.assign(m_inflight.begin(), m_inflight.end());
+            m_inflight.clear();
+        }
+        for (auto segment : segments)
+            complete(segment, error);
+    }
+#endif
+
+private:
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    bool                    m_continue;
+    std::deque<Segment*>    m_queue;
+    std::vector<std::thread> m_threads;
+#if METHCLA_SOUNDFILE_API_ASYNC_IO_URING
+    IoUring                 m_ring;
+    int                     m_eventFd;
+    // Segments submitted to the ring whose completions haven't been reaped yet.
+    std::unordered_set<Segment*> m_inflight;
+    std::atomic<bool>       m_ringFailed;
+#endif
+};
+
+//* Queue reads for the segments ahead of the read position.
+//
+// Must be called with the file's mutex locked.
+void prefetch(SoundFileHandle* file)
+{
+    if (file->closing)
+        return;
+
+    const uint64_t begin = segmentOffset(file->byteOffset(file->position));
+    const uint64_t end = begin + kNumSegments * kSegmentSize;
+
+    for (uint64_t offset = begin; offset < std::min(end, file->dataEnd); offset += kSegmentSize)
+    {
+        if (file->find(offset) != nullptr)
+            continue;
+
+        // Reuse a segment outside of the window; segments still being read
+        // after a seek become available when their reads complete.
+        Segment* segment = nullptr;
+        for (size_t i=0; i < kNumSegments; i++)
+        {
+            Segment* s = &file->segments[i];
+            if (s->state != kSegmentPending
+                && (s->state == kSegmentEmpty || s->offset < begin || s->offset >= end))
+            {
+                segment = s;
+                break;
+            }
+        }
+        if (segment == nullptr)
+            break;
+
+        segment->offset = offset;
+        segment->expected = (size_t)std::min<uint64_t>(kSegmentSize, file->dataEnd - offset);
+        segment->size = 0;
+        segment->state = kSegmentPending;
+        segment->error = 0;
+        file->numPending++;
+        file->service->submit(segment);
+    }
+}
+
+//* Return a pointer to the data at offset and the number of bytes available.
+//
+// Waits for the segment containing offset to be read. Returns nullptr and
+// sets error if the read failed.
+const uint8_t* acquire(SoundFileHandle* file, std::unique_lock<std::mutex>& lock, uint64_t offset, size_t& available, int& error)
+{
+    for (;;)
+    {
+        Segment* segment = file->find(segmentOffset(offset));
+        if (segment == nullptr)
+        {
+            prefetch(file);
+            segment = file->find(segmentOffset(offset));
+        }
+        if (segment == nullptr || segment->state == kSegmentPending)
+        {
+            file->cond.wait(lock);
+            continue;
+        }
+        if (segment->state == kSegmentFailed)
+        {
+            // Retry on the next read.
+            segment->state = kSegmentEmpty;
+            error = segment->error;
+            return nullptr;
+        }
+        const size_t begin = (size_t)(offset - segment->offset);
+        available = segment->size > begin
+                        ? (size_t)std::min<uint64_t>(segment->size - begin, file->dataEnd - offset)
+                        : 0;
+        return segment->data + begin;
+    }
+}
+
+} // namespace
+
+extern "C" {
+    static Methcla_Error soundfile_close(const Methcla_SoundFile*);
+    static Methcla_Error soundfile_seek(const Methcla_SoundFile*, int64_t);
+    static Methcla_Error soundfile_tell(const Methcla_SoundFile*, int64_t*);
+    static Methcla_Error soundfile_read_float(const Methcla_SoundFile*, float*, size_t, size_t*);
+    static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char*, Methcla_FileMode, Methcla_SoundFile**, Methcla_SoundFileInfo*);
+} // extern "C"
+
+static Methcla_Error soundfile_close(const Methcla_SoundFile* file)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    {
+        // The buffers must stay valid until all reads have completed.
+        std::unique_lock<std::mutex> lock(handle->mutex);
+        handle->closing = true;
+        handle->cond.wait(lock, [handle](){ return handle->numPending == 0; });
+    }
+    delete handle;
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_seek(const Methcla_SoundFile* file, int64_t numFrames)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    if (numFrames < 0 || numFrames > handle->layout.frames)
+        return methcla_error_new(kMethcla_ArgumentError);
+    handle->position = numFrames;
+    prefetch(handle);
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_tell(const Methcla_SoundFile* file, int64_t* numFrames)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    *numFrames = handle->position;
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_read_float(const Methcla_SoundFile* file, float* buffer, size_t inNumFrames, size_t* outNumFrames)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    std::unique_lock<std::mutex> lock(handle->mutex);
+
+    const size_t channels = handle->layout.channels;
+    const size_t frameSize = handle->layout.frameSize();
+    const size_t numFrames = (size_t)std::min<int64_t>(inNumFrames, handle->layout.frames - handle->position);
+
+    size_t done = 0;
+    int error = 0;
+
+    while (done < numFrames)
+    {
+        const uint64_t offset = handle->byteOffset(handle->position);
+        size_t available;
+        const uint8_t* data = acquire(handle, lock, offset, available, error);
+        if (data == nullptr)
+            break;
+        // Premature end of file.
+        if (available == 0)
+            break;
+
+        if (available >= frameSize)
+        {
+            const size_t n = std::min(numFrames - done, available / frameSize);
+            convertSamples(data, buffer + done * channels, n * channels, handle->layout.format, handle->layout.bigEndian);
+            done += n;
+            handle->position += n;
+        }
+        else
+        {
+            // The frame continues in the next segment.
+            std::memcpy(handle->frameBuffer.data(), data, available);
+            size_t available2;
+            const uint8_t* data2 = acquire(handle, lock, offset + available, available2, error);
+            if (data2 == nullptr)
+                break;
+            if (available2 < frameSize - available)
+                break;
+            std::memcpy(handle->frameBuffer.data() + available, data2, frameSize - available);
+            convertSamples(handle->frameBuffer.data(), buffer + done * channels, channels, handle->layout.format, handle->layout.bigEndian);
+            done++;
+            handle->position++;
+        }
+    }
+
+    // Read ahead of the new position.
+    prefetch(handle);
+
+    *outNumFrames = done;
+
+    return error == 0 ? methcla_no_error() : systemError(error);
+}
+
+static bool readHeader(int fd, std::vector<uint8_t>& header)
+{
+    size_t size = 0;
+    while (size < header.size())
+    {
+        const ssize_t result = pread(fd, header.data() + size, header.size() - size, size);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (result == 0)
+            break;
+        size += result;
+    }
+    header.resize(size);
+    return true;
+}
+
+static int openDirect(const char* path)
+{
+#if defined(O_DIRECT)
+    return open(path, O_RDONLY|O_CLOEXEC|O_DIRECT);
+#elif defined(F_NOCACHE)
+    const int fd = open(path, O_RDONLY|O_CLOEXEC);
+    if (fd != -1 && fcntl(fd, F_NOCACHE, 1) == -1)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+static Methcla_Error soundfile_open(const Methcla_SoundFileAPI* api, const char* path, Methcla_FileMode mode, Methcla_SoundFile** outFile, Methcla_SoundFileInfo* info)
+{
+    if (path == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (outFile == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (mode != kMethcla_FileModeRead)
+        // Let other APIs handle writing.
+        return methcla_error_new_with_message(kMethcla_UnsupportedFileTypeError, "Asynchronous sound files are read only");
+
+    std::unique_ptr<SoundFileHandle> handle;
+    std::vector<uint8_t> header;
+
+    try {
+        handle.reset(new SoundFileHandle(static_cast<IOService*>(api->handle)));
+        header.resize(kHeaderSize);
+    } catch (std::bad_alloc&) {
+        return methcla_error_new(kMethcla_MemoryError);
+    }
+
+    handle->fd = open(path, O_RDONLY|O_CLOEXEC);
+    if (handle->fd == -1)
+        return systemError(errno);
+
+    struct stat st;
+    if (fstat(handle->fd, &st) == -1)
+        return systemError(errno);
+
+    if (!readHeader(handle->fd, header))
+        return systemError(errno);
+
+    Methcla_ErrorCode result = parseWAV(header.data(), header.size(), st.st_size, handle->layout);
+    if (result == kMethcla_UnsupportedFileTypeError)
+        result = parseAIFF(header.data(), header.size(), st.st_size, handle->layout);
+    if (result != kMethcla_NoError)
+        return methcla_error_new(result);
+
+    if (gDirectIO.load(std::memory_order_relaxed))
+    {
+        // Fall back to buffered I/O if the file system doesn't support direct I/O.
+        const int fd = openDirect(path);
+        if (fd != -1)
+        {
+            ::close(handle->fd);
+            handle->fd = fd;
+        }
+    }
+
+    handle->dataEnd = handle->byteOffset(handle->layout.frames);
+
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, kAlignment, kNumSegments * kSegmentSize) != 0)
+        return methcla_error_new(kMethcla_MemoryError);
+    handle->buffer = static_cast<uint8_t*>(buffer);
+
+    for (size_t i=0; i < kNumSegments; i++)
+    {
+        handle->segments[i].file = handle.get();
+        handle->segments[i].data = handle->buffer + i * kSegmentSize;
+        handle->segments[i].state = kSegmentEmpty;
+    }
+
+    try {
+        handle->frameBuffer.resize(handle->layout.frameSize());
+    } catch (std::bad_alloc&) {
+        return methcla_error_new(kMethcla_MemoryError);
+    }
+
+    Methcla_SoundFile* file = &handle->soundFile;
+    file->handle = handle.get();
+    file->close = soundfile_close;
+    file->seek = soundfile_seek;
+    file->tell = soundfile_tell;
+    file->read_float = soundfile_read_float;
+
+    *outFile = file;
+
+    if (info != nullptr)
+    {
+        info->frames = handle->layout.frames;
+        info->channels = handle->layout.channels;
+        info->samplerate = handle->layout.samplerate;
+        info->file_type = handle->layout.fileType;
+        info->file_format = handle->layout.format;
+    }
+
+    // Start reading ahead.
+    {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        prefetch(handle.get());
+    }
+    handle.release();
+
+    return methcla_no_error();
+}
+
+class AsyncLibrary
+{
+public:
+    AsyncLibrary()
+    {
+        m_library.handle = this;
+        m_library.destroy = destroy;
+        m_api.handle = &m_service;
+        m_api.valid_file_extensions = "wav,wave,aif,aiff,aifc";
+        m_api.open = soundfile_open;
+    }
+
+    const Methcla_Library* library() const
+    {
+        return &m_library;
+    }
+
+    const Methcla_SoundFileAPI* api() const
+    {
+        return &m_api;
+    }
+
+private:
+    static void destroy(const Methcla_Library* library)
+    {
+        // Stops the I/O threads.
+        delete static_cast<AsyncLibrary*>(library->handle);
+    }
+
+private:
+    Methcla_Library         m_library;
+    Methcla_SoundFileAPI    m_api;
+    IOService               m_service;
+};
+
+METHCLA_EXPORT void methcla_soundfile_api_async_set_direct_io(bool flag)
+{
+    gDirectIO.store(flag, std::memory_order_relaxed);
+}
+
+METHCLA_EXPORT const Methcla_Library* methcla_soundfile_api_async(const Methcla_Host* host, const char*)
+{
+    AsyncLibrary* library = new AsyncLibrary();
+    methcla_host_register_soundfile_api(host, library->api());
+    return library->library();
+}
@@ -87,6 +87,7 @@ extern "C" {
     static Methcla_Error soundfile_seek(const Methcla_SoundFile*, int64_t);
     static Methcla_Error soundfile_tell(const Methcla_SoundFile*, int64_t*);
     static Methcla_Error soundfile_read_float(const Methcla_SoundFile*, float*, size_t, size_t*);
+    static Methcla_Error soundfile_write_float(const Methcla_SoundFile*, const float*, size_t, size_t*);
     static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char*, Methcla_FileMode, Methcla_SoundFile**, Methcla_SoundFileInfo*);
 } // extern "C"
 
@@ -125,6 +126,18 @@ static Methcla_Error soundfile_read_float(const Methcla_SoundFile* file, float*
     return methcla_no_error();
 }
 
+static Methcla_Error soundfile_write_float(const Methcla_SoundFile* file, const float* buffer, size_t inNumFrames, size_t* outNumFrames)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+
+    sf_count_t n = sf_writef_float(handle->sndfile, buffer, inNumFrames);
+    if (n < (sf_count_t)inNumFrames) return handle->error();
+
+    *outNumFrames = n;
+
+    return methcla_no_error();
+}
+
 static bool convertMode(Methcla_FileMode mode, int* outMode)
 {
     switch (mode) {
@@ -138,6 +151,37 @@ static bool convertMode(Methcla_FileMode mode, int* outMode)
     return true;
 }
 
+static Methcla_SoundFileFormat convertFormat(int format)
+{
+    switch (format & SF_FORMAT_SUBMASK) {
+        case SF_FORMAT_PCM_16: return kMethcla_SoundFileFormatPCM16;
+        case SF_FORMAT_PCM_24: return kMethcla_SoundFileFormatPCM24;
+        case SF_FORMAT_PCM_32: return kMethcla_SoundFileFormatPCM32;
+        case SF_FORMAT_FLOAT:  return kMethcla_SoundFileFormatFloat;
+    }
+    return kMethcla_SoundFileFormatUnknown;
+}
+
+//* Convert file type and sample format to a libsndfile format for writing.
+static bool convertInfo(const Methcla_SoundFileInfo* info, int* outFormat)
+{
+    int format;
+    switch (info->file_type) {
+        case kMethcla_SoundFileTypeAIFF: format = SF_FORMAT_AIFF; break;
+        case kMethcla_SoundFileTypeWAV:  format = SF_FORMAT_WAV; break;
+        default: return false;
+    }
+    switch (info->file_format) {
+        case kMethcla_SoundFileFormatPCM16: format |= SF_FORMAT_PCM_16; break;
+        case kMethcla_SoundFileFormatPCM24: format |= SF_FORMAT_PCM_24; break;
+        case kMethcla_SoundFileFormatPCM32: format |= SF_FORMAT_PCM_32; break;
+        case kMethcla_SoundFileFormatFloat: format |= SF_FORMAT_FLOAT; break;
+        default: return false;
+    }
+    *outFormat = format;
+    return true;
+}
+
 static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* path, Methcla_FileMode mode, Methcla_SoundFile** outFile, Methcla_SoundFileInfo* info)
 {
     if (path == nullptr)
@@ -155,6 +199,15 @@ static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* pat
     auto handleRef = SoundFileHandle::Ref(handle);
 
     SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    if (mode == kMethcla_FileModeWrite)
+    {
+        if (info == nullptr || !convertInfo(info, &sfinfo.format))
+            return methcla_error_new(kMethcla_ArgumentError);
+        sfinfo.channels = info->channels;
+        sfinfo.samplerate = info->samplerate;
+    }
+
     handle->sndfile = sf_open(path, sfmode, &sfinfo);
     if (handle->sndfile == nullptr)
         return handle->error();
@@ -166,6 +219,7 @@ static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* pat
     file->seek = soundfile_seek;
     file->tell = soundfile_tell;
     file->read_float = soundfile_read_float;
+    file->write_float = soundfile_write_float;
 
     *outFile = file;
 
@@ -174,6 +228,7 @@ static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* pat
         info->frames = sfinfo.frames;
         info->channels = sfinfo.channels;
         info->samplerate = sfinfo.samplerate;
+        info->file_format = convertFormat(sfinfo.format);
     }
 
     // METHCLA_PRINT_DEBUG("soundfile_open: %s %lld %u %u", path, info->frames, info->channels, info->samplerate);
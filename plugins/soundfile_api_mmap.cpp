@@ -0,0 +1,217 @@
+// Copyright 2013 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <methcla/plugins/soundfile_api_mmap.h>
+#include "soundfile_pcm.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+using namespace Methcla::Plugin::PCMFile;
+
+struct SoundFileHandle
+{
+    void*             mapping;
+    size_t            mappingSize;
+    SampleLayout      layout;
+    int64_t           position;
+    Methcla_SoundFile soundFile;
+
+    struct Destructor
+    {
+        void operator()(SoundFileHandle* handle)
+        {
+            if (handle != nullptr)
+            {
+                if (handle->mapping != nullptr)
+                    munmap(handle->mapping, handle->mappingSize);
+                free(handle);
+            }
+        }
+    };
+
+    typedef std::unique_ptr<SoundFileHandle,Destructor> Ref;
+
+    const uint8_t* frame(int64_t index) const
+    {
+        return static_cast<const uint8_t*>(mapping) + layout.dataOffset + index * layout.frameSize();
+    }
+};
+
+} // namespace
+
+extern "C" {
+    static Methcla_Error soundfile_close(const Methcla_SoundFile*);
+    static Methcla_Error soundfile_seek(const Methcla_SoundFile*, int64_t);
+    static Methcla_Error soundfile_tell(const Methcla_SoundFile*, int64_t*);
+    static Methcla_Error soundfile_read_float(const Methcla_SoundFile*, float*, size_t, size_t*);
+    static Methcla_Error soundfile_view(const Methcla_SoundFile*, Methcla_SoundFileView*);
+    static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char*, Methcla_FileMode, Methcla_SoundFile**, Methcla_SoundFileInfo*);
+} // extern "C"
+
+static Methcla_Error soundfile_close(const Methcla_SoundFile* file)
+{
+    SoundFileHandle::Destructor()(static_cast<SoundFileHandle*>(file->handle));
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_seek(const Methcla_SoundFile* file, int64_t numFrames)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    if (numFrames < 0 || numFrames > handle->layout.frames)
+        return methcla_error_new(kMethcla_ArgumentError);
+    handle->position = numFrames;
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_tell(const Methcla_SoundFile* file, int64_t* numFrames)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    *numFrames = handle->position;
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_read_float(const Methcla_SoundFile* file, float* buffer, size_t inNumFrames, size_t* outNumFrames)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+
+    const size_t numFrames = (size_t)std::min<int64_t>(inNumFrames, handle->layout.frames - handle->position);
+
+    convertSamples(
+        handle->frame(handle->position),
+        buffer,
+        numFrames * handle->layout.channels,
+        handle->layout.format,
+        handle->layout.bigEndian);
+
+    handle->position += numFrames;
+    *outNumFrames = numFrames;
+
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_view(const Methcla_SoundFile* file, Methcla_SoundFileView* view)
+{
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+
+    if (!handle->layout.isNativeByteOrder())
+        return methcla_error_new(kMethcla_UnsupportedDataFormatError);
+
+    view->data = handle->frame(0);
+    view->frames = handle->layout.frames;
+    view->channels = handle->layout.channels;
+    view->format = handle->layout.format;
+
+    return methcla_no_error();
+}
+
+static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* path, Methcla_FileMode mode, Methcla_SoundFile** outFile, Methcla_SoundFileInfo* info)
+{
+    if (path == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (outFile == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (mode != kMethcla_FileModeRead)
+        // Let other APIs handle writing.
+        return methcla_error_new_with_message(kMethcla_UnsupportedFileTypeError, "Memory mapped sound files are read only");
+
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(std::malloc(sizeof(SoundFileHandle)));
+    if (handle == nullptr)
+        return methcla_error_new(kMethcla_MemoryError);
+
+    std::memset(handle, 0, sizeof(*handle));
+    auto handleRef = SoundFileHandle::Ref(handle);
+
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return systemError(errno);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        const int code = errno;
+        ::close(fd);
+        return systemError(code);
+    }
+
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        return methcla_error_new(kMethcla_InvalidFileError);
+    }
+
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after closing the file descriptor.
+    const int code = errno;
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return systemError(code);
+
+    handle->mapping = mapping;
+    handle->mappingSize = st.st_size;
+
+    const uint8_t* data = static_cast<const uint8_t*>(mapping);
+    Methcla_ErrorCode result = parseWAV(data, handle->mappingSize, handle->mappingSize, handle->layout);
+    if (result == kMethcla_UnsupportedFileTypeError)
+        result = parseAIFF(data, handle->mappingSize, handle->mappingSize, handle->layout);
+    if (result != kMethcla_NoError)
+        return methcla_error_new(result);
+
+    Methcla_SoundFile* file = &handle->soundFile;
+    file->handle = handle;
+    file->close = soundfile_close;
+    file->seek = soundfile_seek;
+    file->tell = soundfile_tell;
+    file->read_float = soundfile_read_float;
+    file->view = soundfile_view;
+
+    *outFile = file;
+
+    if (info != nullptr)
+    {
+        info->frames = handle->layout.frames;
+        info->channels = handle->layout.channels;
+        info->samplerate = handle->layout.samplerate;
+        info->file_type = handle->layout.fileType;
+        info->file_format = handle->layout.format;
+    }
+
+    handleRef.release();
+
+    return methcla_no_error();
+}
+
+static const Methcla_SoundFileAPI kSoundFileAPI = {
+    nullptr,
+    "wav,wave,aif,aiff,aifc",
+    soundfile_open
+};
+
+METHCLA_EXPORT const Methcla_Library* methcla_soundfile_api_mmap(const Methcla_Host* host, const char*)
+{
+    methcla_host_register_soundfile_api(host, &kSoundFileAPI);
+    return nullptr;
+}
@@ -17,34 +17,62 @@
 #include <mpg123.h>
 
 #include <algorithm>
-#include <memory>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace {
+
+// Number of frames decoded ahead of the read position.
+static const size_t kDecodeAheadFrames = 65536;
+// Number of frames decoded at once by the decoder thread.
+static const size_t kDecodeChunkFrames = 4096;
+
+// Number of entries the frame index grows by.
+static const long kIndexGrowSize = 1024;
+
+// Seek index cache file format.
+static const uint32_t kIndexMagic = 0x4d504958; // "MPIX"
+static const uint32_t kIndexVersion = 2;
+
+std::mutex gIndexCacheMutex;
+std::string gIndexCacheDirectory;
+
+class DecodeService;
 
 struct SoundFileHandle
 {
-    mpg123_handle*    handle;
-    size_t            frameSize;
-    Methcla_SoundFile soundFile;
-
-    struct Destructor
+    SoundFileHandle(DecodeService* service)
+        : service(service)
+        , handle(nullptr)
+        , channels(0)
+        , frameSize(0)
+        , position(0)
+        , numFramesBuffered(0)
+        , ringPos(0)
+        , done(false)
+        , queued(false)
+        , requested(false)
+    { }
+
+    ~SoundFileHandle()
     {
-        void operator()(SoundFileHandle* handle)
+        if (handle != nullptr)
         {
-            if (handle != nullptr)
-            {
-                if (handle->handle != nullptr)
-                {
-                    mpg123_close(handle->handle);
-                    mpg123_delete(handle->handle);
-                }
-                free(handle);
-            }
+            mpg123_close(handle);
+            mpg123_delete(handle);
         }
-    };
-
-    typedef std::unique_ptr<SoundFileHandle,Destructor> Ref;
+    }
 
     Methcla_Error error(Methcla_ErrorCode code=kMethcla_UnspecifiedError)
     {
@@ -53,8 +81,305 @@ struct SoundFileHandle
             mpg123_strerror(handle)
         );
     }
+
+    //* Number of frames that can be decoded into the ring buffer.
+    size_t writable() const
+    {
+        return done ? 0 : kDecodeAheadFrames - numFramesBuffered;
+    }
+
+    DecodeService*      service;
+    // Decoder state; only accessed with decodeMutex locked.
+    mpg123_handle*      handle;
+    size_t              channels;
+    size_t              frameSize;
+    std::vector<float>  decodeBuffer;
+    std::mutex          decodeMutex;
+
+    // Ring buffer state; only accessed with mutex locked. Lock decodeMutex
+    // before mutex when both are needed.
+    std::mutex              mutex;
+    std::condition_variable cond;
+    std::vector<float>      ring;
+    // File position of the next frame returned by read_float.
+    int64_t                 position;
+    size_t                  numFramesBuffered;
+    size_t                  ringPos;
+    // Set when the decoder reached the end of the file or failed.
+    bool                    done;
+    std::string             errorMessage;
+    // Decode queue state; only accessed by DecodeService with its mutex locked.
+    // queued is set while the handle is in the queue or being decoded,
+    // requested when decoding was requested again while being decoded.
+    bool                    queued;
+    bool                    requested;
+
+    Methcla_SoundFile       soundFile;
+};
+
+//* Decodes compressed files ahead of the read position on a background thread.
+class DecodeService
+{
+public:
+    DecodeService()
+        : m_continue(true)
+    {
+        m_thread = std::thread([this](){ this->process(); });
+    }
+
+    ~DecodeService()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_continue = false;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+
+    DecodeService(const DecodeService&) = delete;
+    DecodeService& operator=(const DecodeService&) = delete;
+
+    //* Schedule decoding for a file that has space in its ring buffer.
+    void request(SoundFileHandle* file)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!file->queued)
+        {
+            file->queued = true;
+            m_queue.push_back(file);
+            m_cond.notify_one();
+        }
+        else
+        {
+            file->requested = true;
+        }
+    }
+
+    //* Remove a file from the decode queue and wait until it is not being decoded anymore.
+    void cancel(SoundFileHandle* file)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this,file](){ return m_current != file; });
+        m_queue.remove(file);
+    }
+
+private:
+    void process();
+    // Decode the next chunk of file; returns true if more chunks can be decoded.
+    bool decode(SoundFileHandle* file);
+
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cond;
+    std::condition_variable     m_done;
+    bool                        m_continue;
+    std::list<SoundFileHandle*> m_queue;
+    SoundFileHandle*            m_current = nullptr;
+    std::thread                 m_thread;
 };
 
+void DecodeService::process()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_continue)
+    {
+        if (m_queue.empty())
+        {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        SoundFileHandle* file = m_queue.front();
+        m_queue.pop_front();
+        m_current = file;
+        file->requested = false;
+
+        lock.unlock();
+        const bool more = decode(file);
+        lock.lock();
+
+        m_current = nullptr;
+        // Interleave chunks of concurrently decoded files.
+        if (more || file->requested)
+            m_queue.push_back(file);
+        else
+            file->queued = false;
+        m_done.notify_all();
+    }
+}
+
+bool DecodeService::decode(SoundFileHandle* file)
+{
+    std::lock_guard<std::mutex> decodeLock(file->decodeMutex);
+
+    size_t numFrames;
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        numFrames = std::min(kDecodeChunkFrames, file->writable());
+    }
+
+    if (numFrames == 0)
+        return false;
+
+    size_t numBytes = 0;
+    const int err = mpg123_read(
+        file->handle,
+        reinterpret_cast<unsigned char*>(file->decodeBuffer.data()),
+        numFrames * file->frameSize,
+        &numBytes
+    );
+    const size_t numFramesDecoded = numBytes / file->frameSize;
+
+    std::lock_guard<std::mutex> lock(file->mutex);
+
+    // Copy to the ring buffer in at most two segments.
+    const size_t writePos = (file->ringPos + file->numFramesBuffered) % kDecodeAheadFrames;
+    const size_t numFrames1 = std::min(numFramesDecoded, kDecodeAheadFrames - writePos);
+    std::copy(file->decodeBuffer.data(),
+              file->decodeBuffer.data() + numFrames1 * file->channels,
+              file->ring.data() + writePos * file->channels);
+    std::copy(file->decodeBuffer.data() + numFrames1 * file->channels,
+              file->decodeBuffer.data() + numFramesDecoded * file->channels,
+              file->ring.data());
+    file->numFramesBuffered += numFramesDecoded;
+
+    if (err == MPG123_DONE)
+    {
+        file->done = true;
+    }
+    else if (err != MPG123_OK && err != MPG123_NEW_FORMAT)
+    {
+        file->done = true;
+        file->errorMessage = mpg123_strerror(file->handle);
+    }
+
+    file->cond.notify_all();
+
+    return file->writable() > 0;
+}
+
+//* Return the path of the seek index cache file for path or an empty string if caching is disabled.
+std::string indexCachePath(const char* path)
+{
+    std::lock_guard<std::mutex> lock(gIndexCacheMutex);
+    if (gIndexCacheDirectory.empty())
+        return std::string();
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.mp3idx",
+             (unsigned long long)std::hash<std::string>()(path));
+    return gIndexCacheDirectory + "/" + name;
+}
+
+// Cached seek indices are stored along with the file's path, size and
+// modification time (in nanoseconds) and are rebuilt when any of them
+// changes.
+struct IndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t  fileSize;
+    int64_t  fileTime;
+    int64_t  frames;
+    int64_t  step;
+    uint64_t fill;
+    uint64_t pathSize;
+};
+
+bool fileStatus(const char* path, int64_t& size, int64_t& time)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+#if defined(__APPLE__)
+    const struct timespec& mtime = st.st_mtimespec;
+#else
+    const struct timespec& mtime = st.st_mtim;
+#endif
+    size = st.st_size;
+    time = (int64_t)mtime.tv_sec * 1000000000 + (int64_t)mtime.tv_nsec;
+    return true;
+}
+
+//* Restore a cached seek index; returns the number of frames in the file or -1.
+off_t loadIndex(mpg123_handle* handle, const char* path)
+{
+    const std::string cachePath = indexCachePath(path);
+    int64_t fileSize, fileTime;
+    if (cachePath.empty() || !fileStatus(path, fileSize, fileTime))
+        return -1;
+
+    std::unique_ptr<FILE,int(*)(FILE*)> file(fopen(cachePath.c_str(), "rb"), fclose);
+    if (!file)
+        return -1;
+
+    IndexHeader header;
+    if (fread(&header, sizeof(header), 1, file.get()) != 1
+        || header.magic != kIndexMagic
+        || header.version != kIndexVersion
+        || header.fileSize != fileSize
+        || header.fileTime != fileTime
+        || header.pathSize != strlen(path))
+        return -1;
+
+    std::string indexedPath(header.pathSize, '\0');
+    if (fread(&indexedPath[0], 1, header.pathSize, file.get()) != header.pathSize
+        || indexedPath != path)
+        return -1;
+
+    std::vector<int64_t> storedOffsets(header.fill);
+    if (fread(storedOffsets.data(), sizeof(int64_t), header.fill, file.get()) != header.fill)
+        return -1;
+
+    std::vector<off_t> offsets(storedOffsets.begin(), storedOffsets.end());
+    if (mpg123_set_index(handle, offsets.data(), header.step, offsets.size()) != MPG123_OK)
+        return -1;
+
+    return header.frames;
+}
+
+//* Write the seek index built by mpg123_scan to the cache.
+void storeIndex(mpg123_handle* handle, const char* path, off_t frames)
+{
+    const std::string cachePath = indexCachePath(path);
+    int64_t fileSize, fileTime;
+    if (cachePath.empty() || !fileStatus(path, fileSize, fileTime))
+        return;
+
+    off_t* offsets;
+    off_t step;
+    size_t fill;
+    if (mpg123_index(handle, &offsets, &step, &fill) != MPG123_OK)
+        return;
+
+    IndexHeader header;
+    header.magic = kIndexMagic;
+    header.version = kIndexVersion;
+    header.fileSize = fileSize;
+    header.fileTime = fileTime;
+    header.frames = frames;
+    header.step = step;
+    header.fill = fill;
+    header.pathSize = strlen(path);
+
+    const std::vector<int64_t> storedOffsets(offsets, offsets + fill);
+
+    // Write to a temporary file first so that concurrent readers never see a partial index.
+    const std::string tmpPath = cachePath + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr)
+        return;
+    const bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+                 && fwrite(path, 1, header.pathSize, file) == header.pathSize
+                 && fwrite(storedOffsets.data(), sizeof(int64_t), fill, file) == fill;
+    if (fclose(file) == 0 && ok)
+        rename(tmpPath.c_str(), cachePath.c_str());
+    else
+        remove(tmpPath.c_str());
+}
+
+} // namespace
+
 extern "C"
 {
     static Methcla_Error soundfile_close(const Methcla_SoundFile*);
@@ -66,55 +391,116 @@ extern "C"
 
 static Methcla_Error soundfile_close(const Methcla_SoundFile* file)
 {
-    SoundFileHandle::Destructor()(static_cast<SoundFileHandle*>(file->handle));
+    SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    handle->service->cancel(handle);
+    delete handle;
     return methcla_no_error();
 }
 
 static Methcla_Error soundfile_seek(const Methcla_SoundFile* file, int64_t numFrames)
 {
     SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
-    off_t n = mpg123_seek(handle->handle, static_cast<off_t>(std::max<int64_t>(0, numFrames)), SEEK_SET);
-    return n >= 0 ? methcla_no_error() : handle->error();
+    const int64_t target = std::max<int64_t>(0, numFrames);
+    bool skipped = false;
+
+    {
+        // Skip frames that have been decoded already.
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        if (target >= handle->position && target < handle->position + (int64_t)handle->numFramesBuffered)
+        {
+            const size_t n = target - handle->position;
+            skipped = true;
+            handle->ringPos = (handle->ringPos + n) % kDecodeAheadFrames;
+            handle->numFramesBuffered -= n;
+            handle->position = target;
+        }
+    }
+
+    if (skipped)
+    {
+        handle->service->request(handle);
+        return methcla_no_error();
+    }
+
+    std::lock_guard<std::mutex> decodeLock(handle->decodeMutex);
+    {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        handle->position = target;
+        handle->numFramesBuffered = 0;
+        handle->ringPos = 0;
+        handle->done = false;
+        handle->errorMessage.clear();
+    }
+
+    // Seeking is fast with the frame index built when opening the file.
+    off_t n = mpg123_seek(handle->handle, static_cast<off_t>(target), SEEK_SET);
+    if (n < 0)
+        return handle->error();
+
+    handle->service->request(handle);
+
+    return methcla_no_error();
 }
 
 static Methcla_Error soundfile_tell(const Methcla_SoundFile* file, int64_t* numFrames)
 {
     SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
-    off_t n = mpg123_tell(handle->handle);
-    if (n < 0) return handle->error();
-    *numFrames = static_cast<int64_t>(n);
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    *numFrames = handle->position;
     return methcla_no_error();
 }
 
 static Methcla_Error soundfile_read_float(const Methcla_SoundFile* file, float* buffer, size_t inNumFrames, size_t* outNumFrames)
 {
     SoundFileHandle* handle = static_cast<SoundFileHandle*>(file->handle);
+    const size_t channels = handle->channels;
 
-    size_t numBytes = 0;
+    std::unique_lock<std::mutex> lock(handle->mutex);
 
-    int err = mpg123_read(
-        handle->handle,
-        reinterpret_cast<unsigned char*>(buffer),
-        inNumFrames * handle->frameSize,
-        &numBytes
-    );
+    size_t numFramesRead = 0;
 
-    if (err == MPG123_DONE)
+    while (numFramesRead < inNumFrames)
     {
-        *outNumFrames = 0;
-        return methcla_no_error();
-    }
-    else if (err != MPG123_OK)
-    {
-        return handle->error();
+        if (handle->numFramesBuffered == 0)
+        {
+            if (handle->done)
+                break;
+            // Wait for the decoder to catch up.
+            lock.unlock();
+            handle->service->request(handle);
+            lock.lock();
+            handle->cond.wait(lock, [handle](){ return handle->numFramesBuffered > 0 || handle->done; });
+            continue;
+        }
+
+        const size_t n = std::min(std::min(inNumFrames - numFramesRead, handle->numFramesBuffered),
+                                  kDecodeAheadFrames - handle->ringPos);
+        const float* src = handle->ring.data() + handle->ringPos * channels;
+        std::copy(src, src + n * channels, buffer + numFramesRead * channels);
+
+        handle->ringPos = (handle->ringPos + n) % kDecodeAheadFrames;
+        handle->numFramesBuffered -= n;
+        handle->position += n;
+        numFramesRead += n;
     }
 
-    *outNumFrames = numBytes / handle->frameSize;
+    const bool failed = numFramesRead == 0 && !handle->errorMessage.empty();
+    const std::string errorMessage = handle->errorMessage;
+
+    lock.unlock();
+
+    // Refill the space that has been read.
+    handle->service->request(handle);
+
+    if (failed)
+        return methcla_error_new_with_message(kMethcla_UnspecifiedError, errorMessage.c_str());
+
+    *outNumFrames = numFramesRead;
 
     return methcla_no_error();
 }
 
-static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* path, Methcla_FileMode mode, Methcla_SoundFile** outFile, Methcla_SoundFileInfo* info)
+static Methcla_Error soundfile_open(const Methcla_SoundFileAPI* api, const char* path, Methcla_FileMode mode, Methcla_SoundFile** outFile, Methcla_SoundFileInfo* info)
 {
     if (path == nullptr)
         return methcla_error_new(kMethcla_ArgumentError);
@@ -123,11 +509,12 @@ static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* pat
     if (mode != kMethcla_FileModeRead)
         return methcla_error_new(kMethcla_ArgumentError);
 
-    SoundFileHandle* handle = static_cast<SoundFileHandle*>(std::malloc(sizeof(SoundFileHandle)));
-    if (handle == nullptr)
+    std::unique_ptr<SoundFileHandle> handle;
+    try {
+        handle.reset(new SoundFileHandle(static_cast<DecodeService*>(api->handle)));
+    } catch (std::bad_alloc&) {
         return methcla_error_new(kMethcla_MemoryError);
-
-    auto handleRef = SoundFileHandle::Ref(handle);
+    }
 
     int err;
     handle->handle = mpg123_new(nullptr, &err);
@@ -137,13 +524,26 @@ static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* pat
     if (mpg123_param(handle->handle, MPG123_ADD_FLAGS, MPG123_FORCE_FLOAT, 0.) != MPG123_OK)
         return handle->error();
 
+    // Let the frame index grow to cover the whole file for fast and accurate seeking.
+    if (mpg123_param(handle->handle, MPG123_INDEX_SIZE, -kIndexGrowSize, 0.) != MPG123_OK)
+        return handle->error();
+
     if (mpg123_open(handle->handle, path) != MPG123_OK)
         return handle->error();
 
-    // Check number of frames in file here because mpg123_open doesn't return an error for an invalid mp3 file
-    const off_t frames = mpg123_length(handle->handle);
+    // Restore the seek index from the cache or build it by scanning all
+    // frames, which also yields the exact length of the file.
+    off_t frames = loadIndex(handle->handle, path);
     if (frames < 0)
-        return methcla_error_new(kMethcla_UnsupportedFileTypeError);
+    {
+        if (mpg123_scan(handle->handle) != MPG123_OK)
+            return methcla_error_new(kMethcla_UnsupportedFileTypeError);
+        // Check number of frames in file here because mpg123_open doesn't return an error for an invalid mp3 file
+        frames = mpg123_length(handle->handle);
+        if (frames < 0)
+            return methcla_error_new(kMethcla_UnsupportedFileTypeError);
+        storeIndex(handle->handle, path, frames);
+    }
 
     long rate;
     int channels, encoding;
@@ -158,11 +558,23 @@ static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* pat
     mpg123_format_none(handle->handle);
     mpg123_format(handle->handle, rate, channels, encoding);
 
+    // The scan leaves the stream at its end.
+    if (mpg123_seek(handle->handle, 0, SEEK_SET) < 0)
+        return handle->error();
+
+    handle->channels = channels;
     handle->frameSize = channels * sizeof(float);
 
+    try {
+        handle->decodeBuffer.resize(kDecodeChunkFrames * channels);
+        handle->ring.resize(kDecodeAheadFrames * channels);
+    } catch (std::bad_alloc&) {
+        return methcla_error_new(kMethcla_MemoryError);
+    }
+
     Methcla_SoundFile* file = &handle->soundFile;
     memset(file, 0, sizeof(*file));
-    file->handle = handle;
+    file->handle = handle.get();
     file->close = soundfile_close;
     file->seek = soundfile_seek;
     file->tell = soundfile_tell;
@@ -179,32 +591,60 @@ static Methcla_Error soundfile_open(const Methcla_SoundFileAPI*, const char* pat
 
     // METHCLA_PRINT_DEBUG("soundfile_open: %s %lld %u %u", path, info->frames, info->channels, info->samplerate);
 
-    handleRef.release();
+    // Start decoding ahead.
+    handle->service->request(handle.get());
+    handle.release();
 
     return methcla_no_error();
 }
 
-static void methcla_mpg123_library_destroy(const Methcla_Library*)
+class Mpg123Library
 {
-    mpg123_exit();
-}
+public:
+    Mpg123Library()
+    {
+        m_library.handle = this;
+        m_library.destroy = destroy;
+        m_api.handle = &m_service;
+        m_api.valid_file_extensions = "mp3";
+        m_api.open = soundfile_open;
+    }
+
+    const Methcla_Library* library() const
+    {
+        return &m_library;
+    }
 
-static const Methcla_SoundFileAPI kSoundFileAPI_mpg123 = {
-    nullptr,
-    "mp3",
-    soundfile_open
+    const Methcla_SoundFileAPI* api() const
+    {
+        return &m_api;
+    }
+
+private:
+    static void destroy(const Methcla_Library* library)
+    {
+        // Stops the decoder thread.
+        delete static_cast<Mpg123Library*>(library->handle);
+        mpg123_exit();
+    }
+
+private:
+    Methcla_Library         m_library;
+    Methcla_SoundFileAPI    m_api;
+    DecodeService           m_service;
 };
 
-static const Methcla_Library kLibrary_mpg123 =
+METHCLA_EXPORT void methcla_soundfile_api_mpg123_set_index_cache(const char* directory)
 {
-    nullptr,
-    methcla_mpg123_library_destroy
-};
+    std::lock_guard<std::mutex> lock(gIndexCacheMutex);
+    gIndexCacheDirectory = directory == nullptr ? "" : directory;
+}
 
 METHCLA_EXPORT const Methcla_Library* methcla_soundfile_api_mpg123(const Methcla_Host* host, const char*)
 {
     if (mpg123_init() != MPG123_OK)
         return nullptr;
-    methcla_host_register_soundfile_api(host, &kSoundFileAPI_mpg123);
-    return &kLibrary_mpg123;
+    Mpg123Library* library = new Mpg123Library();
+    methcla_host_register_soundfile_api(host, library->api());
+    return library->library();
 }
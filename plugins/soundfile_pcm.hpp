@@ -0,0 +1,337 @@
+// Copyright 2013 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_PLUGINS_SOUNDFILE_PCM_HPP_INCLUDED
+#define METHCLA_PLUGINS_SOUNDFILE_PCM_HPP_INCLUDED
+
+// Header parsing and sample conversion for uncompressed WAV and AIFF files
+// shared by the sound file APIs that read them directly.
+
+#include <methcla/common.h>
+#include <methcla/file.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+namespace Methcla { namespace Plugin { namespace PCMFile {
+
+inline bool isLittleEndian()
+{
+    const uint16_t x = 1;
+    return *reinterpret_cast<const uint8_t*>(&x) == 1;
+}
+
+inline uint16_t readLE16(const uint8_t* p)
+{
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+inline uint32_t readLE32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint16_t readBE16(const uint8_t* p)
+{
+    return ((uint16_t)p[0] << 8) | (uint16_t)p[1];
+}
+
+inline uint32_t readBE32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// 80 bit IEEE 754 extended precision number (AIFF sample rate).
+inline double readExtended(const uint8_t* p)
+{
+    const int exponent = ((p[0] & 0x7F) << 8) | p[1];
+    uint64_t mantissa = 0;
+    for (size_t i=0; i < 8; i++)
+        mantissa = (mantissa << 8) | p[2+i];
+    if (exponent == 0 && mantissa == 0)
+        return 0.;
+    const double value = std::ldexp((double)mantissa, exponent - 16383 - 63);
+    return (p[0] & 0x80) ? -value : value;
+}
+
+inline bool isChunk(const uint8_t* p, const char* id)
+{
+    return std::memcmp(p, id, 4) == 0;
+}
+
+inline size_t bytesPerSample(Methcla_SoundFileFormat format)
+{
+    switch (format)
+    {
+        case kMethcla_SoundFileFormatPCM16: return 2;
+        case kMethcla_SoundFileFormatPCM24: return 3;
+        case kMethcla_SoundFileFormatPCM32: return 4;
+        case kMethcla_SoundFileFormatFloat: return 4;
+        default: return 0;
+    }
+}
+
+inline Methcla_SoundFileFormat pcmFormat(unsigned int bitsPerSample)
+{
+    switch (bitsPerSample)
+    {
+        case 16: return kMethcla_SoundFileFormatPCM16;
+        case 24: return kMethcla_SoundFileFormatPCM24;
+        case 32: return kMethcla_SoundFileFormatPCM32;
+        default: return kMethcla_SoundFileFormatUnknown;
+    }
+}
+
+//* Location and encoding of the sample data within the file.
+struct SampleLayout
+{
+    Methcla_SoundFileType   fileType;
+    Methcla_SoundFileFormat format;
+    bool                    bigEndian;
+    unsigned int            channels;
+    unsigned int            samplerate;
+    size_t                  dataOffset;
+    int64_t                 frames;
+
+    size_t frameSize() const
+    {
+        return channels * bytesPerSample(format);
+    }
+
+    bool isNativeByteOrder() const
+    {
+        return bigEndian != isLittleEndian();
+    }
+};
+
+//* Parse the header of a WAV file.
+//
+// data points to the first size bytes of a file of fileSize bytes; the
+// header up to the beginning of the sample data must be contained in data.
+inline Methcla_ErrorCode parseWAV(const uint8_t* data, size_t size, uint64_t fileSize, SampleLayout& layout)
+{
+    if (size < 12 || !isChunk(data, "RIFF") || !isChunk(data + 8, "WAVE"))
+        return kMethcla_UnsupportedFileTypeError;
+
+    layout.fileType = kMethcla_SoundFileTypeWAV;
+    layout.bigEndian = false;
+
+    bool haveFormat = false;
+    size_t pos = 12;
+
+    while (pos + 8 <= size)
+    {
+        const uint8_t* chunk = data + pos;
+        const size_t chunkSize = readLE32(chunk + 4);
+        const size_t body = pos + 8;
+
+        if (isChunk(chunk, "fmt "))
+        {
+            if (chunkSize < 16 || body + 16 > size)
+                return kMethcla_InvalidFileError;
+
+            unsigned int formatTag = readLE16(data + body);
+            layout.channels = readLE16(data + body + 2);
+            layout.samplerate = readLE32(data + body + 4);
+            const unsigned int bitsPerSample = readLE16(data + body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE: Format tag is in the first two bytes of the sub format GUID.
+            if (formatTag == 0xFFFE && chunkSize >= 26 && body + 26 <= size)
+                formatTag = readLE16(data + body + 24);
+
+            if (formatTag == 1)
+                layout.format = pcmFormat(bitsPerSample);
+            else if (formatTag == 3 && bitsPerSample == 32)
+                layout.format = kMethcla_SoundFileFormatFloat;
+            else
+                layout.format = kMethcla_SoundFileFormatUnknown;
+
+            if (layout.format == kMethcla_SoundFileFormatUnknown)
+                return kMethcla_UnsupportedDataFormatError;
+            if (layout.channels == 0)
+                return kMethcla_InvalidFileError;
+
+            haveFormat = true;
+        }
+        else if (isChunk(chunk, "data"))
+        {
+            if (!haveFormat)
+                return kMethcla_InvalidFileError;
+
+            layout.dataOffset = body;
+            layout.frames = std::min<uint64_t>(chunkSize, fileSize - body) / layout.frameSize();
+
+            return kMethcla_NoError;
+        }
+
+        // Chunks are padded to an even number of bytes.
+        pos = body + chunkSize + (chunkSize & 1);
+    }
+
+    return kMethcla_InvalidFileError;
+}
+
+//* Parse the header of an AIFF or AIFC file (see parseWAV).
+inline Methcla_ErrorCode parseAIFF(const uint8_t* data, size_t size, uint64_t fileSize, SampleLayout& layout)
+{
+    if (size < 12 || !isChunk(data, "FORM"))
+        return kMethcla_UnsupportedFileTypeError;
+
+    const bool isAIFC = isChunk(data + 8, "AIFC");
+    if (!isAIFC && !isChunk(data + 8, "AIFF"))
+        return kMethcla_UnsupportedFileTypeError;
+
+    layout.fileType = kMethcla_SoundFileTypeAIFF;
+    layout.bigEndian = true;
+
+    bool haveFormat = false;
+    int64_t numFrames = 0;
+    size_t dataOffset = 0;
+    uint64_t dataSize = 0;
+    bool haveData = false;
+    size_t pos = 12;
+
+    while (pos + 8 <= size)
+    {
+        const uint8_t* chunk = data + pos;
+        const size_t chunkSize = readBE32(chunk + 4);
+        const size_t body = pos + 8;
+
+        if (isChunk(chunk, "COMM"))
+        {
+            if (chunkSize < 18 || body + 18 > size)
+                return kMethcla_InvalidFileError;
+
+            layout.channels = readBE16(data + body);
+            numFrames = readBE32(data + body + 2);
+            const unsigned int bitsPerSample = readBE16(data + body + 6);
+            layout.samplerate = (unsigned int)readExtended(data + body + 8);
+            layout.format = pcmFormat(bitsPerSample);
+
+            if (isAIFC && chunkSize >= 22 && body + 22 <= size)
+            {
+                const uint8_t* compression = data + body + 18;
+                if (isChunk(compression, "sowt"))
+                {
+                    layout.bigEndian = false;
+                }
+                else if (isChunk(compression, "fl32") || isChunk(compression, "FL32"))
+                {
+                    layout.format = bitsPerSample == 32
+                                        ? kMethcla_SoundFileFormatFloat
+                                        : kMethcla_SoundFileFormatUnknown;
+                }
+                else if (!isChunk(compression, "NONE"))
+                {
+                    layout.format = kMethcla_SoundFileFormatUnknown;
+                }
+            }
+
+            if (layout.format == kMethcla_SoundFileFormatUnknown)
+                return kMethcla_UnsupportedDataFormatError;
+            if (layout.channels == 0)
+                return kMethcla_InvalidFileError;
+
+            haveFormat = true;
+        }
+        else if (isChunk(chunk, "SSND"))
+        {
+            if (chunkSize < 8 || body + 8 > size)
+                return kMethcla_InvalidFileError;
+
+            const size_t offset = readBE32(data + body);
+            dataOffset = body + 8 + offset;
+            if (dataOffset > fileSize || chunkSize < 8 + offset)
+                return kMethcla_InvalidFileError;
+            dataSize = std::min<uint64_t>(chunkSize - 8 - offset, fileSize - dataOffset);
+            haveData = true;
+        }
+
+        pos = body + chunkSize + (chunkSize & 1);
+    }
+
+    if (!haveFormat || !haveData)
+        return kMethcla_InvalidFileError;
+
+    layout.dataOffset = dataOffset;
+    layout.frames = std::min<int64_t>(numFrames, dataSize / layout.frameSize());
+
+    return kMethcla_NoError;
+}
+
+inline void convertSamples(const uint8_t* src, float* dst, size_t numSamples, Methcla_SoundFileFormat format, bool bigEndian)
+{
+    switch (format)
+    {
+        case kMethcla_SoundFileFormatPCM16:
+            for (size_t i=0; i < numSamples; i++, src += 2)
+            {
+                const int16_t x = (int16_t)(bigEndian ? readBE16(src) : readLE16(src));
+                dst[i] = (float)x * (1.f / 32768.f);
+            }
+            break;
+        case kMethcla_SoundFileFormatPCM24:
+            for (size_t i=0; i < numSamples; i++, src += 3)
+            {
+                const uint32_t u = bigEndian
+                    ? ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8)
+                    : ((uint32_t)src[2] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[0] << 8);
+                dst[i] = (float)(int32_t)u * (1.f / 2147483648.f);
+            }
+            break;
+        case kMethcla_SoundFileFormatPCM32:
+            for (size_t i=0; i < numSamples; i++, src += 4)
+            {
+                const int32_t x = (int32_t)(bigEndian ? readBE32(src) : readLE32(src));
+                dst[i] = (float)x * (1.f / 2147483648.f);
+            }
+            break;
+        case kMethcla_SoundFileFormatFloat:
+            if (bigEndian != isLittleEndian())
+            {
+                std::memcpy(dst, src, numSamples * sizeof(float));
+            }
+            else
+            {
+                for (size_t i=0; i < numSamples; i++, src += 4)
+                {
+                    const uint32_t u = bigEndian ? readBE32(src) : readLE32(src);
+                    std::memcpy(dst + i, &u, sizeof(float));
+                }
+            }
+            break;
+        default:
+            assert(false);
+    }
+}
+
+inline Methcla_Error systemError(int code)
+{
+    switch (code)
+    {
+        case ENOENT:
+            return methcla_error_new_with_message(kMethcla_FileNotFoundError, std::strerror(code));
+        case EACCES:
+            return methcla_error_new_with_message(kMethcla_PermissionsError, std::strerror(code));
+    }
+    return methcla_error_new_with_message(kMethcla_SystemError, std::strerror(code));
+}
+
+} } }
+
+#endif // METHCLA_PLUGINS_SOUNDFILE_PCM_HPP_INCLUDED
@@ -19,11 +19,13 @@
 #include "Methcla/API.hpp"
 #include "Methcla/Audio/Engine.hpp"
 #include "Methcla/Audio/IO/Driver.hpp"
+#include "Methcla/Audio/SoundFileIndex.hpp"
 #include "Methcla/Audio/SynthDef.hpp"
 #include "Methcla/Exception.hpp"
 #include "Methcla/Platform.hpp"
 #include "Methcla/Version.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
@@ -32,6 +34,7 @@
 #include <oscpp/server.hpp>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
 struct Methcla_AudioDriver
 {
@@ -59,6 +62,11 @@ Methcla_AudioDriver* Methcla::API::wrapAudioDriver(Methcla::Audio::IO::Driver* d
     return new Methcla_AudioDriver(driver);
 }
 
+Methcla::Audio::IO::Driver* Methcla::API::unwrapAudioDriver(Methcla_AudioDriver* driver)
+{
+    return driver->driver();
+}
+
 Methcla::Audio::Environment::Options Methcla::API::convertOptions(const Methcla_EngineOptions* options)
 {
     Methcla::Audio::Environment::Options result;
@@ -68,6 +76,11 @@ Methcla::Audio::Environment::Options Methcla::API::convertOptions(const Methcla_
     result.realtimeMemorySize = options->realtime_memory_size;
     result.maxNumNodes = options->max_num_nodes;
     result.maxNumAudioBuses = options->max_num_audio_buses;
+    result.maxNumBuffers = options->max_num_buffers;
+    result.bufferCacheSize = options->buffer_cache_size;
+    result.compactSampleBuffers = options->compact_sample_buffers;
+    if (options->soundfile_index_path != nullptr)
+        result.soundFileIndexPath = options->soundfile_index_path;
 
     if (options->plugin_libraries != nullptr)
     {
@@ -137,12 +150,13 @@ private:
     static void processCallback(
         void* data,
         Methcla_Time currentTime,
+        double sampleRate,
         size_t numFrames,
         const Methcla_AudioSample* const* inputs,
         Methcla_AudioSample* const* outputs
         )
     {
-        static_cast<Methcla_Engine*>(data)->m_env->process(currentTime, numFrames, inputs, outputs);
+        static_cast<Methcla_Engine*>(data)->m_env->process(currentTime, sampleRate, numFrames, inputs, outputs);
     }
 
 private:
@@ -219,6 +233,7 @@ METHCLA_EXPORT void methcla_engine_options_init(Methcla_EngineOptions* options)
     memset(options, 0, sizeof(Methcla_EngineOptions));
     options->log_handler = Methcla::Platform::defaultLogHandler();
     options->packet_handler = defaultPacketHandler();
+    options->buffer_cache_size = 64*1024*1024;
 }
 
 METHCLA_EXPORT Methcla_Error methcla_engine_new_with_driver(
@@ -337,6 +352,45 @@ METHCLA_EXPORT Methcla_Error methcla_engine_soundfile_open(const Methcla_Engine*
     return methcla_host_soundfile_open(host, path, mode, file, info);
 }
 
+METHCLA_EXPORT Methcla_Error methcla_engine_soundfile_info(const Methcla_Engine* engine, const char* path, Methcla_SoundFileInfo* info)
+{
+    if (engine == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (path == nullptr || *path == '\0')
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (info == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    METHCLA_API_TRY {
+        *info = engine->env()->soundFileIndex().lookup(path);
+    } METHCLA_API_CATCH;
+    return methcla_no_error();
+}
+
+METHCLA_EXPORT Methcla_Error methcla_engine_soundfile_scan(Methcla_Engine* engine, const char* directory, Methcla_SoundFileScanFunction callback, void* data)
+{
+    if (engine == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+    if (directory == nullptr || *directory == '\0')
+        return methcla_error_new(kMethcla_ArgumentError);
+    METHCLA_API_TRY {
+        Methcla::Audio::SoundFileIndex& index = engine->env()->soundFileIndex();
+        // Opening files is mostly waiting for I/O; use at least a few threads on machines with few cores.
+        const size_t numThreads = std::max(std::thread::hardware_concurrency(), 4u);
+        const auto files = index.scan(directory, numThreads);
+        try {
+            index.save();
+        } catch (Methcla::Error& e) {
+            engine->env()->logLineNRT(kMethcla_LogWarn, e.what());
+        }
+        if (callback != nullptr)
+        {
+            for (const auto& file : files)
+                callback(data, file.first.c_str(), &file.second);
+        }
+    } METHCLA_API_CATCH;
+    return methcla_no_error();
+}
+
 METHCLA_EXPORT const char* methcla_error_code_description(Methcla_ErrorCode code)
 {
     switch (code)
@@ -355,6 +409,7 @@ METHCLA_EXPORT const char* methcla_error_code_description(Methcla_ErrorCode code
         case kMethcla_SynthDefNotFoundError: return "SynthDef not found";
         case kMethcla_NodeIdError: return "Invalid node id";
         case kMethcla_NodeTypeError: return "Invalid node type";
+        case kMethcla_BufferIdError: return "Invalid buffer id";
 
         /* File errors */
         case kMethcla_FileNotFoundError: return "File not found";
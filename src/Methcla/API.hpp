@@ -26,6 +26,7 @@ namespace Methcla { namespace API {
     Methcla::Audio::Environment::Options convertOptions(const Methcla_EngineOptions* options);
 
     Methcla_AudioDriver* wrapAudioDriver(Methcla::Audio::IO::Driver* driver);
+    Methcla::Audio::IO::Driver* unwrapAudioDriver(Methcla_AudioDriver* driver);
     Methcla::Audio::IO::Driver* getDriver(Methcla_Engine* engine);
 } }
 
@@ -15,6 +15,8 @@
 #include "Methcla/Audio/AudioBus.hpp"
 #include "Methcla/Audio/Engine.hpp"
 
+#include <algorithm>
+
 using namespace Methcla::Audio;
 using namespace Methcla::Memory;
 
@@ -36,6 +38,7 @@ ExternalAudioBus::ExternalAudioBus(Epoch epoch)
 InternalAudioBus::InternalAudioBus(size_t numFrames, Epoch epoch)
     : AudioBus( allocAlignedOf<sample_t>(kSIMDAlignment, numFrames)
               , epoch )
+    , m_numFrames(numFrames)
 {
 }
 
@@ -43,3 +46,17 @@ InternalAudioBus::~InternalAudioBus()
 {
     Methcla::Memory::freeAligned(data());
 }
+
+void InternalAudioBus::reserve(size_t numFrames)
+{
+    if (numFrames > m_numFrames)
+    {
+        sample_t* data = allocAlignedOf<sample_t>(kSIMDAlignment, numFrames);
+        // Keep the previous block for feedback connections.
+        std::copy(this->data(), this->data() + m_numFrames, data);
+        std::fill(data + m_numFrames, data + numFrames, 0.f);
+        Methcla::Memory::freeAligned(this->data());
+        setData(data);
+        m_numFrames = numFrames;
+    }
+}
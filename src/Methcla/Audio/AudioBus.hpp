@@ -91,6 +91,20 @@ class InternalAudioBus : public AudioBus
 public:
     InternalAudioBus(size_t numFrames, Epoch epoch);
     virtual ~InternalAudioBus();
+
+    //* Return the number of frames the bus can hold.
+    size_t numFrames() const
+    {
+        return m_numFrames;
+    }
+
+    //* Make room for at least numFrames frames, preserving the bus contents.
+    //
+    // Context: NRT, while the engine is not processing.
+    void reserve(size_t numFrames);
+
+private:
+    size_t m_numFrames;
 };
 
 } }
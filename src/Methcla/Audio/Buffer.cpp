@@ -0,0 +1,95 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Methcla/Audio/Buffer.hpp"
+#include "Methcla/Audio/BufferCache.hpp"
+#include "Methcla/Audio/Engine.hpp"
+#include "Methcla/Exception.hpp"
+#include "Methcla/Memory.hpp"
+
+#include <algorithm>
+#include <memory>
+
+using namespace Methcla;
+using namespace Methcla::Audio;
+
+Buffer::Buffer(Environment& env, BufferId id)
+    : Resource<BufferId>(env, id)
+    , m_data(nullptr)
+    , m_cached(nullptr)
+{
+    data = nullptr;
+    format = kMethcla_SoundFileFormatFloat;
+    channels = 0;
+    frames = 0;
+    samplerate = env.sampleRate();
+    frames_available = nullptr;
+}
+
+Buffer::~Buffer()
+{
+    if (m_data != nullptr)
+        Memory::freeAligned(m_data);
+    if (m_cached != nullptr)
+        env().bufferCache().release(m_cached);
+}
+
+Buffer* Buffer::alloc(Environment& env, BufferId id, size_t numChannels, int64_t numFrames)
+{
+    if (numChannels == 0 || numFrames <= 0)
+        throw Error(kMethcla_ArgumentError, "Invalid buffer size");
+
+    std::unique_ptr<Buffer> buffer(new Buffer(env, id));
+
+    const size_t numSamples = numChannels * numFrames;
+    buffer->m_data = Memory::allocAlignedOf<float>(Memory::kSIMDAlignment, numSamples);
+    std::fill(buffer->m_data, buffer->m_data + numSamples, 0.f);
+
+    buffer->data = buffer->m_data;
+    buffer->channels = numChannels;
+    buffer->frames = numFrames;
+
+    return buffer.release();
+}
+
+Buffer* Buffer::read(Environment& env, BufferId id, const char* path, int64_t startFrame, int64_t numFrames)
+{
+    std::unique_ptr<Buffer> buffer(new Buffer(env, id));
+
+    buffer->m_cached = env.bufferCache().acquire(path, startFrame, numFrames, env.sampleRate());
+
+    buffer->data = buffer->m_cached->data;
+    buffer->format = buffer->m_cached->format;
+    buffer->channels = buffer->m_cached->channels;
+    buffer->frames = buffer->m_cached->frames;
+    buffer->samplerate = buffer->m_cached->samplerate;
+    buffer->frames_available = cachedFramesAvailable;
+
+    return buffer.release();
+}
+
+int64_t Buffer::cachedFramesAvailable(const Methcla_SampleBuffer* buffer)
+{
+    return methcla_sample_buffer_frames_available(static_cast<const Buffer*>(buffer)->m_cached);
+}
+
+static void perform_delete_buffer(Environment*, void* data)
+{
+    delete static_cast<Buffer*>(data);
+}
+
+void Buffer::free()
+{
+    env().sendToWorker(perform_delete_buffer, this);
+}
@@ -0,0 +1,87 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_AUDIO_BUFFER_HPP_INCLUDED
+#define METHCLA_AUDIO_BUFFER_HPP_INCLUDED
+
+#include "Methcla/Audio/Resource.hpp"
+
+#include <methcla/plugin.h>
+
+#include <boost/serialization/strong_typedef.hpp>
+
+namespace Methcla { namespace Audio {
+
+BOOST_STRONG_TYPEDEF(int32_t, BufferId);
+
+//* Engine buffer addressed by id.
+//
+// Buffers are created in the non-realtime context and installed in the
+// environment's buffer map. Reference counting happens in the realtime
+// context; when the last reference is released the buffer is deleted in
+// the non-realtime context.
+class Buffer : public Resource<BufferId>
+             , public Methcla_SampleBuffer
+{
+public:
+    //* Allocate a zero-initialized buffer.
+    //
+    // The sample data is owned by the buffer and can be written in the
+    // realtime context (see writableData).
+    //
+    // Context: NRT
+    static Buffer* alloc(Environment& env, BufferId id, size_t numChannels, int64_t numFrames);
+
+    //* Read a buffer from a sound file.
+    //
+    // The sample data is converted to the environment's sample rate.
+    //
+    // Buffer data is shared with the environment's buffer cache and may
+    // still be loading when the buffer is returned.
+    //
+    // Context: NRT
+    static Buffer* read(Environment& env, BufferId id, const char* path, int64_t startFrame, int64_t numFrames);
+
+    ~Buffer();
+
+    //* Return the interleaved sample data of an allocated buffer or nullptr if the buffer has been read from a sound file.
+    //
+    // Context: RT
+    float* writableData()
+    {
+        return m_data;
+    }
+
+    static Buffer* fromSampleBuffer(const Methcla_SampleBuffer* buffer)
+    {
+        return const_cast<Buffer*>(static_cast<const Buffer*>(buffer));
+    }
+
+protected:
+    void free() override;
+
+private:
+    Buffer(Environment& env, BufferId id);
+
+    static int64_t cachedFramesAvailable(const Methcla_SampleBuffer* buffer);
+
+    float*                      m_data;
+    const Methcla_SampleBuffer* m_cached;
+};
+
+typedef ResourceMap<BufferId,Buffer> BufferMap;
+
+} }
+
+#endif // METHCLA_AUDIO_BUFFER_HPP_INCLUDED
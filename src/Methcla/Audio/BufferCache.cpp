@@ -0,0 +1,489 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Methcla/Audio/BufferCache.hpp"
+#include "Methcla/Audio/SampleRateConverter.hpp"
+#include "Methcla/Exception.hpp"
+#include "Methcla/Memory.hpp"
+
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+using namespace Methcla;
+using namespace Methcla::Audio;
+
+static void checkError(Methcla_Error err)
+{
+    if (methcla_is_error(err))
+    {
+        Error error(methcla_error_code(err),
+                    methcla_error_message(err) ? methcla_error_message(err) : "");
+        methcla_error_free(err);
+        throw error;
+    }
+}
+
+static void closeSoundFile(Methcla_SoundFile* file)
+{
+    methcla_error_free(methcla_soundfile_close(file));
+}
+
+static size_t sampleSize(Methcla_SoundFileFormat format)
+{
+    switch (format)
+    {
+        case kMethcla_SoundFileFormatPCM16: return sizeof(int16_t);
+        case kMethcla_SoundFileFormatPCM24: return 3;
+        default: return sizeof(float);
+    }
+}
+
+static inline int32_t quantize(float x, float scale, int32_t maxValue)
+{
+    const float y = std::round(x * scale);
+    return y >= maxValue ? maxValue : (y <= -maxValue - 1 ? -maxValue - 1 : (int32_t)y);
+}
+
+// Convert float samples to the compact storage format.
+static void storeSamples(Methcla_SoundFileFormat format, const float* src, uint8_t* dst, size_t numSamples)
+{
+    if (format == kMethcla_SoundFileFormatPCM16)
+    {
+        int16_t* dst16 = reinterpret_cast<int16_t*>(dst);
+        for (size_t i=0; i < numSamples; i++)
+            dst16[i] = (int16_t)quantize(src[i], 32768.f, 32767);
+    }
+    else
+    {
+        assert(format == kMethcla_SoundFileFormatPCM24);
+        for (size_t i=0; i < numSamples; i++, dst += 3)
+        {
+            const uint32_t x = (uint32_t)quantize(src[i], 8388608.f, 8388607);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+            dst[0] = (uint8_t)(x >> 16); dst[1] = (uint8_t)(x >> 8); dst[2] = (uint8_t)x;
+#else
+            dst[0] = (uint8_t)x; dst[1] = (uint8_t)(x >> 8); dst[2] = (uint8_t)(x >> 16);
+#endif
+        }
+    }
+}
+
+struct BufferCache::Entry : Methcla_SampleBuffer
+{
+    enum State
+    {
+        kLoading,
+        kLoaded,
+        kFailed
+    };
+
+    Entry(const Key& key)
+        : key(key)
+        , state(kLoading)
+        , refs(0)
+        , memory(0)
+        , storage(nullptr)
+        , file(nullptr)
+        , loadFile(nullptr)
+        , framesLoaded(0)
+        , errorCode(kMethcla_NoError)
+        , isUnused(false)
+    {
+        data = nullptr;
+        format = kMethcla_SoundFileFormatFloat;
+        channels = 0;
+        frames = 0;
+        samplerate = 0.;
+        frames_available = framesAvailable;
+    }
+
+    ~Entry()
+    {
+        if (storage != nullptr)
+            Memory::freeAligned(storage);
+        if (file != nullptr)
+            closeSoundFile(file);
+        if (loadFile != nullptr)
+            closeSoundFile(loadFile);
+    }
+
+    // Context: RT
+    static int64_t framesAvailable(const Methcla_SampleBuffer* buffer)
+    {
+        return static_cast<const Entry*>(buffer)->framesLoaded.load(std::memory_order_acquire);
+    }
+
+    Entry(const Entry&) = delete;
+    Entry& operator=(const Entry&) = delete;
+
+    Key                 key;
+    State               state;
+    size_t              refs;
+    size_t              memory;
+    // Sample data owned by the entry, or the sound file providing a view.
+    uint8_t*            storage;
+    Methcla_SoundFile*  file;
+    // Sound file the remaining chunks are read from.
+    Methcla_SoundFile*  loadFile;
+    // Converter for files with a sample rate different from the requested one.
+    std::unique_ptr<SampleRateConverter> converter;
+    std::atomic<int64_t> framesLoaded;
+    Methcla_ErrorCode   errorCode;
+    std::string         errorMessage;
+    bool                isUnused;
+    LRUList::iterator   unusedPos;
+};
+
+size_t BufferCache::KeyHash::operator()(const Key& key) const
+{
+    size_t seed = 0;
+    boost::hash_combine(seed, key.path);
+    boost::hash_combine(seed, key.startFrame);
+    boost::hash_combine(seed, key.numFrames);
+    boost::hash_combine(seed, key.sampleRate);
+    return seed;
+}
+
+BufferCache::BufferCache(const Methcla_Host* host, size_t memoryBudget, bool compact)
+    : m_host(host)
+    , m_memoryBudget(memoryBudget)
+    , m_compact(compact)
+    , m_memoryUsed(0)
+    , m_continue(true)
+{
+    m_loader = std::thread(&BufferCache::processLoads, this);
+}
+
+BufferCache::~BufferCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_continue = false;
+        m_loadsChanged.notify_all();
+    }
+    m_loader.join();
+    m_loads.clear();
+    m_unused.clear();
+    m_entries.clear();
+}
+
+const Methcla_SampleBuffer* BufferCache::acquire(const char* path, int64_t startFrame, int64_t numFrames, double sampleRate)
+{
+    assert(path != nullptr);
+
+    const Key key = {
+        path,
+        std::max<int64_t>(0, startFrame),
+        numFrames < 0 ? -1 : numFrames,
+        std::max(0., sampleRate)
+    };
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    auto it = m_entries.find(key);
+
+    if (it != m_entries.end())
+    {
+        EntryRef entry = it->second;
+        entry->refs++;
+
+        if (entry->isUnused)
+        {
+            m_unused.erase(entry->unusedPos);
+            entry->isUnused = false;
+        }
+
+        // Wait for another thread loading the same buffer.
+        m_loaded.wait(lock, [&entry](){ return entry->state != Entry::kLoading; });
+
+        if (entry->state == Entry::kFailed)
+        {
+            entry->refs--;
+            throw Error(entry->errorCode, entry->errorMessage);
+        }
+
+        return entry.get();
+    }
+
+    EntryRef entry = std::make_shared<Entry>(key);
+    entry->refs = 1;
+    m_entries[key] = entry;
+
+    lock.unlock();
+
+    try
+    {
+        load(entry.get());
+    }
+    catch (Error& e)
+    {
+        entry->errorCode = e.errorCode();
+        entry->errorMessage = e.errorMessage();
+    }
+    catch (std::bad_alloc&)
+    {
+        entry->errorCode = kMethcla_MemoryError;
+    }
+
+    lock.lock();
+
+    if (entry->errorCode != kMethcla_NoError)
+    {
+        entry->state = Entry::kFailed;
+        entry->refs--;
+        m_entries.erase(key);
+        m_loaded.notify_all();
+        throw Error(entry->errorCode, entry->errorMessage);
+    }
+
+    entry->state = Entry::kLoaded;
+    m_memoryUsed += entry->memory;
+    m_loaded.notify_all();
+
+    if (entry->loadFile != nullptr)
+    {
+        m_loads.push_back(entry);
+        m_loadsChanged.notify_one();
+    }
+
+    evict();
+
+    return entry.get();
+}
+
+void BufferCache::release(const Methcla_SampleBuffer* buffer)
+{
+    assert(buffer != nullptr);
+
+    Entry* entry = const_cast<Entry*>(static_cast<const Entry*>(buffer));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    assert(entry->state == Entry::kLoaded);
+    assert(entry->refs > 0);
+
+    entry->refs--;
+
+    if (entry->refs == 0)
+    {
+        entry->unusedPos = m_unused.insert(m_unused.begin(), entry);
+        entry->isUnused = true;
+        evict();
+    }
+}
+
+size_t BufferCache::memoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryUsed;
+}
+
+size_t BufferCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void BufferCache::load(Entry* entry)
+{
+    Methcla_SoundFile* file = nullptr;
+    Methcla_SoundFileInfo info;
+    memset(&info, 0, sizeof(info));
+
+    checkError(methcla_host_soundfile_open(m_host, entry->key.path.c_str(), kMethcla_FileModeRead, &file, &info));
+
+    std::unique_ptr<Methcla_SoundFile,void(*)(Methcla_SoundFile*)>
+        fileRef(file, closeSoundFile);
+
+    if (info.samplerate <= 0)
+    {
+        throw Error(kMethcla_UnsupportedDataFormatError, "Invalid sample rate");
+    }
+
+    const int64_t startFrame = std::min(entry->key.startFrame, info.frames);
+    const int64_t numFrames = entry->key.numFrames < 0
+                                ? info.frames - startFrame
+                                : std::min(entry->key.numFrames, info.frames - startFrame);
+
+    if (entry->key.sampleRate > 0. && entry->key.sampleRate != info.samplerate)
+    {
+        // Convert once while loading, frame ranges refer to the sound file.
+        entry->converter.reset(new SampleRateConverter(info.channels, info.samplerate, entry->key.sampleRate, numFrames));
+    }
+
+    entry->channels = info.channels;
+    entry->frames = entry->converter ? entry->converter->numOutputFrames() : numFrames;
+    entry->samplerate = entry->converter ? entry->key.sampleRate : info.samplerate;
+    if (m_compact && !entry->converter
+        && (info.file_format == kMethcla_SoundFileFormatPCM16
+         || info.file_format == kMethcla_SoundFileFormatPCM24))
+    {
+        entry->format = info.file_format;
+    }
+    const size_t frameSize = info.channels * sampleSize(entry->format);
+    entry->memory = entry->frames * frameSize;
+
+    if (entry->frames == 0)
+        return;
+
+    if (!entry->converter)
+    {
+        Methcla_SoundFileView view;
+        Methcla_Error viewErr = methcla_soundfile_view(file, &view);
+
+        if (methcla_is_ok(viewErr) && view.format == entry->format)
+        {
+            // Use the sound file's sample data directly and keep the file open
+            // as long as the entry exists.
+            entry->data = static_cast<const uint8_t*>(view.data) + startFrame * frameSize;
+            entry->file = fileRef.release();
+            entry->framesLoaded.store(numFrames, std::memory_order_release);
+            return;
+        }
+
+        methcla_error_free(viewErr);
+    }
+
+    entry->storage = Memory::allocAlignedOf<uint8_t>(Memory::kSIMDAlignment, entry->memory);
+    entry->data = entry->storage;
+
+    checkError(methcla_soundfile_seek(file, startFrame));
+
+    // Read the first chunk here; the remaining chunks are read by the loader thread.
+    entry->loadFile = fileRef.release();
+    if (!loadChunk(entry))
+        return;
+
+    closeSoundFile(entry->loadFile);
+    entry->loadFile = nullptr;
+    entry->converter.reset();
+}
+
+bool BufferCache::loadChunk(Entry* entry)
+{
+    assert(entry->loadFile != nullptr);
+
+    const int64_t numFramesLoaded = entry->framesLoaded.load(std::memory_order_relaxed);
+    const int64_t numFrames = std::min<int64_t>(kLoadChunkFrames, entry->frames - numFramesLoaded);
+    const size_t frameSize = entry->channels * sampleSize(entry->format);
+    uint8_t* buffer = entry->storage + numFramesLoaded * frameSize;
+
+    // Compact buffers are read as float and converted afterwards.
+    std::vector<float> scratch;
+    if (entry->format != kMethcla_SoundFileFormatFloat)
+        scratch.resize(numFrames * entry->channels);
+    float* floatBuffer = scratch.empty() ? reinterpret_cast<float*>(buffer) : scratch.data();
+
+    Methcla_SoundFile* file = entry->loadFile;
+    auto read = [file](float* data, size_t count) -> size_t {
+        size_t numFramesRead = 0;
+        checkError(methcla_soundfile_read_float(file, data, count, &numFramesRead));
+        return numFramesRead;
+    };
+
+    size_t numFramesRead = 0;
+
+    try
+    {
+        if (entry->converter)
+        {
+            // The converter pads the output with silence at the end of the input.
+            entry->converter->process(read, floatBuffer, numFrames);
+            numFramesRead = numFrames;
+        }
+        else
+        {
+            numFramesRead = read(floatBuffer, numFrames);
+        }
+        if (!scratch.empty())
+            storeSamples(entry->format, floatBuffer, buffer, numFramesRead * entry->channels);
+    }
+    catch (Error& e)
+    {
+        std::stringstream s;
+        s << "Couldn't read " << entry->key.path << ": " << e.errorMessage();
+        methcla_host_log_line(m_host, kMethcla_LogError, s.str().c_str());
+    }
+    catch (std::bad_alloc&)
+    {
+        std::stringstream s;
+        s << "Couldn't read " << entry->key.path << ": out of memory";
+        methcla_host_log_line(m_host, kMethcla_LogError, s.str().c_str());
+    }
+
+    if (numFramesRead == 0)
+    {
+        // Fill the rest of the buffer with silence.
+        std::memset(buffer, 0, entry->memory - numFramesLoaded * frameSize);
+        entry->framesLoaded.store(entry->frames, std::memory_order_release);
+    }
+    else
+    {
+        entry->framesLoaded.store(numFramesLoaded + numFramesRead, std::memory_order_release);
+    }
+
+    return entry->framesLoaded.load(std::memory_order_relaxed) == entry->frames;
+}
+
+void BufferCache::processLoads()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_continue)
+    {
+        if (m_loads.empty())
+        {
+            m_loadsChanged.wait(lock);
+            continue;
+        }
+
+        EntryRef entry = m_loads.front();
+        m_loads.pop_front();
+
+        lock.unlock();
+        const bool done = loadChunk(entry.get());
+        if (done)
+        {
+            closeSoundFile(entry->loadFile);
+            entry->loadFile = nullptr;
+            entry->converter.reset();
+        }
+        lock.lock();
+
+        // Interleave chunks of concurrent loads.
+        if (!done)
+            m_loads.push_back(entry);
+    }
+}
+
+void BufferCache::evict()
+{
+    while (m_memoryUsed > m_memoryBudget && !m_unused.empty())
+    {
+        Entry* entry = m_unused.back();
+        m_unused.pop_back();
+        assert(entry->refs == 0);
+        m_memoryUsed -= entry->memory;
+        // Copy the key, erasing the map entry destroys the entry.
+        const Key key(entry->key);
+        m_entries.erase(key);
+    }
+}
@@ -0,0 +1,131 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_AUDIO_BUFFERCACHE_HPP_INCLUDED
+#define METHCLA_AUDIO_BUFFERCACHE_HPP_INCLUDED
+
+#include <methcla/plugin.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace Methcla { namespace Audio {
+
+//* Reference counted cache of sample buffers loaded from sound files.
+//
+// Buffers are keyed by path, frame range and sample rate. Unreferenced
+// buffers are kept in least recently used order and evicted when the
+// memory used by all buffers exceeds the cache's memory budget; buffers
+// that are still referenced are never evicted.
+//
+// Buffers are loaded progressively: `acquire` returns as soon as the first
+// chunk has been read and a background thread reads the remaining chunks.
+// `methcla_sample_buffer_frames_available` returns the number of frames
+// that can be accessed so far.
+//
+// If compact is true, 16 and 24 bit sound files are kept in their file
+// sample format instead of being converted to float (see
+// `Methcla_SampleBuffer::format`); buffers converted to a different sample
+// rate are always stored as float.
+//
+// Context: NRT (thread-safe)
+class BufferCache
+{
+public:
+    BufferCache(const Methcla_Host* host, size_t memoryBudget, bool compact=false);
+    ~BufferCache();
+
+    BufferCache(const BufferCache&) = delete;
+    BufferCache& operator=(const BufferCache&) = delete;
+
+    //* Acquire a reference to the buffer for the given parameters.
+    //
+    // If the buffer is not in the cache its first chunk is loaded by the
+    // calling thread; other threads requesting the same buffer in the
+    // meantime wait for the first chunk instead of loading it again.
+    //
+    // If sampleRate is non-zero and differs from the sound file's sample
+    // rate, the sample data is converted to sampleRate while loading;
+    // startFrame and numFrames refer to the sound file's frames.
+    //
+    // @throw Methcla::Error
+    const Methcla_SampleBuffer* acquire(const char* path, int64_t startFrame, int64_t numFrames, double sampleRate);
+
+    //* Release a buffer reference returned by `acquire`.
+    void release(const Methcla_SampleBuffer* buffer);
+
+    //* Return the number of bytes used by cached buffers.
+    size_t memoryUsed() const;
+
+    //* Return the number of buffers in the cache.
+    size_t size() const;
+
+private:
+    struct Key
+    {
+        std::string path;
+        int64_t     startFrame;
+        int64_t     numFrames;
+        double      sampleRate;
+
+        bool operator==(const Key& other) const
+        {
+            return path == other.path
+                && startFrame == other.startFrame
+                && numFrames == other.numFrames
+                && sampleRate == other.sampleRate;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry;
+
+    typedef std::shared_ptr<Entry> EntryRef;
+    typedef std::list<Entry*> LRUList;
+    typedef std::unordered_map<Key,EntryRef,KeyHash> Map;
+
+    enum { kLoadChunkFrames = 65536 };
+
+    void load(Entry* entry);
+    bool loadChunk(Entry* entry);
+    void processLoads();
+    void evict();
+
+    const Methcla_Host*     m_host;
+    size_t                  m_memoryBudget;
+    bool                    m_compact;
+    size_t                  m_memoryUsed;
+    Map                     m_entries;
+    LRUList                 m_unused;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_loaded;
+    std::list<EntryRef>     m_loads;
+    std::condition_variable m_loadsChanged;
+    bool                    m_continue;
+    std::thread             m_loader;
+};
+
+} }
+
+#endif // METHCLA_AUDIO_BUFFERCACHE_HPP_INCLUDED
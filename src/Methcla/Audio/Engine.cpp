@@ -12,16 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "Methcla/Audio/Buffer.hpp"
+#include "Methcla/Audio/BufferCache.hpp"
 #include "Methcla/Audio/Engine.hpp"
 #include "Methcla/Audio/EngineImpl.hpp"
 #include "Methcla/Audio/Group.hpp"
 #include "Methcla/Audio/Synth.hpp"
+#include "Methcla/Exception.hpp"
 #include "Methcla/Memory.hpp"
 #include "Methcla/Platform.hpp"
 
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -99,10 +104,12 @@ std::vector<std::string> split(const std::string& s, char delim)
     return elems;
 }
 
-std::string takeExtension(const std::string& path)
+std::string takeExtension(const char* path)
 {
-    auto exts = split(path, '.');
-    return exts.size() >= 2 ? exts.back() : std::string();
+    const char* ext = std::strrchr(path, '.');
+    return ext == nullptr || std::strchr(ext, '/') != nullptr
+            ? std::string()
+            : std::string(ext + 1);
 }
 
 std::string toLower(const std::string& s)
@@ -112,14 +119,10 @@ std::string toLower(const std::string& s)
     return result;
 }
 
-bool matchExtension(std::vector<std::string> extensions, std::string ext)
+// Extensions are expected in lower case.
+bool matchExtension(const std::vector<std::string>& extensions, const std::string& ext)
 {
-    for (auto validExt : extensions)
-    {
-        if (toLower(validExt) == toLower(ext))
-            return true;
-    }
-    return false;
+    return std::find(extensions.begin(), extensions.end(), ext) != extensions.end();
 }
 
 METHCLA_C_LINKAGE Methcla_Error methcla_api_host_soundfile_open(const Methcla_Host* host, const char* path, Methcla_FileMode mode, Methcla_SoundFile** file, Methcla_SoundFileInfo* info)
@@ -139,13 +142,16 @@ METHCLA_C_LINKAGE Methcla_Error methcla_api_host_soundfile_open(const Methcla_Ho
         );
     }
 
+    const std::string ext = toLower(takeExtension(path));
+
     // Open sound file with first API that matches the file extension or doesn't return an error (if the API doesn't specify file extensions).
     for (auto it=apis.begin(); it != apis.end(); it++)
     {
-        if (   (*it)->valid_file_extensions == nullptr
-            || matchExtension(split((*it)->valid_file_extensions, ','), takeExtension(path)))
+        const Methcla_SoundFileAPI* api = it->api;
+        if (   api->valid_file_extensions == nullptr
+            || matchExtension(it->extensions, ext))
         {
-            Methcla_Error result = (*it)->open(*it, path, mode, file, info);
+            Methcla_Error result = api->open(api, path, mode, file, info);
             if (methcla_is_ok(result))
             {
                 assert(file != nullptr);
@@ -169,6 +175,28 @@ METHCLA_C_LINKAGE Methcla_Error methcla_api_host_soundfile_open(const Methcla_Ho
     );
 }
 
+METHCLA_C_LINKAGE Methcla_Error methcla_api_host_buffer_acquire(const Methcla_Host* host, const char* path, int64_t startFrame, int64_t numFrames, double sampleRate, const Methcla_SampleBuffer** buffer)
+{
+    assert(host && host->handle);
+    assert(path);
+    assert(buffer);
+
+    try {
+        *buffer = static_cast<Environment*>(host->handle)->bufferCache().acquire(path, startFrame, numFrames, sampleRate);
+        return methcla_no_error();
+    } catch (Error& e) {
+        return methcla_error_new_with_message(e.errorCode(), e.what());
+    } catch (std::bad_alloc) {
+        return methcla_error_new(kMethcla_MemoryError);
+    }
+}
+
+METHCLA_C_LINKAGE void methcla_api_host_buffer_release(const Methcla_Host* host, const Methcla_SampleBuffer* buffer)
+{
+    assert(host && host->handle);
+    static_cast<Environment*>(host->handle)->bufferCache().release(buffer);
+}
+
 METHCLA_C_LINKAGE double methcla_api_world_samplerate(const Methcla_World* world)
 {
     assert(world && world->handle);
@@ -234,6 +262,24 @@ METHCLA_C_LINKAGE void methcla_api_world_synth_done(const Methcla_World*, Methcl
     assert(synth != nullptr);
     Synth::fromSynth(synth)->setDone();
 }
+
+METHCLA_C_LINKAGE const Methcla_SampleBuffer* methcla_api_world_buffer(const Methcla_World* world, Methcla_BufferId id)
+{
+    assert(world && world->handle);
+    return static_cast<Environment*>(world->handle)->buffer(id);
+}
+
+METHCLA_C_LINKAGE void methcla_api_world_buffer_retain(const Methcla_World*, const Methcla_SampleBuffer* buffer)
+{
+    assert(buffer != nullptr);
+    Buffer::fromSampleBuffer(buffer)->retain();
+}
+
+METHCLA_C_LINKAGE void methcla_api_world_buffer_release(const Methcla_World*, const Methcla_SampleBuffer* buffer)
+{
+    assert(buffer != nullptr);
+    Buffer::fromSampleBuffer(buffer)->release();
+}
 }
 
 extern "C" {
@@ -263,7 +309,9 @@ Environment::Environment(
         methcla_api_host_soundfile_open,
         methcla_api_host_perform_command,
         methcla_api_host_notify,
-        methcla_api_host_log_line
+        methcla_api_host_log_line,
+        methcla_api_host_buffer_acquire,
+        methcla_api_host_buffer_release
     };
 
     // Initialize Methcla_World interface
@@ -278,7 +326,10 @@ Environment::Environment(
         methcla_api_world_free_aligned,
         methcla_api_world_perform_command,
         methcla_api_world_log_line,
-        methcla_api_world_synth_done
+        methcla_api_world_synth_done,
+        methcla_api_world_buffer,
+        methcla_api_world_buffer_retain,
+        methcla_api_world_buffer_release
     };
 
     m_impl = new EnvironmentImpl(this, logHandler, packetHandler, options, messageQueue, worker);
@@ -377,10 +428,9 @@ void Environment::sendFromWorker(PerformFunc f, void* data)
     m_impl->sendFromWorker(f, data);
 }
 
-void Environment::process(Methcla_Time currentTime, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs)
+void Environment::process(Methcla_Time currentTime, double sampleRate, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs)
 {
-    assert( numFrames <= blockSize() );
-    m_impl->process(currentTime, numFrames, inputs, outputs);
+    m_impl->process(currentTime, sampleRate, numFrames, inputs, outputs);
 }
 
 void Environment::setLogFlags(Methcla_EngineLogFlags flags)
@@ -423,6 +473,11 @@ void Environment::replyError(Methcla_RequestId requestId, const char* msg)
     m_impl->replyError(requestId, msg);
 }
 
+void Environment::replyError(Methcla_RequestId requestId, Methcla_ErrorCode errorCode, const char* msg)
+{
+    m_impl->replyError(requestId, errorCode, msg);
+}
+
 void Environment::notify(const void* packet, size_t size)
 {
     m_impl->notify(packet, size);
@@ -445,14 +500,36 @@ const Memory::shared_ptr<SynthDef>& Environment::synthDef(const char* uri) const
 
 void Environment::registerSoundFileAPI(const Methcla_SoundFileAPI* api)
 {
-    m_impl->m_soundFileAPIs.push_front(api);
+    SoundFileAPI entry;
+    entry.api = api;
+    if (api->valid_file_extensions != nullptr)
+    {
+        for (auto ext : split(api->valid_file_extensions, ','))
+            entry.extensions.push_back(toLower(ext));
+    }
+    m_impl->m_soundFileAPIs.push_front(entry);
 }
 
-const std::list<const Methcla_SoundFileAPI*>& Environment::soundFileAPIs() const
+const std::list<Environment::SoundFileAPI>& Environment::soundFileAPIs() const
 {
     return m_impl->m_soundFileAPIs;
 }
 
+BufferCache& Environment::bufferCache()
+{
+    return *m_impl->m_bufferCache;
+}
+
+SoundFileIndex& Environment::soundFileIndex() const
+{
+    return *m_impl->m_soundFileIndex;
+}
+
+Buffer* Environment::buffer(int32_t id)
+{
+    return m_impl->m_buffers.lookup(BufferId(id)).get();
+}
+
 template <typename T> struct CallbackData
 {
     T     func;
@@ -29,6 +29,7 @@
 
 #include <cstddef>
 #include <functional>
+#include <list>
 #include <string>
 #include <vector>
 
@@ -37,7 +38,10 @@
 
 namespace Methcla { namespace Audio
 {
+    class Buffer;
+    class BufferCache;
     class Environment;
+    class SoundFileIndex;
 
     typedef void (*PerformFunc)(Environment* env, void* data);
 
@@ -66,6 +70,10 @@ namespace Methcla { namespace Audio
             size_t maxNumNodes = 1024;
             size_t maxNumAudioBuses = 1024;
             size_t maxNumControlBuses = 4096;
+            size_t maxNumBuffers = 1024;
+            size_t bufferCacheSize = 64*1024*1024;
+            bool compactSampleBuffers = false;
+            std::string soundFileIndexPath;
             size_t sampleRate = 44100;
             size_t blockSize = 64;
             size_t numHardwareInputChannels = 2;
@@ -109,6 +117,11 @@ namespace Methcla { namespace Audio
         Group* rootNode();
 
         double sampleRate() const { return m_sampleRate; }
+
+        //* Return the maximum number of frames processed in one block.
+        //
+        // The block size changes when the engine is reconfigured by an
+        // /engine/block-size/set request.
         size_t blockSize() const { return m_blockSize; }
 
         //* Return number of external audio outputs.
@@ -148,8 +161,26 @@ namespace Methcla { namespace Audio
         //* Sound file API registration
         void registerSoundFileAPI(const Methcla_SoundFileAPI* api);
 
+        //* Registered sound file API with its lower case file extensions.
+        struct SoundFileAPI
+        {
+            const Methcla_SoundFileAPI* api;
+            std::vector<std::string>    extensions;
+        };
+
         //* Get list of registered soundfile APIs (most recent ones first).
-        const std::list<const Methcla_SoundFileAPI*>& soundFileAPIs() const;
+        const std::list<SoundFileAPI>& soundFileAPIs() const;
+
+        //* Return the shared sample buffer cache.
+        BufferCache& bufferCache();
+
+        //* Return the sound file metadata index.
+        SoundFileIndex& soundFileIndex() const;
+
+        //* Return buffer with id or nullptr if there is no such buffer.
+        //
+        // Context: RT
+        Buffer* buffer(int32_t id);
 
         //* Send a command from the realtime thread to the worker thread.
         //
@@ -161,8 +192,16 @@ namespace Methcla { namespace Audio
         // Context: NRT
         void sendFromWorker(PerformFunc f, void* data);
 
+        //* Process numFrames frames starting at currentTime.
+        //
+        // sampleRate is the actual sample rate of the audio clock; it is used
+        // for converting bundle times to frame offsets. Periods longer than
+        // the block size are processed in several blocks.
+        //
+        // Context: RT
         void process(
             Methcla_Time currentTime,
+            double sampleRate,
             size_t numFrames,
             const sample_t* const* inputs,
             sample_t* const* outputs
@@ -182,6 +221,8 @@ namespace Methcla { namespace Audio
         void reply(Methcla_RequestId requestId, const OSCPP::Client::Packet& packet);
         //* Context: NRT
         void replyError(Methcla_RequestId requestId, const char* what);
+        //* Context: NRT
+        void replyError(Methcla_RequestId requestId, Methcla_ErrorCode errorCode, const char* what);
 
         //* Context: NRT
         void notify(const void* packet, size_t size);
@@ -190,6 +231,7 @@ namespace Methcla { namespace Audio
 
     private:
         friend class Node;
+        friend class EnvironmentImpl;
 
         //* Notify the client that a node has been flagged as 'done'.
         //
@@ -204,7 +246,8 @@ namespace Methcla { namespace Audio
     private:
         EnvironmentImpl*    m_impl;
         const double        m_sampleRate;
-        const size_t        m_blockSize;
+        // Only modified by the worker while processing is paused.
+        size_t              m_blockSize;
         Methcla_Host        m_host;
         Methcla_World       m_world;
     };
@@ -131,6 +131,16 @@ template <class T> T* lookupNodeAs(std::vector<Node*>& nodes, const char* prefix
     return result;
 }
 
+static inline void checkBufferIdIsValid(const BufferMap& buffers, BufferId bufferId)
+{
+    if (bufferId < 0 || (size_t)bufferId >= buffers.size())
+    {
+        throwErrorWith(kMethcla_BufferIdError, [&](std::stringstream& s) {
+            s << "Buffer id " << bufferId << " out of range";
+        });
+    }
+}
+
 static inline void addNodeToTarget(Node* target, Node* node, Methcla_NodePlacement nodePlacement)
 {
     switch (nodePlacement)
@@ -200,16 +210,27 @@ EnvironmentImpl::EnvironmentImpl(
     : m_owner(owner)
     , m_logHandler(logHandler)
     , m_packetHandler(listener)
+    , m_bufferCache(new BufferCache(*owner, options.bufferCacheSize, options.compactSampleBuffers))
+    , m_soundFileIndex(new SoundFileIndex(*owner, options.soundFileIndexPath))
     , m_rtMem(options.realtimeMemorySize)
     , m_requests(messageQueue == nullptr ? new Utility::MessageQueue<Request*>(kQueueSize) : messageQueue)
     , m_worker(worker ? worker : new Utility::WorkerThread<Environment::Command>(kQueueSize, 2))
     , m_scheduler(options.mode == Environment::kRealtimeMode ? kQueueSize : 0)
     , m_epoch(0)
     , m_currentTime(0)
+    , m_currentSampleRate(options.sampleRate)
     , m_nodes(options.maxNumNodes, nullptr)
+    , m_buffers(options.maxNumBuffers)
+    , m_bufferLoads(options.maxNumBuffers, 0)
+    , m_lastBufferLoad(0)
     , m_logFlags(kMethcla_EngineLogDefault)
+    , m_blockSizeCommand(nullptr)
+    , m_paused(false)
+    , m_blockInputs(options.numHardwareInputChannels)
+    , m_blockOutputs(options.numHardwareOutputChannels)
 {
     assert( m_logFlags.is_lock_free() );
+    assert( m_paused.is_lock_free() );
 
     const Epoch prevEpoch = m_epoch - 1;
 
@@ -240,10 +261,20 @@ EnvironmentImpl::EnvironmentImpl(
 EnvironmentImpl::~EnvironmentImpl()
 {
     m_rootNode->free();
+    // Release buffers while the worker is still running; buffers are deleted
+    // asynchronously in the worker thread.
+    m_buffers.clear();
     // Stop worker thread(s). Note that relying on the destructor here doesn't
     // cut it, because asynchronous commands in the worker thread queue might
     // reference a partially destroyed Environment.
     m_worker->stop();
+    // Close cached sound files while the sound file APIs that opened them
+    // are still loaded.
+    m_bufferCache.reset();
+    m_soundFileIndex.reset();
+    // Destroy plugin libraries before the realtime memory pool and the worker
+    // go away; libraries may own threads that still reference either.
+    m_plugins.unloadPlugins();
 }
 
 void EnvironmentImpl::init(const Environment::Options& options)
@@ -255,10 +286,137 @@ void EnvironmentImpl::init(const Environment::Options& options)
     m_plugins.loadPlugins(*m_owner, options.pluginLibraries);
 }
 
-void EnvironmentImpl::process(Methcla_Time currentTime, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs)
+class EnvironmentImpl::CommandSetBlockSize
+{
+public:
+    CommandSetBlockSize(EnvironmentImpl* env, Methcla_RequestId requestId, size_t blockSize, const char* error=nullptr)
+        : m_env(env)
+        , m_requestId(requestId)
+        , m_blockSize(blockSize)
+        , m_error(error)
+    {
+    }
+
+    //* Return true if the engine needs to be paused for performing the command.
+    bool needsPause() const
+    {
+        return m_error == nullptr;
+    }
+
+    // Context: NRT
+    void perform(Environment* env)
+    {
+        static const char* address = "/engine/block-size/set";
+
+        Methcla_ErrorCode errorCode = kMethcla_ArgumentError;
+        const char* error = m_error;
+
+        if (needsPause())
+        {
+            try
+            {
+                m_env->setBlockSize(m_blockSize);
+            }
+            catch (std::bad_alloc&)
+            {
+                errorCode = kMethcla_MemoryError;
+                error = "Couldn't allocate buffers for the new block size";
+            }
+            // Resume processing
+            m_env->m_paused.store(false, std::memory_order_release);
+        }
+
+        if (error == nullptr)
+        {
+            OSCPP::Client::DynamicPacket packet(OSCPP::Size::message(address, 0));
+            packet.openMessage(address, 0);
+            packet.closeMessage();
+            env->reply(m_requestId, packet);
+        }
+        else
+        {
+            env->replyError(m_requestId, errorCode, error);
+        }
+
+        env->sendFromWorker(perform_rt_free, this);
+    }
+
+private:
+    EnvironmentImpl*  m_env;
+    Methcla_RequestId m_requestId;
+    size_t            m_blockSize;
+    const char*       m_error;
+};
+
+void EnvironmentImpl::setBlockSize(size_t blockSize)
+{
+    for (auto& bus : m_internalAudioBuses)
+    {
+        static_cast<InternalAudioBus*>(bus.get())->reserve(blockSize);
+    }
+
+    for (Node* node : m_nodes)
+    {
+        if (node != nullptr && node->isSynth())
+            static_cast<Synth*>(node)->reserveAudioBuffers(blockSize);
+    }
+
+    m_owner->m_blockSize = blockSize;
+}
+
+void EnvironmentImpl::process(Methcla_Time currentTime, double sampleRate, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs)
 {
-    // Update current time
+    if (m_paused.load(std::memory_order_acquire))
+    {
+        // The worker is reallocating buffers; requests are queued until
+        // processing resumes.
+        for (size_t i=0; i < m_externalAudioOutputs.size(); i++)
+        {
+            memset(outputs[i], 0, numFrames * sizeof(sample_t));
+        }
+        return;
+    }
+
+    const size_t blockSize = m_owner->blockSize();
+
+    if (numFrames <= blockSize)
+    {
+        processBlock(currentTime, sampleRate, numFrames, inputs, outputs);
+    }
+    else
+    {
+        const double blockSampleRate = sampleRate > 0 ? sampleRate : m_owner->sampleRate();
+        for (size_t offset=0; offset < numFrames; offset += blockSize)
+        {
+            for (size_t i=0; i < m_blockInputs.size(); i++)
+                m_blockInputs[i] = inputs[i] + offset;
+            for (size_t i=0; i < m_blockOutputs.size(); i++)
+                m_blockOutputs[i] = outputs[i] + offset;
+            processBlock(
+                currentTime + (double)offset / blockSampleRate,
+                sampleRate,
+                std::min(blockSize, numFrames - offset),
+                m_blockInputs.data(),
+                m_blockOutputs.data()
+                );
+        }
+    }
+
+    if (m_blockSizeCommand != nullptr)
+    {
+        // Hand the engine over to the worker; nothing may be touched by this
+        // thread until the command has finished.
+        m_paused.store(true, std::memory_order_release);
+        sendToWorker(m_blockSizeCommand);
+        m_blockSizeCommand = nullptr;
+    }
+}
+
+void EnvironmentImpl::processBlock(Methcla_Time currentTime, double sampleRate, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs)
+{
+    // Update current time and sample rate estimate
     m_currentTime = currentTime;
+    m_currentSampleRate = sampleRate > 0 ? sampleRate : m_owner->sampleRate();
 
     // Load log flags
     const Methcla_EngineLogFlags logFlags = (Methcla_EngineLogFlags)m_logFlags.load();
@@ -266,7 +424,7 @@ void EnvironmentImpl::process(Methcla_Time currentTime, size_t numFrames, const
     // Process external requests
     processRequests(logFlags, currentTime);
     // Process scheduled requests
-    processScheduler(logFlags, currentTime, currentTime + numFrames / m_owner->sampleRate());
+    processScheduler(logFlags, currentTime, currentTime + numFrames / m_currentSampleRate);
     // std::cout << "Environment::process " << currentTime << std::endl;
 
     // Process non-realtime commands
@@ -436,11 +594,8 @@ void EnvironmentImpl::processMessage(Methcla_EngineLogFlags logFlags, const OSCP
 
             const shared_ptr<SynthDef> def = m_owner->synthDef(defName);
 
+            // Control inputs without initial value are set to zero.
             auto synthControls = args.atEnd() ? OSCPP::Server::ArgStream() : args.array();
-            // FIXME: Cannot be checked before the synth is instantiated.
-            // if (def->numControlInputs() != synthControls.size()) {
-            //     throw std::runtime_error("Missing synth control initialisers");
-            // }
             auto synthArgs = args.atEnd() ? OSCPP::Server::ArgStream() : args.array();
 
             Node* target = lookupNode(m_nodes, "Target node", targetId);
@@ -474,8 +629,7 @@ void EnvironmentImpl::processMessage(Methcla_EngineLogFlags logFlags, const OSCP
         {
             NodeId nodeId = NodeId(args.int32());
             Synth* synth = lookupNodeAs<Synth>(m_nodes, "Synth", nodeId);
-            // TODO: Use sample rate estimate from driver
-            const double sampleOffset = std::max(0., (scheduleTime - currentTime) * m_owner->sampleRate());
+            const double sampleOffset = std::max(0., (scheduleTime - currentTime) * m_currentSampleRate);
             synth->activate(sampleOffset);
         }
         else if (msg == "/synth/map/input")
@@ -578,6 +732,27 @@ void EnvironmentImpl::processMessage(Methcla_EngineLogFlags logFlags, const OSCP
 
             synth->controlInput(index) = value;
         }
+        else if (msg == "/node/set-range")
+        {
+            NodeId nodeId = NodeId(args.int32());
+            int32_t index = args.int32();
+            auto values = args.array();
+
+            Synth* synth = lookupNodeAs<Synth>(m_nodes, "Synth", nodeId);
+
+            if ((index < 0) || (index + values.size() > synth->numControlInputs()))
+            {
+                throwErrorWith(kMethcla_ArgumentError, [&](std::stringstream& s) {
+                    s << "Control input range " << index << "+" << values.size()
+                      << " out of range for synth " << nodeId;
+                });
+            }
+
+            for (Methcla_PortCount i = index; !values.atEnd(); i++)
+            {
+                synth->controlInput(i) = values.float32();
+            }
+        }
         else if (msg == "/node/tree/statistics")
         {
             class CommandNodeTreeStatistics
@@ -650,6 +825,278 @@ void EnvironmentImpl::processMessage(Methcla_EngineLogFlags logFlags, const OSCP
 
             sendToWorker<CommandNodeTreeStatistics>(requestId, stats);
         }
+        else if (msg == "/synth/statistics")
+        {
+            class CommandSynthStatistics
+            {
+            public:
+                enum { kMaxNumValues = 16 };
+                enum { kMaxErrorSize = 128 };
+
+                CommandSynthStatistics(Methcla_RequestId requestId)
+                    : m_requestId(requestId)
+                    , m_numValues(0)
+                    , m_errorCode(kMethcla_NoError)
+                {
+                    m_error[0] = '\0';
+                }
+
+                void collect(Synth* synth)
+                {
+                    m_numValues = std::min<size_t>(synth->statistics(m_values, kMaxNumValues), kMaxNumValues);
+                }
+
+                void fail(const Error& e)
+                {
+                    m_errorCode = e.errorCode();
+                    strncpy(m_error, e.errorMessage(), kMaxErrorSize-1);
+                    m_error[kMaxErrorSize-1] = '\0';
+                }
+
+                void perform(Environment* env)
+                {
+                    static const char* address = "/synth/statistics";
+                    if (m_errorCode == kMethcla_NoError)
+                    {
+                        OSCPP::Client::DynamicPacket packet(
+                            OSCPP::Size::message(address, m_numValues)
+                          + OSCPP::Size::int32(m_numValues)
+                        );
+                        packet.openMessage(address, m_numValues);
+                        for (size_t i=0; i < m_numValues; i++)
+                            packet.int32(m_values[i]);
+                        packet.closeMessage();
+                        env->reply(m_requestId, packet);
+                    }
+                    else
+                    {
+                        env->replyError(m_requestId, m_errorCode, m_error);
+                    }
+                    env->sendFromWorker(perform_rt_free, this);
+                }
+
+            private:
+                Methcla_RequestId m_requestId;
+                int32_t           m_values[kMaxNumValues];
+                size_t            m_numValues;
+                Methcla_ErrorCode m_errorCode;
+                char              m_error[kMaxErrorSize];
+            };
+
+            const Methcla_RequestId requestId = args.int32();
+            NodeId nodeId = NodeId(args.int32());
+
+            CommandSynthStatistics* command = rtMem().construct<CommandSynthStatistics>(requestId);
+
+            try
+            {
+                command->collect(lookupNodeAs<Synth>(m_nodes, "Synth", nodeId));
+            }
+            catch (Error& e)
+            {
+                // Reply with the error instead of the statistics, so that
+                // the client receives exactly one response to its request.
+                command->fail(e);
+            }
+
+            sendToWorker(command);
+        }
+        else if (msg == "/buffer/alloc" || msg == "/buffer/read")
+        {
+            class CommandLoadBuffer
+            {
+            public:
+                CommandLoadBuffer(EnvironmentImpl* env, BufferId bufferId, char* path, int64_t startFrame, int64_t numFrames, size_t numChannels)
+                    : m_env(env)
+                    , m_bufferId(bufferId)
+                    , m_load(env->beginBufferLoad(bufferId))
+                    , m_path(path)
+                    , m_startFrame(startFrame)
+                    , m_numFrames(numFrames)
+                    , m_numChannels(numChannels)
+                    , m_buffer(nullptr)
+                {
+                }
+
+                // Context: NRT
+                void perform(Environment* env)
+                {
+                    Methcla_ErrorCode errorCode = kMethcla_NoError;
+                    std::string error;
+
+                    try
+                    {
+                        m_buffer = m_path == nullptr
+                            ? Buffer::alloc(*env, m_bufferId, m_numChannels, m_numFrames)
+                            : Buffer::read(*env, m_bufferId, m_path, m_startFrame, m_numFrames);
+                    }
+                    catch (Error& e)
+                    {
+                        errorCode = e.errorCode();
+                        error = e.what();
+                    }
+                    catch (std::bad_alloc&)
+                    {
+                        errorCode = kMethcla_MemoryError;
+                        error = methcla_error_code_description(errorCode);
+                    }
+                    catch (std::exception& e)
+                    {
+                        errorCode = kMethcla_UnspecifiedError;
+                        error = e.what();
+                    }
+
+                    if (errorCode != kMethcla_NoError)
+                    {
+                        std::stringstream s;
+                        s << "Couldn't load buffer " << m_bufferId;
+                        if (m_path != nullptr)
+                            s << " from " << m_path;
+                        s << ": " << error;
+                        env->replyError(kMethcla_Notification, s.str().c_str());
+                        m_env->notifyBufferError(m_bufferId, errorCode, s.str().c_str());
+                    }
+
+                    env->sendFromWorker(perform_install, this);
+                }
+
+            private:
+                // Context: RT
+                static void perform_install(Environment* env, void* data)
+                {
+                    CommandLoadBuffer* self = static_cast<CommandLoadBuffer*>(data);
+                    if (self->m_env->endBufferLoad(self->m_bufferId, self->m_load))
+                    {
+                        if (self->m_buffer != nullptr)
+                            self->m_env->setBuffer(self->m_buffer);
+                    }
+                    else if (self->m_buffer != nullptr)
+                    {
+                        // Freed or replaced while loading; releasing the
+                        // only reference deletes the buffer in the worker.
+                        BufferMap::Pointer buffer(self->m_buffer);
+                    }
+                    if (self->m_path != nullptr)
+                        env->rtMem().free(self->m_path);
+                    env->rtMem().free(self);
+                }
+
+                EnvironmentImpl* m_env;
+                BufferId         m_bufferId;
+                uint64_t         m_load;
+                char*            m_path;
+                int64_t          m_startFrame;
+                int64_t          m_numFrames;
+                size_t           m_numChannels;
+                Buffer*          m_buffer;
+            };
+
+            BufferId bufferId = BufferId(args.int32());
+            checkBufferIdIsValid(m_buffers, bufferId);
+
+            if (msg == "/buffer/alloc")
+            {
+                const int32_t numChannels = args.int32();
+                const int32_t numFrames = args.int32();
+
+                if (numChannels <= 0 || numFrames <= 0)
+                {
+                    throwErrorWith(kMethcla_ArgumentError, [&](std::stringstream& s) {
+                        s << "Invalid size " << numChannels << "x" << numFrames << " for buffer " << bufferId;
+                    });
+                }
+
+                sendToWorker<CommandLoadBuffer>(this, bufferId, nullptr, 0, numFrames, numChannels);
+            }
+            else
+            {
+                const char* path = args.string();
+                const int32_t startFrame = args.atEnd() ? 0 : args.int32();
+                const int32_t numFrames = args.atEnd() ? -1 : args.int32();
+
+                char* pathCopy = rtMem().allocOf<char>(strlen(path)+1);
+                strcpy(pathCopy, path);
+
+                sendToWorker<CommandLoadBuffer>(this, bufferId, pathCopy, startFrame, numFrames, 0);
+            }
+        }
+        else if (msg == "/buffer/set")
+        {
+            BufferId bufferId = BufferId(args.int32());
+            checkBufferIdIsValid(m_buffers, bufferId);
+            const int32_t startFrame = args.int32();
+            auto values = args.array();
+
+            BufferMap::Pointer buffer = m_buffers.lookup(bufferId);
+            if (buffer == nullptr)
+            {
+                throwErrorWith(kMethcla_BufferIdError, [&](std::stringstream& s) {
+                    s << "Buffer " << bufferId << " not found";
+                });
+            }
+
+            // Buffers read from sound files share their data with the buffer cache.
+            float* data = buffer->writableData();
+            if (data == nullptr)
+            {
+                throwErrorWith(kMethcla_ArgumentError, [&](std::stringstream& s) {
+                    s << "Buffer " << bufferId << " is not writable";
+                });
+            }
+
+            const size_t numSamples = buffer->channels * (size_t)buffer->frames;
+            const size_t offset = (size_t)startFrame * buffer->channels;
+            if ((startFrame < 0) || (offset + values.size() > numSamples))
+            {
+                throwErrorWith(kMethcla_ArgumentError, [&](std::stringstream& s) {
+                    s << "Sample range " << startFrame << "+" << values.size()
+                      << " out of range for buffer " << bufferId;
+                });
+            }
+
+            // Synths read buffers in the realtime context, so the samples can be written in place.
+            for (size_t i = offset; !values.atEnd(); i++)
+            {
+                data[i] = values.float32();
+            }
+        }
+        else if (msg == "/buffer/free")
+        {
+            BufferId bufferId = BufferId(args.int32());
+            checkBufferIdIsValid(m_buffers, bufferId);
+
+            // A pending load is cancelled and its buffer dropped when it arrives.
+            const bool cancelled = cancelBufferLoad(bufferId);
+
+            if (!m_buffers.contains(bufferId) && !cancelled)
+            {
+                throwErrorWith(kMethcla_BufferIdError, [&](std::stringstream& s) {
+                    s << "Buffer " << bufferId << " not found";
+                });
+            }
+
+            // The buffer is deleted when the last synth using it releases its reference.
+            m_buffers.remove(bufferId);
+        }
+        else if (msg == "/engine/block-size/set")
+        {
+            const Methcla_RequestId requestId = args.int32();
+            const int32_t blockSize = args.int32();
+
+            if (blockSize <= 0)
+            {
+                sendToWorker<CommandSetBlockSize>(this, requestId, 0, "Invalid block size");
+            }
+            else if (m_blockSizeCommand != nullptr)
+            {
+                sendToWorker<CommandSetBlockSize>(this, requestId, 0, "Block size change already in progress");
+            }
+            else
+            {
+                // Sent to the worker after the current period has been processed.
+                m_blockSizeCommand = rtMem().construct<CommandSetBlockSize>(this, requestId, (size_t)blockSize);
+            }
+        }
         else if (msg == "/engine/realtime-memory/statistics")
         {
             class CommandRealtimeMemoryStatistics
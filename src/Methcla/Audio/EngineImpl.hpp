@@ -16,7 +16,10 @@
 #define METHCLA_AUDIO_ENGINE_IMPL_HPP_INCLUDED
 
 #include "Methcla/Audio/AudioBus.hpp"
+#include "Methcla/Audio/Buffer.hpp"
+#include "Methcla/Audio/BufferCache.hpp"
 #include "Methcla/Audio/Group.hpp"
+#include "Methcla/Audio/SoundFileIndex.hpp"
 #include "Methcla/Audio/Synth.hpp"
 #include "Methcla/Memory.hpp"
 #include "Methcla/Memory/Manager.hpp"
@@ -224,6 +227,10 @@ public:
     PacketHandler               m_packetHandler;
 
     PluginManager               m_plugins;
+    // NOTE: Buffer cache and sound file index need to be destroyed before
+    // plugins (m_plugins) are unloaded, see ~EnvironmentImpl.
+    std::unique_ptr<BufferCache> m_bufferCache;
+    std::unique_ptr<SoundFileIndex> m_soundFileIndex;
     Memory::RTMemoryManager     m_rtMem;
 
     typedef Utility::MessageQueue<Request*> MessageQueue;
@@ -253,15 +260,30 @@ public:
 
     Epoch                                               m_epoch;
     Methcla_Time                                        m_currentTime;
+    double                                              m_currentSampleRate;
 
     std::vector<Node*>                                  m_nodes;
     Group*                                              m_rootNode;
 
+    BufferMap                                           m_buffers;
+    // Sequence number of the pending load per buffer id, zero if none.
+    std::vector<uint64_t>                               m_bufferLoads;
+    uint64_t                                            m_lastBufferLoad;
+
     SynthDefMap                                         m_synthDefs;
-    std::list<const Methcla_SoundFileAPI*>              m_soundFileAPIs;
+    std::list<Environment::SoundFileAPI>                m_soundFileAPIs;
 
     std::atomic<int>                                    m_logFlags;
 
+    // Block size reconfiguration; see setBlockSize.
+    class CommandSetBlockSize;
+    CommandSetBlockSize*                                m_blockSizeCommand;
+    std::atomic<bool>                                   m_paused;
+
+    // Port buffers of the current block when splitting periods.
+    std::vector<const sample_t*>                        m_blockInputs;
+    std::vector<sample_t*>                              m_blockOutputs;
+
     EnvironmentImpl(Environment* owner, LogHandler logHandler, PacketHandler listener, const Environment::Options& options, Environment::MessageQueue* messageQueue, Environment::Worker* worker);
     ~EnvironmentImpl();
 
@@ -291,7 +313,17 @@ public:
     void registerSynthDef(const Methcla_SynthDef* def);
     const Memory::shared_ptr<SynthDef>& synthDef(const char* uri) const;
 
-    void process(Methcla_Time currentTime, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs);
+    void process(Methcla_Time currentTime, double sampleRate, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs);
+    void processBlock(Methcla_Time currentTime, double sampleRate, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs);
+
+    //* Reallocate bus and synth buffers for blocks of up to blockSize frames.
+    //
+    // Buffers only grow, so that lowering the block size never fails. Throws
+    // std::bad_alloc and leaves the block size unchanged when the buffers
+    // cannot be allocated.
+    //
+    // Context: NRT, while processing is paused.
+    void setBlockSize(size_t blockSize);
 
     void processRequests(Methcla_EngineLogFlags logFlags, const Methcla_Time currentTime);
     void processScheduler(Methcla_EngineLogFlags logFlags, const Methcla_Time currentTime, const Methcla_Time nextTime);
@@ -420,6 +452,92 @@ public:
         }
     }
 
+    class BufferLoadedNotification : public Notification
+    {
+        BufferId m_bufferId;
+
+    public:
+        BufferLoadedNotification(BufferId bufferId)
+            : m_bufferId(bufferId)
+        {}
+
+    private:
+        void notify(Environment* env) override
+        {
+            static const char* address = "/buffer/loaded";
+            OSCPP::Client::DynamicPacket packet(
+                OSCPP::Size::message(address, 1)
+              + OSCPP::Size::int32(1)
+            );
+            packet.openMessage(address, 1);
+            packet.int32(m_bufferId);
+            packet.closeMessage();
+            env->notify(packet);
+        }
+    };
+
+    //* Install buffer and notify the client.
+    //
+    // Context: RT
+    void setBuffer(Buffer* buffer)
+    {
+        const BufferId bufferId = buffer->id();
+        m_buffers.insert(bufferId, buffer);
+        sendToWorker<BufferLoadedNotification>(bufferId);
+    }
+
+    //* Register a load for bufferId, superseding any pending load, and
+    // return its sequence number.
+    //
+    // Context: RT
+    uint64_t beginBufferLoad(BufferId bufferId)
+    {
+        m_bufferLoads[bufferId] = ++m_lastBufferLoad;
+        return m_bufferLoads[bufferId];
+    }
+
+    //* Finish a load and return false if it has been cancelled or
+    // superseded by a later load in the meantime.
+    //
+    // Context: RT
+    bool endBufferLoad(BufferId bufferId, uint64_t load)
+    {
+        if (m_bufferLoads[bufferId] != load)
+            return false;
+        m_bufferLoads[bufferId] = 0;
+        return true;
+    }
+
+    //* Cancel the pending load for bufferId and return false if there is none.
+    //
+    // Context: RT
+    bool cancelBufferLoad(BufferId bufferId)
+    {
+        if (m_bufferLoads[bufferId] == 0)
+            return false;
+        m_bufferLoads[bufferId] = 0;
+        return true;
+    }
+
+    //* Notify the client that loading a buffer failed.
+    //
+    // Context: NRT
+    void notifyBufferError(BufferId bufferId, Methcla_ErrorCode errorCode, const char* what)
+    {
+        static const char* address = "/buffer/error";
+        OSCPP::Client::DynamicPacket packet(
+            OSCPP::Size::message(address, 3)
+          + OSCPP::Size::int32(2)
+          + OSCPP::Size::string(what)
+        );
+        packet.openMessage(address, 3);
+        packet.int32(bufferId);
+        packet.int32(errorCode);
+        packet.string(what);
+        packet.closeMessage();
+        notify(packet);
+    }
+
     //* Context: NRT
     void reply(Methcla_RequestId requestId, const void* packet, size_t size)
     {
@@ -449,6 +567,22 @@ public:
         out << ": " << what;
     }
 
+    //* Context: NRT
+    // Reply to a request with an /error message carrying errorCode and what.
+    void replyError(Methcla_RequestId requestId, Methcla_ErrorCode errorCode, const char* what)
+    {
+        OSCPP::Client::DynamicPacket packet(
+            OSCPP::Size::message("/error", 2)
+          + OSCPP::Size::int32(1)
+          + OSCPP::Size::string(what)
+        );
+        packet.openMessage("/error", 2);
+        packet.int32(errorCode);
+        packet.string(what);
+        packet.closeMessage();
+        reply(requestId, packet);
+    }
+
     //* Context: NRT
     void notify(const void* packet, size_t size)
     {
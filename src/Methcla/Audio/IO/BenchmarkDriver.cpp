@@ -0,0 +1,207 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Methcla/Audio/IO/BenchmarkDriver.hpp"
+#include "Methcla/API.hpp"
+
+#include <methcla/platform/benchmark.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+using namespace Methcla::Audio::IO;
+
+constexpr double BenchmarkDriver::kDefaultSampleRate;
+constexpr size_t BenchmarkDriver::kDefaultNumInputs;
+constexpr size_t BenchmarkDriver::kDefaultNumOutputs;
+
+BenchmarkDriver::BenchmarkDriver(Options options, uint64_t numWarmupBlocks, uint64_t numBlocks, BlockCallback callback, void* callbackData)
+    : Driver(options)
+    , m_sampleRate(options.sampleRate > 0 ? options.sampleRate : kDefaultSampleRate)
+    , m_numInputs(options.numInputs >= 0 ? options.numInputs : kDefaultNumInputs)
+    , m_numOutputs(options.numOutputs >= 0 ? options.numOutputs : kDefaultNumOutputs)
+    , m_bufferSize(options.bufferSize > 0 ? options.bufferSize : kDefaultBufferSize)
+    , m_numWarmupBlocks(numWarmupBlocks)
+    , m_numBlocks(numBlocks)
+    , m_callback(callback)
+    , m_callbackData(callbackData)
+    , m_elapsedTime(0)
+    , m_continue(false)
+    , m_block(0)
+    , m_done(false)
+{
+    assert(m_numOutputs > 0);
+    m_inputBuffers = makeBuffers(m_numInputs, m_bufferSize);
+    m_outputBuffers = makeBuffers(m_numOutputs, m_bufferSize);
+    // Allocate up front so that recording a measurement doesn't allocate.
+    m_latencies.reserve(m_numBlocks);
+}
+
+BenchmarkDriver::~BenchmarkDriver()
+{
+    stop();
+    freeBuffers(m_numInputs, m_inputBuffers);
+    freeBuffers(m_numOutputs, m_outputBuffers);
+}
+
+void BenchmarkDriver::start()
+{
+    if (!m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done = false;
+        }
+        resetTimeFilter();
+        m_latencies.clear();
+        m_elapsedTime = 0;
+        m_block = 0;
+        m_continue = true;
+        m_thread = std::thread(&BenchmarkDriver::run, this);
+    }
+}
+
+void BenchmarkDriver::stop()
+{
+    if (m_thread.joinable())
+    {
+        m_continue = false;
+        m_thread.join();
+    }
+}
+
+Methcla_Time BenchmarkDriver::currentTime()
+{
+    return (double)m_block.load() * (double)m_bufferSize / m_sampleRate;
+}
+
+void BenchmarkDriver::run()
+{
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<double> Seconds;
+
+    const uint64_t numBlocks = m_numWarmupBlocks + m_numBlocks;
+    auto t0 = Clock::now();
+
+    for (uint64_t block=0; block < numBlocks && m_continue; block++)
+    {
+        if (m_callback != nullptr)
+            m_callback(m_callbackData, block);
+
+        const Methcla_Time time = (double)block * (double)m_bufferSize / m_sampleRate;
+
+        const auto start = Clock::now();
+        process(time, m_bufferSize, m_inputBuffers, m_outputBuffers);
+        const auto end = Clock::now();
+
+        if (block >= m_numWarmupBlocks)
+            m_latencies.push_back(std::chrono::duration_cast<Seconds>(end - start).count());
+        else
+            t0 = end;
+
+        m_block = block + 1;
+    }
+
+    m_elapsedTime = std::chrono::duration_cast<Seconds>(Clock::now() - t0).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done = true;
+    m_cond.notify_all();
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    // Nearest rank
+    const size_t rank = (size_t)std::ceil(p * (double)sorted.size());
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+BenchmarkDriver::Statistics BenchmarkDriver::wait()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_done; });
+    }
+
+    std::vector<double> latencies(m_latencies);
+    std::sort(latencies.begin(), latencies.end());
+
+    Statistics stats;
+    stats.numBlocks = latencies.size();
+    stats.processTime = 0;
+    for (double t : latencies)
+        stats.processTime += t;
+    stats.elapsedTime = m_elapsedTime;
+    stats.blocksPerSecond = stats.processTime > 0 ? (double)stats.numBlocks / stats.processTime : 0;
+    stats.realtimeFactor = stats.blocksPerSecond * (double)m_bufferSize / m_sampleRate;
+    stats.latencyP50 = percentile(latencies, 0.5);
+    stats.latencyP90 = percentile(latencies, 0.9);
+    stats.latencyP99 = percentile(latencies, 0.99);
+    stats.latencyP999 = percentile(latencies, 0.999);
+    stats.latencyMax = latencies.empty() ? 0 : latencies.back();
+
+    return stats;
+}
+
+METHCLA_EXPORT Methcla_AudioDriver* methcla_benchmark_driver_new(
+    const Methcla_AudioDriverOptions* options,
+    uint64_t num_warmup_blocks,
+    uint64_t num_blocks,
+    Methcla_BenchmarkBlockCallback block_callback,
+    void* block_callback_data
+    )
+{
+    return Methcla::API::wrapAudioDriver(
+        new BenchmarkDriver(
+            Methcla::API::convertOptions(options),
+            num_warmup_blocks,
+            num_blocks,
+            block_callback,
+            block_callback_data
+            )
+        );
+}
+
+METHCLA_EXPORT Methcla_Error methcla_benchmark_driver_wait(
+    Methcla_AudioDriver* driver,
+    Methcla_BenchmarkStatistics* statistics
+    )
+{
+    if (driver == nullptr || statistics == nullptr)
+        return methcla_error_new(kMethcla_ArgumentError);
+
+    BenchmarkDriver* benchmarkDriver =
+        dynamic_cast<BenchmarkDriver*>(Methcla::API::unwrapAudioDriver(driver));
+    if (benchmarkDriver == nullptr)
+        return methcla_error_new_with_message(kMethcla_ArgumentError, "Not a benchmark driver");
+
+    BenchmarkDriver::Statistics stats = benchmarkDriver->wait();
+
+    statistics->num_blocks = stats.numBlocks;
+    statistics->process_time = stats.processTime;
+    statistics->elapsed_time = stats.elapsedTime;
+    statistics->blocks_per_second = stats.blocksPerSecond;
+    statistics->realtime_factor = stats.realtimeFactor;
+    statistics->latency_p50 = stats.latencyP50;
+    statistics->latency_p90 = stats.latencyP90;
+    statistics->latency_p99 = stats.latencyP99;
+    statistics->latency_p999 = stats.latencyP999;
+    statistics->latency_max = stats.latencyMax;
+
+    return methcla_no_error();
+}
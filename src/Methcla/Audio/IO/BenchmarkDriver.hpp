@@ -0,0 +1,110 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_AUDIO_IO_BENCHMARKDRIVER_HPP_INCLUDED
+#define METHCLA_AUDIO_IO_BENCHMARKDRIVER_HPP_INCLUDED
+
+#include "Methcla/Audio/IO/Driver.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Methcla { namespace Audio { namespace IO
+{
+    //* Driver that processes a fixed number of blocks back-to-back.
+    //
+    // Unlike DummyDriver it doesn't wait for the realtime duration of a block
+    // between process calls, so that the time spent in the engine can be
+    // measured. The time reported to the engine advances by one block
+    // duration per block regardless of wall clock time.
+    //
+    // The first numWarmupBlocks blocks are processed but not measured.
+    class BenchmarkDriver : public Driver
+    {
+    public:
+        static constexpr double kDefaultSampleRate = 44100;
+        static constexpr size_t kDefaultNumInputs = 0;
+        static constexpr size_t kDefaultNumOutputs = 2;
+
+        //* Called on the driver thread before each block, including warm-up
+        //  blocks; the time spent in the callback is not measured.
+        typedef void (*BlockCallback)(void* data, uint64_t block);
+
+        struct Statistics
+        {
+            //* Number of measured blocks.
+            uint64_t numBlocks;
+            //* Total time spent in process in seconds.
+            double processTime;
+            //* Wall clock time from the first measured block to the last block in seconds.
+            double elapsedTime;
+            double blocksPerSecond;
+            //* Ratio of processed audio time to processing time.
+            double realtimeFactor;
+            //* Block latency percentiles and maximum in seconds.
+            double latencyP50;
+            double latencyP90;
+            double latencyP99;
+            double latencyP999;
+            double latencyMax;
+        };
+
+        BenchmarkDriver(Options options, uint64_t numWarmupBlocks, uint64_t numBlocks, BlockCallback callback=nullptr, void* callbackData=nullptr);
+        virtual ~BenchmarkDriver();
+
+        virtual double sampleRate() const override { return m_sampleRate; }
+        virtual size_t numInputs() const override { return m_numInputs; }
+        virtual size_t numOutputs() const override { return m_numOutputs; }
+        virtual size_t bufferSize() const override { return m_bufferSize; }
+
+        virtual void start() override;
+        virtual void stop() override;
+
+        virtual Methcla_Time currentTime() override;
+
+        //* Wait until all blocks have been processed and return the statistics.
+        //
+        // Must only be called after start.
+        Statistics wait();
+
+    private:
+        void run();
+
+    private:
+        double                  m_sampleRate;
+        size_t                  m_numInputs;
+        size_t                  m_numOutputs;
+        size_t                  m_bufferSize;
+        uint64_t                m_numWarmupBlocks;
+        uint64_t                m_numBlocks;
+        BlockCallback           m_callback;
+        void*                   m_callbackData;
+        sample_t**              m_inputBuffers;
+        sample_t**              m_outputBuffers;
+        std::vector<double>     m_latencies;
+        double                  m_elapsedTime;
+        std::atomic<bool>       m_continue;
+        std::atomic<uint64_t>   m_block;
+        std::mutex              m_mutex;
+        std::condition_variable m_cond;
+        bool                    m_done;
+        std::thread             m_thread;
+    };
+} } }
+
+#endif // METHCLA_AUDIO_IO_BENCHMARKDRIVER_HPP_INCLUDED
@@ -20,8 +20,14 @@ void Driver::setProcessCallback(ProcessCallback callback, void* data)
 
 void Driver::process(Methcla_Time currentTime, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs)
 {
+    m_timeFilter.update(currentTime, numFrames, sampleRate());
     if (m_processCallback != nullptr)
-        m_processCallback(m_processData, currentTime, numFrames, inputs, outputs);
+        m_processCallback(m_processData, m_timeFilter.time(), m_timeFilter.sampleRate(), numFrames, inputs, outputs);
+}
+
+void Driver::resetTimeFilter()
+{
+    m_timeFilter.reset();
 }
 
 Methcla_Time Driver::currentTime()
@@ -17,6 +17,7 @@
 
 #include "Methcla/Audio.hpp"
 #include "Methcla/Audio/MultiChannelBuffer.hpp"
+#include "Methcla/Audio/IO/TimeFilter.hpp"
 
 #include <cstdint>
 #include <cstring>
@@ -36,9 +37,14 @@ public:
         int bufferSize    = -1;
     };
 
+    //* Callback invoked by the driver for each block.
+    //
+    // currentTime is the filtered time of the first frame of the block and
+    // sampleRate the sample rate estimated from the driver's timestamps.
     typedef void (*ProcessCallback)(
         void* data,
         Methcla_Time currentTime,
+        double sampleRate,
         size_t numFrames,
         const sample_t* const* inputs,
         sample_t* const* outputs
@@ -70,11 +76,19 @@ public:
     }
 
 protected:
+    //* Process a block of audio.
+    //
+    // currentTime is the driver's unfiltered timestamp of the first frame of
+    // the block, measured in the time base of currentTime().
     void process(Methcla_Time currentTime, size_t numFrames, const sample_t* const* inputs, sample_t* const* outputs);
 
+    //* Restart time filtering with the next block, e.g. after a discontinuity of the driver's clock.
+    void resetTimeFilter();
+
 private:
     ProcessCallback m_processCallback;
     void*           m_processData;
+    TimeFilter      m_timeFilter;
 };
 
 } } }
@@ -52,6 +52,7 @@ void DummyDriver::start()
 {
     if (!m_thread.joinable())
     {
+        resetTimeFilter();
         m_continue = true;
         m_thread = std::thread(&DummyDriver::run, this);
     }
@@ -74,34 +75,54 @@ static void storeTime(std::atomic<uint64_t>& mem, double time)
     mem.store(t64);
 }
 
+#if defined(__native_client__)
+static double monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+#endif
+
 void DummyDriver::run()
 {
+    // Blocks are scheduled at absolute deadlines so that the block rate
+    // doesn't drift; the timestamps passed to process are the actual wakeup
+    // times, whose jitter is removed by the driver's time filter.
 #if defined(__native_client__)
-    // TODO: Remove drift and jitter
     const double dt = (double)bufferSize()/(double)sampleRate();
-    double t = 0.;
+    const double t0 = monotonicTime();
+    double t = t0;
     while (m_continue)
     {
-        storeTime(m_time, t);
-        process(t, bufferSize(), m_inputBuffers, m_outputBuffers);
-        struct timespec ts;
-        ts.tv_sec = dt;
-        ts.tv_nsec = (dt - ts.tv_sec) * 1e9;
-        nanosleep(&ts, &ts);
+        const double now = monotonicTime() - t0;
+        storeTime(m_time, now);
+        process(now, bufferSize(), m_inputBuffers, m_outputBuffers);
         t += dt;
+        const double delay = t - monotonicTime();
+        if (delay > 0)
+        {
+            struct timespec ts;
+            ts.tv_sec = delay;
+            ts.tv_nsec = (delay - ts.tv_sec) * 1e9;
+            nanosleep(&ts, &ts);
+        }
     }
 #else
-    auto dt = std::chrono::duration<double>(bufferSize()/sampleRate());
-    auto t0 = std::chrono::steady_clock::now();
-    auto t = t0 + std::chrono::duration<double>(0);
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<double> Seconds;
+
+    const Seconds dt(bufferSize()/sampleRate());
+    const auto t0 = Clock::now();
+    auto t = t0 + Seconds(0);
 
     while (m_continue)
     {
-        const double tDouble = std::chrono::duration_cast<std::chrono::duration<double>>(t-t0).count();
-        storeTime(m_time, tDouble);
-        process(tDouble, bufferSize(), m_inputBuffers, m_outputBuffers);
-        std::this_thread::sleep_until(t);
+        const double now = std::chrono::duration_cast<Seconds>(Clock::now()-t0).count();
+        storeTime(m_time, now);
+        process(now, bufferSize(), m_inputBuffers, m_outputBuffers);
         t += dt;
+        std::this_thread::sleep_until(t);
     }
 #endif
 }
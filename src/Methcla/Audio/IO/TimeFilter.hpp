@@ -0,0 +1,159 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_AUDIO_IO_TIMEFILTER_HPP_INCLUDED
+#define METHCLA_AUDIO_IO_TIMEFILTER_HPP_INCLUDED
+
+#include <methcla/common.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace Methcla { namespace Audio { namespace IO {
+
+//* Second order delay-locked loop filtering audio callback timestamps.
+//
+// The loop predicts the time of the next callback from the estimated
+// duration of a sample frame and corrects the prediction and the frame
+// duration by the error of each measured timestamp (F. Adriaensen, "Using a
+// DLL to filter time", 2005). The filtered times are free of scheduling
+// jitter and the frame duration converges to the actual sample rate of the
+// audio clock measured in the time base of the timestamps.
+//
+// The loop starts with a wide bandwidth for locking quickly onto the clock
+// and narrows it towards the final bandwidth, which determines how much
+// timestamp jitter is suppressed. The filter restarts from the measured
+// timestamp when the error exceeds what jitter can explain, e.g. after an
+// overload or a stream restart.
+//
+// Context: RT
+class TimeFilter
+{
+public:
+    //* Final loop bandwidth in Hz.
+    static constexpr double kDefaultBandwidth = 0.02;
+    //* Loop bandwidth in Hz after a restart.
+    static constexpr double kInitialBandwidth = 1;
+    //* Relative decrease of the loop bandwidth per second.
+    static constexpr double kNarrowingRate = 0.5;
+    //* Maximum deviation of the sample rate estimate from the nominal sample rate.
+    static constexpr double kMaxRateDeviation = 0.05;
+    //* Minimum error in seconds that causes the filter to restart.
+    static constexpr double kMinResetError = 0.05;
+
+    TimeFilter(double bandwidth=kDefaultBandwidth)
+        : m_finalBandwidth(bandwidth)
+        , m_bandwidth(bandwidth)
+        , m_nominalSampleRate(0)
+        , m_time(0)
+        , m_frameDuration(0)
+        , m_numFrames(0)
+    { }
+
+    //* Reset the filter; the next update restarts the loop.
+    void reset()
+    {
+        m_numFrames = 0;
+    }
+
+    //* Update the filter with the timestamp of a callback processing numFrames frames.
+    void update(Methcla_Time time, size_t numFrames, double nominalSampleRate)
+    {
+        if (m_numFrames == 0 || nominalSampleRate != m_nominalSampleRate)
+        {
+            restart(time, nominalSampleRate);
+        }
+        else
+        {
+            const double period = (double)m_numFrames * m_frameDuration;
+            const Methcla_Time predicted = m_time + period;
+            const double error = time - predicted;
+
+            if (std::fabs(error) > std::max(double(kMinResetError), 4. * period))
+            {
+                restart(time, nominalSampleRate);
+            }
+            else
+            {
+                // Loop coefficients for critical damping at the current period.
+                const double omega = 2. * kPi * m_bandwidth * period;
+                const double b = std::sqrt(2.) * omega;
+                const double c = omega * omega;
+
+                m_time = predicted + b * error;
+                m_frameDuration += c * error / (double)m_numFrames;
+                m_bandwidth = std::max(m_finalBandwidth, m_bandwidth * (1. - kNarrowingRate * period));
+
+                const double nominalFrameDuration = 1. / nominalSampleRate;
+                if (std::fabs(m_frameDuration - nominalFrameDuration) > kMaxRateDeviation * nominalFrameDuration)
+                    restart(time, nominalSampleRate);
+            }
+        }
+        m_numFrames = numFrames;
+    }
+
+    //* Filtered time of the most recent callback.
+    Methcla_Time time() const
+    {
+        return m_time;
+    }
+
+    //* Predicted time of the next callback.
+    Methcla_Time nextTime() const
+    {
+        return m_time + (double)m_numFrames * m_frameDuration;
+    }
+
+    //* Estimated sample rate.
+    double sampleRate() const
+    {
+        return m_frameDuration > 0 ? 1. / m_frameDuration : m_nominalSampleRate;
+    }
+
+    //* Convert a time to a frame offset relative to the most recent callback.
+    double timeToFrames(Methcla_Time time) const
+    {
+        return (time - m_time) * sampleRate();
+    }
+
+    //* Convert a frame offset relative to the most recent callback to a time.
+    Methcla_Time framesToTime(double frames) const
+    {
+        return m_time + frames * m_frameDuration;
+    }
+
+private:
+    static constexpr double kPi = 3.14159265358979323846;
+
+    void restart(Methcla_Time time, double nominalSampleRate)
+    {
+        m_nominalSampleRate = nominalSampleRate;
+        m_time = time;
+        m_frameDuration = 1. / nominalSampleRate;
+        m_bandwidth = std::max(m_finalBandwidth, double(kInitialBandwidth));
+    }
+
+private:
+    double          m_finalBandwidth;
+    double          m_bandwidth;
+    double          m_nominalSampleRate;
+    Methcla_Time    m_time;
+    double          m_frameDuration;
+    size_t          m_numFrames;
+};
+
+} } }
+
+#endif // METHCLA_AUDIO_IO_TIMEFILTER_HPP_INCLUDED
@@ -161,6 +161,13 @@ namespace Methcla { namespace Audio
             return nullptr;
         }
 
+        void clear()
+        {
+            for (auto& x : m_elems) {
+                x = nullptr;
+            }
+        }
+
     private:
         std::vector<Pointer> m_elems;
     };
@@ -0,0 +1,195 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Methcla/Audio/SampleRateConverter.hpp"
+
+#include <methcla/plugins/simd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace Methcla::Audio;
+
+// Number of phases in the coefficient table.
+static const size_t kNumPhases = 256;
+// Kernel half width in input frames when not lowering the cutoff.
+static const size_t kHalfWidth = 16;
+
+SampleRateConverter::SampleRateConverter(size_t numChannels, double inputSampleRate, double outputSampleRate, int64_t numInputFrames)
+    : m_numChannels(numChannels)
+    , m_step(inputSampleRate / outputSampleRate)
+    , m_numInputFrames(numInputFrames)
+    , m_numOutputFrames((int64_t)std::ceil(numInputFrames * outputSampleRate / inputSampleRate))
+    , m_outputFrame(0)
+    , m_inputBegin(0)
+    , m_inputEnd(0)
+{
+    assert(numChannels > 0);
+    assert(inputSampleRate > 0. && outputSampleRate > 0.);
+
+    const double pi = 3.14159265358979323846;
+
+    // Cutoff relative to the input's Nyquist frequency.
+    const double cutoff = std::min(1., outputSampleRate / inputSampleRate);
+    const size_t halfWidth = (size_t)std::ceil(kHalfWidth / cutoff);
+
+    m_numTaps = 2 * halfWidth;
+    m_tapStride = (4 % numChannels) == 0 ? numChannels : 1;
+    m_rowSize = (m_numTaps * m_tapStride + 3) & ~(size_t)3;
+    // Padding coefficients stay zero.
+    m_coeffs.assign((kNumPhases + 1) * m_rowSize, 0.f);
+
+    std::vector<double> kernel(m_numTaps);
+
+    for (size_t p=0; p <= kNumPhases; p++)
+    {
+        const double x = (double)p / kNumPhases;
+        double sum = 0.;
+
+        for (size_t i=0; i < m_numTaps; i++)
+        {
+            const double t = (double)i - (double)(halfWidth - 1) - x;
+            const double u = t / halfWidth;
+            const double s = t == 0. ? 1. : std::sin(pi * cutoff * t) / (pi * cutoff * t);
+            const double w = std::abs(u) >= 1. ? 0. : 0.42 + 0.5 * std::cos(pi * u) + 0.08 * std::cos(2. * pi * u);
+            kernel[i] = s * w;
+            sum += s * w;
+        }
+
+        // Normalize to unity gain at DC.
+        float* coeffs = &m_coeffs[p * m_rowSize];
+        for (size_t i=0; i < m_numTaps; i++)
+            std::fill(coeffs + i * m_tapStride, coeffs + (i + 1) * m_tapStride, (float)(kernel[i] / sum));
+    }
+}
+
+// Apply n coefficients to n interleaved input samples, where numChannels
+// divides four, so that vector lane l accumulates channel l % numChannels.
+static inline void convolveInterleaved(const float* coeffs, const float* input, size_t n, size_t numChannels, float* output)
+{
+    const size_t numVectorSamples = n & ~(size_t)3;
+
+    Methcla_Float4 acc = methcla_float4_splat(0.f);
+    for (size_t k=0; k < numVectorSamples; k += 4)
+        acc += methcla_float4_load(coeffs + k) * methcla_float4_load(input + k);
+
+    std::fill(output, output + numChannels, 0.f);
+    for (size_t l=0; l < 4; l++)
+        output[l % numChannels] += acc[l];
+    for (size_t k=numVectorSamples; k < n; k++)
+        output[k % numChannels] += coeffs[k] * input[k];
+}
+
+// Apply numTaps coefficients to numTaps interleaved input frames, four
+// channels at a time.
+static inline void convolveChannels(const float* coeffs, const float* input, size_t numTaps, size_t numChannels, float* output)
+{
+    const size_t numVectorChannels = numChannels & ~(size_t)3;
+
+    for (size_t c=0; c < numVectorChannels; c += 4)
+    {
+        Methcla_Float4 acc = methcla_float4_splat(0.f);
+        for (size_t i=0; i < numTaps; i++)
+            acc += methcla_float4_splat(coeffs[i]) * methcla_float4_load(input + i * numChannels + c);
+        methcla_float4_store(output + c, acc);
+    }
+
+    for (size_t c=numVectorChannels; c < numChannels; c++)
+    {
+        float acc = 0.f;
+        for (size_t i=0; i < numTaps; i++)
+            acc += coeffs[i] * input[i * numChannels + c];
+        output[c] = acc;
+    }
+}
+
+void SampleRateConverter::readInput(const ReadFunction& read, int64_t begin, int64_t end)
+{
+    if (end > m_inputEnd)
+    {
+        m_input.resize((end - m_inputBegin) * m_numChannels);
+
+        while (m_inputEnd < end)
+        {
+            const size_t numFrames = read(&m_input[(m_inputEnd - m_inputBegin) * m_numChannels], end - m_inputEnd);
+            if (numFrames == 0)
+            {
+                m_numInputFrames = m_inputEnd;
+                m_input.resize((m_inputEnd - m_inputBegin) * m_numChannels);
+                break;
+            }
+            m_inputEnd += numFrames;
+        }
+    }
+
+    // Drop input frames that aren't needed anymore.
+    const int64_t numFramesUnused = std::min(begin, m_inputEnd) - m_inputBegin;
+    if (numFramesUnused > 0)
+    {
+        m_input.erase(m_input.begin(), m_input.begin() + numFramesUnused * m_numChannels);
+        m_inputBegin += numFramesUnused;
+    }
+}
+
+void SampleRateConverter::process(const ReadFunction& read, float* output, size_t numFrames)
+{
+    if (numFrames == 0)
+        return;
+
+    const size_t numTaps = m_numTaps;
+    const size_t numChannels = m_numChannels;
+    const int64_t halfWidth = numTaps / 2;
+
+    readInput(
+        read,
+        std::max<int64_t>(0, (int64_t)std::floor(m_outputFrame * m_step) - (halfWidth - 1)),
+        std::min<int64_t>(m_numInputFrames, (int64_t)std::floor((m_outputFrame + numFrames - 1) * m_step) + halfWidth + 1)
+    );
+
+    const size_t tapStride = m_tapStride;
+    const size_t rowSize = m_rowSize;
+    std::vector<float> coeffs(rowSize);
+
+    for (size_t j=0; j < numFrames; j++)
+    {
+        const double pos = (m_outputFrame + j) * m_step;
+        const int64_t index = (int64_t)std::floor(pos);
+        const double phase = (pos - index) * kNumPhases;
+        const size_t phaseIndex = std::min((size_t)phase, kNumPhases - 1);
+        const float weight = (float)(phase - phaseIndex);
+
+        const float* c0 = &m_coeffs[phaseIndex * rowSize];
+        const float* c1 = c0 + rowSize;
+        const Methcla_Float4 w = methcla_float4_splat(weight);
+        for (size_t i=0; i < rowSize; i += 4)
+        {
+            const Methcla_Float4 x0 = methcla_float4_load(c0 + i);
+            methcla_float4_store(&coeffs[i], x0 + w * (methcla_float4_load(c1 + i) - x0));
+        }
+
+        // Restrict the kernel to the available input frames.
+        const int64_t first = index - (halfWidth - 1);
+        const size_t tapBegin = (size_t)std::max<int64_t>(0, std::min<int64_t>(numTaps, m_inputBegin - first));
+        const size_t tapEnd = (size_t)std::max<int64_t>(tapBegin, std::min<int64_t>(numTaps, m_inputEnd - first));
+
+        const float* input = m_input.data() + (first + (int64_t)tapBegin - m_inputBegin) * numChannels;
+        if (tapStride == numChannels)
+            convolveInterleaved(&coeffs[tapBegin * tapStride], input, (tapEnd - tapBegin) * numChannels, numChannels, output + j * numChannels);
+        else
+            convolveChannels(&coeffs[tapBegin], input, tapEnd - tapBegin, numChannels, output + j * numChannels);
+    }
+
+    m_outputFrame += numFrames;
+}
@@ -0,0 +1,82 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_AUDIO_SAMPLERATECONVERTER_HPP_INCLUDED
+#define METHCLA_AUDIO_SAMPLERATECONVERTER_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Methcla { namespace Audio {
+
+//* Streaming sample rate converter for interleaved sample data.
+//
+// Uses a Blackman windowed sinc kernel with a polyphase coefficient table
+// computed for the conversion ratio; when converting to a lower sample
+// rate the kernel's cutoff is lowered accordingly in order to avoid
+// aliasing. Input frames outside of the input range are treated as zero.
+//
+// The kernel is applied with four lane vector operations: for one, two or
+// four channels the coefficients are stored repeated for each channel and
+// applied to the interleaved input frames directly, otherwise each group
+// of four channels is processed in parallel.
+//
+// Context: NRT
+class SampleRateConverter
+{
+public:
+    //* Read at most numFrames input frames into buffer and return the number of frames read.
+    typedef std::function<size_t (float* buffer, size_t numFrames)> ReadFunction;
+
+    SampleRateConverter(size_t numChannels, double inputSampleRate, double outputSampleRate, int64_t numInputFrames);
+
+    //* Return the number of output frames corresponding to the input frames.
+    int64_t numOutputFrames() const
+    {
+        return m_numOutputFrames;
+    }
+
+    //* Compute the next numFrames output frames.
+    //
+    // Input frames are read sequentially with read as needed; if read
+    // returns zero frames the input is considered to end there. Exceptions
+    // thrown by read are propagated.
+    void process(const ReadFunction& read, float* output, size_t numFrames);
+
+private:
+    void readInput(const ReadFunction& read, int64_t begin, int64_t end);
+
+    const size_t        m_numChannels;
+    // Input frames per output frame.
+    const double        m_step;
+    int64_t             m_numInputFrames;
+    const int64_t       m_numOutputFrames;
+    int64_t             m_outputFrame;
+    size_t              m_numTaps;
+    // Coefficients per tap in the table; numChannels or 1.
+    size_t              m_tapStride;
+    // Size of a table row, padded to a multiple of four.
+    size_t              m_rowSize;
+    std::vector<float>  m_coeffs;
+    // Input frames [m_inputBegin, m_inputEnd) needed by the next output frames.
+    std::vector<float>  m_input;
+    int64_t             m_inputBegin;
+    int64_t             m_inputEnd;
+};
+
+} }
+
+#endif // METHCLA_AUDIO_SAMPLERATECONVERTER_HPP_INCLUDED
@@ -0,0 +1,360 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Methcla/Audio/SoundFileIndex.hpp"
+#include "Methcla/Exception.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace Methcla;
+using namespace Methcla::Audio;
+
+static const uint32_t kIndexMagic = 0x4946534d; // "MSFI"
+static const uint32_t kIndexVersion = 3;
+
+// Return the modification time of a file in nanoseconds; timestamps with
+// second resolution would miss files rewritten within the same second.
+static int64_t modificationTime(const struct stat& st)
+{
+#if defined(__APPLE__)
+    const struct timespec& time = st.st_mtimespec;
+#else
+    const struct timespec& time = st.st_mtim;
+#endif
+    return (int64_t)time.tv_sec * 1000000000 + (int64_t)time.tv_nsec;
+}
+
+static Methcla_ErrorCode systemErrorCode(int code)
+{
+    switch (code)
+    {
+        case ENOENT: return kMethcla_FileNotFoundError;
+        case EACCES: return kMethcla_PermissionsError;
+        default: return kMethcla_SystemError;
+    }
+}
+
+// Return true if a failure to open a file with error code depends only on
+// the file's contents and can be cached along with its size and
+// modification time.
+static bool isPersistentError(Methcla_ErrorCode code)
+{
+    switch (code)
+    {
+        case kMethcla_MemoryError:
+        case kMethcla_SystemError:
+        case kMethcla_FileNotFoundError:
+        case kMethcla_PermissionsError:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static void checkError(Methcla_Error err)
+{
+    if (methcla_is_error(err))
+    {
+        Error error(methcla_error_code(err),
+                    methcla_error_message(err) ? methcla_error_message(err) : "");
+        methcla_error_free(err);
+        throw error;
+    }
+}
+
+template <typename T> static bool readValue(FILE* file, T& value)
+{
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T> static bool writeValue(FILE* file, const T& value)
+{
+    return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+SoundFileIndex::SoundFileIndex(const Methcla_Host* host, const std::string& indexPath)
+    : m_host(host)
+    , m_indexPath(indexPath)
+    , m_modified(false)
+{
+    if (!m_indexPath.empty())
+        load();
+}
+
+SoundFileIndex::~SoundFileIndex()
+{
+    try {
+        save();
+    } catch (std::exception&) {
+    }
+}
+
+Methcla_SoundFileInfo SoundFileIndex::lookup(const std::string& path)
+{
+    Methcla_SoundFileInfo info;
+    Methcla_Error err;
+    if (!lookup(path, info, err))
+        checkError(err);
+    return info;
+}
+
+bool SoundFileIndex::lookup(const std::string& path, Methcla_SoundFileInfo& info, Methcla_Error& error)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        const int code = errno;
+        error = methcla_error_new_with_message(systemErrorCode(code), std::strerror(code));
+        return false;
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        error = methcla_error_new_with_message(kMethcla_ArgumentError, "Not a regular file");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(path);
+        if (it != m_entries.end()
+            && it->second.fileSize == (int64_t)st.st_size
+            && it->second.fileTime == modificationTime(st))
+        {
+            if (it->second.error != kMethcla_NoError)
+            {
+                error = methcla_error_new(it->second.error);
+                return false;
+            }
+            info = it->second.info;
+            return true;
+        }
+    }
+
+    // Open the file without holding the lock so that files can be indexed in parallel.
+    Methcla_SoundFile* file = nullptr;
+    Methcla_SoundFileInfo fileInfo;
+    std::memset(&fileInfo, 0, sizeof(fileInfo));
+    error = methcla_host_soundfile_open(m_host, path.c_str(), kMethcla_FileModeRead, &file, &fileInfo);
+    const Methcla_ErrorCode errorCode = methcla_error_code(error);
+    if (methcla_is_ok(error))
+        methcla_error_free(methcla_soundfile_close(file));
+    else if (!isPersistentError(errorCode))
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry& entry = m_entries[path];
+        entry.fileSize = st.st_size;
+        entry.fileTime = modificationTime(st);
+        entry.error = errorCode;
+        entry.info = fileInfo;
+        m_modified = true;
+    }
+
+    if (methcla_is_error(error))
+        return false;
+
+    info = fileInfo;
+    return true;
+}
+
+std::vector<SoundFileIndex::Item> SoundFileIndex::scan(const std::string& directory, size_t numThreads)
+{
+    std::vector<std::string> paths;
+
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr)
+    {
+        const int code = errno;
+        throw Error(systemErrorCode(code), "Couldn't open directory " + directory + ": " + std::strerror(code));
+    }
+    while (struct dirent* entry = readdir(dir))
+    {
+        // Skip hidden files and the . and .. entries.
+        if (entry->d_name[0] != '.')
+            paths.push_back(directory + "/" + entry->d_name);
+    }
+    closedir(dir);
+
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Methcla_SoundFileInfo> infos(paths.size());
+    std::vector<char> found(paths.size(), false);
+    std::atomic<size_t> next(0);
+
+    auto process = [&]() {
+        for (;;)
+        {
+            const size_t i = next.fetch_add(1);
+            if (i >= paths.size())
+                break;
+            Methcla_Error err;
+            if (lookup(paths[i], infos[i], err))
+                found[i] = true;
+            else
+                methcla_error_free(err);
+        }
+    };
+
+    // The calling thread takes part in the scan.
+    std::vector<std::thread> threads;
+    numThreads = std::min(std::max(numThreads, (size_t)1), std::max(paths.size(), (size_t)1));
+    for (size_t i=1; i < numThreads; i++)
+        threads.emplace_back(process);
+    process();
+    for (auto& thread : threads)
+        thread.join();
+
+    std::vector<Item> result;
+    for (size_t i=0; i < paths.size(); i++)
+    {
+        if (found[i])
+            result.push_back(Item(paths[i], infos[i]));
+    }
+
+    // Remove the entries of files in directory that have been deleted.
+    const std::string prefix = directory + "/";
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        const std::string& path = it->first;
+        if (path.compare(0, prefix.size(), prefix) == 0
+            && path.size() > prefix.size()
+            && path[prefix.size()] != '.'
+            && path.find('/', prefix.size()) == std::string::npos
+            && !std::binary_search(paths.begin(), paths.end(), path))
+        {
+            it = m_entries.erase(it);
+            m_modified = true;
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    return result;
+}
+
+void SoundFileIndex::save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_indexPath.empty() || !m_modified)
+        return;
+
+    // Write to a temporary file first so that readers never see a partial index.
+    const std::string tmpPath = m_indexPath + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        const int code = errno;
+        throw Error(systemErrorCode(code), "Couldn't write sound file index " + m_indexPath + ": " + std::strerror(code));
+    }
+
+    bool ok = writeValue(file, kIndexMagic)
+           && writeValue(file, kIndexVersion)
+           && writeValue(file, (uint64_t)m_entries.size());
+
+    for (auto it = m_entries.begin(); ok && it != m_entries.end(); it++)
+    {
+        const Entry& entry = it->second;
+        ok = writeValue(file, (uint32_t)it->first.size())
+          && fwrite(it->first.data(), 1, it->first.size(), file) == it->first.size()
+          && writeValue(file, entry.fileSize)
+          && writeValue(file, entry.fileTime)
+          && writeValue(file, (int32_t)entry.error)
+          && writeValue(file, entry.info.frames)
+          && writeValue(file, (uint32_t)entry.info.channels)
+          && writeValue(file, (uint32_t)entry.info.samplerate)
+          && writeValue(file, (int32_t)entry.info.file_type)
+          && writeValue(file, (int32_t)entry.info.file_format);
+    }
+
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || rename(tmpPath.c_str(), m_indexPath.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        throw Error(kMethcla_SystemError, "Couldn't write sound file index " + m_indexPath);
+    }
+
+    m_modified = false;
+}
+
+size_t SoundFileIndex::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void SoundFileIndex::load()
+{
+    FILE* file = fopen(m_indexPath.c_str(), "rb");
+    if (file == nullptr)
+        return;
+
+    uint32_t magic, version;
+    uint64_t numEntries;
+    bool ok = readValue(file, magic) && magic == kIndexMagic
+           && readValue(file, version) && version == kIndexVersion
+           && readValue(file, numEntries);
+
+    Map entries;
+    std::string path;
+
+    for (uint64_t i=0; ok && i < numEntries; i++)
+    {
+        uint32_t pathSize, channels, samplerate;
+        int32_t error, fileType, fileFormat;
+        Entry entry;
+        ok = readValue(file, pathSize);
+        if (ok)
+        {
+            path.resize(pathSize);
+            ok = fread(&path[0], 1, pathSize, file) == pathSize
+              && readValue(file, entry.fileSize)
+              && readValue(file, entry.fileTime)
+              && readValue(file, error)
+              && readValue(file, entry.info.frames)
+              && readValue(file, channels)
+              && readValue(file, samplerate)
+              && readValue(file, fileType)
+              && readValue(file, fileFormat);
+        }
+        if (ok)
+        {
+            entry.error = (Methcla_ErrorCode)error;
+            entry.info.channels = channels;
+            entry.info.samplerate = samplerate;
+            entry.info.file_type = (Methcla_SoundFileType)fileType;
+            entry.info.file_format = (Methcla_SoundFileFormat)fileFormat;
+            entries[path] = entry;
+        }
+    }
+
+    fclose(file);
+
+    // A damaged or outdated index is rebuilt from scratch.
+    if (ok)
+        m_entries.swap(entries);
+}
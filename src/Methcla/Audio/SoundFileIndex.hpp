@@ -0,0 +1,98 @@
+// Copyright 2012-2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METHCLA_AUDIO_SOUNDFILEINDEX_HPP_INCLUDED
+#define METHCLA_AUDIO_SOUNDFILEINDEX_HPP_INCLUDED
+
+#include <methcla/plugin.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Methcla { namespace Audio {
+
+//* Index of sound file metadata keyed by path.
+//
+// An entry stays valid as long as the size and modification time of its
+// file don't change; lookups of unchanged files are answered from the index
+// without opening them. Files that can't be opened as sound files are
+// indexed too, so that they aren't reopened on every lookup.
+//
+// If indexPath is non-empty the index is loaded from indexPath on
+// construction and written back by `save` and on destruction when entries
+// have been added or updated.
+//
+// Context: NRT (thread-safe)
+class SoundFileIndex
+{
+public:
+    typedef std::pair<std::string,Methcla_SoundFileInfo> Item;
+
+    SoundFileIndex(const Methcla_Host* host, const std::string& indexPath=std::string());
+    ~SoundFileIndex();
+
+    SoundFileIndex(const SoundFileIndex&) = delete;
+    SoundFileIndex& operator=(const SoundFileIndex&) = delete;
+
+    //* Return the info of the sound file at path.
+    //
+    // @throw Methcla::Error
+    Methcla_SoundFileInfo lookup(const std::string& path);
+
+    //* Index the sound files in directory with numThreads threads.
+    //
+    // Returns the sound files in directory sorted by path; files that can't
+    // be opened as sound files are skipped. Subdirectories are not scanned.
+    // Entries of files in directory that no longer exist are removed from
+    // the index.
+    //
+    // @throw Methcla::Error if directory can't be read.
+    std::vector<Item> scan(const std::string& directory, size_t numThreads);
+
+    //* Write the index to its file if it has been modified.
+    //
+    // @throw Methcla::Error
+    void save();
+
+    //* Return the number of entries in the index.
+    size_t size() const;
+
+private:
+    struct Entry
+    {
+        int64_t                 fileSize;
+        int64_t                 fileTime; // Nanoseconds
+        Methcla_ErrorCode       error;    // Error opening the file
+        Methcla_SoundFileInfo   info;
+    };
+
+    typedef std::unordered_map<std::string,Entry> Map;
+
+    bool lookup(const std::string& path, Methcla_SoundFileInfo& info, Methcla_Error& error);
+    void load();
+
+    const Methcla_Host*     m_host;
+    std::string             m_indexPath;
+    mutable std::mutex      m_mutex;
+    Map                     m_entries;
+    bool                    m_modified;
+};
+
+} }
+
+#endif // METHCLA_AUDIO_SOUNDFILEINDEX_HPP_INCLUDED
@@ -47,6 +47,8 @@ Synth::Synth( Environment& env
     , m_audioOutputConnections(audioOutputConnections)
     , m_controlBuffers(controlBuffers)
     , m_audioBuffers(audioBuffers)
+    , m_audioBufferSize(env.blockSize())
+    , m_reservedAudioBuffers(nullptr)
 {
     // Initialize flags
     memset(&m_flags, 0, sizeof(m_flags));
@@ -68,6 +70,8 @@ Synth::Synth( Environment& env
 Synth::~Synth()
 {
     m_synthDef.destroy(env(), m_synth);
+    if (m_reservedAudioBuffers != nullptr)
+        env().rtMem().freeAligned(m_reservedAudioBuffers);
 }
 
 Synth* Synth::construct(Environment& env, NodeId nodeId, const SynthDef& synthDef, OSCPP::Server::ArgStream controls, OSCPP::Server::ArgStream options)
@@ -174,8 +178,8 @@ void Synth::connectPorts(const Methcla_SynthOptions* synthOptions, OSCPP::Server
         case kMethcla_ControlPort:
             switch (port.direction) {
             case kMethcla_Input: {
-                // Initialize with control value
-                m_controlBuffers[controlInputIndex] = controls.next<float>();
+                // Initialize with control value; missing values default to zero.
+                m_controlBuffers[controlInputIndex] = controls.atEnd() ? 0.f : controls.next<float>();
                 sample_t* buffer = &m_controlBuffers[controlInputIndex];
                 m_synthDef.connect(m_synth, i, buffer);
                 controlInputIndex++;
@@ -192,16 +196,16 @@ void Synth::connectPorts(const Methcla_SynthOptions* synthOptions, OSCPP::Server
         case kMethcla_AudioPort:
             switch (port.direction) {
             case kMethcla_Input: {
-                new (&m_audioInputConnections[audioInputIndex]) AudioInputConnection(audioInputIndex);
-                sample_t* buffer = m_audioBuffers + audioInputIndex * env().blockSize();
+                new (&m_audioInputConnections[audioInputIndex]) AudioInputConnection(audioInputIndex, i);
+                sample_t* buffer = m_audioBuffers + audioInputIndex * m_audioBufferSize;
                 assert( kBufferAlignment.isAligned(buffer) );
                 m_synthDef.connect(m_synth, i, buffer);
                 audioInputIndex++;
                 };
                 break;
             case kMethcla_Output: {
-                new (&m_audioOutputConnections[audioOutputIndex]) AudioOutputConnection(audioOutputIndex);
-                sample_t* buffer = m_audioBuffers + (numAudioInputs() + audioOutputIndex) * env().blockSize();
+                new (&m_audioOutputConnections[audioOutputIndex]) AudioOutputConnection(audioOutputIndex, i);
+                sample_t* buffer = m_audioBuffers + (numAudioInputs() + audioOutputIndex) * m_audioBufferSize;
                 assert( kBufferAlignment.isAligned(buffer) );
                 m_synthDef.connect(m_synth, i, buffer);
                 audioOutputIndex++;
@@ -280,6 +284,38 @@ void Synth::activate(double sampleOffset)
     }
 }
 
+void Synth::reserveAudioBuffers(size_t numFrames)
+{
+    const size_t numBuffers = numAudioInputs() + numAudioOutputs();
+
+    if (numFrames <= m_audioBufferSize || numBuffers == 0)
+        return;
+
+    // Throws std::bad_alloc before the synth has been modified.
+    sample_t* buffers = env().rtMem().allocAlignedOf<sample_t>(kBufferAlignment, numBuffers * numFrames);
+
+    for (size_t i=0; i < numAudioInputs(); i++) {
+        const AudioInputConnection& x = m_audioInputConnections[i];
+        m_synthDef.connect(m_synth, x.port(), buffers + x.index() * numFrames);
+    }
+    for (size_t i=0; i < numAudioOutputs(); i++) {
+        const AudioOutputConnection& x = m_audioOutputConnections[i];
+        m_synthDef.connect(m_synth, x.port(), buffers + (numAudioInputs() + x.index()) * numFrames);
+    }
+
+    if (m_reservedAudioBuffers != nullptr)
+        env().rtMem().freeAligned(m_reservedAudioBuffers);
+
+    m_audioBuffers = buffers;
+    m_reservedAudioBuffers = buffers;
+    m_audioBufferSize = numFrames;
+}
+
+size_t Synth::statistics(int32_t* values, size_t size)
+{
+    return m_synthDef.statistics(env(), m_synth, values, size);
+}
+
 void Synth::doProcess(size_t numFrames)
 {
     // Sort connections by bus id (if necessary)
@@ -298,7 +334,7 @@ void Synth::doProcess(size_t numFrames)
     // }
 
     Environment& env = this->env();
-    const size_t blockSize = env.blockSize();
+    const size_t blockSize = m_audioBufferSize;
 
     sample_t* const inputBuffers = m_audioBuffers;
     sample_t* const outputBuffers = m_audioBuffers + numAudioInputs() * blockSize;
@@ -44,12 +44,14 @@ template <typename Bus>
 class Connection
 {
     Methcla_PortCount       m_index;
+    Methcla_PortCount       m_port;
     Methcla_BusMappingFlags m_flags;
     Bus*                    m_bus;
 
 public:
-    Connection(Methcla_PortCount index)
+    Connection(Methcla_PortCount index, Methcla_PortCount port)
         : m_index(index)
+        , m_port(port)
         , m_flags(kMethcla_BusMappingInternal)
         , m_bus(nullptr)
     {}
@@ -59,6 +61,12 @@ public:
         return m_index;
     }
 
+    //* Return the index of the synth definition port.
+    Methcla_PortCount port() const
+    {
+        return m_port;
+    }
+
     bool connect(Bus* bus, Methcla_BusMappingFlags flags)
     {
         bool changed = false;
@@ -78,8 +86,8 @@ protected:
 class AudioInputConnection : public Connection<AudioBus>
 {
 public:
-    AudioInputConnection(Methcla_PortCount index)
-        : Connection<AudioBus>(index)
+    AudioInputConnection(Methcla_PortCount index, Methcla_PortCount port)
+        : Connection<AudioBus>(index, port)
     { }
 
     void read(const Environment& env, size_t numFrames, sample_t* dst, size_t offset=0)
@@ -103,8 +111,8 @@ public:
 class AudioOutputConnection : public Connection<AudioBus>
 {
 public:
-    AudioOutputConnection(Methcla_PortCount index)
-        : Connection<AudioBus>(index)
+    AudioOutputConnection(Methcla_PortCount index, Methcla_PortCount port)
+        : Connection<AudioBus>(index, port)
     { }
 
     void write(const Environment& env, size_t numFrames, const sample_t* src, size_t offset=0)
@@ -200,6 +208,22 @@ public:
     //* Activate synth.
     void activate(double sampleOffset=0.);
 
+    //* Retrieve synth specific statistics.
+    //
+    // Write at most size values and return the number of values written.
+    size_t statistics(int32_t* values, size_t size);
+
+    //* Return the number of frames per audio port buffer.
+    size_t audioBufferSize() const
+    {
+        return m_audioBufferSize;
+    }
+
+    //* Make room for blocks of at least numFrames frames in the audio port buffers.
+    //
+    // Context: NRT, while the engine is not processing.
+    void reserveAudioBuffers(size_t numFrames);
+
     /// Sample offset for sample accurate synth scheduling.
     float sampleOffset() const
     {
@@ -231,6 +255,10 @@ private:
     AudioOutputConnection*  m_audioOutputConnections;
     sample_t*               m_controlBuffers;
     sample_t*               m_audioBuffers;
+    size_t                  m_audioBufferSize;
+    // Audio buffers allocated after construction, nullptr if m_audioBuffers
+    // points into the synth's memory block.
+    sample_t*               m_reservedAudioBuffers;
 };
 
 } }
@@ -102,3 +102,8 @@ void PluginManager::loadPlugins(const Methcla_Host* /*host*/, const std::string&
 {
     std::cout << "PluginManager::loadPlugins not yet implemented" << std::endl;
 }
+
+void PluginManager::unloadPlugins()
+{
+    m_libs.clear();
+}
@@ -70,6 +70,11 @@ public:
         m_descriptor->process(world, synth, numFrames);
     }
 
+    inline size_t statistics(const Methcla_World* world, Methcla_Synth* synth, int32_t* values, size_t size) const
+    {
+        return m_descriptor->statistics ? m_descriptor->statistics(world, synth, values, size) : 0;
+    }
+
 private:
     const Methcla_SynthDef* m_descriptor;
     Methcla_SynthOptions*   m_options; // Only access from one thread
@@ -110,6 +115,9 @@ public:
     //* Load plugins from directory.
     void loadPlugins(const Methcla_Host* host, const std::string& directory);
 
+    //* Destroy all plugin libraries.
+    void unloadPlugins();
+
 private:
     typedef std::list<Memory::shared_ptr<PluginLibrary>>
             Libraries;
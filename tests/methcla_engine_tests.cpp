@@ -16,11 +16,43 @@
 
 #include <methcla/engine.h>
 #include <methcla/engine.hpp>
+#include <methcla/file.hpp>
+#include <methcla/platform/benchmark.h>
+#include <methcla/plugins/convolver.h>
+#include <methcla/plugins/disk-recorder.h>
+#include <methcla/plugins/disksampler.h>
+#include <methcla/plugins/filterbank.h>
+#include <methcla/plugins/matrix-mixer.h>
 #include <methcla/plugins/node-control.h>
+#include <methcla/plugins/oscbank.h>
+#include <methcla/plugins/resample.h>
+#include <methcla/plugins/resample.hpp>
+#include <methcla/plugins/sampler.h>
 #include <methcla/plugins/sine.h>
+#include <methcla/plugins/soundfile_api_async.h>
+#include <methcla/plugins/soundfile_api_libsndfile.h>
+#include <methcla/plugins/soundfile_api_mmap.h>
+#if defined(__linux__)
+# include <methcla/platform/shm.h>
+# include <methcla/shm_client.h>
+# include <dirent.h>
+#endif
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 using namespace Methcla::Tests;
 
 TEST(Methcla_Engine, Creation_and_destruction)
@@ -184,3 +216,1204 @@ TEST(Methcla_Engine, Node_ended_notification)
     ASSERT_EQ( engine->getNodeTreeStatistics().numSynths, 0ul );
     ASSERT_EQ( engine->nodeIdAllocator().getStatistics().allocated(), 0ul );
 }
+
+TEST(Methcla_Engine, Synth_statistics_should_be_empty_for_synths_without_statistics)
+{
+    auto engine = std::unique_ptr<Methcla::Engine>(
+        new Methcla::Engine(Methcla::EngineOptions().addLibrary(methcla_plugins_sine))
+    );
+
+    engine->start();
+
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(*engine);
+        request.openBundle();
+        synth = request.synth(METHCLA_PLUGINS_SINE_URI, engine->root(), { 440.f, 1.f });
+        request.closeBundle();
+        request.send();
+    }
+
+    EXPECT_TRUE( engine->getSynthStatistics(synth).empty() );
+}
+
+TEST(Methcla_Engine, Synth_statistics_should_fail_for_invalid_node_ids)
+{
+    auto engine = std::unique_ptr<Methcla::Engine>(
+        new Methcla::Engine(Methcla::EngineOptions().addLibrary(methcla_plugins_sine))
+    );
+
+    engine->start();
+
+    // Exactly one reply, the error, is sent for the request.
+    EXPECT_THROW( engine->getSynthStatistics(Methcla::SynthId(-1)), std::runtime_error );
+    EXPECT_THROW( engine->getSynthStatistics(Methcla::SynthId(1000)), std::runtime_error );
+    // Groups don't have statistics either.
+    EXPECT_THROW( engine->getSynthStatistics(Methcla::SynthId(engine->root().id())), std::runtime_error );
+    // Subsequent requests are answered normally.
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(*engine);
+        request.openBundle();
+        synth = request.synth(METHCLA_PLUGINS_SINE_URI, engine->root(), { 440.f, 1.f });
+        request.closeBundle();
+        request.send();
+    }
+    EXPECT_TRUE( engine->getSynthStatistics(synth).empty() );
+}
+
+TEST(Methcla_Engine, Allocated_buffers_should_notify_when_loaded)
+{
+    auto engine = std::unique_ptr<Methcla::Engine>(
+        new Methcla::Engine()
+    );
+
+    engine->start();
+
+    std::promise<Methcla::BufferId> loaded;
+    std::future<Methcla::BufferId> result = loaded.get_future();
+
+    Methcla::Request request(*engine);
+    Methcla::BufferId buffer = request.allocBuffer(2, 1024);
+    engine->addNotificationHandler(
+        Methcla::Engine::bufferLoadedHandler(buffer, [&loaded](Methcla::BufferId bufferId) {
+            loaded.set_value(bufferId);
+        })
+    );
+    request.send();
+
+    ASSERT_EQ( result.wait_for(std::chrono::seconds(1)), std::future_status::ready );
+    EXPECT_EQ( result.get(), buffer );
+
+    engine->freeBuffer(buffer);
+    EXPECT_EQ( engine->bufferIdAllocator().getStatistics().allocated(), 0ul );
+}
+
+TEST(Methcla_Engine, Changing_the_block_size_should_preserve_the_node_tree)
+{
+    auto engine = std::unique_ptr<Methcla::Engine>(
+        new Methcla::Engine(Methcla::EngineOptions().addLibrary(methcla_plugins_sine))
+    );
+
+    engine->start();
+
+    {
+        Methcla::Request request(*engine);
+        request.openBundle();
+        Methcla::GroupId group = request.group(engine->root());
+        Methcla::SynthId synth = request.synth(METHCLA_PLUGINS_SINE_URI, group, { 440.f, 0.5f });
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    // Grow beyond and shrink below the driver's buffer size.
+    for (size_t blockSize : { 4096ul, 16ul, 100ul })
+    {
+        ASSERT_NO_THROW( engine->setBlockSize(blockSize) );
+        sleepFor(0.05);
+        const Methcla::NodeTreeStatistics stats = engine->getNodeTreeStatistics();
+        EXPECT_EQ( stats.numGroups, 2ul );
+        EXPECT_EQ( stats.numSynths, 1ul );
+    }
+
+    EXPECT_ANY_THROW( engine->setBlockSize(0) );
+}
+
+static void countBlocks(void* data, uint64_t)
+{
+    static_cast<std::atomic<uint64_t>*>(data)->fetch_add(1);
+}
+
+TEST(Methcla_Engine, Benchmark_driver_should_measure_the_requested_number_of_blocks)
+{
+    Methcla_AudioDriverOptions driverOptions;
+    methcla_audio_driver_options_init(&driverOptions);
+    driverOptions.buffer_size = 64;
+
+    std::atomic<uint64_t> numCallbacks(0);
+    Methcla_AudioDriver* driver = methcla_benchmark_driver_new(&driverOptions, 10, 100, countBlocks, &numCallbacks);
+
+    auto engine = std::unique_ptr<Methcla::Engine>(
+        new Methcla::Engine(Methcla::EngineOptions().addLibrary(methcla_plugins_sine), driver)
+    );
+
+    engine->start();
+
+    Methcla_BenchmarkStatistics stats;
+    ASSERT_TRUE( methcla_is_ok(methcla_benchmark_driver_wait(driver, &stats)) );
+    EXPECT_EQ( stats.num_blocks, 100ul );
+    EXPECT_EQ( numCallbacks.load(), 110ul );
+    EXPECT_LE( stats.latency_p50, stats.latency_p99 );
+    EXPECT_LE( stats.latency_p99, stats.latency_max );
+    EXPECT_GT( stats.realtime_factor, 0. );
+}
+
+#if defined(__linux__)
+// Engine rendering through the shared memory driver. Blocks are only
+// rendered when the test processes them.
+class ShmEngine
+{
+public:
+    typedef std::function<float(size_t channel, size_t frame)> Signal;
+
+    ShmEngine(const char* name, Methcla::EngineOptions options, size_t numInputs, size_t numOutputs,
+              size_t blockSize=64, size_t numSlots=1)
+        : m_client(nullptr)
+        , m_blockSize(blockSize)
+        , m_numFramesProcessed(0)
+        , m_delay(0.)
+        , m_inputs(numInputs, std::vector<float>(blockSize, 0.f))
+        , m_outputs(numOutputs, std::vector<float>(blockSize, 0.f))
+    {
+        Methcla_AudioDriverOptions driverOptions;
+        methcla_audio_driver_options_init(&driverOptions);
+        driverOptions.buffer_size = blockSize;
+        driverOptions.num_inputs = numInputs;
+        driverOptions.num_outputs = numOutputs;
+
+        Methcla_AudioDriver* driver = nullptr;
+        Methcla::detail::checkReturnCode(methcla_shm_driver_new(&driverOptions, name, numSlots, &driver));
+        m_engine = std::unique_ptr<Methcla::Engine>(new Methcla::Engine(options, driver));
+
+        if (methcla_shm_client_open(name, &m_client) != 0)
+            throw std::runtime_error(std::string("Couldn't open shared memory segment ") + name);
+
+        m_engine->start();
+    }
+
+    ~ShmEngine()
+    {
+        m_engine.reset();
+        methcla_shm_client_close(m_client);
+    }
+
+    Methcla::Engine& engine() { return *m_engine; }
+    Methcla_ShmClient* client() { return m_client; }
+
+    size_t blockSize() const { return m_blockSize; }
+    double sampleRate() const { return methcla_shm_client_sample_rate(m_client); }
+
+    //* Number of frames processed so far.
+    size_t numFramesProcessed() const { return m_numFramesProcessed; }
+
+    //* Input channels are silent unless a signal is set.
+    void setInput(Signal signal) { m_signal = signal; }
+
+    //* Sleep before each block, leaving plugin threads time for their work.
+    void setDelay(double seconds) { m_delay = seconds; }
+
+    const std::vector<float>& output(size_t channel=0) const { return m_outputs[channel]; }
+
+    //* Process n blocks and return the first non-zero client status.
+    int process(size_t n=1)
+    {
+        std::vector<const float*> inputs;
+        for (auto& x : m_inputs)
+            inputs.push_back(x.data());
+        std::vector<float*> outputs;
+        for (auto& x : m_outputs)
+            outputs.push_back(x.data());
+
+        for (size_t i=0; i < n; i++)
+        {
+            if (m_signal)
+            {
+                for (size_t c=0; c < m_inputs.size(); c++)
+                    for (size_t k=0; k < m_blockSize; k++)
+                        m_inputs[c][k] = m_signal(c, m_numFramesProcessed + k);
+            }
+            if (m_delay > 0.)
+                sleepFor(m_delay);
+            const int result = methcla_shm_client_process(m_client, inputs.data(), outputs.data(), 1000);
+            if (result != 0)
+                return result;
+            m_numFramesProcessed += m_blockSize;
+        }
+
+        return 0;
+    }
+
+    //* Send the buffer request built by load and process blocks until the
+    // buffer has been installed. Throws if loading the buffer fails.
+    Methcla::BufferId loadBuffer(std::function<Methcla::BufferId(Methcla::Request&)> load)
+    {
+        std::promise<void> loaded;
+        std::future<void> result = loaded.get_future();
+
+        Methcla::BufferId buffer;
+        {
+            Methcla::Request request(*m_engine);
+            buffer = load(request);
+            m_engine->addNotificationHandler(
+                Methcla::Engine::bufferLoadedHandler(buffer, [&loaded](Methcla::BufferId) {
+                    loaded.set_value();
+                }, [&loaded](Methcla::BufferId, const std::string& error) {
+                    loaded.set_exception(std::make_exception_ptr(std::runtime_error(error)));
+                })
+            );
+            request.send();
+        }
+
+        while (result.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+            EXPECT_EQ( process(), 0 );
+        result.get();
+
+        return buffer;
+    }
+
+    Methcla::BufferId allocBuffer(size_t numChannels, size_t numFrames)
+    {
+        return loadBuffer([=](Methcla::Request& request) { return request.allocBuffer(numChannels, numFrames); });
+    }
+
+    //* The engine only replies while blocks are being processed.
+    std::vector<int32_t> statistics(Methcla::SynthId synth)
+    {
+        auto result = std::async(std::launch::async, [&]() { return m_engine->getSynthStatistics(synth); });
+        while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            EXPECT_EQ( process(), 0 );
+        return result.get();
+    }
+
+private:
+    std::unique_ptr<Methcla::Engine>    m_engine;
+    Methcla_ShmClient*                  m_client;
+    size_t                              m_blockSize;
+    size_t                              m_numFramesProcessed;
+    double                              m_delay;
+    Signal                              m_signal;
+    std::vector<std::vector<float>>     m_inputs;
+    std::vector<std::vector<float>>     m_outputs;
+};
+
+static float peak(const std::vector<float>& xs)
+{
+    float result = 0.f;
+    for (float x : xs)
+        result = std::max(result, std::abs(x));
+    return result;
+}
+
+TEST(Methcla_Engine, Shared_memory_driver_should_not_replace_existing_segments)
+{
+    const char* name = "/methcla-tests-shm-exists";
+    ShmEngine shm(name, Methcla::EngineOptions(), 0, 1);
+
+    Methcla_AudioDriverOptions driverOptions;
+    methcla_audio_driver_options_init(&driverOptions);
+    driverOptions.num_outputs = 1;
+
+    Methcla_AudioDriver* driver = nullptr;
+    Methcla_Error error = methcla_shm_driver_new(&driverOptions, name, 1, &driver);
+    EXPECT_EQ( methcla_error_code(error), kMethcla_DeviceUnavailableError );
+    EXPECT_TRUE( driver == nullptr );
+    methcla_error_free(error);
+
+    // The segment is still usable by clients.
+    EXPECT_EQ( shm.process(), 0 );
+
+    // Invalid options are reported as errors.
+    driverOptions.num_outputs = 0;
+    error = methcla_shm_driver_new(&driverOptions, "/methcla-tests-shm-no-outputs", 1, &driver);
+    EXPECT_EQ( methcla_error_code(error), kMethcla_ArgumentError );
+    EXPECT_TRUE( driver == nullptr );
+    methcla_error_free(error);
+}
+
+TEST(Methcla_Engine, Benchmark_driver_wait_should_reject_other_drivers)
+{
+    Methcla_AudioDriverOptions driverOptions;
+    methcla_audio_driver_options_init(&driverOptions);
+    driverOptions.num_outputs = 1;
+
+    Methcla_AudioDriver* driver = nullptr;
+    Methcla::detail::checkReturnCode(methcla_shm_driver_new(&driverOptions, "/methcla-tests-shm-benchmark", 1, &driver));
+    Methcla::Engine engine(Methcla::EngineOptions(), driver);
+
+    Methcla_BenchmarkStatistics stats;
+    Methcla_Error error = methcla_benchmark_driver_wait(driver, &stats);
+    EXPECT_EQ( methcla_error_code(error), kMethcla_ArgumentError );
+    methcla_error_free(error);
+}
+
+TEST(Methcla_Engine, Shared_memory_driver_should_render_blocks_submitted_by_client)
+{
+    ShmEngine shm("/methcla-tests-shm", Methcla::EngineOptions().addLibrary(methcla_plugins_sine), 1, 2, 64, 3);
+    Methcla_ShmClient* client = shm.client();
+
+    EXPECT_EQ( methcla_shm_client_num_inputs(client), 1ul );
+    EXPECT_EQ( methcla_shm_client_num_outputs(client), 2ul );
+    EXPECT_EQ( methcla_shm_client_block_size(client), shm.blockSize() );
+    EXPECT_EQ( methcla_shm_client_num_slots(client), 4ul );
+
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        Methcla::SynthId synth = request.synth(METHCLA_PLUGINS_SINE_URI, shm.engine().root(), { 440.f, 0.5f });
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    // The synth is created in one of the following blocks.
+    for (int i=0; i < 1000 && peak(shm.output(0)) == 0.f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    EXPECT_GT( peak(shm.output(0)), 0.f );
+    EXPECT_LE( peak(shm.output(0)), 0.5f );
+    for (float x : shm.output(1))
+        EXPECT_EQ( x, 0.f );
+
+    // Keep all slots in flight.
+    for (size_t i=0; i < methcla_shm_client_num_slots(client); i++)
+    {
+        float* const* slotInputs;
+        ASSERT_EQ( methcla_shm_client_begin_write(client, &slotInputs), 0 );
+        ASSERT_EQ( methcla_shm_client_end_write(client), 0 );
+    }
+    float* const* slotInputs;
+    EXPECT_EQ( methcla_shm_client_begin_write(client, &slotInputs), -EAGAIN );
+    for (size_t i=0; i < methcla_shm_client_num_slots(client); i++)
+    {
+        const float* const* slotOutputs;
+        ASSERT_EQ( methcla_shm_client_begin_read(client, 1000, &slotOutputs), 0 );
+        ASSERT_EQ( methcla_shm_client_end_read(client), 0 );
+    }
+
+    shm.engine().stop();
+
+    ASSERT_EQ( methcla_shm_client_begin_write(client, &slotInputs), 0 );
+    ASSERT_EQ( methcla_shm_client_end_write(client), 0 );
+    const float* const* slotOutputs;
+    EXPECT_EQ( methcla_shm_client_begin_read(client, 1000, &slotOutputs), -EPIPE );
+}
+
+TEST(Methcla_Engine, Allocated_buffers_should_be_writable)
+{
+    ShmEngine shm("/methcla-tests-buffer-set", Methcla::EngineOptions().addLibrary(methcla_plugins_sampler), 0, 1);
+    const size_t blockSize = shm.blockSize();
+
+    // The engine only installs the buffer while blocks are being processed.
+    Methcla::BufferId buffer = shm.allocBuffer(1, blockSize);
+
+    // Write the second half first, so that the buffer is filled by two messages.
+    std::vector<float> ramp(blockSize);
+    for (size_t i=0; i < blockSize; i++)
+        ramp[i] = (float)i / (float)blockSize;
+
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        request.setBuffer(buffer, blockSize / 2, std::vector<float>(ramp.begin() + blockSize / 2, ramp.end()));
+        request.setBuffer(buffer, 0, std::vector<float>(ramp.begin(), ramp.begin() + blockSize / 2));
+        Methcla::SynthId synth = request.synth(
+            METHCLA_PLUGINS_SAMPLER_URI,
+            shm.engine().root(),
+            { 1.f, 1.f },
+            { Methcla::Value(buffer.id()), Methcla::Value(true), Methcla::Value(0), Methcla::Value((int)blockSize),
+              Methcla::Value(kMethcla_ResampleNone), Methcla::Value(1) }
+            );
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    // Skip the block(s) preceding the synth's activation.
+    for (int i=0; i < 1000 && shm.output()[blockSize-1] == 0.f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    ASSERT_NE( shm.output()[blockSize-1], 0.f );
+
+    for (size_t i=0; i < blockSize; i++)
+        EXPECT_EQ( shm.output()[i], ramp[i] ) << "frame " << i;
+}
+
+TEST(Methcla_Engine, Freeing_a_loading_buffer_should_cancel_the_load)
+{
+    ShmEngine shm("/methcla-tests-buffer-free", Methcla::EngineOptions().addLibrary(methcla_soundfile_api_mmap), 0, 1);
+
+    // The load of the freed buffer is performed before the second buffer's.
+    std::atomic<bool> freedLoaded(false);
+    const Methcla::BufferId other = shm.loadBuffer([&](Methcla::Request& request) {
+        request.openBundle();
+        const Methcla::BufferId freed = request.allocBuffer(1, shm.blockSize());
+        shm.engine().addNotificationHandler(
+            Methcla::Engine::bufferLoadedHandler(freed, [&freedLoaded](Methcla::BufferId) {
+                freedLoaded = true;
+            })
+        );
+        const Methcla::BufferId result = request.allocBuffer(1, shm.blockSize());
+        request.freeBuffer(freed);
+        request.closeBundle();
+        return result;
+    });
+    EXPECT_FALSE( freedLoaded.load() );
+
+    // Failed loads are reported for the buffer.
+    EXPECT_THROW(
+        shm.loadBuffer([](Methcla::Request& request) {
+            return request.readBuffer(Methcla::Tests::inputFile("does-not-exist.wav").c_str());
+        }),
+        std::runtime_error
+    );
+
+    // The freed buffer id can be reused.
+    const Methcla::BufferId reused = shm.allocBuffer(1, shm.blockSize());
+    EXPECT_NE( reused.id(), other.id() );
+}
+
+TEST(Methcla_Engine, Changing_the_block_size_should_resize_audio_buffers)
+{
+    const size_t bufferSize = 256;
+    ShmEngine shm(
+        "/methcla-tests-block-size",
+        Methcla::EngineOptions()
+            .addLibrary(methcla_plugins_sampler)
+            .addLibrary(methcla_plugins_matrix_mixer),
+        0, 1, bufferSize
+    );
+    Methcla::Engine& engine = shm.engine();
+
+    Methcla::BufferId buffer = shm.allocBuffer(1, bufferSize);
+
+    // Block size changes are only answered while periods are being
+    // processed, so the client runs in its own thread and keeps the first
+    // period containing a sample different from the reference value.
+    std::atomic<bool> running(true);
+    std::mutex mutex;
+    bool armed = false;
+    float reference = 0.f;
+    std::vector<float> captured;
+
+    std::thread thread([&]() {
+        while (running.load() && shm.process() == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const std::vector<float>& output = shm.output();
+            if (armed && std::any_of(output.begin(), output.end(), [&](float x) { return x != reference; }))
+            {
+                captured = output;
+                armed = false;
+            }
+        }
+    });
+
+    auto capture = [&](float value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        armed = true;
+        reference = value;
+        captured.clear();
+    };
+
+    auto waitForCapture = [&]() -> std::vector<float> {
+        for (int i=0; i < 1000; i++)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!armed)
+                    return captured;
+            }
+            sleepFor(0.001);
+        }
+        return std::vector<float>();
+    };
+
+    // Synths created with a small block size have to grow their port
+    // buffers when the block size is raised again.
+    const size_t smallBlockSize = 16;
+    ASSERT_NO_THROW( engine.setBlockSize(smallBlockSize) );
+
+    // A looped buffer of ones is routed through an internal bus to a mixer
+    // whose gain ramps over one block.
+    capture(0.f);
+    Methcla::SynthId mixer;
+    {
+        Methcla::Request request(engine);
+        request.openBundle();
+        request.setBuffer(buffer, 0, std::vector<float>(bufferSize, 1.f));
+        Methcla::SynthId sampler = request.synth(
+            METHCLA_PLUGINS_SAMPLER_URI,
+            engine.root(),
+            { 1.f, 1.f },
+            { Methcla::Value(buffer.id()), Methcla::Value(true), Methcla::Value(0), Methcla::Value((int)bufferSize),
+              Methcla::Value(kMethcla_ResampleNone), Methcla::Value(1) }
+            );
+        request.mapOutput(sampler, 0, Methcla::AudioBusId(0));
+        mixer = request.synth(
+            METHCLA_PLUGINS_MATRIX_MIXER_URI,
+            engine.root(),
+            { 0.f },
+            { Methcla::Value(1), Methcla::Value(1) }
+            );
+        request.mapInput(mixer, 0, Methcla::AudioBusId(0));
+        request.mapOutput(mixer, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(sampler);
+        request.activate(mixer);
+        request.closeBundle();
+        request.send();
+    }
+    engine.set(mixer, 0, 1.);
+
+    std::vector<float> output = waitForCapture();
+    ASSERT_EQ( output.size(), bufferSize );
+    // The ramp starts at a block boundary and lasts one block.
+    const size_t start = std::find_if(output.begin(), output.end(), [](float x) { return x != 0.f; }) - output.begin() - 1;
+    ASSERT_EQ( start % smallBlockSize, 0u );
+    for (size_t i=0; i < smallBlockSize; i++)
+        EXPECT_FLOAT_EQ( output[start + i], (float)i / (float)smallBlockSize ) << "frame " << start + i;
+    for (size_t i=start + smallBlockSize; i < bufferSize; i++)
+        EXPECT_EQ( output[i], 1.f ) << "frame " << i;
+
+    // Grow the synth port buffers and then the internal buses beyond their
+    // initial size.
+    ASSERT_NO_THROW( engine.setBlockSize(bufferSize) );
+    ASSERT_NO_THROW( engine.setBlockSize(4 * bufferSize) );
+    // Skip periods rendered while processing was paused.
+    sleepFor(0.05);
+
+    capture(1.f);
+    engine.set(mixer, 0, 0.5);
+
+    // Each period is now rendered in a single block.
+    output = waitForCapture();
+    ASSERT_EQ( output.size(), bufferSize );
+    for (size_t i=0; i < bufferSize; i++)
+        EXPECT_FLOAT_EQ( output[i], 1.f - 0.5f * (float)i / (float)bufferSize ) << "frame " << i;
+
+    const Methcla::NodeTreeStatistics stats = engine.getNodeTreeStatistics();
+    EXPECT_EQ( stats.numSynths, 2ul );
+
+    running.store(false);
+    thread.join();
+}
+
+TEST(Methcla_Engine, Disksampler_should_report_stream_statistics)
+{
+    ShmEngine shm(
+        "/methcla-tests-disksampler",
+        Methcla::EngineOptions()
+            .addLibrary(methcla_soundfile_api_mmap)
+            .addLibrary(methcla_plugins_disksampler),
+        0, 1
+    );
+    // Leave the streaming threads time for refilling the buffer.
+    shm.setDelay(0.001);
+
+    // Longer than one disk transfer, so that it is streamed.
+    const std::string path = Methcla::Tests::inputFile("glockenspiel.wav");
+
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        synth = request.synth(
+            METHCLA_PLUGINS_DISKSAMPLER_URI,
+            shm.engine().root(),
+            { 1.f, 1.f },
+            { Methcla::Value(path), Methcla::Value(1), Methcla::Value(0), Methcla::Value(-1),
+              Methcla::Value((int)kMethcla_ResampleHermite), Methcla::Value(1) }
+            );
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    // Play through more than one buffer.
+    ASSERT_EQ( shm.process(1000), 0 );
+
+    const std::vector<int32_t> stats = shm.statistics(synth);
+    ASSERT_EQ( stats.size(), (size_t)kMethcla_DiskSamplerNumStatistics );
+    EXPECT_EQ( stats[kMethcla_DiskSamplerUnderruns], 0 );
+    EXPECT_EQ( stats[kMethcla_DiskSamplerOverflows], 0 );
+    EXPECT_GT( stats[kMethcla_DiskSamplerKilobytesRead], 0 );
+    EXPECT_GT( stats[kMethcla_DiskSamplerBufferFrames], 0 );
+    EXPECT_GT( stats[kMethcla_DiskSamplerBufferedFrames], 0 );
+    EXPECT_LT( stats[kMethcla_DiskSamplerBufferedFrames], stats[kMethcla_DiskSamplerBufferFrames] );
+}
+
+TEST(Methcla_Engine, Disksampler_should_interpolate_across_buffer_wraps)
+{
+    const float rate = 1.37f;
+    // Several wraps of the stream buffer, but not the end of the file.
+    const size_t numFrames = 150000;
+
+    ShmEngine shm(
+        "/methcla-tests-disksampler-sinc",
+        Methcla::EngineOptions()
+            .addLibrary(methcla_soundfile_api_mmap)
+            .addLibrary(methcla_plugins_disksampler),
+        0, 1, 256
+    );
+    // Leave the streaming threads time for refilling the buffer.
+    shm.setDelay(0.001);
+
+    const std::string path = Methcla::Tests::inputFile("glockenspiel.wav");
+
+    // Resample the whole file from memory for reference.
+    std::vector<float> reference(numFrames);
+    {
+        Methcla::SoundFile file(shm.engine(), path);
+        ASSERT_EQ( file.info().channels, 1u );
+        ASSERT_EQ( file.info().samplerate, shm.sampleRate() );
+        std::vector<float> data(file.info().frames);
+        ASSERT_EQ( file.read(data.data(), data.size()), data.size() );
+
+        const Methcla::Plugin::Resample::Source source = { data.data(), kMethcla_SoundFileFormatFloat, 1, data.size(), false };
+        double phase = 0.;
+        float* outputs[] = { reference.data() };
+        ASSERT_EQ( Methcla::Plugin::Resample::resample(kMethcla_ResampleSinc, source, data.size(), phase, rate, 1.f, outputs, 1, numFrames), numFrames );
+    }
+
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        synth = request.synth(
+            METHCLA_PLUGINS_DISKSAMPLER_URI,
+            shm.engine().root(),
+            { 1.f, rate },
+            { Methcla::Value(path), Methcla::Value(0), Methcla::Value(0), Methcla::Value(-1),
+              Methcla::Value((int)kMethcla_ResampleSinc), Methcla::Value(1) }
+            );
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    // The output is silent until the stream has been opened.
+    for (int i=0; i < 1000 && peak(shm.output()) == 0.f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    ASSERT_NE( peak(shm.output()), 0.f );
+
+    std::vector<float> response(shm.output());
+    while (response.size() < numFrames)
+    {
+        ASSERT_EQ( shm.process(), 0 );
+        response.insert(response.end(), shm.output().begin(), shm.output().end());
+    }
+
+    for (size_t i=0; i < numFrames; i++)
+        ASSERT_NEAR( response[i], reference[i], 1e-4f ) << "frame " << i;
+
+    const std::vector<int32_t> stats = shm.statistics(synth);
+    ASSERT_EQ( stats.size(), (size_t)kMethcla_DiskSamplerNumStatistics );
+    EXPECT_EQ( stats[kMethcla_DiskSamplerUnderruns], 0 );
+    // Played through the stream buffer more than once.
+    EXPECT_LT( stats[kMethcla_DiskSamplerBufferFrames], (int32_t)(rate * numFrames) / 2 );
+}
+
+TEST(Methcla_Engine, Disk_recorder_should_write_its_input_to_a_sound_file)
+{
+    // More than one chunk written by the service thread.
+    const size_t numBlocks = 300;
+    const std::string path = Methcla::Tests::outputFile("disk-recorder.wav");
+    std::remove(path.c_str());
+
+    // Frame n of the input is n * 1e-5.
+    auto signal = [](size_t n) { return (float)n * 1e-5f; };
+
+    size_t blockSize, numFramesProcessed;
+    std::vector<int32_t> stats;
+    {
+        ShmEngine shm(
+            "/methcla-tests-disk-recorder",
+            Methcla::EngineOptions()
+                .addLibrary(methcla_soundfile_api_libsndfile)
+                .addLibrary(methcla_plugins_disk_recorder),
+            1, 1
+        );
+        shm.setInput([&signal](size_t, size_t frame) { return signal(frame); });
+        // Leave the service thread time for writing.
+        shm.setDelay(0.001);
+
+        Methcla::SynthId synth, invalidSynth;
+        {
+            Methcla::Request request(shm.engine());
+            request.openBundle();
+            synth = request.synth(
+                METHCLA_PLUGINS_DISK_RECORDER_URI,
+                shm.engine().root(),
+                {},
+                { Methcla::Value(path), Methcla::Value(1) }
+                );
+            request.mapInput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+            request.activate(synth);
+            invalidSynth = request.synth(
+                METHCLA_PLUGINS_DISK_RECORDER_URI,
+                shm.engine().root(),
+                {},
+                { Methcla::Value(Methcla::Tests::outputFile("disk-recorder-invalid.wav")), Methcla::Value(1),
+                  Methcla::Value((int)kMethcla_SoundFileTypeWAV), Methcla::Value(-1) }
+                );
+            request.closeBundle();
+            request.send();
+        }
+
+        ASSERT_EQ( shm.process(numBlocks), 0 );
+
+        stats = shm.statistics(synth);
+        ASSERT_EQ( stats.size(), (size_t)kMethcla_DiskRecorderNumStatistics );
+        EXPECT_EQ( stats[kMethcla_DiskRecorderOverruns], 0 );
+        EXPECT_GT( stats[kMethcla_DiskRecorderKilobytesWritten], 0 );
+        EXPECT_LE( stats[kMethcla_DiskRecorderKilobytesWritten], (int32_t)(shm.numFramesProcessed() * sizeof(float) / 1024) );
+
+        // Unknown file formats are rejected.
+        EXPECT_TRUE( shm.statistics(invalidSynth).empty() );
+
+        blockSize = shm.blockSize();
+        numFramesProcessed = shm.numFramesProcessed();
+    }
+
+    // The recording is closed when the engine shuts down.
+    Methcla::Engine engine(Methcla::EngineOptions().addLibrary(methcla_soundfile_api_mmap));
+    engine.start();
+
+    Methcla::SoundFile file(engine, path);
+    ASSERT_EQ( file.info().channels, 1u );
+    ASSERT_EQ( file.info().file_format, kMethcla_SoundFileFormatFloat );
+
+    std::vector<float> recording(file.info().frames);
+    ASSERT_EQ( file.read(recording.data(), recording.size()), recording.size() );
+    ASSERT_GT( recording.size(), 0u );
+
+    // Recording starts at a block boundary once the file has been opened
+    // and continues until the last block processed.
+    const size_t offset = (size_t)std::lround(recording[0] / 1e-5f);
+    EXPECT_EQ( offset % blockSize, 0u );
+    EXPECT_EQ( offset + recording.size(), numFramesProcessed );
+    EXPECT_GE( recording.size() * sizeof(float) / 1024, (size_t)stats[kMethcla_DiskRecorderKilobytesWritten] );
+
+    for (size_t i=0; i < recording.size(); i++)
+        ASSERT_EQ( recording[i], signal(offset + i) ) << "frame " << i;
+
+    engine.stop();
+    std::remove(path.c_str());
+}
+
+TEST(Methcla_Engine, Shutdown_should_close_cached_sound_files_before_unloading_plugins)
+{
+    // Many load chunks, so that the engine shuts down while the buffer
+    // cache is still reading from the sound file.
+    const std::string path = Methcla::Tests::outputFile("buffer-cache.wav");
+    {
+        Methcla::Engine engine(Methcla::EngineOptions().addLibrary(methcla_soundfile_api_libsndfile));
+        engine.start();
+        Methcla::SoundFileInfo info;
+        info.frames = 0;
+        info.channels = 1;
+        info.samplerate = 44100;
+        info.file_type = kMethcla_SoundFileTypeWAV;
+        info.file_format = kMethcla_SoundFileFormatFloat;
+        Methcla::SoundFile file(engine, path, info);
+        const std::vector<float> data(44100, 0.5f);
+        for (int i=0; i < 60; i++)
+            ASSERT_EQ( file.write(data.data(), data.size()), data.size() );
+        file.close();
+        engine.stop();
+    }
+
+    {
+        // The asynchronous API can't provide views, so the cached buffer is
+        // loaded progressively.
+        ShmEngine shm(
+            "/methcla-tests-buffer-cache",
+            Methcla::EngineOptions()
+                .addLibrary(methcla_soundfile_api_async)
+                .addLibrary(methcla_plugins_sampler),
+            0, 1
+        );
+
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        Methcla::SynthId synth = request.synth(
+            METHCLA_PLUGINS_SAMPLER_URI,
+            shm.engine().root(),
+            { 1.f, 1.f },
+            { Methcla::Value(path) }
+            );
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+
+        for (int i=0; i < 1000 && peak(shm.output()) == 0.f; i++)
+            ASSERT_EQ( shm.process(), 0 );
+        EXPECT_EQ( peak(shm.output()), 0.5f );
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(Methcla_Engine, Async_sound_files_should_read_the_same_data_as_mapped_sound_files)
+{
+    auto mappedEngine = std::unique_ptr<Methcla::Engine>(
+        new Methcla::Engine(Methcla::EngineOptions().addLibrary(methcla_soundfile_api_mmap))
+    );
+    auto asyncEngine = std::unique_ptr<Methcla::Engine>(
+        new Methcla::Engine(Methcla::EngineOptions().addLibrary(methcla_soundfile_api_async))
+    );
+    mappedEngine->start();
+    asyncEngine->start();
+
+    std::vector<std::string> paths;
+    const std::string inputDirectory = Methcla::Tests::inputFile("");
+    DIR* dir = opendir(inputDirectory.c_str());
+    ASSERT_NE( dir, nullptr );
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+            paths.push_back(inputDirectory + entry->d_name);
+    }
+    closedir(dir);
+    ASSERT_FALSE( paths.empty() );
+
+    std::mt19937 gen(17);
+
+    for (bool directIO : { false, true })
+    {
+        methcla_soundfile_api_async_set_direct_io(directIO);
+
+        for (const auto& path : paths)
+        {
+            SCOPED_TRACE(path + (directIO ? " (direct I/O)" : ""));
+
+            Methcla::SoundFile expected(*mappedEngine, path);
+            Methcla::SoundFile actual(*asyncEngine, path);
+
+            ASSERT_EQ( actual.info().frames, expected.info().frames );
+            ASSERT_EQ( actual.info().channels, expected.info().channels );
+            ASSERT_EQ( actual.info().samplerate, expected.info().samplerate );
+
+            const size_t channels = expected.info().channels;
+            // Reads span several of the asynchronous API's segments.
+            std::uniform_int_distribution<int64_t> positionDist(0, expected.info().frames);
+            std::uniform_int_distribution<size_t> lengthDist(1, 200000);
+            std::vector<float> expectedData, actualData;
+
+            for (int i=0; i < 50; i++)
+            {
+                // Also read sequentially after a seek.
+                if (i % 2 == 0)
+                {
+                    const int64_t position = positionDist(gen);
+                    expected.seek(position);
+                    actual.seek(position);
+                }
+                ASSERT_EQ( actual.tell(), expected.tell() );
+
+                const size_t numFrames = lengthDist(gen);
+                expectedData.assign(numFrames * channels, 0.f);
+                actualData.assign(numFrames * channels, 1.f);
+
+                const size_t numFramesRead = expected.read(expectedData.data(), numFrames);
+                ASSERT_EQ( actual.read(actualData.data(), numFrames), numFramesRead );
+                ASSERT_TRUE( std::equal(expectedData.begin(), expectedData.begin() + numFramesRead * channels, actualData.begin()) )
+                    << "read " << i << " at frame " << expected.tell() - (int64_t)numFramesRead;
+            }
+        }
+    }
+
+    methcla_soundfile_api_async_set_direct_io(false);
+
+    asyncEngine->stop();
+    mappedEngine->stop();
+}
+
+TEST(Methcla_Engine, Oscbank_partials_should_be_settable_in_bulk)
+{
+    const size_t numPartials = 6;
+
+    ShmEngine shm("/methcla-tests-oscbank", Methcla::EngineOptions().addLibrary(methcla_plugins_oscbank), 0, 1);
+    const size_t blockSize = shm.blockSize();
+
+    // Partial i at frequency (i+1) * sampleRate / blockSize, so that every
+    // block contains whole periods; all amplitudes zero.
+    std::vector<float> controls(2 * numPartials, 0.f);
+    for (size_t i=0; i < numPartials; i++)
+        controls[i] = (float)((i + 1) * shm.sampleRate() / blockSize);
+
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        synth = request.synth(METHCLA_PLUGINS_OSCBANK_URI, shm.engine().root(), controls, { Methcla::Value((int)numPartials) });
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    ASSERT_EQ( shm.process(10), 0 );
+    EXPECT_EQ( peak(shm.output()), 0.f );
+
+    // Set all amplitudes with one message; the block following the update
+    // ramps towards the new amplitudes.
+    shm.engine().setRange(synth, numPartials, std::vector<float>(numPartials, 0.1f));
+    for (int i=0; i < 1000 && peak(shm.output()) == 0.f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    EXPECT_GT( peak(shm.output()), 0.f );
+    EXPECT_LE( std::abs(shm.output()[0]), 1e-6f );
+
+    ASSERT_EQ( shm.process(), 0 );
+    EXPECT_GT( peak(shm.output()), 0.f );
+    EXPECT_LE( peak(shm.output()), numPartials * 0.1f + 1e-5f );
+}
+
+TEST(Methcla_Engine, Oscbank_should_be_created_without_initial_controls)
+{
+    // The initial values of all control inputs don't fit into one request.
+    const size_t numPartials = 2048;
+    const size_t partial = numPartials - 1;
+
+    ShmEngine shm("/methcla-tests-oscbank-large", Methcla::EngineOptions().addLibrary(methcla_plugins_oscbank), 0, 1);
+
+    // All frequencies and amplitudes default to zero.
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        synth = request.synth(METHCLA_PLUGINS_OSCBANK_URI, shm.engine().root(), {}, { Methcla::Value((int)numPartials) });
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    ASSERT_EQ( shm.process(10), 0 );
+    EXPECT_EQ( peak(shm.output()), 0.f );
+
+    // Turn on the last partial with four periods per block.
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        request.set(synth, partial, 4. * shm.sampleRate() / shm.blockSize());
+        request.set(synth, numPartials + partial, 0.5);
+        request.closeBundle();
+        request.send();
+    }
+
+    // Skip the block ramping towards the new values.
+    for (int i=0; i < 1000 && peak(shm.output()) == 0.f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    EXPECT_GT( peak(shm.output()), 0.f );
+
+    ASSERT_EQ( shm.process(), 0 );
+    EXPECT_NEAR( peak(shm.output()), 0.5f, 0.01f );
+}
+
+TEST(Methcla_Engine, Convolver_should_render_the_impulse_response)
+{
+    const size_t partitionSize = 32;
+    // Covers the realtime partitions and several background partitions.
+    const size_t numFrames = 4096;
+
+    ShmEngine shm(
+        "/methcla-tests-convolver",
+        Methcla::EngineOptions()
+            .addLibrary(methcla_soundfile_api_mmap)
+            .addLibrary(methcla_plugins_convolver),
+        1, 1
+    );
+    // Leave the background thread time for computing its partitions.
+    shm.setDelay(0.001);
+
+    const std::string path = Methcla::Tests::inputFile("glockenspiel.wav");
+    std::vector<float> ir(numFrames);
+    {
+        Methcla::SoundFile file(shm.engine(), path);
+        ASSERT_EQ( file.info().channels, 1u );
+        ASSERT_EQ( file.read(ir.data(), numFrames), numFrames );
+    }
+
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        synth = request.synth(
+            METHCLA_PLUGINS_CONVOLVER_URI,
+            shm.engine().root(),
+            { 0.5f },
+            { Methcla::Value(path), Methcla::Value(0), Methcla::Value((int)numFrames), Methcla::Value((int)partitionSize) }
+            );
+        request.mapInput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    // Wait for the impulse response to be read.
+    std::vector<int32_t> stats;
+    for (int i=0; i < 100; i++)
+    {
+        stats = shm.statistics(synth);
+        if (stats.size() == kMethcla_ConvolverNumStatistics && stats[kMethcla_ConvolverImpulseResponseFrames] > 0)
+            break;
+    }
+    ASSERT_EQ( stats.size(), (size_t)kMethcla_ConvolverNumStatistics );
+    EXPECT_EQ( stats[kMethcla_ConvolverImpulseResponseFrames], (int32_t)numFrames );
+    EXPECT_EQ( stats[kMethcla_ConvolverLatency], (int32_t)partitionSize );
+
+    const size_t impulse = shm.numFramesProcessed();
+    shm.setInput([impulse](size_t, size_t frame) { return frame == impulse ? 1.f : 0.f; });
+
+    std::vector<float> response;
+    while (response.size() < partitionSize + numFrames + shm.blockSize())
+    {
+        ASSERT_EQ( shm.process(), 0 );
+        response.insert(response.end(), shm.output().begin(), shm.output().end());
+    }
+
+    for (size_t i=0; i < partitionSize; i++)
+        EXPECT_NEAR( response[i], 0.f, 1e-5f );
+    for (size_t i=0; i < numFrames; i++)
+        EXPECT_NEAR( response[partitionSize + i], 0.5f * ir[i], 1e-4f ) << "frame " << i;
+    for (size_t i=partitionSize + numFrames; i < response.size(); i++)
+        EXPECT_NEAR( response[i], 0.f, 1e-5f );
+
+    stats = shm.statistics(synth);
+    ASSERT_EQ( stats.size(), (size_t)kMethcla_ConvolverNumStatistics );
+    EXPECT_EQ( stats[kMethcla_ConvolverUnderruns], 0 );
+}
+
+TEST(Methcla_Engine, Filterbank_should_filter_all_bands)
+{
+    const size_t numFilters = 5;
+    const size_t numStages = 2;
+
+    ShmEngine shm("/methcla-tests-filterbank", Methcla::EngineOptions().addLibrary(methcla_plugins_filterbank), 1, numFilters);
+    const float sampleRate = (float)shm.sampleRate();
+
+    // The input is a sine at sampleRate / 8, ten times the cutoff frequency
+    // of the low and high pass filters and at the center of the others.
+    shm.setInput([](size_t, size_t frame) {
+        return (float)std::sin(2. * 3.14159265358979323846 * (double)(frame % 8) / 8.);
+    });
+
+    const float types[numFilters] = {
+        kMethcla_FilterbankLowpass, kMethcla_FilterbankHighpass, kMethcla_FilterbankBandpass,
+        kMethcla_FilterbankNotch, kMethcla_FilterbankPeak
+    };
+    const float freqs[numFilters] = {
+        sampleRate / 80.f, sampleRate / 80.f, sampleRate / 8.f, sampleRate / 8.f, sampleRate / 8.f
+    };
+    std::vector<float> controls;
+    controls.insert(controls.end(), types, types + numFilters);
+    controls.insert(controls.end(), freqs, freqs + numFilters);
+    controls.insert(controls.end(), numFilters, 1.f);
+    // Gain of the peak filter per stage.
+    controls.insert(controls.end(), numFilters, 6.f);
+
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        synth = request.synth(
+            METHCLA_PLUGINS_FILTERBANK_URI,
+            shm.engine().root(),
+            controls,
+            { Methcla::Value((int)numFilters), Methcla::Value((int)numStages), Methcla::Value(1) }
+            );
+        request.mapInput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        for (size_t i=0; i < numFilters; i++)
+            request.mapOutput(synth, i, Methcla::AudioBusId(i), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    // Blocks contain whole periods of the input.
+    auto amplitude = [&](size_t i) {
+        float sum = 0.f;
+        for (float x : shm.output(i))
+            sum += x * x;
+        return std::sqrt(2.f * sum / (float)shm.blockSize());
+    };
+
+    // Wait for the coefficients and for the filters to settle.
+    for (int i=0; i < 1000 && amplitude(1) == 0.f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    ASSERT_EQ( shm.process(100), 0 );
+
+    EXPECT_LT( amplitude(0), 1e-2f );
+    EXPECT_NEAR( amplitude(1), 1.f, 2e-2f );
+    EXPECT_NEAR( amplitude(2), 1.f, 1e-3f );
+    EXPECT_LT( amplitude(3), 1e-3f );
+    EXPECT_NEAR( amplitude(4), std::pow(10.f, numStages * 6.f / 20.f), 1e-2f );
+
+    // Changing the type of the first filter turns it into a high pass.
+    shm.engine().setRange(synth, 0, { (float)kMethcla_FilterbankHighpass });
+    for (int i=0; i < 1000 && amplitude(0) < 0.5f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    ASSERT_EQ( shm.process(100), 0 );
+
+    EXPECT_NEAR( amplitude(0), amplitude(1), 1e-4f );
+}
+
+TEST(Methcla_Engine, Matrix_mixer_gains_should_change_at_block_boundaries)
+{
+    const size_t numChannels = 2;
+
+    ShmEngine shm("/methcla-tests-matrix-mixer", Methcla::EngineOptions().addLibrary(methcla_plugins_matrix_mixer), numChannels, numChannels);
+    const size_t blockSize = shm.blockSize();
+    const std::vector<float>& output0 = shm.output(0);
+    const std::vector<float>& output1 = shm.output(1);
+
+    // Input 0 is constant one, input 1 constant two.
+    shm.setInput([](size_t channel, size_t) { return (float)(channel + 1); });
+
+    // Output 0 is half of input 0, output 1 input 1 plus a quarter of input 0.
+    Methcla::SynthId synth;
+    {
+        Methcla::Request request(shm.engine());
+        request.openBundle();
+        synth = request.synth(
+            METHCLA_PLUGINS_MATRIX_MIXER_URI,
+            shm.engine().root(),
+            { 0.5f, 0.f, 0.25f, 1.f },
+            { Methcla::Value((int)numChannels), Methcla::Value((int)numChannels) }
+            );
+        for (size_t i=0; i < numChannels; i++)
+        {
+            request.mapInput(synth, i, Methcla::AudioBusId(i), Methcla::kBusMappingExternal);
+            request.mapOutput(synth, i, Methcla::AudioBusId(i), Methcla::kBusMappingExternal);
+        }
+        request.activate(synth);
+        request.closeBundle();
+        request.send();
+    }
+
+    for (int i=0; i < 1000 && output1[0] == 0.f; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    ASSERT_EQ( shm.process(), 0 );
+    for (size_t k=0; k < blockSize; k++)
+    {
+        EXPECT_EQ( output0[k], 0.5f );
+        EXPECT_EQ( output1[k], 2.25f );
+    }
+
+    // Swap the inputs with one message; both outputs ramp during the same block.
+    shm.engine().setRange(synth, 0, { 0.f, 1.f, 1.f, 0.f });
+    float previous = output0[blockSize-1];
+    for (int i=0; i < 1000 && output0[blockSize-1] == previous; i++)
+        ASSERT_EQ( shm.process(), 0 );
+    EXPECT_EQ( output0[0], 0.5f );
+    EXPECT_EQ( output1[0], 2.25f );
+    for (size_t k=1; k < blockSize; k++)
+    {
+        EXPECT_GT( output0[k], output0[k-1] );
+        EXPECT_LT( output1[k], output1[k-1] );
+    }
+
+    ASSERT_EQ( shm.process(), 0 );
+    for (size_t k=0; k < blockSize; k++)
+    {
+        EXPECT_EQ( output0[k], 2.f );
+        EXPECT_EQ( output1[k], 1.f );
+    }
+}
+#endif
@@ -190,3 +190,712 @@ TEST(Methcla_Memory_Manager, Alloc_free_should_be_noop)
     ASSERT_EQ(stats.freeNumBytes, memSize);
     ASSERT_EQ(stats.usedNumBytes, 0u);
 }
+
+#include "Methcla/Audio/BufferCache.hpp"
+#include <methcla/plugins/soundfile_api_dummy.h>
+
+namespace test_Methcla_Audio_BufferCache
+{
+    // Minimal host that opens sound files with the dummy sound file API;
+    // files with a .txt extension are rejected.
+    class Host
+    {
+    public:
+        Host()
+            : m_api(nullptr)
+            , m_numOpened(0)
+            , m_fileFormat(kMethcla_SoundFileFormatUnknown)
+        {
+            memset(&m_host, 0, sizeof(m_host));
+            m_host.handle = this;
+            m_host.register_soundfile_api = registerSoundFileAPI;
+            m_host.soundfile_open = soundFileOpen;
+            methcla_soundfile_api_dummy(&m_host, nullptr);
+        }
+
+        operator const Methcla_Host* () const
+        {
+            return &m_host;
+        }
+
+        size_t numOpened() const
+        {
+            return m_numOpened;
+        }
+
+        //* Report fileFormat as the format of opened sound files.
+        void setFileFormat(Methcla_SoundFileFormat fileFormat)
+        {
+            m_fileFormat = fileFormat;
+        }
+
+    private:
+        static void registerSoundFileAPI(const Methcla_Host* host, const Methcla_SoundFileAPI* api)
+        {
+            static_cast<Host*>(host->handle)->m_api = api;
+        }
+
+        static Methcla_Error soundFileOpen(const Methcla_Host* host, const char* path, Methcla_FileMode mode, Methcla_SoundFile** file, Methcla_SoundFileInfo* info)
+        {
+            Host* self = static_cast<Host*>(host->handle);
+            self->m_numOpened++;
+            const size_t pathSize = strlen(path);
+            if (pathSize >= 4 && strcmp(path + pathSize - 4, ".txt") == 0)
+                return methcla_error_new(kMethcla_UnsupportedFileTypeError);
+            Methcla_Error err = self->m_api->open(self->m_api, path, mode, file, info);
+            if (methcla_is_ok(err) && self->m_fileFormat != kMethcla_SoundFileFormatUnknown)
+                info->file_format = self->m_fileFormat;
+            return err;
+        }
+
+        Methcla_Host                m_host;
+        const Methcla_SoundFileAPI* m_api;
+        std::atomic<size_t>         m_numOpened;
+        Methcla_SoundFileFormat     m_fileFormat;
+    };
+};
+
+TEST(Methcla_Audio_BufferCache, Buffers_with_same_key_should_be_shared)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+
+    Host host;
+    Methcla::Audio::BufferCache cache(host, 1024*1024*1024);
+
+    const Methcla_SampleBuffer* a = cache.acquire("a", 0, 1000, 0.);
+    const Methcla_SampleBuffer* b = cache.acquire("a", 0, 1000, 0.);
+    const Methcla_SampleBuffer* c = cache.acquire("a", 1000, 1000, 0.);
+
+    EXPECT_EQ(a, b);
+    EXPECT_NE(a, c);
+    EXPECT_EQ(a->frames, 1000);
+    EXPECT_EQ(host.numOpened(), 2u);
+    EXPECT_EQ(cache.size(), 2u);
+
+    cache.release(a);
+    cache.release(b);
+    cache.release(c);
+
+    // Unreferenced buffers stay in the cache while within budget.
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.acquire("a", 0, 1000, 0.), a);
+    EXPECT_EQ(host.numOpened(), 2u);
+    cache.release(a);
+}
+
+TEST(Methcla_Audio_BufferCache, Unreferenced_buffers_should_be_evicted_over_budget)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+
+    Host host;
+    Methcla::Audio::BufferCache cache(host, 0);
+
+    const Methcla_SampleBuffer* a = cache.acquire("a", 0, 1000, 0.);
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_GT(cache.memoryUsed(), 0u);
+
+    cache.release(a);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.memoryUsed(), 0u);
+}
+
+TEST(Methcla_Audio_BufferCache, Buffers_should_be_converted_to_requested_sample_rate)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+
+    Host host;
+    Methcla::Audio::BufferCache cache(host, 64*1024*1024);
+
+    const Methcla_SampleBuffer* a = cache.acquire("a", 0, 1000, 0.);
+    const Methcla_SampleBuffer* b = cache.acquire("a", 0, 1000, a->samplerate / 2.);
+
+    EXPECT_NE(a, b);
+    EXPECT_EQ(b->samplerate, a->samplerate / 2.);
+    EXPECT_EQ(b->channels, a->channels);
+    EXPECT_EQ(b->frames, 500);
+
+    while (methcla_sample_buffer_frames_available(b) < b->frames)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // The dummy sound file API reads silence.
+    const float* data = static_cast<const float*>(b->data);
+    EXPECT_TRUE(std::all_of(data, data + b->frames * b->channels, [](float x) { return x == 0.f; }));
+
+    cache.release(a);
+    cache.release(b);
+}
+
+TEST(Methcla_Audio_BufferCache, Buffers_should_be_loaded_progressively)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+
+    Host host;
+    Methcla::Audio::BufferCache cache(host, 64*1024*1024);
+
+    const Methcla_SampleBuffer* a = cache.acquire("a", 0, -1, 0.);
+    ASSERT_GT(a->frames, 0);
+
+    int64_t available = methcla_sample_buffer_frames_available(a);
+    EXPECT_GT(available, 0);
+
+    while (available < a->frames)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        const int64_t next = methcla_sample_buffer_frames_available(a);
+        EXPECT_GE(next, available);
+        available = next;
+    }
+
+    EXPECT_EQ(available, a->frames);
+    cache.release(a);
+}
+
+TEST(Methcla_Audio_BufferCache, Compact_buffers_should_keep_file_format)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+
+    Host host;
+    host.setFileFormat(kMethcla_SoundFileFormatPCM16);
+    Methcla::Audio::BufferCache cache(host, 64*1024*1024, true);
+
+    const Methcla_SampleBuffer* a = cache.acquire("a", 0, 1000, 0.);
+    EXPECT_EQ(a->format, kMethcla_SoundFileFormatPCM16);
+    EXPECT_EQ(cache.memoryUsed(), 1000 * a->channels * sizeof(int16_t));
+    EXPECT_EQ(methcla_sample_buffer_frame(a, 10), (const char*)a->data + 10 * a->channels * sizeof(int16_t));
+
+    // Converted buffers are stored as float.
+    const Methcla_SampleBuffer* b = cache.acquire("a", 0, 1000, a->samplerate / 2.);
+    EXPECT_EQ(b->format, kMethcla_SoundFileFormatFloat);
+
+    while (methcla_sample_buffer_frames_available(b) < b->frames)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    cache.release(a);
+    cache.release(b);
+}
+
+#include "Methcla/Audio/SampleRateConverter.hpp"
+#include <cmath>
+
+TEST(Methcla_Audio_SampleRateConverter, Converted_samples_should_match_reference_signal)
+{
+    const double pi = 3.14159265358979323846;
+    const int64_t numInputFrames = 4096;
+    // Output frames affected by the kernel extending beyond the input.
+    const size_t numEdgeFrames = 64;
+
+    const std::pair<double,double> rates[] = { { 44100., 48000. }, { 48000., 44100. }, { 44100., 22050. } };
+
+    // Vectorised per frame (1, 2, 4) and per group of channels (3, 8).
+    for (size_t numChannels : { 1, 2, 3, 4, 8 })
+    {
+        for (auto rate : rates)
+        {
+            // Channel c is a sine at (c+1) * 440 Hz.
+            auto signal = [&](size_t c, double t) { return 0.5 * std::sin(2. * pi * 440. * (c + 1) * t); };
+
+            std::vector<float> input(numInputFrames * numChannels);
+            for (int64_t i=0; i < numInputFrames; i++)
+                for (size_t c=0; c < numChannels; c++)
+                    input[i * numChannels + c] = signal(c, i / rate.first);
+
+            Methcla::Audio::SampleRateConverter converter(numChannels, rate.first, rate.second, numInputFrames);
+            ASSERT_EQ(converter.numOutputFrames(), (int64_t)std::ceil(numInputFrames * rate.second / rate.first));
+
+            // Read and convert in chunks of different sizes.
+            size_t inputPos = 0;
+            auto read = [&](float* buffer, size_t numFrames) {
+                const size_t n = std::min<size_t>(std::min<size_t>(numFrames, 333), numInputFrames - inputPos);
+                std::copy(&input[inputPos * numChannels], &input[(inputPos + n) * numChannels], buffer);
+                inputPos += n;
+                return n;
+            };
+
+            const size_t numOutputFrames = converter.numOutputFrames();
+            std::vector<float> output(numOutputFrames * numChannels);
+            for (size_t j=0; j < numOutputFrames; j += 100)
+                converter.process(read, &output[j * numChannels], std::min<size_t>(100, numOutputFrames - j));
+
+            for (size_t j=numEdgeFrames; j < numOutputFrames - numEdgeFrames; j++)
+            {
+                for (size_t c=0; c < numChannels; c++)
+                {
+                    ASSERT_NEAR(output[j * numChannels + c], signal(c, j / rate.second), 1e-3)
+                        << numChannels << " channels, " << rate.first << " -> " << rate.second
+                        << ", frame " << j << ", channel " << c;
+                }
+            }
+        }
+    }
+}
+
+#include "Methcla/Audio/SoundFileIndex.hpp"
+#include "Methcla/Exception.hpp"
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace test_Methcla_Audio_SoundFileIndex
+{
+    void writeFile(const std::string& path, size_t size)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        ASSERT_TRUE( file != nullptr );
+        for (size_t i=0; i < size; i++)
+            fputc(0, file);
+        fclose(file);
+    }
+};
+
+TEST(Methcla_Audio_SoundFileIndex, Unchanged_files_should_not_be_reopened)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+    using test_Methcla_Audio_SoundFileIndex::writeFile;
+
+    const std::string path = Methcla::Tests::outputFile("soundfile_index_a");
+    writeFile(path, 16);
+
+    Host host;
+    Methcla::Audio::SoundFileIndex index(host);
+
+    const Methcla_SoundFileInfo a = index.lookup(path);
+    const Methcla_SoundFileInfo b = index.lookup(path);
+    EXPECT_EQ(host.numOpened(), 1u);
+    EXPECT_EQ(a.frames, b.frames);
+    EXPECT_EQ(a.channels, b.channels);
+
+    // Changing the file's size invalidates the entry.
+    writeFile(path, 32);
+    index.lookup(path);
+    EXPECT_EQ(host.numOpened(), 2u);
+    EXPECT_EQ(index.size(), 1u);
+
+    // So does a modification within the same second.
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = 1400000000;
+    times[0].tv_nsec = times[1].tv_nsec = 1000;
+    ASSERT_EQ( utimensat(AT_FDCWD, path.c_str(), times, 0), 0 );
+    index.lookup(path);
+    EXPECT_EQ(host.numOpened(), 3u);
+    times[1].tv_nsec = 2000;
+    ASSERT_EQ( utimensat(AT_FDCWD, path.c_str(), times, 0), 0 );
+    index.lookup(path);
+    EXPECT_EQ(host.numOpened(), 4u);
+
+    EXPECT_THROW(index.lookup(Methcla::Tests::outputFile("soundfile_index_missing")), Methcla::Error);
+}
+
+TEST(Methcla_Audio_SoundFileIndex, Index_should_be_restored_from_file)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+    using test_Methcla_Audio_SoundFileIndex::writeFile;
+
+    const std::string path = Methcla::Tests::outputFile("soundfile_index_b");
+    const std::string indexPath = Methcla::Tests::outputFile("soundfile_index_b.idx");
+    writeFile(path, 16);
+    std::remove(indexPath.c_str());
+
+    Methcla_SoundFileInfo a;
+    {
+        Host host;
+        Methcla::Audio::SoundFileIndex index(host, indexPath);
+        a = index.lookup(path);
+        index.save();
+    }
+
+    Host host;
+    Methcla::Audio::SoundFileIndex index(host, indexPath);
+    EXPECT_EQ(index.size(), 1u);
+    const Methcla_SoundFileInfo b = index.lookup(path);
+    EXPECT_EQ(host.numOpened(), 0u);
+    EXPECT_EQ(a.frames, b.frames);
+    EXPECT_EQ(a.channels, b.channels);
+    EXPECT_EQ(a.samplerate, b.samplerate);
+}
+
+TEST(Methcla_Audio_SoundFileIndex, Scan_should_index_directory_in_parallel)
+{
+    using test_Methcla_Audio_BufferCache::Host;
+    using test_Methcla_Audio_SoundFileIndex::writeFile;
+
+    const std::string dir = Methcla::Tests::outputFile("soundfile_index_scan");
+    mkdir(dir.c_str(), 0755);
+
+    const size_t numFiles = 50;
+    for (size_t i=0; i < numFiles; i++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "/%03u.wav", (unsigned)i);
+        writeFile(dir + name, 16);
+    }
+    writeFile(dir + "/notes.txt", 16);
+
+    Host host;
+    Methcla::Audio::SoundFileIndex index(host);
+
+    auto files = index.scan(dir, 4);
+    ASSERT_EQ(files.size(), numFiles);
+    EXPECT_EQ(files.front().first, dir + "/000.wav");
+    EXPECT_EQ(files.back().first, dir + "/049.wav");
+    EXPECT_EQ(host.numOpened(), numFiles + 1);
+
+    // Neither sound files nor other files are reopened.
+    files = index.scan(dir, 4);
+    EXPECT_EQ(files.size(), numFiles);
+    EXPECT_EQ(host.numOpened(), numFiles + 1);
+    EXPECT_EQ(index.size(), numFiles + 1);
+    EXPECT_THROW(index.lookup(dir + "/notes.txt"), Methcla::Error);
+    EXPECT_EQ(host.numOpened(), numFiles + 1);
+
+    // Deleted files are removed from the index.
+    std::remove((dir + "/049.wav").c_str());
+    files = index.scan(dir, 4);
+    EXPECT_EQ(files.size(), numFiles - 1);
+    EXPECT_EQ(index.size(), numFiles);
+}
+
+#include "Methcla/Audio/IO/TimeFilter.hpp"
+#include <random>
+
+TEST(Methcla_Audio_IO_TimeFilter, Should_estimate_sample_rate_and_remove_jitter)
+{
+    const double nominalSampleRate = 44100;
+    const double actualSampleRate = nominalSampleRate * (1. + 100e-6);
+    const size_t blockSize = 256;
+    const double jitter = 0.5e-3;
+
+    std::minstd_rand rng(1);
+    std::uniform_real_distribution<double> noise(-jitter, jitter);
+
+    Methcla::Audio::IO::TimeFilter filter;
+    double maxError = 0;
+
+    // Ten minutes of callbacks
+    const size_t numBlocks = 10 * 60 * actualSampleRate / blockSize;
+    for (size_t i=0; i < numBlocks; i++)
+    {
+        const double time = 1000. + (double)(i * blockSize) / actualSampleRate;
+        filter.update(time + noise(rng), blockSize, nominalSampleRate);
+        // Skip the first minute while the loop locks and narrows its bandwidth.
+        if (i * blockSize > 60 * actualSampleRate)
+            maxError = std::max(maxError, std::fabs(filter.time() - time));
+    }
+
+    EXPECT_NEAR(filter.sampleRate(), actualSampleRate, 5e-6 * actualSampleRate);
+    EXPECT_LT(maxError, jitter / 10);
+}
+
+TEST(Methcla_Audio_IO_TimeFilter, Should_restart_after_discontinuity)
+{
+    const double sampleRate = 48000;
+    const size_t blockSize = 64;
+
+    Methcla::Audio::IO::TimeFilter filter;
+
+    double time = 0;
+    for (size_t i=0; i < 1000; i++)
+    {
+        filter.update(time, blockSize, sampleRate);
+        time += blockSize / sampleRate;
+    }
+    EXPECT_NEAR(filter.time(), time - blockSize / sampleRate, 1e-9);
+
+    // Stream restarted one second later
+    time += 1;
+    filter.update(time, blockSize, sampleRate);
+    EXPECT_EQ(filter.time(), time);
+    EXPECT_EQ(filter.sampleRate(), sampleRate);
+    EXPECT_NEAR(filter.framesToTime(blockSize), time + blockSize / sampleRate, 1e-9);
+}
+
+#include <methcla/plugins/resample.hpp>
+#include <cmath>
+#include <limits>
+
+TEST(Methcla_Plugin_Resample, Interpolation_should_reproduce_input_at_integer_phases)
+{
+    using namespace Methcla::Plugin::Resample;
+
+    const size_t kFrames = 100;
+    float buffer[kFrames*2];
+    for (size_t i=0; i < kFrames*2; i++)
+        buffer[i] = std::sin(0.1f * i);
+
+    const Source source = { buffer, kMethcla_SoundFileFormatFloat, 2, kFrames, false };
+
+    for (int quality = kMethcla_ResampleNone; quality <= kMethcla_ResampleSinc; quality++)
+    {
+        float out0[kFrames];
+        float out1[kFrames];
+        float* outputs[] = { out0, out1 };
+        double phase = 0.;
+
+        const size_t numFrames = resample((Methcla_ResampleQuality)quality, source, kFrames, phase, 1.f, 1.f, outputs, 2, kFrames);
+
+        EXPECT_EQ(numFrames, kFrames);
+        EXPECT_EQ(phase, (double)kFrames);
+        for (size_t i=0; i < numFrames; i++)
+        {
+            EXPECT_NEAR(out0[i], buffer[i*2], 1e-5f);
+            EXPECT_NEAR(out1[i], buffer[i*2+1], 1e-5f);
+        }
+    }
+}
+
+TEST(Methcla_Plugin_Resample, Looped_sources_should_wrap_phase)
+{
+    using namespace Methcla::Plugin::Resample;
+
+    const size_t kFrames = 10;
+    float buffer[kFrames];
+    for (size_t i=0; i < kFrames; i++)
+        buffer[i] = (float)i;
+
+    const Source source = { buffer, kMethcla_SoundFileFormatFloat, 1, kFrames, true };
+
+    float out0[25];
+    float out1[25];
+    float* outputs[] = { out0, out1 };
+    double phase = 4.;
+
+    const size_t numFrames = resample<Nearest>(source, std::numeric_limits<int64_t>::max(), phase, 2.f, 1.f, outputs, 2, 25);
+
+    EXPECT_EQ(numFrames, 25u);
+    EXPECT_EQ(phase, 4.);
+    for (size_t i=0; i < numFrames; i++)
+    {
+        EXPECT_EQ(out0[i], (float)((4 + 2*i) % kFrames));
+        EXPECT_EQ(out1[i], out0[i]);
+    }
+}
+
+TEST(Methcla_Plugin_Resample, Kernels_should_only_write_the_requested_frames)
+{
+    using namespace Methcla::Plugin::Resample;
+
+    const size_t kFrames = 100;
+    float buffer[kFrames];
+    for (size_t i=0; i < kFrames; i++)
+        buffer[i] = (float)i;
+
+    const Source source = { buffer, kMethcla_SoundFileFormatFloat, 1, kFrames, false };
+
+    // Frame counts that aren't a multiple of the kernels' vector width.
+    for (int quality = kMethcla_ResampleNone; quality <= kMethcla_ResampleSinc; quality++)
+    {
+        for (size_t numFrames = 1; numFrames <= 7; numFrames++)
+        {
+            float out[8];
+            std::fill(out, out + 8, -1.f);
+            float* outputs[] = { out };
+            double phase = 20.5;
+
+            EXPECT_EQ(resample((Methcla_ResampleQuality)quality, source, kFrames, phase, 0.5f, 1.f, outputs, 1, numFrames), numFrames);
+            for (size_t i=0; i < numFrames; i++)
+            {
+                // Nearest truncates the phase, the other kernels reproduce the ramp.
+                const float expected = quality == kMethcla_ResampleNone ? std::floor(20.5f + 0.5f * i) : 20.5f + 0.5f * i;
+                EXPECT_NEAR(out[i], expected, 1e-3f) << "quality " << quality << " frame " << i;
+            }
+            for (size_t i=numFrames; i < 8; i++)
+                EXPECT_EQ(out[i], -1.f);
+        }
+    }
+
+    // Playback at rate 1 from an integer phase copies the frames.
+    for (size_t numFrames = 1; numFrames <= 7; numFrames++)
+    {
+        float out[8];
+        std::fill(out, out + 8, -1.f);
+        float* outputs[] = { out };
+        double phase = 20.;
+
+        EXPECT_EQ(resample(kMethcla_ResampleHermite, source, kFrames, phase, 1.f, 0.5f, outputs, 1, numFrames), numFrames);
+        for (size_t i=0; i < numFrames; i++)
+            EXPECT_EQ(out[i], 0.5f * (20.f + i));
+        for (size_t i=numFrames; i < 8; i++)
+            EXPECT_EQ(out[i], -1.f);
+    }
+}
+
+TEST(Methcla_Plugin_Resample, Compact_sources_should_be_converted_to_float)
+{
+    using namespace Methcla::Plugin::Resample;
+
+    const size_t kFrames = 100;
+    int16_t pcm16[kFrames];
+    uint8_t pcm24[kFrames*3];
+    float float16[kFrames];
+    float float24[kFrames];
+    for (size_t i=0; i < kFrames; i++)
+    {
+        pcm16[i] = (int16_t)(std::sin(0.1f * i) * 30000.f);
+        float16[i] = pcm16[i] / 32768.f;
+        const int32_t x = (int32_t)(std::sin(0.1f * i) * 8000000.f);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        pcm24[i*3] = (uint8_t)(x >> 16); pcm24[i*3+1] = (uint8_t)(x >> 8); pcm24[i*3+2] = (uint8_t)x;
+#else
+        pcm24[i*3] = (uint8_t)x; pcm24[i*3+1] = (uint8_t)(x >> 8); pcm24[i*3+2] = (uint8_t)(x >> 16);
+#endif
+        float24[i] = x / 8388608.f;
+    }
+
+    const Source sources[][2] = {
+        { { pcm16, kMethcla_SoundFileFormatPCM16, 1, kFrames, false },
+          { float16, kMethcla_SoundFileFormatFloat, 1, kFrames, false } },
+        { { pcm24, kMethcla_SoundFileFormatPCM24, 1, kFrames, false },
+          { float24, kMethcla_SoundFileFormatFloat, 1, kFrames, false } }
+    };
+
+    for (const auto& pair : sources)
+    {
+        float out0[kFrames], out1[kFrames];
+        float expected0[kFrames], expected1[kFrames];
+        float* outputs[] = { out0, out1 };
+        float* expected[] = { expected0, expected1 };
+        double phase = 0.5;
+        double expectedPhase = 0.5;
+
+        const size_t numFrames = resample(kMethcla_ResampleHermite, pair[0], kFrames, phase, 0.75f, 1.f, outputs, 2, kFrames);
+        const size_t expectedNumFrames = resample(kMethcla_ResampleHermite, pair[1], kFrames, expectedPhase, 0.75f, 1.f, expected, 2, kFrames);
+
+        EXPECT_EQ(numFrames, expectedNumFrames);
+        EXPECT_EQ(phase, expectedPhase);
+        for (size_t i=0; i < numFrames; i++)
+            EXPECT_FLOAT_EQ(out0[i], expected0[i]);
+    }
+}
+
+TEST(Methcla_Plugin_Resample, Vector_loads_should_convert_samples_exactly)
+{
+    using namespace Methcla::Plugin::Resample;
+
+    const int16_t pcm16[] = { -32768, -1, 0, 32767 };
+    const int32_t values24[] = { -8388608, -255, 256, 8388607 };
+    uint8_t pcm24[12];
+    for (size_t i=0; i < 4; i++)
+    {
+        const int32_t x = values24[i];
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        pcm24[i*3] = (uint8_t)(x >> 16); pcm24[i*3+1] = (uint8_t)(x >> 8); pcm24[i*3+2] = (uint8_t)x;
+#else
+        pcm24[i*3] = (uint8_t)x; pcm24[i*3+1] = (uint8_t)(x >> 8); pcm24[i*3+2] = (uint8_t)(x >> 16);
+#endif
+    }
+
+    const size_t index[] = { 3, 2, 1, 0 };
+    const Methcla_Float4 x16 = PCM16::load4(pcm16, index, 0);
+    const Methcla_Float4 x24 = PCM24::load4(pcm24, index, 0);
+    for (size_t l=0; l < 4; l++)
+    {
+        EXPECT_EQ(x16[l], PCM16::load(pcm16, index[l]));
+        EXPECT_EQ(x24[l], PCM24::load(pcm24, index[l]));
+    }
+}
+
+TEST(Methcla_Plugin_Resample, Channels_should_be_deinterleaved_to_outputs)
+{
+    using namespace Methcla::Plugin::Resample;
+
+    const size_t kFrames = 64;
+    const size_t kChannels = 8;
+    const size_t kOutputs = 10;
+    float buffer[kFrames*kChannels];
+    for (size_t i=0; i < kFrames; i++)
+    {
+        for (size_t c=0; c < kChannels; c++)
+            buffer[i*kChannels+c] = (float)(c * 1000 + i);
+    }
+
+    const Source source = { buffer, kMethcla_SoundFileFormatFloat, kChannels, kFrames, false };
+
+    float out[kOutputs][kFrames];
+    float* outputs[kOutputs];
+    for (size_t c=0; c < kOutputs; c++)
+        outputs[c] = out[c];
+
+    // Rate 1 copies the frames, rate 0.5 interpolates between them.
+    const float rates[] = { 1.f, 0.5f };
+    for (float rate : rates)
+    {
+        double phase = 0.;
+        const size_t numFrames = resample(kMethcla_ResampleLinear, source, kFrames, phase, rate, 1.f, outputs, kOutputs, kFrames);
+
+        EXPECT_EQ(numFrames, kFrames);
+        EXPECT_EQ(phase, kFrames * rate);
+        for (size_t c=0; c < kOutputs; c++)
+        {
+            for (size_t i=0; i < numFrames; i++)
+            {
+                if (c < kChannels)
+                    EXPECT_FLOAT_EQ(out[c][i], c * 1000 + i * rate);
+                else
+                    EXPECT_EQ(out[c][i], 0.f);
+            }
+        }
+    }
+}
+
+#include <methcla/plugins/oscillator.h>
+
+TEST(Methcla_Plugin_Oscillator, Sine_should_be_within_error_bound)
+{
+    const size_t kFrames = 1000;
+    float out[kFrames];
+
+    // Include increments close to Nyquist, negative increments and block
+    // sizes that aren't multiples of the vector or chunk size.
+    const double increments[] = { 1e-4, 440. / 44100., 0.2371, 0.4999, -0.13 };
+    for (double inc : increments)
+    {
+        const double phase = 0.3;
+        const size_t numFrames = 997;
+        out[numFrames] = 42.f;
+
+        const double nextPhase = methcla_oscillator_sine(out, numFrames, phase, inc, 0.5f);
+
+        for (size_t k=0; k < numFrames; k++)
+            EXPECT_NEAR(out[k], 0.5 * std::sin(2. * M_PI * (phase + k * inc)), 0.5 * 1.5e-6);
+        EXPECT_EQ(out[numFrames], 42.f);
+        EXPECT_LE(std::abs(nextPhase), 0.5);
+        EXPECT_NEAR(std::sin(2. * M_PI * nextPhase), std::sin(2. * M_PI * (phase + numFrames * inc)), 1e-9);
+    }
+}
+
+#include <methcla/plugins/fft.hpp>
+
+TEST(Methcla_Plugin_FFT, Real_FFT_should_match_DFT_and_invert)
+{
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+    for (size_t size=2; size <= 1024; size *= 2)
+    {
+        Methcla::Plugin::FFT::RealFFT fft(size);
+        ASSERT_EQ(fft.numBins(), size / 2 + 1);
+
+        std::vector<float> x(size), re(fft.numBins()), im(fft.numBins()), y(size);
+        for (auto& v : x)
+            v = dist(gen);
+
+        fft.forward(x.data(), re.data(), im.data());
+
+        for (size_t k=0; k < fft.numBins(); k++)
+        {
+            double dftRe = 0., dftIm = 0.;
+            for (size_t n=0; n < size; n++)
+            {
+                const double w = -2. * M_PI * (double)(k * n) / (double)size;
+                dftRe += x[n] * std::cos(w);
+                dftIm += x[n] * std::sin(w);
+            }
+            EXPECT_NEAR(re[k], dftRe, 1e-5 * size);
+            EXPECT_NEAR(im[k], dftIm, 1e-5 * size);
+        }
+
+        fft.inverse(re.data(), im.data(), y.data());
+
+        for (size_t n=0; n < size; n++)
+            EXPECT_NEAR(y[n] / (float)size, x[n], 1e-6f);
+    }
+}
@@ -0,0 +1,662 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Run standard workloads on an engine driven by the benchmark driver and
+// report throughput and block latency.
+//
+// Usage: methcla-benchmark SCENARIO [OPTION=VALUE ...]
+//
+// Scenarios:
+//
+//   sine           voices sine oscillators
+//   disksampler    voices looping disk streams of file
+//   node-set       voices sine oscillators receiving messages /node/set
+//                  requests per block
+//   voice-churn    voices sine oscillators, replacing churn of them per block
+//   oscbank        one oscbank synth with voices partials, receiving all
+//                  partial frequencies per block with /node/set-range
+//   convolver      voices convolvers of one sine oscillator with the
+//                  impulse response in file
+//   filterbank     one filterbank synth with voices band pass filters of one
+//                  sine oscillator, receiving all band frequencies every 16
+//                  blocks with /node/set-range
+//   matrix-mixer   one voices x voices matrix mixer of sine oscillators with
+//                  every other gain zero, receiving one row per block with
+//                  /node/set-range
+//
+// Options (defaults in parentheses):
+//
+//   voices (64), messages (256), churn (4), file, blocks (10000),
+//   warmup (100), block-size (64), sample-rate (44100), outputs (2)
+//
+// Convolvers compute their background partitions on a separate thread,
+// which the realtime factor doesn't account for.
+//
+// Disk streams are refilled at disk speed, not at the speed the benchmark
+// consumes them, so the disksampler scenario mostly measures the realtime
+// side of streaming once the initial read-ahead has been used up.
+
+#include <methcla/engine.hpp>
+#include <methcla/platform/benchmark.h>
+#include <methcla/plugins/convolver.h>
+#include <methcla/plugins/disksampler.h>
+#include <methcla/plugins/filterbank.h>
+#include <methcla/plugins/matrix-mixer.h>
+#include <methcla/plugins/oscbank.h>
+#include <methcla/plugins/sine.h>
+#include <methcla/plugins/soundfile_api_libsndfile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class Options
+{
+public:
+    Options(int argc, const char* const* argv)
+    {
+        for (int i=2; i < argc; i++)
+        {
+            const std::string arg(argv[i]);
+            const size_t eq = arg.find('=');
+            if (eq == std::string::npos)
+                throw std::invalid_argument("Invalid option " + arg + ", expected OPTION=VALUE");
+            m_values[arg.substr(0, eq)] = arg.substr(eq+1);
+        }
+    }
+
+    std::string string(const std::string& key, const std::string& def) const
+    {
+        auto it = m_values.find(key);
+        return it == m_values.end() ? def : it->second;
+    }
+
+    size_t size(const std::string& key, size_t def) const
+    {
+        auto it = m_values.find(key);
+        if (it == m_values.end())
+            return def;
+        std::istringstream s(it->second);
+        size_t value;
+        if (!(s >> value))
+            throw std::invalid_argument("Invalid value for option " + key + ": " + it->second);
+        return value;
+    }
+
+private:
+    std::map<std::string,std::string> m_values;
+};
+
+// Maximum number of messages per request packet.
+const size_t kMaxMessagesPerRequest = 64;
+
+class Scenario
+{
+public:
+    virtual ~Scenario() { }
+
+    //* Called before the first block.
+    virtual void setup(Methcla::Engine& engine) = 0;
+
+    //* Called before each following block.
+    virtual void block(Methcla::Engine&, uint64_t) { }
+};
+
+class SineScenario : public Scenario
+{
+public:
+    SineScenario(size_t numVoices)
+        : m_numVoices(numVoices)
+        , m_numStarted(0)
+    { }
+
+    void setup(Methcla::Engine& engine) override
+    {
+        for (size_t i=0; i < m_numVoices; i++)
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            m_voices.push_back(startVoice(engine, request));
+            request.closeBundle();
+            request.send();
+        }
+    }
+
+protected:
+    Methcla::SynthId startVoice(Methcla::Engine& engine, Methcla::Request& request)
+    {
+        // Spread the voices over two octaves.
+        const float freq = 220.f * (1.f + (float)(m_numStarted % 100) / 50.f);
+        const float amp = 1.f / (float)m_numVoices;
+        Methcla::SynthId synth = request.synth(METHCLA_PLUGINS_SINE_URI, engine.root(), { freq, amp });
+        request.mapOutput(synth, 0, Methcla::AudioBusId(m_numStarted % 2), Methcla::kBusMappingExternal);
+        request.activate(synth);
+        m_numStarted++;
+        return synth;
+    }
+
+    size_t                      m_numVoices;
+    size_t                      m_numStarted;
+    std::deque<Methcla::SynthId> m_voices;
+};
+
+class NodeSetScenario : public SineScenario
+{
+public:
+    NodeSetScenario(size_t numVoices, size_t numMessages)
+        : SineScenario(numVoices)
+        , m_numMessages(numMessages)
+    { }
+
+    void block(Methcla::Engine& engine, uint64_t blockIndex) override
+    {
+        if (m_voices.empty())
+            return;
+        for (size_t i=0; i < m_numMessages; i += kMaxMessagesPerRequest)
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            for (size_t j=i; j < std::min(i + kMaxMessagesPerRequest, m_numMessages); j++)
+            {
+                const size_t k = (size_t)blockIndex * m_numMessages + j;
+                request.set(m_voices[k % m_voices.size()], 0, 220. + (double)(k % 440));
+            }
+            request.closeBundle();
+            request.send();
+        }
+    }
+
+private:
+    size_t m_numMessages;
+};
+
+class VoiceChurnScenario : public SineScenario
+{
+public:
+    VoiceChurnScenario(size_t numVoices, size_t churn)
+        : SineScenario(numVoices)
+        , m_churn(std::min(churn, numVoices))
+    { }
+
+    void block(Methcla::Engine& engine, uint64_t) override
+    {
+        for (size_t i=0; i < m_churn; i++)
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            request.free(m_voices.front());
+            m_voices.pop_front();
+            m_voices.push_back(startVoice(engine, request));
+            request.closeBundle();
+            request.send();
+        }
+    }
+
+private:
+    size_t m_churn;
+};
+
+class OscbankScenario : public Scenario
+{
+public:
+    OscbankScenario(size_t numPartials)
+        : m_numPartials(numPartials)
+    {
+        if (m_numPartials > 4096)
+            throw std::invalid_argument("The oscbank scenario supports at most 4096 voices");
+    }
+
+    void setup(Methcla::Engine& engine) override
+    {
+        // Controls are set in several messages, which may not fit into one
+        // request with the synth.
+        Methcla::Request request(engine);
+        request.openBundle();
+        m_synth = request.synth(METHCLA_PLUGINS_OSCBANK_URI, engine.root(), {}, { Methcla::Value((int)m_numPartials) });
+        request.mapOutput(m_synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+        request.activate(m_synth);
+        request.closeBundle();
+        request.send();
+
+        std::vector<float> amps(m_numPartials, 1.f / (float)m_numPartials);
+        setRange(engine, m_numPartials, amps);
+        setFrequencies(engine, 0);
+    }
+
+    void block(Methcla::Engine& engine, uint64_t blockIndex) override
+    {
+        setFrequencies(engine, blockIndex);
+    }
+
+private:
+    void setFrequencies(Methcla::Engine& engine, uint64_t blockIndex)
+    {
+        std::vector<float> freqs(m_numPartials);
+        for (size_t i=0; i < m_numPartials; i++)
+            freqs[i] = frequency(i, blockIndex);
+        setRange(engine, 0, freqs);
+    }
+
+    void setRange(Methcla::Engine& engine, size_t index, const std::vector<float>& values)
+    {
+        for (size_t i=0; i < values.size(); i += kMaxValuesPerRequest)
+        {
+            engine.setRange(
+                m_synth,
+                index + i,
+                std::vector<float>(values.begin() + i, values.begin() + std::min(i + kMaxValuesPerRequest, values.size()))
+                );
+        }
+    }
+
+    // Maximum number of values per /node/set-range message.
+    static const size_t kMaxValuesPerRequest = 1024;
+
+    // Partials spread over two octaves with a slow vibrato.
+    static float frequency(size_t partial, uint64_t blockIndex)
+    {
+        return 220.f * (1.f + (float)(partial % 100) / 50.f) + (float)(blockIndex % 64) / 8.f;
+    }
+
+    size_t              m_numPartials;
+    Methcla::SynthId    m_synth;
+};
+
+class ConvolverScenario : public Scenario
+{
+public:
+    ConvolverScenario(size_t numVoices, const std::string& path)
+        : m_numVoices(numVoices)
+        , m_path(path)
+    {
+        if (m_path.empty())
+            throw std::invalid_argument("The convolver scenario requires option file");
+    }
+
+    void setup(Methcla::Engine& engine) override
+    {
+        // One source on an internal bus feeding all convolvers.
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            Methcla::SynthId synth = request.synth(METHCLA_PLUGINS_SINE_URI, engine.root(), { 440.f, 0.5f });
+            request.mapOutput(synth, 0, Methcla::AudioBusId(0));
+            request.activate(synth);
+            request.closeBundle();
+            request.send();
+        }
+        for (size_t i=0; i < m_numVoices; i++)
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            Methcla::SynthId synth = request.synth(
+                METHCLA_PLUGINS_CONVOLVER_URI,
+                engine.root(),
+                { 1.f / (float)m_numVoices },
+                { Methcla::Value(m_path) }
+                );
+            request.mapInput(synth, 0, Methcla::AudioBusId(0));
+            request.mapOutput(synth, 0, Methcla::AudioBusId(i % 2), Methcla::kBusMappingExternal);
+            request.activate(synth);
+            request.closeBundle();
+            request.send();
+        }
+    }
+
+    void block(Methcla::Engine&, uint64_t blockIndex) override
+    {
+        // Give the convolvers time to read the impulse response.
+        if (blockIndex == 1)
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+private:
+    size_t      m_numVoices;
+    std::string m_path;
+};
+
+class FilterbankScenario : public Scenario
+{
+public:
+    FilterbankScenario(size_t numBands)
+        : m_numBands(numBands)
+    {
+        if (m_numBands > 256)
+            throw std::invalid_argument("The filterbank scenario supports at most 256 voices");
+    }
+
+    void setup(Methcla::Engine& engine) override
+    {
+        std::vector<float> controls(4 * m_numBands);
+        for (size_t i=0; i < m_numBands; i++)
+        {
+            controls[i] = kMethcla_FilterbankBandpass;
+            controls[m_numBands + i] = frequency(i, 0);
+            controls[2 * m_numBands + i] = 4.f;
+            controls[3 * m_numBands + i] = 0.f;
+        }
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            Methcla::SynthId source = request.synth(METHCLA_PLUGINS_SINE_URI, engine.root(), { 440.f, 0.5f });
+            request.mapOutput(source, 0, Methcla::AudioBusId(0));
+            request.activate(source);
+            m_synth = request.synth(
+                METHCLA_PLUGINS_FILTERBANK_URI,
+                engine.root(),
+                controls,
+                { Methcla::Value((int)m_numBands), Methcla::Value(2), Methcla::Value(1) }
+                );
+            request.mapInput(m_synth, 0, Methcla::AudioBusId(0));
+            request.closeBundle();
+            request.send();
+        }
+        // Map the outputs in several requests to stay within the packet size.
+        for (size_t i=0; i < m_numBands; i += kMaxMappingsPerRequest)
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            for (size_t j=i; j < std::min(i + kMaxMappingsPerRequest, m_numBands); j++)
+                request.mapOutput(m_synth, j, Methcla::AudioBusId(j % 2), Methcla::kBusMappingExternal);
+            if (i + kMaxMappingsPerRequest >= m_numBands)
+                request.activate(m_synth);
+            request.closeBundle();
+            request.send();
+        }
+    }
+
+    void block(Methcla::Engine& engine, uint64_t blockIndex) override
+    {
+        if (blockIndex % 16 == 0)
+        {
+            std::vector<float> freqs(m_numBands);
+            for (size_t i=0; i < m_numBands; i++)
+                freqs[i] = frequency(i, blockIndex);
+            engine.setRange(m_synth, m_numBands, freqs);
+        }
+    }
+
+private:
+    static const size_t kMaxMappingsPerRequest = 64;
+
+    // Bands spread over four octaves, sweeping slowly.
+    static float frequency(size_t band, uint64_t blockIndex)
+    {
+        return 220.f * std::pow(2.f, 4.f * (float)band / 256.f) + (float)(blockIndex % 256);
+    }
+
+    size_t              m_numBands;
+    Methcla::SynthId    m_synth;
+};
+
+class MatrixMixerScenario : public Scenario
+{
+public:
+    MatrixMixerScenario(size_t numChannels)
+        : m_numChannels(numChannels)
+    {
+        if (m_numChannels > 32)
+            throw std::invalid_argument("The matrix-mixer scenario supports at most 32 voices");
+    }
+
+    void setup(Methcla::Engine& engine) override
+    {
+        std::vector<float> gains;
+        for (size_t j=0; j < m_numChannels; j++)
+        {
+            const std::vector<float> row = this->row(j, 0);
+            gains.insert(gains.end(), row.begin(), row.end());
+        }
+        // Sources, mixer and mappings in separate requests to stay within the packet size.
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            for (size_t i=0; i < m_numChannels; i++)
+            {
+                Methcla::SynthId source = request.synth(METHCLA_PLUGINS_SINE_URI, engine.root(), { 220.f * (1.f + (float)i / 8.f), 0.5f });
+                request.mapOutput(source, 0, Methcla::AudioBusId(i));
+                request.activate(source);
+            }
+            request.closeBundle();
+            request.send();
+        }
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            m_synth = request.synth(
+                METHCLA_PLUGINS_MATRIX_MIXER_URI,
+                engine.root(),
+                gains,
+                { Methcla::Value((int)m_numChannels), Methcla::Value((int)m_numChannels) }
+                );
+            request.closeBundle();
+            request.send();
+        }
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            for (size_t i=0; i < m_numChannels; i++)
+            {
+                request.mapInput(m_synth, i, Methcla::AudioBusId(i));
+                request.mapOutput(m_synth, i, Methcla::AudioBusId(i % 2), Methcla::kBusMappingExternal);
+            }
+            request.activate(m_synth);
+            request.closeBundle();
+            request.send();
+        }
+    }
+
+    void block(Methcla::Engine& engine, uint64_t blockIndex) override
+    {
+        const size_t j = blockIndex % m_numChannels;
+        engine.setRange(m_synth, j * m_numChannels, row(j, blockIndex));
+    }
+
+private:
+    // Gains of output j, with every other input muted.
+    std::vector<float> row(size_t j, uint64_t blockIndex) const
+    {
+        std::vector<float> gains(m_numChannels);
+        for (size_t i=0; i < m_numChannels; i++)
+        {
+            if ((i + j) % 2 == 0)
+                gains[i] = (1.f + (float)(blockIndex % 64) / 64.f) / (float)m_numChannels;
+        }
+        return gains;
+    }
+
+    size_t              m_numChannels;
+    Methcla::SynthId    m_synth;
+};
+
+class DiskSamplerScenario : public Scenario
+{
+public:
+    DiskSamplerScenario(size_t numVoices, const std::string& path)
+        : m_numVoices(numVoices)
+        , m_path(path)
+    {
+        if (m_path.empty())
+            throw std::invalid_argument("The disksampler scenario requires option file");
+    }
+
+    void setup(Methcla::Engine& engine) override
+    {
+        for (size_t i=0; i < m_numVoices; i++)
+        {
+            Methcla::Request request(engine);
+            request.openBundle();
+            Methcla::SynthId synth = request.synth(
+                METHCLA_PLUGINS_DISKSAMPLER_URI,
+                engine.root(),
+                { 1.f / (float)m_numVoices, 1.f },
+                { Methcla::Value(m_path), Methcla::Value(true) }
+                );
+            request.mapOutput(synth, 0, Methcla::AudioBusId(0), Methcla::kBusMappingExternal);
+            request.mapOutput(synth, 1, Methcla::AudioBusId(1), Methcla::kBusMappingExternal);
+            request.activate(synth);
+            request.closeBundle();
+            request.send();
+        }
+    }
+
+    void block(Methcla::Engine&, uint64_t blockIndex) override
+    {
+        // Give the streams time to open and fill their buffers.
+        if (blockIndex == 1)
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+private:
+    size_t      m_numVoices;
+    std::string m_path;
+};
+
+std::unique_ptr<Scenario> makeScenario(const std::string& name, const Options& options)
+{
+    const size_t numVoices = options.size("voices", 64);
+    if (name == "sine")
+        return std::unique_ptr<Scenario>(new SineScenario(numVoices));
+    if (name == "disksampler")
+        return std::unique_ptr<Scenario>(new DiskSamplerScenario(numVoices, options.string("file", "")));
+    if (name == "node-set")
+        return std::unique_ptr<Scenario>(new NodeSetScenario(numVoices, options.size("messages", 256)));
+    if (name == "voice-churn")
+        return std::unique_ptr<Scenario>(new VoiceChurnScenario(numVoices, options.size("churn", 4)));
+    if (name == "oscbank")
+        return std::unique_ptr<Scenario>(new OscbankScenario(numVoices));
+    if (name == "convolver")
+        return std::unique_ptr<Scenario>(new ConvolverScenario(numVoices, options.string("file", "")));
+    if (name == "filterbank")
+        return std::unique_ptr<Scenario>(new FilterbankScenario(numVoices));
+    if (name == "matrix-mixer")
+        return std::unique_ptr<Scenario>(new MatrixMixerScenario(numVoices));
+    throw std::invalid_argument("Unknown scenario " + name);
+}
+
+struct Benchmark
+{
+    Methcla::Engine* engine;
+    Scenario*        scenario;
+};
+
+void blockCallback(void* data, uint64_t block)
+{
+    Benchmark* self = static_cast<Benchmark*>(data);
+    if (block == 0)
+        self->scenario->setup(*self->engine);
+    else
+        self->scenario->block(*self->engine, block);
+}
+
+void printLatency(const char* name, double seconds)
+{
+    std::cout << std::setw(24) << std::left << name
+              << std::fixed << std::setprecision(2) << seconds * 1e6 << " us"
+              << std::endl;
+}
+
+}
+
+int main(int argc, const char* const* argv)
+{
+    try
+    {
+        if (argc < 2)
+            throw std::invalid_argument("Usage: methcla-benchmark sine|disksampler|node-set|voice-churn|oscbank|convolver|filterbank|matrix-mixer [OPTION=VALUE ...]");
+
+        const std::string scenarioName(argv[1]);
+        const Options options(argc, argv);
+
+        std::unique_ptr<Scenario> scenario = makeScenario(scenarioName, options);
+
+        const size_t blockSize = options.size("block-size", 64);
+        const size_t sampleRate = options.size("sample-rate", 44100);
+        const size_t numVoices = options.size("voices", 64);
+
+        Methcla::EngineOptions engineOptions;
+        engineOptions.blockSize = blockSize;
+        engineOptions.sampleRate = sampleRate;
+        engineOptions.maxNumNodes = 2 * numVoices + 1024;
+        engineOptions.realtimeMemorySize = (16 + numVoices / 16) * 1024 * 1024;
+        engineOptions.audioDriver.bufferSize = blockSize;
+        engineOptions.audioDriver.sampleRate = sampleRate;
+        engineOptions.audioDriver.numInputs = 0;
+        engineOptions.audioDriver.numOutputs = options.size("outputs", 2);
+        engineOptions.addLibrary(methcla_soundfile_api_libsndfile)
+                     .addLibrary(methcla_plugins_sine)
+                     .addLibrary(methcla_plugins_disksampler)
+                     .addLibrary(methcla_plugins_oscbank)
+                     .addLibrary(methcla_plugins_convolver)
+                     .addLibrary(methcla_plugins_filterbank)
+                     .addLibrary(methcla_plugins_matrix_mixer);
+
+        Benchmark benchmark;
+        benchmark.scenario = scenario.get();
+
+        Methcla_AudioDriverOptions driverOptions(engineOptions.audioDriver);
+        Methcla_AudioDriver* driver = methcla_benchmark_driver_new(
+            &driverOptions,
+            options.size("warmup", 100),
+            options.size("blocks", 10000),
+            blockCallback,
+            &benchmark
+            );
+
+        Methcla::Engine engine(engineOptions, driver);
+        benchmark.engine = &engine;
+
+        engine.start();
+
+        Methcla_BenchmarkStatistics stats;
+        Methcla::detail::checkReturnCode(methcla_benchmark_driver_wait(driver, &stats));
+
+        engine.stop();
+
+        std::cout << std::setw(24) << std::left << "scenario" << scenarioName << std::endl
+                  << std::setw(24) << std::left << "voices" << numVoices << std::endl
+                  << std::setw(24) << std::left << "block size" << blockSize << std::endl
+                  << std::setw(24) << std::left << "sample rate" << sampleRate << std::endl
+                  << std::setw(24) << std::left << "blocks" << stats.num_blocks << std::endl
+                  << std::setw(24) << std::left << "blocks/second"
+                  << std::fixed << std::setprecision(1) << stats.blocks_per_second << std::endl
+                  << std::setw(24) << std::left << "realtime factor"
+                  << std::fixed << std::setprecision(2) << stats.realtime_factor << std::endl;
+        printLatency("latency p50", stats.latency_p50);
+        printLatency("latency p90", stats.latency_p90);
+        printLatency("latency p99", stats.latency_p99);
+        printLatency("latency p99.9", stats.latency_p999);
+        printLatency("latency max", stats.latency_max);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+// Copyright 2014 Samplecount S.L.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measure the cost of sine oscillator voices outside of the engine.
+//
+// Usage: methcla-oscillator-benchmark [OPTION=VALUE ...]
+//
+// Options (defaults in parentheses):
+//
+//   voices (64), blocks (10000), block-size (64), sample-rate (44100)
+//
+// Compares the per-sample libm oscillator the sine plugin used before with
+// the vectorised kernel in <methcla/plugins/oscillator.h> and reports the
+// processing time per voice and block and the maximum error of the last
+// block relative to the amplitude, which for the libm oscillator grows
+// with the number of blocks because its phase isn't wrapped.
+
+#include <methcla/plugins/oscillator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+size_t sizeOption(const std::map<std::string,std::string>& options, const std::string& key, size_t def)
+{
+    auto it = options.find(key);
+    if (it == options.end())
+        return def;
+    std::istringstream s(it->second);
+    size_t value;
+    if (!(s >> value))
+        throw std::invalid_argument("Invalid value for option " + key + ": " + it->second);
+    return value;
+}
+
+const double kPi = 3.14159265358979323846264338327950288;
+
+struct Voice
+{
+    double phase;
+    double phaseInc;
+    float  amp;
+};
+
+// Oscillator of the sine plugin before the vectorised kernel.
+void referenceSine(Voice& voice, float* output, size_t numFrames)
+{
+    double phase = voice.phase;
+    const double phaseInc = 2. * kPi * voice.phaseInc;
+    for (size_t k = 0; k < numFrames; k++) {
+        output[k] = voice.amp * std::sin(phase);
+        phase += phaseInc;
+    }
+    voice.phase = phase;
+}
+
+void kernelSine(Voice& voice, float* output, size_t numFrames)
+{
+    voice.phase = methcla_oscillator_sine(output, numFrames, voice.phase, voice.phaseInc, voice.amp);
+}
+
+std::vector<Voice> makeVoices(size_t numVoices, double sampleRate)
+{
+    std::vector<Voice> voices(numVoices);
+    for (size_t i=0; i < numVoices; i++)
+    {
+        // Spread the voices over two octaves, like the engine benchmark.
+        voices[i].phase = 0;
+        voices[i].phaseInc = 220. * (1. + (double)(i % 100) / 50.) / sampleRate;
+        voices[i].amp = 1.f / (float)numVoices;
+    }
+    return voices;
+}
+
+// Return the processing time per voice and block in seconds.
+template <typename F> double run(F oscillator, std::vector<Voice> voices, size_t numBlocks, std::vector<float>& output)
+{
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<double> Seconds;
+
+    const size_t blockSize = output.size() / voices.size();
+
+    const auto start = Clock::now();
+    for (size_t block=0; block < numBlocks; block++)
+    {
+        for (size_t i=0; i < voices.size(); i++)
+            oscillator(voices[i], output.data() + i * blockSize, blockSize);
+    }
+    const auto end = Clock::now();
+
+    return std::chrono::duration_cast<Seconds>(end - start).count() / (double)(numBlocks * voices.size());
+}
+
+}
+
+int main(int argc, const char* const* argv)
+{
+    try
+    {
+        std::map<std::string,std::string> options;
+        for (int i=1; i < argc; i++)
+        {
+            const std::string arg(argv[i]);
+            const size_t eq = arg.find('=');
+            if (eq == std::string::npos)
+                throw std::invalid_argument("Invalid option " + arg + ", expected OPTION=VALUE");
+            options[arg.substr(0, eq)] = arg.substr(eq+1);
+        }
+
+        const size_t numVoices = std::max(sizeOption(options, "voices", 64), (size_t)1);
+        const size_t numBlocks = std::max(sizeOption(options, "blocks", 10000), (size_t)1);
+        const size_t blockSize = std::max(sizeOption(options, "block-size", 64), (size_t)1);
+        const double sampleRate = sizeOption(options, "sample-rate", 44100);
+
+        const std::vector<Voice> voices = makeVoices(numVoices, sampleRate);
+        std::vector<float> referenceOutput(numVoices * blockSize);
+        std::vector<float> kernelOutput(numVoices * blockSize);
+
+        const double referenceTime = run(referenceSine, voices, numBlocks, referenceOutput);
+        const double kernelTime = run(kernelSine, voices, numBlocks, kernelOutput);
+
+        double referenceError = 0;
+        double kernelError = 0;
+        for (size_t i=0; i < numVoices; i++)
+        {
+            for (size_t k=0; k < blockSize; k++)
+            {
+                const double t = (double)((numBlocks - 1) * blockSize + k) * voices[i].phaseInc;
+                const double exact = std::sin(2. * kPi * (t - std::floor(t)));
+                const size_t j = i * blockSize + k;
+                referenceError = std::max(referenceError, std::abs(referenceOutput[j] / voices[i].amp - exact));
+                kernelError = std::max(kernelError, std::abs(kernelOutput[j] / voices[i].amp - exact));
+            }
+        }
+
+        std::cout << std::setw(24) << std::left << "voices" << numVoices << std::endl
+                  << std::setw(24) << std::left << "block size" << blockSize << std::endl
+                  << std::setw(24) << std::left << "blocks" << numBlocks << std::endl
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(24) << std::left << "libm ns/voice/block" << referenceTime * 1e9 << std::endl
+                  << std::setw(24) << std::left << "kernel ns/voice/block" << kernelTime * 1e9 << std::endl
+                  << std::setprecision(2)
+                  << std::setw(24) << std::left << "speedup" << referenceTime / kernelTime << std::endl
+                  << std::scientific << std::setprecision(2)
+                  << std::setw(24) << std::left << "libm max error" << referenceError << std::endl
+                  << std::setw(24) << std::left << "kernel max error" << kernelError << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}